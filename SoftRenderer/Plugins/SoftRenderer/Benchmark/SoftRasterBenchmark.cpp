@@ -0,0 +1,408 @@
+﻿#include "Core/SoftRasterCore.h"
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <functional>
+#include <vector>
+
+/**
+ * 软光栅核心库的性能测试，不依赖引擎
+ *    分别测试整帧清空、画线、顶点变换和整帧渲染的吞吐量，每一项重复多次取中位数
+ *    输出的校验值用来确认每次运行的结果相同，同时避免编译器把没有使用的结果优化掉
+ */
+
+using namespace SoftRasterCore;
+
+namespace
+{
+	/** 测试使用的帧大小 */
+	constexpr int32_t FrameWidth = 1920;
+	constexpr int32_t FrameHeight = 1080;
+
+	/**
+	 * 按16字节对齐的数组，长度补齐到4的倍数，满足ProjectToScreen的要求
+	 */
+	template<typename ElementType>
+	class TAlignedArray
+	{
+	public:
+		explicit TAlignedArray(size_t InNum)
+			: Storage((InNum + 3) / 4 * 4 * sizeof(ElementType) + 16)
+			, Num(InNum)
+		{
+			const uintptr_t Address = reinterpret_cast<uintptr_t>(Storage.data());
+			Data = reinterpret_cast<ElementType*>((Address + 15) & ~uintptr_t(15));
+		}
+
+		ElementType* GetData() { return Data; }
+		size_t GetNum() const { return Num; }
+
+	private:
+		std::vector<uint8_t> Storage;
+		ElementType* Data;
+		size_t Num;
+	};
+
+	/**
+	 * 固定种子的线性同余随机数，保证每次运行生成相同的测试数据
+	 */
+	class FRandomStream
+	{
+	public:
+		explicit FRandomStream(uint32_t InSeed) : Seed(InSeed) {}
+
+		uint32_t Next()
+		{
+			Seed = Seed * 196314165u + 907633515u;
+			return Seed;
+		}
+
+		float NextFloat(float Min, float Max)
+		{
+			return Min + (Max - Min) * static_cast<float>(Next() >> 8) / static_cast<float>(1 << 24);
+		}
+
+	private:
+		uint32_t Seed;
+	};
+
+	/**
+	 * 合成网格，顶点位置连续存储为 (X, Y, Z)
+	 */
+	struct FSyntheticMesh
+	{
+		std::vector<float> Positions;
+		std::vector<uint32_t> Indices;
+
+		int32_t GetNumVertices() const { return static_cast<int32_t>(Positions.size() / 3); }
+		int32_t GetNumTriangles() const { return static_cast<int32_t>(Indices.size() / 3); }
+	};
+
+	/**
+	 * 生成经纬度球面，Segments为经线数，纬线数为Segments的一半
+	 */
+	FSyntheticMesh MakeSphere(int32_t Segments, float Radius)
+	{
+		constexpr float Pi = 3.14159265358979f;
+
+		FSyntheticMesh Mesh;
+		const int32_t Rings = Segments / 2;
+		for (int32_t Ring = 0; Ring <= Rings; ++Ring)
+		{
+			const float Theta = Pi * Ring / Rings;
+			for (int32_t Segment = 0; Segment <= Segments; ++Segment)
+			{
+				const float Phi = 2.0f * Pi * Segment / Segments;
+				Mesh.Positions.push_back(Radius * std::sin(Theta) * std::cos(Phi));
+				Mesh.Positions.push_back(Radius * std::sin(Theta) * std::sin(Phi));
+				Mesh.Positions.push_back(Radius * std::cos(Theta));
+			}
+		}
+
+		for (int32_t Ring = 0; Ring < Rings; ++Ring)
+		{
+			for (int32_t Segment = 0; Segment < Segments; ++Segment)
+			{
+				const uint32_t V00 = Ring * (Segments + 1) + Segment;
+				const uint32_t V10 = V00 + 1;
+				const uint32_t V01 = V00 + Segments + 1;
+				const uint32_t V11 = V01 + 1;
+				Mesh.Indices.insert(Mesh.Indices.end(), { V00, V01, V10, V10, V01, V11 });
+			}
+		}
+		return Mesh;
+	}
+
+	/**
+	 * 行向量约定的矩阵乘法 Result = A * B
+	 */
+	void MultiplyMatrix(const float A[4][4], const float B[4][4], float Result[4][4])
+	{
+		for (int32_t Row = 0; Row < 4; ++Row)
+		{
+			for (int32_t Column = 0; Column < 4; ++Column)
+			{
+				Result[Row][Column] = A[Row][0] * B[0][Column] + A[Row][1] * B[1][Column] + A[Row][2] * B[2][Column] + A[Row][3] * B[3][Column];
+			}
+		}
+	}
+
+	/**
+	 * 和FReversedZPerspectiveMatrix相同的远平面在无穷远处的透视矩阵，观察空间X向右，Y向上，Z向前
+	 */
+	void MakeProjectionMatrix(float HalfFOV, float Width, float Height, float NearPlane, float Result[4][4])
+	{
+		const float InvTan = 1.0f / std::tan(HalfFOV);
+		const float Matrix[4][4] =
+		{
+			{ InvTan, 0.0f, 0.0f, 0.0f },
+			{ 0.0f, InvTan * Width / Height, 0.0f, 0.0f },
+			{ 0.0f, 0.0f, 0.0f, 1.0f },
+			{ 0.0f, 0.0f, NearPlane, 0.0f },
+		};
+		std::memcpy(Result, Matrix, sizeof(Matrix));
+	}
+
+	/**
+	 * 网格按Translation平移之后再做透视投影的矩阵
+	 */
+	void MakeLocalToProjectionMatrix(float TranslationX, float TranslationY, float TranslationZ, const float Projection[4][4], float Result[4][4])
+	{
+		const float LocalToView[4][4] =
+		{
+			{ 1.0f, 0.0f, 0.0f, 0.0f },
+			{ 0.0f, 1.0f, 0.0f, 0.0f },
+			{ 0.0f, 0.0f, 1.0f, 0.0f },
+			{ TranslationX, TranslationY, TranslationZ, 1.0f },
+		};
+		MultiplyMatrix(LocalToView, Projection, Result);
+	}
+
+	/**
+	 * 颜色和深度缓冲
+	 */
+	struct FBenchmarkFrame
+	{
+		std::vector<uint32_t> Pixels;
+		std::vector<float> Depth;
+
+		FBenchmarkFrame()
+			: Pixels(size_t(FrameWidth) * FrameHeight)
+			, Depth(size_t(FrameWidth) * FrameHeight)
+		{
+		}
+
+		FRasterSurface GetSurface()
+		{
+			return FRasterSurface{ Pixels.data(), Depth.data(), FrameWidth, FrameHeight };
+		}
+
+		/** 颜色缓冲的FNV-1a哈希 */
+		uint32_t Checksum() const
+		{
+			uint32_t Hash = 2166136261u;
+			for (uint32_t Pixel : Pixels)
+			{
+				Hash = (Hash ^ Pixel) * 16777619u;
+			}
+			return Hash;
+		}
+	};
+
+	/**
+	 * 重复执行Function，返回每次耗时的中位数，单位毫秒
+	 */
+	double MeasureMilliseconds(int32_t Iterations, const std::function<void()>& Function)
+	{
+		// 先执行一次预热缓存和分页
+		Function();
+
+		std::vector<double> Samples;
+		for (int32_t Iteration = 0; Iteration < Iterations; ++Iteration)
+		{
+			const auto StartTime = std::chrono::steady_clock::now();
+			Function();
+			const auto EndTime = std::chrono::steady_clock::now();
+			Samples.push_back(std::chrono::duration<double, std::milli>(EndTime - StartTime).count());
+		}
+
+		std::sort(Samples.begin(), Samples.end());
+		return Samples[Samples.size() / 2];
+	}
+
+	void PrintResult(const char* Name, double Milliseconds, double Throughput, const char* ThroughputUnit, uint32_t Checksum)
+	{
+		std::printf("%-20s %10.3f ms %12.2f %-10s checksum %08x\n", Name, Milliseconds, Throughput, ThroughputUnit, Checksum);
+	}
+
+	/**
+	 * 整帧清空颜色和深度，和UFrameBuffer整帧清空一样使用非临时写入
+	 */
+	void BenchmarkClear(int32_t Iterations)
+	{
+		FBenchmarkFrame Frame;
+		uint32_t ClearColor = 0;
+
+		const double Milliseconds = MeasureMilliseconds(Iterations, [&]()
+		{
+			++ClearColor;
+			FillMemory32(Frame.Pixels.data(), Frame.Pixels.size(), 0xFF000000u | ClearColor, true);
+			FillMemory32(reinterpret_cast<uint32_t*>(Frame.Depth.data()), Frame.Depth.size(), 0, true);
+		});
+
+		const double Bytes = double(Frame.Pixels.size()) * 2 * sizeof(uint32_t);
+		PrintResult("clear", Milliseconds, Bytes / (Milliseconds * 1.0e6), "GB/s", Frame.Checksum());
+	}
+
+	/**
+	 * 画随机线段，一部分端点落在帧外需要裁剪
+	 */
+	void BenchmarkLines(int32_t Iterations)
+	{
+		constexpr int32_t NumLines = 20000;
+
+		FRandomStream Random(0x5EED);
+		std::vector<int32_t> Endpoints(NumLines * 4);
+		for (int32_t Index = 0; Index < NumLines; ++Index)
+		{
+			Endpoints[Index * 4 + 0] = static_cast<int32_t>(Random.NextFloat(-0.1f, 1.1f) * FrameWidth);
+			Endpoints[Index * 4 + 1] = static_cast<int32_t>(Random.NextFloat(-0.1f, 1.1f) * FrameHeight);
+			Endpoints[Index * 4 + 2] = static_cast<int32_t>(Random.NextFloat(-0.1f, 1.1f) * FrameWidth);
+			Endpoints[Index * 4 + 3] = static_cast<int32_t>(Random.NextFloat(-0.1f, 1.1f) * FrameHeight);
+		}
+
+		FBenchmarkFrame Frame;
+		const FRasterRect ClipRect{ 0, 0, FrameWidth, FrameHeight };
+
+		const double Milliseconds = MeasureMilliseconds(Iterations, [&]()
+		{
+			for (int32_t Index = 0; Index < NumLines; ++Index)
+			{
+				const int32_t* Line = &Endpoints[Index * 4];
+				FLineSetup Setup;
+				if (SetupLine(Line[0], Line[1], Line[2], Line[3], ClipRect, FrameWidth, FrameHeight, Setup))
+				{
+					DrawLine(Setup, Frame.Pixels.data(), 0xFF000000u | static_cast<uint32_t>(Index));
+				}
+			}
+		});
+
+		PrintResult("line draw", Milliseconds, NumLines / (Milliseconds * 1.0e3), "Mlines/s", Frame.Checksum());
+	}
+
+	/**
+	 * 顶点变换，包括顶点着色和透视除法、视口变换
+	 */
+	void BenchmarkVertexTransform(int32_t Iterations)
+	{
+		const FSyntheticMesh Mesh = MakeSphere(1024, 100.0f);
+		const int32_t NumVertices = Mesh.GetNumVertices();
+
+		float Projection[4][4];
+		float LocalToProjection[4][4];
+		MakeProjectionMatrix(0.785398f, float(FrameWidth), float(FrameHeight), 10.0f, Projection);
+		MakeLocalToProjectionMatrix(0.0f, 0.0f, 400.0f, Projection, LocalToProjection);
+
+		TAlignedArray<float> ClipX(NumVertices);
+		TAlignedArray<float> ClipY(NumVertices);
+		TAlignedArray<float> ClipZ(NumVertices);
+		TAlignedArray<float> ClipW(NumVertices);
+		std::vector<float> ScreenPos(size_t(NumVertices) * 2);
+		std::vector<float> Depth(NumVertices);
+
+		const double Milliseconds = MeasureMilliseconds(Iterations, [&]()
+		{
+			TransformPositions(Mesh.Positions.data(), NumVertices, LocalToProjection, ClipX.GetData(), ClipY.GetData(), ClipZ.GetData(), ClipW.GetData());
+			ProjectToScreen(ClipX.GetData(), ClipY.GetData(), ClipZ.GetData(), ClipW.GetData(), NumVertices, FrameWidth, FrameHeight, ScreenPos.data(), Depth.data());
+		});
+
+		uint32_t Checksum = 2166136261u;
+		for (float Value : ScreenPos)
+		{
+			uint32_t Bits;
+			std::memcpy(&Bits, &Value, sizeof(Bits));
+			Checksum = (Checksum ^ Bits) * 16777619u;
+		}
+
+		PrintResult("vertex transform", Milliseconds, NumVertices / (Milliseconds * 1.0e3), "Mverts/s", Checksum);
+	}
+
+	/**
+	 * 整帧渲染：清空，变换一组球体，按重心坐标着色填充所有三角形
+	 */
+	void BenchmarkFullFrame(int32_t Iterations)
+	{
+		constexpr int32_t GridSize = 4;
+
+		const FSyntheticMesh Mesh = MakeSphere(128, 60.0f);
+		const int32_t NumVertices = Mesh.GetNumVertices();
+		const int32_t NumTriangles = Mesh.GetNumTriangles();
+
+		float Projection[4][4];
+		MakeProjectionMatrix(0.785398f, float(FrameWidth), float(FrameHeight), 10.0f, Projection);
+
+		// 球体在相机前方排成网格，互相有遮挡
+		std::vector<float> LocalToProjection(GridSize * GridSize * 16);
+		for (int32_t Index = 0; Index < GridSize * GridSize; ++Index)
+		{
+			const float OffsetX = ((Index % GridSize) - (GridSize - 1) * 0.5f) * 90.0f;
+			const float OffsetY = ((Index / GridSize) - (GridSize - 1) * 0.5f) * 60.0f;
+			MakeLocalToProjectionMatrix(OffsetX, OffsetY, 500.0f + 20.0f * Index, Projection, reinterpret_cast<float(*)[4]>(&LocalToProjection[Index * 16]));
+		}
+
+		TAlignedArray<float> ClipX(NumVertices);
+		TAlignedArray<float> ClipY(NumVertices);
+		TAlignedArray<float> ClipZ(NumVertices);
+		TAlignedArray<float> ClipW(NumVertices);
+		std::vector<float> ScreenPos(size_t(NumVertices) * 2);
+		std::vector<float> Depth(NumVertices);
+
+		FBenchmarkFrame Frame;
+		const FRasterSurface Surface = Frame.GetSurface();
+		const FRasterRect ClipRect{ 0, 0, FrameWidth, FrameHeight };
+
+		const double Milliseconds = MeasureMilliseconds(Iterations, [&]()
+		{
+			FillMemory32(Frame.Pixels.data(), Frame.Pixels.size(), 0xFF000000u, true);
+			FillMemory32(reinterpret_cast<uint32_t*>(Frame.Depth.data()), Frame.Depth.size(), 0, true);
+
+			for (int32_t Object = 0; Object < GridSize * GridSize; ++Object)
+			{
+				TransformPositions(Mesh.Positions.data(), NumVertices, reinterpret_cast<const float(*)[4]>(&LocalToProjection[Object * 16]),
+					ClipX.GetData(), ClipY.GetData(), ClipZ.GetData(), ClipW.GetData());
+				ProjectToScreen(ClipX.GetData(), ClipY.GetData(), ClipZ.GetData(), ClipW.GetData(), NumVertices, FrameWidth, FrameHeight, ScreenPos.data(), Depth.data());
+
+				for (int32_t Triangle = 0; Triangle < NumTriangles; ++Triangle)
+				{
+					float TriangleX[3];
+					float TriangleY[3];
+					float TriangleDepth[3];
+					for (int32_t Corner = 0; Corner < 3; ++Corner)
+					{
+						const uint32_t VertexIndex = Mesh.Indices[Triangle * 3 + Corner];
+						TriangleX[Corner] = ScreenPos[VertexIndex * 2];
+						TriangleY[Corner] = ScreenPos[VertexIndex * 2 + 1];
+						TriangleDepth[Corner] = Depth[VertexIndex];
+					}
+
+					FTriangleSetup Setup;
+					if (!SetupTriangle(TriangleX, TriangleY, TriangleDepth, ClipRect, FrameWidth, FrameHeight, Setup))
+						continue;
+
+					RasterizeTriangle(Setup, Surface, [](int32_t, int32_t, float, const float Barycentric[3])
+					{
+						const uint32_t R = static_cast<uint32_t>(Barycentric[0] * 255.0f);
+						const uint32_t G = static_cast<uint32_t>(Barycentric[1] * 255.0f);
+						const uint32_t B = static_cast<uint32_t>(Barycentric[2] * 255.0f);
+						return 0xFF000000u | (R << 16) | (G << 8) | B;
+					});
+				}
+			}
+		});
+
+		PrintResult("full frame", Milliseconds, 1.0e3 / Milliseconds, "frames/s", Frame.Checksum());
+	}
+}
+
+int main(int ArgCount, char** Args)
+{
+	// -Iterations=N 指定每一项的重复次数
+	int32_t Iterations = 20;
+	for (int32_t Index = 1; Index < ArgCount; ++Index)
+	{
+		if (std::strncmp(Args[Index], "-Iterations=", 12) == 0)
+		{
+			Iterations = (std::max)(1, std::atoi(Args[Index] + 12));
+		}
+	}
+
+	std::printf("SoftRasterBenchmark %dx%d, %d iterations, median time per iteration\n", FrameWidth, FrameHeight, Iterations);
+	BenchmarkClear(Iterations);
+	BenchmarkLines(Iterations);
+	BenchmarkVertexTransform(Iterations);
+	BenchmarkFullFrame(Iterations);
+	return 0;
+}
@@ -0,0 +1,197 @@
+﻿#include "Clipper.h"
+#include "Core/SoftRasterCore.h"
+
+/////////////////////////////////////////////////////
+// FClipper
+
+/** 参与裁剪的平面按这个顺序处理，和PlaneDistance的平面编号一一对应 */
+static constexpr uint32 ClipPlaneOutCodes[FClipper::NumClipPlanes] =
+{
+	FClipper::OutCode_Near,
+	FClipper::OutCode_Far,
+	FClipper::OutCode_GuardBandLeft,
+	FClipper::OutCode_GuardBandRight,
+	FClipper::OutCode_GuardBandBottom,
+	FClipper::OutCode_GuardBandTop,
+};
+
+void FClipper::Init(const FIntPoint& ViewportSize)
+{
+	// 1 保护带向屏幕外扩展GuardBandPixels个像素，右下边缘的屏幕坐标是视口大小加上保护带，不能超过光栅化的坐标上限
+	//    裁剪后的顶点落在保护带平面上，插值的误差可能让坐标稍微超出，留出1个像素的余量
+	const auto ClampGuardBand = [](int32 ViewportExtent)
+	{
+		return FMath::Clamp(static_cast<float>(SoftRasterCore::MaxTriangleCoordinate - ViewportExtent - 1), 0.0f, GuardBandPixels);
+	};
+
+	// 2 屏幕坐标 = (NDC + 1) * 半个视口大小，换算到NDC空间
+	GuardBandX = 1.0f + ClampGuardBand(ViewportSize.X) / FMath::Max(1.0f, ViewportSize.X * 0.5f);
+	GuardBandY = 1.0f + ClampGuardBand(ViewportSize.Y) / FMath::Max(1.0f, ViewportSize.Y * 0.5f);
+}
+
+uint32 FClipper::ComputeOutCode(float X, float Y, float Z, float W) const
+{
+	uint32 OutCode = 0;
+	OutCode |= X < -W ? OutCode_Left : 0;
+	OutCode |= X > W ? OutCode_Right : 0;
+	OutCode |= Y < -W ? OutCode_Bottom : 0;
+	OutCode |= Y > W ? OutCode_Top : 0;
+	OutCode |= Z > W ? OutCode_Near : 0;
+	OutCode |= Z < 0.0f ? OutCode_Far : 0;
+	OutCode |= X < -GuardBandX * W ? OutCode_GuardBandLeft : 0;
+	OutCode |= X > GuardBandX * W ? OutCode_GuardBandRight : 0;
+	OutCode |= Y < -GuardBandY * W ? OutCode_GuardBandBottom : 0;
+	OutCode |= Y > GuardBandY * W ? OutCode_GuardBandTop : 0;
+	return OutCode;
+}
+
+float FClipper::PlaneDistance(int32 PlaneIndex, const FVector4& Vertex) const
+{
+	switch (PlaneIndex)
+	{
+	case 0: return Vertex.W - Vertex.Z;
+	case 1: return Vertex.Z;
+	case 2: return Vertex.X + GuardBandX * Vertex.W;
+	case 3: return GuardBandX * Vertex.W - Vertex.X;
+	case 4: return Vertex.Y + GuardBandY * Vertex.W;
+	default: return GuardBandY * Vertex.W - Vertex.Y;
+	}
+}
+
+int32 FClipper::ClipTriangle(const FVector4 Vertices[3], uint32 ClipPlanes, FVector4 OutVertices[MaxPolygonVertices]) const
+{
+	// 两个缓冲交替作为每个平面的输入和输出
+	FVector4 PolygonVertices[2][MaxPolygonVertices];
+	int32 NumVertices = 3;
+	int32 Current = 0;
+	
+	for (int32 Index = 0; Index < 3; ++Index)
+	{
+		PolygonVertices[Current][Index] = Vertices[Index];
+	}
+
+	for (int32 PlaneIndex = 0; PlaneIndex < NumClipPlanes && NumVertices >= 3; ++PlaneIndex)
+	{
+		if (!(ClipPlanes & ClipPlaneOutCodes[PlaneIndex]))
+			continue;
+
+		const FVector4* InVertices = PolygonVertices[Current];
+		FVector4* ClippedVertices = PolygonVertices[Current ^ 1];
+		int32 NumClippedVertices = 0;
+
+		for (int32 Index = 0; Index < NumVertices; ++Index)
+		{
+			const int32 NextIndex = Index + 1 < NumVertices ? Index + 1 : 0;
+			const FVector4& Vertex = InVertices[Index];
+			const FVector4& NextVertex = InVertices[NextIndex];
+			const float Distance = PlaneDistance(PlaneIndex, Vertex);
+			const float NextDistance = PlaneDistance(PlaneIndex, NextVertex);
+			const bool bInside = Distance >= 0.0f;
+			const bool bNextInside = NextDistance >= 0.0f;
+
+			if (bInside)
+			{
+				ClippedVertices[NumClippedVertices++] = Vertex;
+			}
+
+			if (bInside != bNextInside)
+			{
+				// 总是从内侧的顶点向外侧插值，相邻三角形的公共边裁剪出完全相同的交点，不会产生裂缝
+				const FVector4& InsideVertex = bInside ? Vertex : NextVertex;
+				const FVector4& OutsideVertex = bInside ? NextVertex : Vertex;
+				const float InsideDistance = bInside ? Distance : NextDistance;
+				const float OutsideDistance = bInside ? NextDistance : Distance;
+				const float Alpha = InsideDistance / (InsideDistance - OutsideDistance);
+				ClippedVertices[NumClippedVertices++] = InsideVertex + (OutsideVertex - InsideVertex) * Alpha;
+			}
+		}
+
+		NumVertices = NumClippedVertices;
+		Current ^= 1;
+	}
+
+	if (NumVertices < 3)
+		return 0;
+
+	for (int32 Index = 0; Index < NumVertices; ++Index)
+	{
+		OutVertices[Index] = PolygonVertices[Current][Index];
+	}
+	
+	return NumVertices;
+}
+
+bool FClipper::ClipSegment(FVector4& Start, FVector4& End, uint32 ClipPlanes) const
+{
+	for (int32 PlaneIndex = 0; PlaneIndex < NumClipPlanes; ++PlaneIndex)
+	{
+		if (!(ClipPlanes & ClipPlaneOutCodes[PlaneIndex]))
+			continue;
+
+		const float StartDistance = PlaneDistance(PlaneIndex, Start);
+		const float EndDistance = PlaneDistance(PlaneIndex, End);
+		const bool bStartInside = StartDistance >= 0.0f;
+		const bool bEndInside = EndDistance >= 0.0f;
+
+		if (!bStartInside && !bEndInside)
+			return false;
+
+		if (bStartInside != bEndInside)
+		{
+			// 从内侧的端点向外侧插值，替换掉外侧的端点
+			FVector4& OutsideVertex = bStartInside ? End : Start;
+			const FVector4& InsideVertex = bStartInside ? Start : End;
+			const float InsideDistance = bStartInside ? StartDistance : EndDistance;
+			const float OutsideDistance = bStartInside ? EndDistance : StartDistance;
+			const float Alpha = InsideDistance / (InsideDistance - OutsideDistance);
+			OutsideVertex = InsideVertex + (OutsideVertex - InsideVertex) * Alpha;
+		}
+	}
+
+	return true;
+}
+
+bool FClipper::ClipLine(FVector2D& Start, FVector2D& End, const FBox2D& Rect)
+{
+	// 线段参数方程 P(t) = Start + t * Delta, t in [0, 1]
+	// 对每条边界 P * Direction <= Q，求出进入和离开的参数，最后保留 [EnterT, ExitT]
+	const FVector2D Delta = End - Start;
+	const float P[4] = { -Delta.X, Delta.X, -Delta.Y, Delta.Y };
+	const float Q[4] = { Start.X - Rect.Min.X, Rect.Max.X - Start.X, Start.Y - Rect.Min.Y, Rect.Max.Y - Start.Y };
+
+	float EnterT = 0.0f;
+	float ExitT = 1.0f;
+	for (int32 Index = 0; Index < 4; ++Index)
+	{
+		if (P[Index] == 0.0f)
+		{
+			// 和这条边界平行，在外侧时整条线段不可见
+			if (Q[Index] < 0.0f)
+				return false;
+			
+			continue;
+		}
+
+		const float T = Q[Index] / P[Index];
+		if (P[Index] < 0.0f)
+		{
+			EnterT = FMath::Max(EnterT, T);
+		}
+		else
+		{
+			ExitT = FMath::Min(ExitT, T);
+		}
+	}
+
+	if (EnterT > ExitT)
+		return false;
+
+	// 先算出两个新端点再写回，没有被裁剪的端点保持原来的值
+	const FVector2D ClippedStart = EnterT > 0.0f ? Start + Delta * EnterT : Start;
+	const FVector2D ClippedEnd = ExitT < 1.0f ? Start + Delta * ExitT : End;
+	Start = ClippedStart;
+	End = ClippedEnd;
+	return true;
+}
+
+/////////////////////////////////////////////////////
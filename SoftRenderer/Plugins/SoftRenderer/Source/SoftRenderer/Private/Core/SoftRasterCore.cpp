@@ -0,0 +1,360 @@
+﻿#include "Core/SoftRasterCore.h"
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+
+namespace SoftRasterCore
+{
+	/**
+	 * 向上取整的整数除法，Divisor必须大于0，Numerator可以是负数
+	 */
+	static inline int64_t DivideAndRoundUp64(int64_t Numerator, int64_t Divisor)
+	{
+		return Numerator >= 0 ? (Numerator + Divisor - 1) / Divisor : -((-Numerator) / Divisor);
+	}
+
+	/**
+	 * 四舍五入到整数，和FMath::RoundToInt的结果一致
+	 */
+	static inline int64_t RoundToInt64(float Value)
+	{
+		return static_cast<int64_t>(std::floor(Value + 0.5f));
+	}
+
+	void FillMemory32(uint32_t* Data, int64_t Count, uint32_t Value, bool bStreaming)
+	{
+		for (; Count > 0 && (reinterpret_cast<uintptr_t>(Data) & 15) != 0; --Count)
+		{
+			*Data++ = Value;
+		}
+
+		// 只复制位模式，不做浮点运算，任意32位的值都能原样写入
+		const Simd::FInt4 WideValue = Simd::Int4Set1(static_cast<int32_t>(Value));
+		uint32_t* const WideEnd = Data + (Count & ~int64_t(15));
+		for (; Data < WideEnd; Data += 16)
+		{
+			Simd::Store4x32(Data, WideValue, bStreaming);
+			Simd::Store4x32(Data + 4, WideValue, bStreaming);
+			Simd::Store4x32(Data + 8, WideValue, bStreaming);
+			Simd::Store4x32(Data + 12, WideValue, bStreaming);
+		}
+
+		// 非临时写入之后需要内存屏障，保证其他线程能看到写入的结果
+		if (bStreaming)
+		{
+			Simd::StreamingFence();
+		}
+
+		for (Count &= 15; Count > 0; --Count)
+		{
+			*Data++ = Value;
+		}
+	}
+
+	bool SetupLine(int32_t StartX, int32_t StartY, int32_t EndX, int32_t EndY, const FRasterRect& ClipRect, int32_t Width, int32_t Height, FLineSetup& OutSetup)
+	{
+		// 超出这个范围的坐标说明顶点没有经过裁剪，误差项计算会溢出，直接丢弃
+		constexpr int64_t MaxCoordinate = 1 << 24;
+		if (std::abs(int64_t(StartX)) > MaxCoordinate || std::abs(int64_t(StartY)) > MaxCoordinate ||
+			std::abs(int64_t(EndX)) > MaxCoordinate || std::abs(int64_t(EndY)) > MaxCoordinate)
+			return false;
+
+		// 1 裁剪范围限制在目标范围内
+		const int32_t ClipMinX = (std::max)(ClipRect.MinX, 0);
+		const int32_t ClipMinY = (std::max)(ClipRect.MinY, 0);
+		const int32_t ClipMaxX = (std::min)(ClipRect.MaxX, Width);
+		const int32_t ClipMaxY = (std::min)(ClipRect.MaxY, Height);
+		if (ClipMinX >= ClipMaxX || ClipMinY >= ClipMaxY)
+			return false;
+
+		// 2 变化量大的轴作为主轴(Major)，每一步主轴坐标+1，次轴(Minor)坐标由误差项决定是否步进
+		//    起点总是取主轴坐标较小的端点，保证A->B和B->A画出的像素相同
+		const bool bSteep = std::abs(int64_t(EndY) - StartY) > std::abs(int64_t(EndX) - StartX);
+
+		int64_t MajorStart = bSteep ? StartY : StartX;
+		int64_t MajorEnd = bSteep ? EndY : EndX;
+		int64_t MinorStart = bSteep ? StartX : StartY;
+		int64_t MinorEnd = bSteep ? EndX : EndY;
+		if (MajorStart > MajorEnd)
+		{
+			std::swap(MajorStart, MajorEnd);
+			std::swap(MinorStart, MinorEnd);
+		}
+
+		const int64_t DMajor = MajorEnd - MajorStart;
+		const int64_t DMinor = std::abs(MinorEnd - MinorStart);
+		const int64_t MinorStep = MinorEnd >= MinorStart ? 1 : -1;
+
+		const int64_t ClipMajorMin = bSteep ? ClipMinY : ClipMinX;
+		const int64_t ClipMajorMax = bSteep ? ClipMaxY : ClipMaxX;
+		const int64_t ClipMinorMin = bSteep ? ClipMinX : ClipMinY;
+		const int64_t ClipMinorMax = bSteep ? ClipMaxX : ClipMaxY;
+
+		// 3 主轴方向上落在裁剪范围内的步数区间 [FirstStep, LastStep]
+		int64_t FirstStep = (std::max)(int64_t(0), ClipMajorMin - MajorStart);
+		int64_t LastStep = (std::min)(DMajor, ClipMajorMax - 1 - MajorStart);
+
+		// 4 第Step步的次轴偏移 MinorOffset = floor((2 * Step * DMinor + DMajor) / (2 * DMajor))，即 Step * DMinor / DMajor 四舍五入
+		//    MinorOffset随Step单调不减，次轴落在裁剪范围内的步数也是一个连续区间，和主轴的区间求交集后循环内不需要再检查范围
+		const int64_t MinorOffsetMin = MinorStep > 0 ? ClipMinorMin - MinorStart : MinorStart - (ClipMinorMax - 1);
+		const int64_t MinorOffsetMax = MinorStep > 0 ? ClipMinorMax - 1 - MinorStart : MinorStart - ClipMinorMin;
+		if (DMinor == 0)
+		{
+			if (MinorOffsetMin > 0 || MinorOffsetMax < 0)
+				return false;
+		}
+		else
+		{
+			// MinorOffset >= MinorOffsetMin  <=>  2 * Step * DMinor >= 2 * DMajor * MinorOffsetMin - DMajor
+			// MinorOffset <= MinorOffsetMax  <=>  2 * Step * DMinor < 2 * DMajor * (MinorOffsetMax + 1) - DMajor
+			FirstStep = (std::max)(FirstStep, DivideAndRoundUp64(2 * DMajor * MinorOffsetMin - DMajor, 2 * DMinor));
+			LastStep = (std::min)(LastStep, DivideAndRoundUp64(2 * DMajor * (MinorOffsetMax + 1) - DMajor, 2 * DMinor) - 1);
+		}
+
+		if (FirstStep > LastStep)
+			return false;
+
+		// 5 直接算出第FirstStep步的状态，保证裁剪后画出的像素和从起点开始逐步迭代完全一致
+		//    误差项 Error = 2 * Step * DMinor + DMajor - 2 * DMajor * MinorOffset，取值范围 [0, 2 * DMajor)
+		const int64_t MinorOffset = DMajor > 0 ? (2 * FirstStep * DMinor + DMajor) / (2 * DMajor) : 0;
+
+		const int64_t FirstMajor = MajorStart + FirstStep;
+		const int64_t FirstMinor = MinorStart + MinorStep * MinorOffset;
+		const int64_t FirstX = bSteep ? FirstMinor : FirstMajor;
+		const int64_t FirstY = bSteep ? FirstMajor : FirstMinor;
+
+		const int64_t LastMinor = MinorStart + MinorStep * (DMajor > 0 ? (2 * LastStep * DMinor + DMajor) / (2 * DMajor) : 0);
+		const int64_t LastX = bSteep ? LastMinor : MajorStart + LastStep;
+		const int64_t LastY = bSteep ? MajorStart + LastStep : LastMinor;
+
+		OutSetup.Bounds.MinX = static_cast<int32_t>((std::min)(FirstX, LastX));
+		OutSetup.Bounds.MinY = static_cast<int32_t>((std::min)(FirstY, LastY));
+		OutSetup.Bounds.MaxX = static_cast<int32_t>((std::max)(FirstX, LastX)) + 1;
+		OutSetup.Bounds.MaxY = static_cast<int32_t>((std::max)(FirstY, LastY)) + 1;
+
+		OutSetup.FirstPixel = FirstY * Width + FirstX;
+		OutSetup.NumPixels = LastStep - FirstStep + 1;
+		OutSetup.MajorStride = bSteep ? Width : 1;
+		OutSetup.MinorStride = bSteep ? MinorStep : MinorStep * Width;
+		OutSetup.DMajor = DMajor;
+		OutSetup.DMinor = DMinor;
+		OutSetup.Error = 2 * FirstStep * DMinor + DMajor - 2 * DMajor * MinorOffset;
+		return true;
+	}
+
+	void DrawLine(const FLineSetup& Setup, uint32_t* Pixels, uint32_t Color)
+	{
+		uint32_t* PixelData = Pixels + Setup.FirstPixel;
+		int64_t NumPixels = Setup.NumPixels;
+
+		const int64_t DMajor = Setup.DMajor;
+		const int64_t DMinor = Setup.DMinor;
+
+		// 1 水平、垂直和45度对角线，每一步的指针偏移固定
+		if (DMinor == 0 || DMinor == DMajor)
+		{
+			const int64_t Stride = DMinor == 0 ? Setup.MajorStride : Setup.MajorStride + Setup.MinorStride;
+			for (; NumPixels > 0; --NumPixels, PixelData += Stride)
+			{
+				*PixelData = Color;
+			}
+			return;
+		}
+
+		// 2 一般的直线按游程(Run)写入，每一段是次轴步进之前主轴方向连续的像素
+		//    当前误差项为Error时，再走 ceil((2 * DMajor - Error) / (2 * DMinor)) 步次轴就会步进
+		int64_t Error = Setup.Error;
+		while (NumPixels > 0)
+		{
+			const int64_t RunLength = (std::min)(NumPixels, (2 * DMajor - Error + 2 * DMinor - 1) / (2 * DMinor));
+			for (int64_t Index = 0; Index < RunLength; ++Index, PixelData += Setup.MajorStride)
+			{
+				*PixelData = Color;
+			}
+
+			PixelData += Setup.MinorStride;
+			Error += RunLength * 2 * DMinor - 2 * DMajor;
+			NumPixels -= RunLength;
+		}
+	}
+
+	bool SetupTriangle(const float ScreenX[3], const float ScreenY[3], const float Depth[3], const FRasterRect& ClipRect, int32_t Width, int32_t Height, FTriangleSetup& OutSetup)
+	{
+		// 超出这个范围的坐标说明顶点没有经过裁剪，边函数会溢出，直接丢弃
+		constexpr float MaxCoordinate = MaxTriangleCoordinate;
+		for (int32_t Index = 0; Index < 3; ++Index)
+		{
+			if (!(std::fabs(ScreenX[Index]) <= MaxCoordinate && std::fabs(ScreenY[Index]) <= MaxCoordinate))
+				return false;
+		}
+
+		// 1 顶点坐标转换为定点数，亚像素精度为1/SubPixelScale像素
+		int64_t X[3];
+		int64_t Y[3];
+		for (int32_t Index = 0; Index < 3; ++Index)
+		{
+			X[Index] = RoundToInt64(ScreenX[Index] * SubPixelScale);
+			Y[Index] = RoundToInt64(ScreenY[Index] * SubPixelScale);
+		}
+
+		// 2 三角形面积(两倍)，面积为0的三角形不画，面积为负时交换顶点顺序，正反面都填充
+		//    VertexOrder记录交换后的顶点对应原来的第几个顶点，用来还原重心坐标的顺序
+		int64_t Area = (X[1] - X[0]) * (Y[2] - Y[0]) - (Y[1] - Y[0]) * (X[2] - X[0]);
+		if (Area == 0)
+			return false;
+
+		int32_t* VertexOrder = OutSetup.VertexOrder;
+		VertexOrder[0] = 0;
+		VertexOrder[1] = 1;
+		VertexOrder[2] = 2;
+		if (Area < 0)
+		{
+			std::swap(X[1], X[2]);
+			std::swap(Y[1], Y[2]);
+			std::swap(VertexOrder[1], VertexOrder[2]);
+			Area = -Area;
+		}
+
+		// 3 三角形的像素包围盒和裁剪范围求交，像素中心为(X + 0.5, Y + 0.5)
+		const int64_t HalfPixel = SubPixelScale / 2;
+		const int64_t MinVertexX = (std::min)({ X[0], X[1], X[2] });
+		const int64_t MinVertexY = (std::min)({ Y[0], Y[1], Y[2] });
+		const int64_t MaxVertexX = (std::max)({ X[0], X[1], X[2] });
+		const int64_t MaxVertexY = (std::max)({ Y[0], Y[1], Y[2] });
+
+		FRasterRect& Bounds = OutSetup.Bounds;
+		Bounds.MinX = static_cast<int32_t>((std::max)({ int64_t(ClipRect.MinX), int64_t(0), (MinVertexX - HalfPixel + SubPixelScale - 1) >> SubPixelBits }));
+		Bounds.MinY = static_cast<int32_t>((std::max)({ int64_t(ClipRect.MinY), int64_t(0), (MinVertexY - HalfPixel + SubPixelScale - 1) >> SubPixelBits }));
+		Bounds.MaxX = static_cast<int32_t>((std::min)({ int64_t(ClipRect.MaxX), int64_t(Width), ((MaxVertexX - HalfPixel) >> SubPixelBits) + 1 }));
+		Bounds.MaxY = static_cast<int32_t>((std::min)({ int64_t(ClipRect.MaxY), int64_t(Height), ((MaxVertexY - HalfPixel) >> SubPixelBits) + 1 }));
+		if (Bounds.MinX >= Bounds.MaxX || Bounds.MinY >= Bounds.MaxY)
+			return false;
+
+		// 4 三条边的边函数 E(X, Y) = StepX * X + StepY * Y + Origin，(X, Y)为像素坐标，在像素中心处求值
+		//    第Index条边是第Index个顶点的对边，三角形内部的像素三个边函数都大于等于0
+		//    填充规则(Top-Left Rule): 不是上边或左边的边，像素正好落在边上时不填充，通过Bias减1实现
+		for (int32_t Index = 0; Index < 3; ++Index)
+		{
+			const int32_t From = (Index + 1) % 3;
+			const int32_t To = (Index + 2) % 3;
+			const int64_t A = Y[From] - Y[To];
+			const int64_t B = X[To] - X[From];
+
+			OutSetup.EdgeStepX[Index] = A * SubPixelScale;
+			OutSetup.EdgeStepY[Index] = B * SubPixelScale;
+			OutSetup.EdgeOrigin[Index] = A * (HalfPixel - X[From]) + B * (HalfPixel - Y[From]);
+
+			const bool bTopLeft = (A == 0 && B > 0) || A > 0;
+			OutSetup.EdgeBias[Index] = bTopLeft ? 0 : -1;
+		}
+
+		// 5 重心坐标和深度都是像素坐标的线性函数 Value(X, Y) = PlaneX * X + PlaneY * Y + PlaneOrigin
+		//    每个像素都直接用像素坐标求值而不是增量累加，保证同一个像素不管从哪个块开始光栅化结果都一样
+		double DepthPlane[3] = { 0, 0, 0 };
+		for (int32_t Index = 0; Index < 3; ++Index)
+		{
+			const double InvArea = 1.0 / Area;
+			const double PlaneX = OutSetup.EdgeStepX[Index] * InvArea;
+			const double PlaneY = OutSetup.EdgeStepY[Index] * InvArea;
+			const double PlaneOrigin = OutSetup.EdgeOrigin[Index] * InvArea;
+
+			OutSetup.BarycentricPlane[Index][0] = static_cast<float>(PlaneX);
+			OutSetup.BarycentricPlane[Index][1] = static_cast<float>(PlaneY);
+			OutSetup.BarycentricPlane[Index][2] = static_cast<float>(PlaneOrigin);
+
+			const float VertexDepth = Depth[VertexOrder[Index]];
+			DepthPlane[0] += PlaneX * VertexDepth;
+			DepthPlane[1] += PlaneY * VertexDepth;
+			DepthPlane[2] += PlaneOrigin * VertexDepth;
+		}
+
+		OutSetup.DepthPlane[0] = static_cast<float>(DepthPlane[0]);
+		OutSetup.DepthPlane[1] = static_cast<float>(DepthPlane[1]);
+		OutSetup.DepthPlane[2] = static_cast<float>(DepthPlane[2]);
+		return true;
+	}
+
+	void TransformPositions(const float* Positions, int32_t NumVertices, const float Matrix[4][4], float* OutX, float* OutY, float* OutZ, float* OutW)
+	{
+		using namespace Simd;
+
+		// 行向量约定下输出的每个分量是矩阵一列的线性组合
+		// 矩阵的每个元素广播到4个通道，一次计算4个顶点的同一个分量
+		FFloat4 WideMatrix[4][4];
+		for (int32_t Row = 0; Row < 4; ++Row)
+		{
+			for (int32_t Column = 0; Column < 4; ++Column)
+			{
+				WideMatrix[Row][Column] = Float4Set1(Matrix[Row][Column]);
+			}
+		}
+
+		float* const OutputStreams[4] = { OutX, OutY, OutZ, OutW };
+
+		for (int32_t Index = 0; Index < NumVertices; Index += 4)
+		{
+			// 最后不足4个顶点时用最后一个顶点补齐，只写回有效的部分
+			const int32_t NumValid = (std::min)(4, NumVertices - Index);
+			const float* P0 = Positions + 3 * Index;
+			const float* P1 = Positions + 3 * (Index + (std::min)(1, NumValid - 1));
+			const float* P2 = Positions + 3 * (Index + (std::min)(2, NumValid - 1));
+			const float* P3 = Positions + 3 * (Index + (std::min)(3, NumValid - 1));
+
+			// AoS转换为SoA
+			const FFloat4 X = Float4Set(P0[0], P1[0], P2[0], P3[0]);
+			const FFloat4 Y = Float4Set(P0[1], P1[1], P2[1], P3[1]);
+			const FFloat4 Z = Float4Set(P0[2], P1[2], P2[2], P3[2]);
+
+			for (int32_t Column = 0; Column < 4; ++Column)
+			{
+				const FFloat4 Result = Float4MultiplyAdd(X, WideMatrix[0][Column],
+					Float4MultiplyAdd(Y, WideMatrix[1][Column],
+					Float4MultiplyAdd(Z, WideMatrix[2][Column], WideMatrix[3][Column])));
+
+				if (NumValid == 4)
+				{
+					Float4Store(OutputStreams[Column] + Index, Result);
+				}
+				else
+				{
+					alignas(16) float Lanes[4];
+					Float4StoreAligned(Lanes, Result);
+					std::memcpy(OutputStreams[Column] + Index, Lanes, NumValid * sizeof(float));
+				}
+			}
+		}
+	}
+
+	void ProjectToScreen(const float* ClipX, const float* ClipY, const float* ClipZ, const float* ClipW, int32_t NumVertices, int32_t ViewportWidth, int32_t ViewportHeight, float* OutScreenPos, float* OutDepth)
+	{
+		using namespace Simd;
+
+		const FFloat4 One = Float4Set1(1.0f);
+		const FFloat4 HalfViewportX = Float4Set1(ViewportWidth * 0.5f);
+		const FFloat4 HalfViewportY = Float4Set1(ViewportHeight * 0.5f);
+
+		for (int32_t Index = 0; Index < NumVertices; Index += 4)
+		{
+			// 透视除法, 齐次坐标空间 /w 归一化到NDC坐标系中
+			const FFloat4 InvW = Float4Divide(One, Float4LoadAligned(ClipW + Index));
+			const FFloat4 NDCX = Float4Multiply(Float4LoadAligned(ClipX + Index), InvW);
+			const FFloat4 NDCY = Float4Multiply(Float4LoadAligned(ClipY + Index), InvW);
+			const FFloat4 NDCZ = Float4Multiply(Float4LoadAligned(ClipZ + Index), InvW);
+
+			// 计算屏幕坐标
+			alignas(16) float ScreenX[4];
+			alignas(16) float ScreenY[4];
+			alignas(16) float ScreenZ[4];
+			Float4StoreAligned(ScreenX, Float4Multiply(Float4Add(NDCX, One), HalfViewportX));
+			Float4StoreAligned(ScreenY, Float4Multiply(Float4Subtract(One, NDCY), HalfViewportY));
+			Float4StoreAligned(ScreenZ, NDCZ);
+
+			for (int32_t Lane = 0, NumValid = (std::min)(4, NumVertices - Index); Lane < NumValid; ++Lane)
+			{
+				OutScreenPos[2 * (Index + Lane)] = ScreenX[Lane];
+				OutScreenPos[2 * (Index + Lane) + 1] = ScreenY[Lane];
+				OutDepth[Index + Lane] = ScreenZ[Lane];
+			}
+		}
+	}
+}
@@ -0,0 +1,53 @@
+﻿#include "FrameArena.h"
+
+/////////////////////////////////////////////////////
+// FFrameArena
+
+FFrameArena::~FFrameArena()
+{
+	for (void* Block : OverflowBlocks)
+	{
+		FMemory::Free(Block);
+	}
+
+	FMemory::Free(Memory);
+}
+
+void FFrameArena::Reset()
+{
+	if (OverflowBlocks.Num() > 0)
+	{
+		for (void* Block : OverflowBlocks)
+		{
+			FMemory::Free(Block);
+		}
+		OverflowBlocks.Reset();
+
+		// 按本帧的总用量扩容，额外预留1/4避免用量小幅波动时反复扩容
+		FMemory::Free(Memory);
+		Capacity = Align(Offset + Offset / 4, 64 * 1024);
+		Memory = static_cast<uint8*>(FMemory::Malloc(Capacity, MaxAlignment));
+	}
+
+	Offset = 0;
+}
+
+void* FFrameArena::Allocate(SIZE_T Size, uint32 Alignment)
+{
+	check(Alignment <= MaxAlignment && FMath::IsPowerOfTwo(Alignment));
+
+	const SIZE_T AlignedOffset = Align(Offset, Alignment);
+	Offset = AlignedOffset + Size;
+
+	if (Offset <= Capacity)
+	{
+		return Memory + AlignedOffset;
+	}
+
+	// 容量不足，临时从堆上分配，下一次Reset时扩容
+	void* Block = FMemory::Malloc(FMath::Max<SIZE_T>(Size, 1), Alignment);
+	OverflowBlocks.Add(Block);
+	return Block;
+}
+
+/////////////////////////////////////////////////////
@@ -1,15 +1,66 @@
 ﻿#include "FrameBuffer.h"
+#include "SoftRendererStats.h"
+#include "Core/SoftRasterCore.h"
+#include "Async/ParallelFor.h"
+#include "Engine/Texture2D.h"
+#include "RenderingThread.h"
 
 /////////////////////////////////////////////////////
 // UFrameBuffer
 
+/** 整帧清空时超过这个像素个数就分块并行填充 */
+static constexpr int64 ParallelClearMinPixels = 512 * 1024;
+
+/** 整帧并行清空时每一块的像素个数 */
+static constexpr int64 ParallelClearChunkPixels = 64 * 1024;
+
+/**
+ * 整帧清空，目标比较大时分块并行填充
+ */
+static void ClearMemory32(uint32* Data, int64 Count, uint32 Value)
+{
+	if (Count < ParallelClearMinPixels)
+	{
+		SoftRasterCore::FillMemory32(Data, Count, Value, true);
+		return;
+	}
+
+	const int32 NumChunks = static_cast<int32>((Count + ParallelClearChunkPixels - 1) / ParallelClearChunkPixels);
+	ParallelFor(NumChunks, [Data, Count, Value](int32 ChunkIndex)
+	{
+		const int64 ChunkStart = ChunkIndex * ParallelClearChunkPixels;
+		SoftRasterCore::FillMemory32(Data + ChunkStart, FMath::Min(ParallelClearChunkPixels, Count - ChunkStart), Value, true);
+	});
+}
+
+/**
+ * 深度值按位模式转换为32位整数，和颜色使用同样的填充函数
+ */
+static FORCEINLINE uint32 DepthToBits(float Depth)
+{
+	uint32 Bits;
+	FMemory::Memcpy(&Bits, &Depth, sizeof(Bits));
+	return Bits;
+}
+
 UFrameBuffer::UFrameBuffer(const FObjectInitializer& ObjectInitializer)
 	: Super(ObjectInitializer)
 {
 	Width = -1;
 	Height = -1;
 
+	NumClearTilesX = 0;
+	NumClearTilesY = 0;
+	PendingClearColor = 0;
+	PendingClearDepth = 0.0f;
+	bHasPendingColorClear = false;
+	bHasPendingDepthClear = false;
+
+	CurrentPixelStorage = 0;
+	TextureClearColor = 0;
 	Texture = nullptr;
+	UploadTime = 0.0f;
+	NumBytesUploaded = 0;
 }
 
 void UFrameBuffer::Resize(int32 InWidth, int32 InHeight)
@@ -18,135 +69,455 @@ void UFrameBuffer::Resize(int32 InWidth, int32 InHeight)
 	{
 		Width = FMath::Max(2, InWidth);
 		Height = FMath::Max(2, InHeight);
+
+		NumClearTilesX = FMath::DivideAndRoundUp(Width, ClearTileSize);
+		NumClearTilesY = FMath::DivideAndRoundUp(Height, ClearTileSize);
+		const int32 NumClearTiles = NumClearTilesX * NumClearTilesY;
+		
+		// 上传中的旧存储由渲染线程的回调持有，上传完成后才会释放
+		// 只有第0份存储会在下面被清零，其他存储的块版本号为0，切换过去时会从当前存储复制
+		PixelStorages.Reset(NumPixelStorages);
+		for (int32 Index = 0; Index < NumPixelStorages; ++Index)
+		{
+			TSharedRef<FFrameBufferPixelStorage, ESPMode::ThreadSafe> Storage = MakeShared<FFrameBufferPixelStorage, ESPMode::ThreadSafe>();
+			Storage->Pixels.SetNumUninitialized(Width * Height);
+			Storage->TileVersions.Init(Index == 0 ? 1 : 0, NumClearTiles);
+			PixelStorages.Add(Storage);
+		}
+		CurrentPixelStorage = 0;
+		Pixels = PixelStorages[CurrentPixelStorage]->Pixels;
 		
-		Pixels.SetNum(Width * Height);
+		DepthBuffer.SetNum(Width * Height);
+
+		PendingColorClearTiles.SetNumZeroed(NumClearTiles);
+		PendingDepthClearTiles.SetNumZeroed(NumClearTiles);
+		bHasPendingColorClear = false;
+		bHasPendingDepthClear = false;
+		TileVersions.Init(1, NumClearTiles);
+		ModifiedTiles.Init(1, NumClearTiles);
+		TextureClearedTiles.Init(0, NumClearTiles);
 
 		// 所有数据初始化为0，也就是纯黑色
-		FMemory::Memzero(Pixels.GetData(), Pixels.Num());
+		ClearMemory32(Pixels.GetData(), Pixels.Num(), 0);
+		ClearDepth();
 	}
 }
 
-void UFrameBuffer::Clear(FLinearColor ClearColor)
+void UFrameBuffer::Clear(FLinearColor ClearColor, bool bFastClear)
 {
 	if (Pixels.Num() > 0)
 	{
-		const uint32 Color = ClearColor.ToFColor(false).DWColor();
-		for (int32 Index = 0, Count = Pixels.Num(); Index < Count; ++Index)
+		// 先把所有块标记为待清空，切换像素存储时不需要复制任何块
+		PendingClearColor = ClearColor.ToFColor(false).DWColor();
+		FMemory::Memset(PendingColorClearTiles.GetData(), 1, PendingColorClearTiles.Num());
+		bHasPendingColorClear = true;
+
+		// 新的一帧开始，上一帧的像素存储还在上传时换一份存储绘制
+		AcquirePixelStorage();
+		
+		if (!bFastClear)
 		{
-			Pixels[Index] = Color;
+			ClearMemory32(Pixels.GetData(), Pixels.Num(), PendingClearColor);
+			FMemory::Memzero(PendingColorClearTiles.GetData(), PendingColorClearTiles.Num());
+			bHasPendingColorClear = false;
+
+			for (int32 TileIndex = 0, NumTiles = ModifiedTiles.Num(); TileIndex < NumTiles; ++TileIndex)
+			{
+				MarkTileModified(TileIndex);
+			}
 		}
 	}
 }
 
-void UFrameBuffer::Point(int32 X, int32 Y, FLinearColor Color)
+void UFrameBuffer::ClearDepth(float ClearDepthValue, bool bFastClear)
 {
-	if (X >= 0 && X < Width && Y >= 0 && Y < Height)
+	if (DepthBuffer.Num() > 0)
 	{
-		Pixels[Y * Width + X] = Color.ToFColor(false).DWColor();
+		if (bFastClear)
+		{
+			PendingClearDepth = ClearDepthValue;
+			FMemory::Memset(PendingDepthClearTiles.GetData(), 1, PendingDepthClearTiles.Num());
+			bHasPendingDepthClear = true;
+			return;
+		}
+
+		ClearMemory32(reinterpret_cast<uint32*>(DepthBuffer.GetData()), DepthBuffer.Num(), DepthToBits(ClearDepthValue));
+		bHasPendingDepthClear = false;
 	}
 }
 
-UTexture2D* UFrameBuffer::UpdateTexture2D()
+void UFrameBuffer::ClearTiles(const TBitArray<>& Tiles, FLinearColor ClearColor, bool bClearDepth, float ClearDepthValue)
 {
-	if (Width <= 0 || Height <= 0)
-		return nullptr;
+	if (Pixels.Num() == 0 || Tiles.Num() != PendingColorClearTiles.Num())
+		return;
+
+	// 1 上一帧的像素存储还在上传时换一份存储，内容过期的块从上一份存储复制
+	//    之后可能要填充其他待清空的块，必须先换到不在上传的存储再写入
+	AcquirePixelStorage();
 	
-	if (!IsValid(Texture))
+	// 2 还有其他清空值的块在等待清空时，先把它们填充掉，保证所有待清空的块使用同一个清空值
+	const uint32 Color = ClearColor.ToFColor(false).DWColor();
+	if ((bHasPendingColorClear && PendingClearColor != Color) || (bClearDepth && bHasPendingDepthClear && PendingClearDepth != ClearDepthValue))
 	{
-		Texture = NewObject<UTexture2D>(
-			GetTransientPackage(),
-			NAME_None,
-			RF_Transient
-			);
+		ResolveFastClear();
+	}
 
-		Texture->SRGB = false;
-		Texture->LODGroup = TextureGroup::TEXTUREGROUP_UI;
-		Texture->MipLoadOptions = ETextureMipLoadOptions::OnlyFirstMip;
-		Texture->NeverStream = true;
+	// 3 标记需要清空的块，之前没有待清空的块时标志位可能是旧的，先全部清零
+	if (!bHasPendingColorClear)
+	{
+		FMemory::Memzero(PendingColorClearTiles.GetData(), PendingColorClearTiles.Num());
+	}
+	if (bClearDepth && !bHasPendingDepthClear)
+	{
+		FMemory::Memzero(PendingDepthClearTiles.GetData(), PendingDepthClearTiles.Num());
+	}
+	
+	for (TConstSetBitIterator<> It(Tiles); It; ++It)
+	{
+		PendingColorClearTiles[It.GetIndex()] = 1;
+		if (bClearDepth)
+		{
+			PendingDepthClearTiles[It.GetIndex()] = 1;
+		}
+	}
+	
+	PendingClearColor = Color;
+	bHasPendingColorClear = true;
+	if (bClearDepth)
+	{
+		PendingClearDepth = ClearDepthValue;
+		bHasPendingDepthClear = true;
+	}
+}
 
-		Texture->PlatformData = new FTexturePlatformData();
-		Texture->PlatformData->SizeX = Width;
-		Texture->PlatformData->SizeY = Height;
-		Texture->PlatformData->PixelFormat = EPixelFormat::PF_B8G8R8A8;
-		
-		FTexture2DMipMap* Mip = new FTexture2DMipMap();
-		Texture->PlatformData->Mips.Add(Mip);
+void UFrameBuffer::Point(int32 X, int32 Y, FLinearColor Color)
+{
+	if (X >= 0 && X < Width && Y >= 0 && Y < Height)
+	{
+		BeginWrite(FIntRect(X, Y, X + 1, Y + 1));
+		Pixels[Y * Width + X] = Color.ToFColor(false).DWColor();
 	}
+}
+
+bool UFrameBuffer::GetTileRange(const FIntRect& Rect, FIntRect& OutTileRange) const
+{
+	const int32 MinX = FMath::Max(Rect.Min.X, 0);
+	const int32 MinY = FMath::Max(Rect.Min.Y, 0);
+	const int32 MaxX = FMath::Min(Rect.Max.X, Width);
+	const int32 MaxY = FMath::Min(Rect.Max.Y, Height);
+	if (MinX >= MaxX || MinY >= MaxY)
+		return false;
+
+	OutTileRange = FIntRect(MinX / ClearTileSize, MinY / ClearTileSize, (MaxX - 1) / ClearTileSize + 1, (MaxY - 1) / ClearTileSize + 1);
+	return true;
+}
+
+void UFrameBuffer::MarkTileModified(int32 TileIndex)
+{
+	ModifiedTiles[TileIndex] = 1;
+	PixelStorages[CurrentPixelStorage]->TileVersions[TileIndex] = ++TileVersions[TileIndex];
+}
 
-	if (Texture)
+void UFrameBuffer::ResolveTile(int32 TileIndex)
+{
+	const int32 TileMinX = (TileIndex % NumClearTilesX) * ClearTileSize;
+	const int32 TileMinY = (TileIndex / NumClearTilesX) * ClearTileSize;
+	const int32 TileWidth = FMath::Min(TileMinX + ClearTileSize, Width) - TileMinX;
+	const int32 TileMaxY = FMath::Min(TileMinY + ClearTileSize, Height);
+
+	// 块马上就要被写入，使用普通写入让数据留在缓存中
+	if (bHasPendingColorClear && PendingColorClearTiles[TileIndex])
 	{
-		Texture->PlatformData->Mips[0].SizeX = Width;
-		Texture->PlatformData->Mips[0].SizeY = Height;
+		for (int32 Y = TileMinY; Y < TileMaxY; ++Y)
+		{
+			SoftRasterCore::FillMemory32(Pixels.GetData() + Y * Width + TileMinX, TileWidth, PendingClearColor, false);
+		}
+		PendingColorClearTiles[TileIndex] = 0;
+		MarkTileModified(TileIndex);
+	}
 
-		Texture->PlatformData->Mips[0].BulkData.Lock(LOCK_READ_WRITE);
-		
-		uint8* RawData = static_cast<uint8*>(Texture->PlatformData->Mips[0].BulkData.Realloc(Pixels.Num() * GPixelFormats[EPixelFormat::PF_B8G8R8A8].BlockBytes));
-		FMemory::Memcpy(RawData, Pixels.GetData(), Pixels.Num() * GPixelFormats[EPixelFormat::PF_B8G8R8A8].BlockBytes);
-		
-		Texture->PlatformData->Mips[0].BulkData.Unlock();
-		
-		Texture->UpdateResource();
+	if (bHasPendingDepthClear && PendingDepthClearTiles[TileIndex])
+	{
+		const uint32 ClearDepthBits = DepthToBits(PendingClearDepth);
+		for (int32 Y = TileMinY; Y < TileMaxY; ++Y)
+		{
+			SoftRasterCore::FillMemory32(reinterpret_cast<uint32*>(DepthBuffer.GetData()) + Y * Width + TileMinX, TileWidth, ClearDepthBits, false);
+		}
+		PendingDepthClearTiles[TileIndex] = 0;
 	}
-	
-	return Texture;
 }
 
-void UFrameBuffer::DrawLine(int32 StartX, int32 StartY, int32 EndX, int32 EndY)
+void UFrameBuffer::BeginWrite(const FIntRect& Rect)
 {
-	int32 Dx=abs(StartX-EndX);
-	int32 Dy=abs(StartY-EndY);
-	int32 E=Dx-Dy*2;
-	int32 Flag=0;
-	int32 Tmp;
+	FIntRect TileRange;
+	if (!GetTileRange(Rect, TileRange))
+		return;
+
+	// 上传之后没有Clear就直接写入时，当前的像素存储还在被渲染线程读取，先换一份存储，不在上传时只检查一个标志
+	AcquirePixelStorage();
 
-	if(Dy>Dx)
+	for (int32 TileY = TileRange.Min.Y; TileY < TileRange.Max.Y; ++TileY)
 	{
-		Tmp=StartX;
-		StartX=StartY;
-		StartY = Tmp;
+		for (int32 TileX = TileRange.Min.X; TileX < TileRange.Max.X; ++TileX)
+		{
+			const int32 TileIndex = TileY * NumClearTilesX + TileX;
+			ResolveTile(TileIndex);
+			MarkTileModified(TileIndex);
+		}
+	}
+}
 
-		Tmp = EndX;
-		EndX = EndY;
-		EndY = Tmp;
-		Flag=1;
+void UFrameBuffer::ResolveFastClear(const FIntRect& Rect)
+{
+	if (!bHasPendingColorClear && !bHasPendingDepthClear)
+		return;
+
+	FIntRect TileRange;
+	if (!GetTileRange(Rect, TileRange))
+		return;
+	
+	for (int32 TileY = TileRange.Min.Y; TileY < TileRange.Max.Y; ++TileY)
+	{
+		for (int32 TileX = TileRange.Min.X; TileX < TileRange.Max.X; ++TileX)
+		{
+			ResolveTile(TileY * NumClearTilesX + TileX);
+		}
 	}
+}
+
+void UFrameBuffer::ResolveFastClear()
+{
+	if (!bHasPendingColorClear && !bHasPendingDepthClear)
+		return;
 
-	if (StartX > EndX)
+	// 每一行块由一个线程处理，不同线程不会填充同一个块
+	ParallelFor(NumClearTilesY, [this](int32 TileY)
 	{
-                Tmp = StartX;
-		StartX = EndX;
-		EndX = Tmp;
+		ResolveFastClear(FIntRect(0, TileY * ClearTileSize, Width, (TileY + 1) * ClearTileSize));
+	});
 
-		Tmp = StartY;
-		StartY = EndY;
-		EndY = Tmp;
+	bHasPendingColorClear = false;
+	bHasPendingDepthClear = false;
+}
 
-	}
+void UFrameBuffer::ReadPixels(TArray<FColor>& OutPixels)
+{
+	static_assert(sizeof(FColor) == sizeof(uint32), "Packed pixels are stored in the FColor memory layout.");
+	
+	ResolveFastClear();
+	
+	OutPixels.SetNumUninitialized(Pixels.Num());
+	FMemory::Memcpy(OutPixels.GetData(), Pixels.GetData(), Pixels.Num() * sizeof(uint32));
+}
+
+void UFrameBuffer::AcquirePixelStorage()
+{
+	if (PixelStorages.Num() == 0 || !PixelStorages[CurrentPixelStorage]->bUploading)
+		return;
 
-	while (StartX<= EndX)
+	int32 NextPixelStorage = INDEX_NONE;
+	for (int32 Offset = 1; Offset < PixelStorages.Num(); ++Offset)
 	{
-		if (Flag == 1)
+		const int32 Index = (CurrentPixelStorage + Offset) % PixelStorages.Num();
+		if (!PixelStorages[Index]->bUploading)
 		{
-			Point(StartY, StartX,BLue);
+			NextPixelStorage = Index;
+			break;
 		}
-		else
+	}
+
+	// 所有的存储都在上传，等待渲染线程处理完再继续使用当前的存储
+	if (NextPixelStorage == INDEX_NONE)
+	{
+		FlushRenderingCommands();
+		return;
+	}
+
+	// 新存储中内容过期的块从当前存储复制，待清空的块之后会重新填充，不需要复制
+	//    渲染线程同时也在读取当前存储，两边都只读不会冲突
+	const FFrameBufferPixelStorage& Previous = *PixelStorages[CurrentPixelStorage];
+	FFrameBufferPixelStorage& Next = *PixelStorages[NextPixelStorage];
+	for (int32 TileIndex = 0, NumTiles = TileVersions.Num(); TileIndex < NumTiles; ++TileIndex)
+	{
+		if ((bHasPendingColorClear && PendingColorClearTiles[TileIndex]) || Next.TileVersions[TileIndex] == TileVersions[TileIndex])
+			continue;
+
+		const int32 TileMinX = (TileIndex % NumClearTilesX) * ClearTileSize;
+		const int32 TileMinY = (TileIndex / NumClearTilesX) * ClearTileSize;
+		const int32 TileWidth = FMath::Min(TileMinX + ClearTileSize, Width) - TileMinX;
+		const int32 TileMaxY = FMath::Min(TileMinY + ClearTileSize, Height);
+		for (int32 Y = TileMinY; Y < TileMaxY; ++Y)
 		{
-			Point(StartX, StartY, Blue);
+			FMemory::Memcpy(Next.Pixels.GetData() + Y * Width + TileMinX, Previous.Pixels.GetData() + Y * Width + TileMinX, TileWidth * sizeof(uint32));
 		}
+		Next.TileVersions[TileIndex] = TileVersions[TileIndex];
+	}
 
+	CurrentPixelStorage = NextPixelStorage;
+	Pixels = Next.Pixels;
+}
 
-		StartX++;
+bool UFrameBuffer::IsTileDirtyForTexture(int32 TileIndex) const
+{
+	// 没有画过的块，纹理中已经是同样的清空颜色时不需要上传
+	if (bHasPendingColorClear && PendingColorClearTiles[TileIndex])
+		return !TextureClearedTiles[TileIndex] || TextureClearColor != PendingClearColor;
 
+	// 上一次上传之后被修改过的块需要上传
+	return ModifiedTiles[TileIndex] != 0;
+}
 
-		if (E < 0)
-		{
-			E += 2 * Dx;
-			StartY++;
-		}
-		else
+UTexture2D* UFrameBuffer::UpdateTexture2D()
+{
+	UploadTime = 0.0f;
+	NumBytesUploaded = 0;
+	
+	if (Width <= 0 || Height <= 0)
+		return nullptr;
+
+	SCOPE_SOFTRENDERER_STAGE(STAT_SoftRenderer_Upload, UploadTime);
+
+	// 1 第一次调用或者大小变化时创建纹理资源，新纹理的所有块都需要上传
+	if (!IsValid(Texture) || Texture->GetSizeX() != Width || Texture->GetSizeY() != Height)
+	{
+		Texture = UTexture2D::CreateTransient(Width, Height, EPixelFormat::PF_B8G8R8A8);
+		if (!IsValid(Texture))
+			return nullptr;
+		
+		Texture->SRGB = false;
+		Texture->LODGroup = TextureGroup::TEXTUREGROUP_UI;
+		Texture->UpdateResource();
+
+		TextureClearedTiles.Init(0, NumClearTilesX * NumClearTilesY);
+	}
+
+	// 渲染资源还没有创建好时不能上传，块的修改记录和纹理的清空状态都保持不变，下一次调用时再上传
+	if (Texture->Resource == nullptr)
+		return Texture;
+
+	// 2 收集需要上传的块，同一行中相邻的块合并成一个区域
+	//    需要上传但还没有写入清空颜色的块，先在像素存储中填充
+	TArray<FUpdateTextureRegion2D, TInlineAllocator<64>> Regions;
+	for (int32 TileY = 0; TileY < NumClearTilesY; ++TileY)
+	{
+		const int32 TileMinY = TileY * ClearTileSize;
+		const int32 TileHeight = FMath::Min(TileMinY + ClearTileSize, Height) - TileMinY;
+		int32 RunStartX = INDEX_NONE;
+
+		// 多循环一次，把每一行最后一段连续的块输出
+		for (int32 TileX = 0; TileX <= NumClearTilesX; ++TileX)
 		{
-			E -= 2 * Dy;
+			const int32 TileIndex = TileY * NumClearTilesX + TileX;
+			const bool bDirty = TileX < NumClearTilesX && IsTileDirtyForTexture(TileIndex);
+			if (bDirty)
+			{
+				const bool bCleared = bHasPendingColorClear && PendingColorClearTiles[TileIndex];
+				if (bCleared)
+				{
+					ResolveFastClear(FIntRect(TileX * ClearTileSize, TileMinY, (TileX + 1) * ClearTileSize, TileMinY + ClearTileSize));
+				}
+				TextureClearedTiles[TileIndex] = bCleared ? 1 : 0;
+				ModifiedTiles[TileIndex] = 0;
+
+				if (RunStartX == INDEX_NONE)
+				{
+					RunStartX = TileX;
+				}
+			}
+			else if (RunStartX != INDEX_NONE)
+			{
+				const int32 RunMinX = RunStartX * ClearTileSize;
+				const int32 RunMaxX = FMath::Min(TileX * ClearTileSize, Width);
+				Regions.Emplace(RunMinX, TileMinY, RunMinX, TileMinY, RunMaxX - RunMinX, TileHeight);
+				RunStartX = INDEX_NONE;
+			}
 		}
 	}
+	TextureClearColor = PendingClearColor;
+
+	if (Regions.Num() == 0)
+		return Texture;
+
+	for (const FUpdateTextureRegion2D& Region : Regions)
+	{
+		NumBytesUploaded += static_cast<int32>(Region.Width * Region.Height * sizeof(uint32));
+	}
+	INC_DWORD_STAT_BY(STAT_SoftRenderer_BytesUploaded, NumBytesUploaded);
+
+	// 3 当前的像素存储直接交给渲染线程上传，上传完成后在渲染线程上释放区域数组并归还存储
+	//    区域数组和像素存储都要保持有效，直到渲染线程执行完上传
+	TSharedRef<FFrameBufferPixelStorage, ESPMode::ThreadSafe> Storage = PixelStorages[CurrentPixelStorage];
+	Storage->bUploading = true;
+
+	FUpdateTextureRegion2D* UploadRegions = new FUpdateTextureRegion2D[Regions.Num()];
+	FMemory::Memcpy(UploadRegions, Regions.GetData(), Regions.Num() * sizeof(FUpdateTextureRegion2D));
+
+	Texture->UpdateTextureRegions(0, Regions.Num(), UploadRegions, Width * sizeof(uint32), sizeof(uint32), reinterpret_cast<uint8*>(Pixels.GetData()),
+		[Storage](uint8* SrcData, const FUpdateTextureRegion2D* InRegions)
+		{
+			delete[] InRegions;
+			Storage->bUploading = false;
+		});
+	
+	return Texture;
+}
+
+void UFrameBuffer::DrawLine(int32 StartX, int32 StartY, int32 EndX, int32 EndY, const FLinearColor& Color)
+{
+	DrawLine(StartX, StartY, EndX, EndY, Color.ToFColor(false).DWColor(), FIntRect(0, 0, Width, Height));
+}
+
+void UFrameBuffer::DrawLine(int32 StartX, int32 StartY, int32 EndX, int32 EndY, const FLinearColor& Color, const FIntRect& ClipRect)
+{
+	DrawLine(StartX, StartY, EndX, EndY, Color.ToFColor(false).DWColor(), ClipRect);
+}
+
+/**
+ * FIntRect转换为核心库使用的像素矩形
+ */
+static FORCEINLINE SoftRasterCore::FRasterRect ToRasterRect(const FIntRect& Rect)
+{
+	return SoftRasterCore::FRasterRect{ Rect.Min.X, Rect.Min.Y, Rect.Max.X, Rect.Max.Y };
+}
+
+int32 UFrameBuffer::DrawLine(int32 StartX, int32 StartY, int32 EndX, int32 EndY, uint32 PackedColor, const FIntRect& ClipRect)
+{
+	// 1 裁剪直线，完全在裁剪范围外时不画
+	SoftRasterCore::FLineSetup Setup;
+	if (!SoftRasterCore::SetupLine(StartX, StartY, EndX, EndY, ToRasterRect(ClipRect), Width, Height, Setup))
+		return 0;
+
+	// 2 画线范围内快速清空还没有写入的块先填充，并记录被修改的块
+	BeginWrite(FIntRect(Setup.Bounds.MinX, Setup.Bounds.MinY, Setup.Bounds.MaxX, Setup.Bounds.MaxY));
+
+	// 3 写入像素
+	SoftRasterCore::DrawLine(Setup, Pixels.GetData(), PackedColor);
+	return static_cast<int32>(Setup.NumPixels);
+}
+
+int32 UFrameBuffer::DrawTriangle(const FVector2D ScreenPos[3], const float Depth[3], FPixelShaderFunction PixelShaderFunction, const FIntRect& ClipRect)
+{
+	// 1 计算边函数和插值平面，不需要绘制的三角形直接返回
+	const float ScreenX[3] = { ScreenPos[0].X, ScreenPos[1].X, ScreenPos[2].X };
+	const float ScreenY[3] = { ScreenPos[0].Y, ScreenPos[1].Y, ScreenPos[2].Y };
+	
+	SoftRasterCore::FTriangleSetup Setup;
+	if (!SoftRasterCore::SetupTriangle(ScreenX, ScreenY, Depth, ToRasterRect(ClipRect), Width, Height, Setup))
+		return 0;
+
+	// 2 包围盒范围内快速清空还没有写入的块先填充，并记录被修改的块
+	BeginWrite(FIntRect(Setup.Bounds.MinX, Setup.Bounds.MinY, Setup.Bounds.MaxX, Setup.Bounds.MaxY));
+
+	// 3 光栅化，深度测试通过的像素执行像素着色器
+	const SoftRasterCore::FRasterSurface Surface{ Pixels.GetData(), DepthBuffer.GetData(), Width, Height };
+	return SoftRasterCore::RasterizeTriangle(Setup, Surface, [&PixelShaderFunction](int32 PixelX, int32 PixelY, float PixelDepth, const float Barycentric[3])
+	{
+		FPixelShaderInput Input;
+		Input.PixelPos = FIntPoint(PixelX, PixelY);
+		Input.Depth = PixelDepth;
+		Input.Barycentric = FVector(Barycentric[0], Barycentric[1], Barycentric[2]);
+		return PixelShaderFunction(Input);
+	});
 }
+
 /////////////////////////////////////////////////////
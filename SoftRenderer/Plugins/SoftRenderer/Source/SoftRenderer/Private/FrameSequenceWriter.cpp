@@ -0,0 +1,135 @@
+﻿#include "FrameSequenceWriter.h"
+#include "FrameBuffer.h"
+#include "SoftRendererModule.h"
+#include "Async/Async.h"
+#include "HAL/FileManager.h"
+#include "IImageWrapper.h"
+#include "IImageWrapperModule.h"
+#include "Misc/FileHelper.h"
+#include "Misc/Paths.h"
+
+/////////////////////////////////////////////////////
+// FFrameSequenceWriter
+
+FFrameSequenceWriter::FFrameSequenceWriter(const FString& InDirectory, const FString& InBaseName, EFrameImageFormat InFormat, int32 InMaxPendingFrames)
+	: Directory(InDirectory), BaseName(InBaseName), Format(InFormat), MaxPendingFrames(FMath::Max(1, InMaxPendingFrames)), NumFrames(0), bAllSucceeded(true)
+{
+	IFileManager::Get().MakeDirectory(*Directory, true);
+
+	// 模块只能在游戏线程加载，后台线程直接使用已经加载的模块
+	if (Format == EFrameImageFormat::PNG)
+	{
+		FModuleManager::LoadModuleChecked<IImageWrapperModule>(FName("ImageWrapper"));
+	}
+}
+
+FFrameSequenceWriter::~FFrameSequenceWriter()
+{
+	Flush();
+}
+
+void FFrameSequenceWriter::AddFrame(UFrameBuffer* FrameBuffer)
+{
+	if (FrameBuffer == nullptr)
+		return;
+
+	// 1 等待写入的帧太多时，先等最早的一帧写完
+	while (PendingFrames.Num() >= MaxPendingFrames)
+	{
+		WaitOldestFrame();
+	}
+
+	// 2 复制像素，之后帧图像可以马上开始绘制下一帧
+	TArray<FColor> Pixels;
+	FrameBuffer->ReadPixels(Pixels);
+	
+	const int32 Width = FrameBuffer->GetWidth();
+	const int32 Height = FrameBuffer->GetHeight();
+	const FString Filename = FPaths::Combine(Directory, FString::Printf(TEXT("%s_%05d.%s"), *BaseName, NumFrames, GetFileExtension(Format)));
+	++NumFrames;
+
+	// 3 编码和写文件都在后台线程池上进行
+	PendingFrames.Add(Async(EAsyncExecution::ThreadPool, [Pixels = MoveTemp(Pixels), Width, Height, ImageFormat = Format, Filename]()
+	{
+		TArray<uint8> FileData;
+		if (!EncodeImage(Pixels, Width, Height, ImageFormat, FileData))
+		{
+			UE_LOG(LogSoftRenderer, Error, TEXT("Failed to encode %s."), *Filename);
+			return false;
+		}
+
+		if (!FFileHelper::SaveArrayToFile(FileData, *Filename))
+		{
+			UE_LOG(LogSoftRenderer, Error, TEXT("Failed to write %s."), *Filename);
+			return false;
+		}
+		
+		return true;
+	}));
+}
+
+bool FFrameSequenceWriter::Flush()
+{
+	while (PendingFrames.Num() > 0)
+	{
+		WaitOldestFrame();
+	}
+	
+	return bAllSucceeded;
+}
+
+void FFrameSequenceWriter::WaitOldestFrame()
+{
+	bAllSucceeded &= PendingFrames[0].Get();
+	PendingFrames.RemoveAt(0, 1, false);
+}
+
+bool FFrameSequenceWriter::EncodeImage(const TArray<FColor>& Pixels, int32 Width, int32 Height, EFrameImageFormat Format, TArray<uint8>& OutData)
+{
+	if (Width <= 0 || Height <= 0 || Pixels.Num() != Width * Height)
+		return false;
+
+	if (Format == EFrameImageFormat::PPM)
+	{
+		// P6头部之后逐像素写入RGB三个字节
+		const FTCHARToUTF8 Header(*FString::Printf(TEXT("P6\n%d %d\n255\n"), Width, Height));
+		OutData.SetNumUninitialized(Header.Length() + Pixels.Num() * 3);
+		FMemory::Memcpy(OutData.GetData(), Header.Get(), Header.Length());
+
+		uint8* RGB = OutData.GetData() + Header.Length();
+		for (const FColor& Pixel : Pixels)
+		{
+			RGB[0] = Pixel.R;
+			RGB[1] = Pixel.G;
+			RGB[2] = Pixel.B;
+			RGB += 3;
+		}
+		return true;
+	}
+
+	// 帧图像的Alpha不表示透明度，PNG按不透明输出
+	TArray<FColor> OpaquePixels(Pixels);
+	for (FColor& Pixel : OpaquePixels)
+	{
+		Pixel.A = 255;
+	}
+
+	IImageWrapperModule& ImageWrapperModule = FModuleManager::GetModuleChecked<IImageWrapperModule>(FName("ImageWrapper"));
+	TSharedPtr<IImageWrapper> ImageWrapper = ImageWrapperModule.CreateImageWrapper(EImageFormat::PNG);
+	if (!ImageWrapper.IsValid() || !ImageWrapper->SetRaw(OpaquePixels.GetData(), OpaquePixels.Num() * sizeof(FColor), Width, Height, ERGBFormat::BGRA, 8))
+		return false;
+
+	const TArray64<uint8>& CompressedData = ImageWrapper->GetCompressed();
+	if (CompressedData.Num() == 0)
+		return false;
+	
+	OutData = TArray<uint8>(CompressedData.GetData(), static_cast<int32>(CompressedData.Num()));
+	return true;
+}
+
+const TCHAR* FFrameSequenceWriter::GetFileExtension(EFrameImageFormat Format)
+{
+	return Format == EFrameImageFormat::PPM ? TEXT("ppm") : TEXT("png");
+}
+
+/////////////////////////////////////////////////////
@@ -0,0 +1,173 @@
+﻿#include "HierarchicalZBuffer.h"
+#include "FrameBuffer.h"
+#include "Async/ParallelFor.h"
+
+/////////////////////////////////////////////////////
+// FHierarchicalZBuffer
+
+static_assert(FHierarchicalZBuffer::TileSize == UFrameBuffer::ClearTileSize, "Hi-Z tiles must match the frame buffer clear tiles.");
+
+void FHierarchicalZBuffer::Init(int32 InWidth, int32 InHeight, float ClearDepth)
+{
+	Width = FMath::Max(0, InWidth);
+	Height = FMath::Max(0, InHeight);
+
+	NumBlocksX = FMath::DivideAndRoundUp(Width, BlockSize);
+	NumTilesX = FMath::DivideAndRoundUp(Width, TileSize);
+
+	const int32 NumBlocks = NumBlocksX * FMath::DivideAndRoundUp(Height, BlockSize);
+	const int32 NumTiles = NumTilesX * FMath::DivideAndRoundUp(Height, TileSize);
+
+	BlockMinDepth.Init(ClearDepth, NumBlocks);
+	BlockMaxDepth.Init(ClearDepth, NumBlocks);
+	TileMinDepth.Init(ClearDepth, NumTiles);
+	TileMaxDepth.Init(ClearDepth, NumTiles);
+
+	DirtyTiles.Init(false, NumTiles);
+	DirtyTileList.Reset();
+}
+
+void FHierarchicalZBuffer::MarkDirty(const FIntRect& Rect)
+{
+	const int32 MinX = FMath::Max(Rect.Min.X, 0);
+	const int32 MinY = FMath::Max(Rect.Min.Y, 0);
+	const int32 MaxX = FMath::Min(Rect.Max.X, Width);
+	const int32 MaxY = FMath::Min(Rect.Max.Y, Height);
+	if (MinX >= MaxX || MinY >= MaxY)
+		return;
+
+	for (int32 TileY = MinY / TileSize, LastTileY = (MaxY - 1) / TileSize; TileY <= LastTileY; ++TileY)
+	{
+		for (int32 TileX = MinX / TileSize, LastTileX = (MaxX - 1) / TileSize; TileX <= LastTileX; ++TileX)
+		{
+			const int32 TileIndex = TileY * NumTilesX + TileX;
+			if (!DirtyTiles[TileIndex])
+			{
+				DirtyTiles[TileIndex] = true;
+				DirtyTileList.Add(TileIndex);
+			}
+		}
+	}
+}
+
+void FHierarchicalZBuffer::Update(const UFrameBuffer* FrameBuffer)
+{
+	ParallelFor(DirtyTileList.Num(), [this, FrameBuffer](int32 Index)
+	{
+		UpdateTile(FrameBuffer, DirtyTileList[Index]);
+	});
+
+	for (const int32 TileIndex : DirtyTileList)
+	{
+		DirtyTiles[TileIndex] = false;
+	}
+	DirtyTileList.Reset();
+}
+
+void FHierarchicalZBuffer::UpdateTile(const UFrameBuffer* FrameBuffer, int32 TileIndex)
+{
+	const float* DepthData = FrameBuffer->GetDepthBuffer().GetData();
+
+	const int32 TileMinX = (TileIndex % NumTilesX) * TileSize;
+	const int32 TileMinY = (TileIndex / NumTilesX) * TileSize;
+	const int32 TileMaxX = FMath::Min(TileMinX + TileSize, Width);
+	const int32 TileMaxY = FMath::Min(TileMinY + TileSize, Height);
+
+	// 快速清空后还没有写入的Tile，内存里是旧的深度，整个Tile都是清空值
+	if (FrameBuffer->IsDepthClearPending(TileIndex))
+	{
+		const float ClearDepth = FrameBuffer->GetPendingClearDepth();
+		for (int32 BlockY = TileMinY; BlockY < TileMaxY; BlockY += BlockSize)
+		{
+			for (int32 BlockX = TileMinX; BlockX < TileMaxX; BlockX += BlockSize)
+			{
+				const int32 BlockIndex = (BlockY / BlockSize) * NumBlocksX + BlockX / BlockSize;
+				BlockMinDepth[BlockIndex] = ClearDepth;
+				BlockMaxDepth[BlockIndex] = ClearDepth;
+			}
+		}
+		
+		TileMinDepth[TileIndex] = ClearDepth;
+		TileMaxDepth[TileIndex] = ClearDepth;
+		return;
+	}
+
+	float TileMin = MAX_flt;
+	float TileMax = -MAX_flt;
+
+	// 先求Tile内每个8x8像素块的最小最大深度，再由像素块求出Tile的
+	for (int32 BlockY = TileMinY; BlockY < TileMaxY; BlockY += BlockSize)
+	{
+		for (int32 BlockX = TileMinX; BlockX < TileMaxX; BlockX += BlockSize)
+		{
+			float BlockMin = MAX_flt;
+			float BlockMax = -MAX_flt;
+			for (int32 Y = BlockY, MaxY = FMath::Min(BlockY + BlockSize, TileMaxY); Y < MaxY; ++Y)
+			{
+				const float* Row = DepthData + Y * Width;
+				for (int32 X = BlockX, MaxX = FMath::Min(BlockX + BlockSize, TileMaxX); X < MaxX; ++X)
+				{
+					BlockMin = FMath::Min(BlockMin, Row[X]);
+					BlockMax = FMath::Max(BlockMax, Row[X]);
+				}
+			}
+
+			const int32 BlockIndex = (BlockY / BlockSize) * NumBlocksX + BlockX / BlockSize;
+			BlockMinDepth[BlockIndex] = BlockMin;
+			BlockMaxDepth[BlockIndex] = BlockMax;
+
+			TileMin = FMath::Min(TileMin, BlockMin);
+			TileMax = FMath::Max(TileMax, BlockMax);
+		}
+	}
+
+	TileMinDepth[TileIndex] = TileMin;
+	TileMaxDepth[TileIndex] = TileMax;
+}
+
+bool FHierarchicalZBuffer::IsOccluded(const FIntRect& ScreenRect, float NearestDepth) const
+{
+	const int32 MinX = FMath::Max(ScreenRect.Min.X, 0);
+	const int32 MinY = FMath::Max(ScreenRect.Min.Y, 0);
+	const int32 MaxX = FMath::Min(ScreenRect.Max.X, Width);
+	const int32 MaxY = FMath::Min(ScreenRect.Max.Y, Height);
+	if (MinX >= MaxX || MinY >= MaxY)
+		return false;
+
+	// 光栅化插值的深度有浮点误差，留一点余量保证剔除是保守的
+	const float OccluderDepth = NearestDepth + FMath::Abs(NearestDepth) * 1.0e-4f;
+
+	for (int32 TileY = MinY / TileSize, LastTileY = (MaxY - 1) / TileSize; TileY <= LastTileY; ++TileY)
+	{
+		for (int32 TileX = MinX / TileSize, LastTileX = (MaxX - 1) / TileSize; TileX <= LastTileX; ++TileX)
+		{
+			const int32 TileIndex = TileY * NumTilesX + TileX;
+
+			// 比Tile内最近的像素还近，一定可见
+			if (NearestDepth > TileMaxDepth[TileIndex])
+				return false;
+
+			// 比Tile内最远的像素还远，这个Tile内被完全遮挡
+			if (TileMinDepth[TileIndex] > OccluderDepth)
+				continue;
+
+			// 逐个测试和物体范围相交的8x8像素块
+			const int32 BlockMinX = FMath::Max(MinX, TileX * TileSize) / BlockSize;
+			const int32 BlockMinY = FMath::Max(MinY, TileY * TileSize) / BlockSize;
+			const int32 BlockMaxX = (FMath::Min(MaxX, (TileX + 1) * TileSize) - 1) / BlockSize;
+			const int32 BlockMaxY = (FMath::Min(MaxY, (TileY + 1) * TileSize) - 1) / BlockSize;
+			for (int32 BlockY = BlockMinY; BlockY <= BlockMaxY; ++BlockY)
+			{
+				for (int32 BlockX = BlockMinX; BlockX <= BlockMaxX; ++BlockX)
+				{
+					if (BlockMinDepth[BlockY * NumBlocksX + BlockX] <= OccluderDepth)
+						return false;
+				}
+			}
+		}
+	}
+
+	return true;
+}
+
+/////////////////////////////////////////////////////
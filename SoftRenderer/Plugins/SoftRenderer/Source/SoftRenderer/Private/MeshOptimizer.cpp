@@ -0,0 +1,771 @@
+﻿#include "MeshOptimizer.h"
+#include "RenderObject.h"
+
+/////////////////////////////////////////////////////
+// FMeshOptimizer
+
+namespace MeshOptimizer
+{
+	/** 模拟的LRU顶点缓存大小 */
+	constexpr int32 VertexCacheSize = 32;
+
+	/** Forsyth算法的得分参数 */
+	constexpr float CacheDecayPower = 1.5f;
+	constexpr float LastTriangleScore = 0.75f;
+	constexpr float ValenceBoostScale = 2.0f;
+	constexpr float ValenceBoostPower = 0.5f;
+
+	/**
+	 * 计算顶点的得分
+	 *    刚用过的三角形的3个顶点得分固定，其余在缓存中的顶点越靠前得分越高，剩余三角形少的顶点额外加分，尽快把它用完
+	 */
+	static float CalculateVertexScore(int32 CachePosition, int32 NumRemainingTriangles)
+	{
+		if (NumRemainingTriangles == 0)
+			return -1.0f;
+
+		float Score = 0.0f;
+		if (CachePosition >= 0)
+		{
+			if (CachePosition < 3)
+			{
+				Score = LastTriangleScore;
+			}
+			else
+			{
+				const float Scaler = 1.0f / (VertexCacheSize - 3);
+				Score = FMath::Pow(1.0f - (CachePosition - 3) * Scaler, CacheDecayPower);
+			}
+		}
+
+		return Score + ValenceBoostScale * FMath::Pow(static_cast<float>(NumRemainingTriangles), -ValenceBoostPower);
+	}
+
+	/** 边界边约束平面的权重，相对于三角形平面按面积加权的误差 */
+	constexpr double BoundaryWeight = 10.0;
+
+	/**
+	 * 二次误差，对称的4x4矩阵只存储上三角的10个元素
+	 *    Q(P) = [P 1] * Q * [P 1]^T，表示点P到一组平面的距离平方和
+	 */
+	struct FQuadric
+	{
+		double XX = 0.0, XY = 0.0, XZ = 0.0, XW = 0.0;
+		double YY = 0.0, YZ = 0.0, YW = 0.0;
+		double ZZ = 0.0, ZW = 0.0;
+		double WW = 0.0;
+
+		/** 加上平面 Normal * P + D = 0 的误差，Normal必须是单位向量 */
+		void AddPlane(const FVector& Normal, float D, double Weight)
+		{
+			const double A = Normal.X, B = Normal.Y, C = Normal.Z;
+			XX += Weight * A * A; XY += Weight * A * B; XZ += Weight * A * C; XW += Weight * A * D;
+			YY += Weight * B * B; YZ += Weight * B * C; YW += Weight * B * D;
+			ZZ += Weight * C * C; ZW += Weight * C * D;
+			WW += Weight * D * D;
+		}
+
+		FQuadric& operator+=(const FQuadric& Other)
+		{
+			XX += Other.XX; XY += Other.XY; XZ += Other.XZ; XW += Other.XW;
+			YY += Other.YY; YZ += Other.YZ; YW += Other.YW;
+			ZZ += Other.ZZ; ZW += Other.ZW;
+			WW += Other.WW;
+			return *this;
+		}
+
+		double Evaluate(const FVector& P) const
+		{
+			const double X = P.X, Y = P.Y, Z = P.Z;
+			return XX * X * X + 2.0 * XY * X * Y + 2.0 * XZ * X * Z + 2.0 * XW * X
+				+ YY * Y * Y + 2.0 * YZ * Y * Z + 2.0 * YW * Y
+				+ ZZ * Z * Z + 2.0 * ZW * Z
+				+ WW;
+		}
+	};
+
+	/**
+	 * 一次候选的边坍缩，把From坍缩到To
+	 *    记录入队时两个端点的版本号，端点的误差或者相邻三角形变化后版本号递增，出队时版本号不同的候选直接丢弃
+	 */
+	struct FEdgeCollapse
+	{
+		double Error;
+		uint32 From;
+		uint32 To;
+		uint32 FromVersion;
+		uint32 ToVersion;
+
+		/** 误差小的排在堆顶 */
+		FORCEINLINE bool operator<(const FEdgeCollapse& Other) const { return Error < Other.Error; }
+	};
+
+	/** 边的两个顶点编码成64位的键，小的顶点索引在高位 */
+	static FORCEINLINE uint64 MakeEdgeKey(uint32 Vertex0, uint32 Vertex1)
+	{
+		return (static_cast<uint64>(FMath::Min(Vertex0, Vertex1)) << 32) | FMath::Max(Vertex0, Vertex1);
+	}
+}
+
+void FMeshOptimizer::OptimizeVertexCache(TArray<uint32>& Indices, int32 NumVertices)
+{
+	using namespace MeshOptimizer;
+	
+	const int32 NumTriangles = Indices.Num() / 3;
+	if (NumTriangles == 0 || NumVertices <= 0)
+		return;
+
+	// 1 建立每个顶点使用的三角形列表，所有列表连续存储，列表中还没有输出的三角形排在前面
+	TArray<int32> RemainingTriangles;
+	RemainingTriangles.SetNumZeroed(NumVertices);
+	for (int32 Index = 0; Index < NumTriangles * 3; ++Index)
+	{
+		++RemainingTriangles[Indices[Index]];
+	}
+
+	TArray<int32> TriangleListOffsets;
+	TriangleListOffsets.SetNumUninitialized(NumVertices + 1);
+	TriangleListOffsets[0] = 0;
+	for (int32 Vertex = 0; Vertex < NumVertices; ++Vertex)
+	{
+		TriangleListOffsets[Vertex + 1] = TriangleListOffsets[Vertex] + RemainingTriangles[Vertex];
+	}
+
+	TArray<int32> TriangleLists;
+	TriangleLists.SetNumUninitialized(NumTriangles * 3);
+	{
+		TArray<int32> WriteOffsets(TriangleListOffsets.GetData(), NumVertices);
+		for (int32 Index = 0; Index < NumTriangles * 3; ++Index)
+		{
+			TriangleLists[WriteOffsets[Indices[Index]]++] = Index / 3;
+		}
+	}
+
+	// 2 计算初始得分，这时所有顶点都不在缓存中
+	TArray<int32> CachePositions;
+	CachePositions.Init(INDEX_NONE, NumVertices);
+
+	TArray<float> VertexScores;
+	VertexScores.SetNumUninitialized(NumVertices);
+	for (int32 Vertex = 0; Vertex < NumVertices; ++Vertex)
+	{
+		VertexScores[Vertex] = CalculateVertexScore(INDEX_NONE, RemainingTriangles[Vertex]);
+	}
+
+	TArray<float> TriangleScores;
+	TriangleScores.SetNumUninitialized(NumTriangles);
+	int32 BestTriangle = 0;
+	for (int32 Triangle = 0; Triangle < NumTriangles; ++Triangle)
+	{
+		TriangleScores[Triangle] = VertexScores[Indices[Triangle * 3]] + VertexScores[Indices[Triangle * 3 + 1]] + VertexScores[Indices[Triangle * 3 + 2]];
+		if (TriangleScores[Triangle] > TriangleScores[BestTriangle])
+		{
+			BestTriangle = Triangle;
+		}
+	}
+
+	// 3 逐个输出得分最高的三角形，然后更新缓存和受影响的得分
+	TBitArray<> TriangleEmitted(false, NumTriangles);
+	TArray<uint32> OptimizedIndices;
+	OptimizedIndices.Reserve(NumTriangles * 3);
+	
+	int32 Cache[VertexCacheSize + 3];
+	int32 NumCached = 0;
+	int32 NextUnemittedTriangle = 0;
+	
+	for (int32 NumEmitted = 0; NumEmitted < NumTriangles; ++NumEmitted)
+	{
+		// 缓存中的顶点没有剩余的三角形时，按原来的顺序取下一个还没有输出的三角形
+		if (BestTriangle == INDEX_NONE)
+		{
+			while (TriangleEmitted[NextUnemittedTriangle])
+			{
+				++NextUnemittedTriangle;
+			}
+			BestTriangle = NextUnemittedTriangle;
+		}
+
+		const uint32 TriangleVertices[3] = { Indices[BestTriangle * 3], Indices[BestTriangle * 3 + 1], Indices[BestTriangle * 3 + 2] };
+		TriangleEmitted[BestTriangle] = true;
+		OptimizedIndices.Append(TriangleVertices, 3);
+
+		// 从三个顶点的列表中移除这个三角形，和列表中最后一个未输出的三角形交换
+		for (const uint32 Vertex : TriangleVertices)
+		{
+			int32* TriangleList = TriangleLists.GetData() + TriangleListOffsets[Vertex];
+			const int32 LastIndex = --RemainingTriangles[Vertex];
+			for (int32 ListIndex = 0; ListIndex <= LastIndex; ++ListIndex)
+			{
+				if (TriangleList[ListIndex] == BestTriangle)
+				{
+					Swap(TriangleList[ListIndex], TriangleList[LastIndex]);
+					break;
+				}
+			}
+		}
+
+		// 刚用过的顶点移到缓存最前面，超出缓存大小的顶点被挤出
+		int32 NewCache[VertexCacheSize + 3];
+		int32 NumNewCached = 0;
+		for (const uint32 Vertex : TriangleVertices)
+		{
+			if (NumNewCached == 0 || (NewCache[0] != static_cast<int32>(Vertex) && (NumNewCached < 2 || NewCache[1] != static_cast<int32>(Vertex))))
+			{
+				NewCache[NumNewCached++] = Vertex;
+			}
+		}
+		const int32 NumTriangleVertices = NumNewCached;
+		for (int32 CacheIndex = 0; CacheIndex < NumCached; ++CacheIndex)
+		{
+			const int32 Vertex = Cache[CacheIndex];
+			bool bInTriangle = false;
+			for (int32 Corner = 0; Corner < NumTriangleVertices; ++Corner)
+			{
+				bInTriangle |= NewCache[Corner] == Vertex;
+			}
+			if (!bInTriangle)
+			{
+				NewCache[NumNewCached++] = Vertex;
+			}
+		}
+
+		// 更新缓存中和被挤出的顶点的得分，以及它们剩余三角形的得分
+		for (int32 CacheIndex = 0; CacheIndex < NumNewCached; ++CacheIndex)
+		{
+			const int32 Vertex = NewCache[CacheIndex];
+			CachePositions[Vertex] = CacheIndex < VertexCacheSize ? CacheIndex : INDEX_NONE;
+
+			const float NewScore = CalculateVertexScore(CachePositions[Vertex], RemainingTriangles[Vertex]);
+			const float DeltaScore = NewScore - VertexScores[Vertex];
+			VertexScores[Vertex] = NewScore;
+
+			const int32* TriangleList = TriangleLists.GetData() + TriangleListOffsets[Vertex];
+			for (int32 ListIndex = 0; ListIndex < RemainingTriangles[Vertex]; ++ListIndex)
+			{
+				TriangleScores[TriangleList[ListIndex]] += DeltaScore;
+			}
+		}
+
+		NumCached = FMath::Min(NumNewCached, VertexCacheSize);
+		FMemory::Memcpy(Cache, NewCache, NumCached * sizeof(int32));
+
+		// 下一个三角形只从缓存中顶点的剩余三角形里选
+		BestTriangle = INDEX_NONE;
+		float BestScore = -MAX_flt;
+		for (int32 CacheIndex = 0; CacheIndex < NumCached; ++CacheIndex)
+		{
+			const int32 Vertex = Cache[CacheIndex];
+			const int32* TriangleList = TriangleLists.GetData() + TriangleListOffsets[Vertex];
+			for (int32 ListIndex = 0; ListIndex < RemainingTriangles[Vertex]; ++ListIndex)
+			{
+				const int32 Triangle = TriangleList[ListIndex];
+				if (TriangleScores[Triangle] > BestScore)
+				{
+					BestScore = TriangleScores[Triangle];
+					BestTriangle = Triangle;
+				}
+			}
+		}
+	}
+
+	// 不足一个三角形的多余索引保持在末尾
+	for (int32 Index = NumTriangles * 3; Index < Indices.Num(); ++Index)
+	{
+		OptimizedIndices.Add(Indices[Index]);
+	}
+	
+	Indices = MoveTemp(OptimizedIndices);
+}
+
+void FMeshOptimizer::OptimizeVertexFetch(TArray<FRenderObjectVertex>& Vertices, TArray<uint32>& Indices)
+{
+	TArray<int32> VertexRemap;
+	VertexRemap.Init(INDEX_NONE, Vertices.Num());
+
+	TArray<FRenderObjectVertex> OptimizedVertices;
+	OptimizedVertices.Reserve(Vertices.Num());
+	
+	for (uint32& Index : Indices)
+	{
+		int32& NewIndex = VertexRemap[Index];
+		if (NewIndex == INDEX_NONE)
+		{
+			NewIndex = OptimizedVertices.Add(Vertices[Index]);
+		}
+		Index = NewIndex;
+	}
+
+	Vertices = MoveTemp(OptimizedVertices);
+}
+
+float FMeshOptimizer::CalculateACMR(TArrayView<const uint32> Indices, int32 NumVertices, int32 CacheSize)
+{
+	const int32 NumTriangles = Indices.Num() / 3;
+	if (NumTriangles == 0 || NumVertices <= 0 || CacheSize <= 0)
+		return 0.0f;
+
+	// 每个顶点记录进入缓存时的时间戳，时间戳和当前时间相差超过缓存大小说明已经被挤出
+	TArray<int32> CacheTimestamps;
+	CacheTimestamps.Init(-CacheSize - 1, NumVertices);
+	
+	int32 NumMisses = 0;
+	for (int32 Index = 0; Index < NumTriangles * 3; ++Index)
+	{
+		int32& Timestamp = CacheTimestamps[Indices[Index]];
+		if (NumMisses - Timestamp > CacheSize)
+		{
+			Timestamp = NumMisses++;
+		}
+	}
+
+	return static_cast<float>(NumMisses) / NumTriangles;
+}
+
+void FMeshOptimizer::WeldVertices(TArrayView<const FRenderObjectVertex> Vertices, TArray<uint32>& Indices)
+{
+	// 每个位置第一次出现的顶点作为合并后的顶点
+	TMap<FVector, uint32> FirstVertices;
+	FirstVertices.Reserve(Vertices.Num());
+	
+	TArray<uint32> VertexRemap;
+	VertexRemap.SetNumUninitialized(Vertices.Num());
+	for (int32 Vertex = 0, Count = Vertices.Num(); Vertex < Count; ++Vertex)
+	{
+		const FVector& Position = Vertices[Vertex].Position;
+		if (const uint32* FirstVertex = FirstVertices.Find(Position))
+		{
+			VertexRemap[Vertex] = *FirstVertex;
+		}
+		else
+		{
+			VertexRemap[Vertex] = FirstVertices.Add(Position, static_cast<uint32>(Vertex));
+		}
+	}
+
+	for (uint32& Index : Indices)
+	{
+		Index = VertexRemap[Index];
+	}
+}
+
+TArray<uint32> FMeshOptimizer::SimplifyMesh(TArrayView<const FRenderObjectVertex> Vertices, TArrayView<const uint32> Indices, int32 TargetNumTriangles, const FThreadSafeBool* bCancelled)
+{
+	using namespace MeshOptimizer;
+
+	const int32 NumVertices = Vertices.Num();
+	const int32 NumTriangles = Indices.Num() / 3;
+
+	TArray<uint32> Triangles(Indices.GetData(), NumTriangles * 3);
+	if (NumTriangles <= TargetNumTriangles || NumVertices == 0)
+		return Triangles;
+
+	const auto GetPosition = [&Vertices](uint32 Vertex) -> const FVector& { return Vertices[Vertex].Position; };
+
+	// 1 建立每个顶点相邻的三角形列表，有重复顶点的退化三角形直接删除
+	TBitArray<> TriangleRemoved(false, NumTriangles);
+	TArray<TArray<int32>> VertexTriangles;
+	VertexTriangles.SetNum(NumVertices);
+	
+	int32 NumRemainingTriangles = 0;
+	for (int32 Triangle = 0; Triangle < NumTriangles; ++Triangle)
+	{
+		const uint32* Corners = &Triangles[Triangle * 3];
+		if (Corners[0] == Corners[1] || Corners[1] == Corners[2] || Corners[2] == Corners[0])
+		{
+			TriangleRemoved[Triangle] = true;
+			continue;
+		}
+
+		for (int32 Corner = 0; Corner < 3; ++Corner)
+		{
+			VertexTriangles[Corners[Corner]].Add(Triangle);
+		}
+		++NumRemainingTriangles;
+	}
+
+	// 2 每个顶点的误差是相邻三角形所在平面的误差之和，按面积加权，大三角形的形状更重要
+	TArray<FQuadric> Quadrics;
+	Quadrics.SetNum(NumVertices);
+	
+	TMap<uint64, int32> EdgeTriangleCounts;
+	for (int32 Triangle = 0; Triangle < NumTriangles; ++Triangle)
+	{
+		if (TriangleRemoved[Triangle])
+			continue;
+
+		const uint32* Corners = &Triangles[Triangle * 3];
+		const FVector Cross = (GetPosition(Corners[1]) - GetPosition(Corners[0])) ^ (GetPosition(Corners[2]) - GetPosition(Corners[0]));
+		const float DoubleArea = Cross.Size();
+		for (int32 Corner = 0; Corner < 3; ++Corner)
+		{
+			++EdgeTriangleCounts.FindOrAdd(MakeEdgeKey(Corners[Corner], Corners[(Corner + 1) % 3]));
+		}
+		
+		if (DoubleArea <= SMALL_NUMBER)
+			continue;
+		
+		const FVector Normal = Cross / DoubleArea;
+		FQuadric PlaneQuadric;
+		PlaneQuadric.AddPlane(Normal, -(Normal | GetPosition(Corners[0])), DoubleArea * 0.5);
+		for (int32 Corner = 0; Corner < 3; ++Corner)
+		{
+			Quadrics[Corners[Corner]] += PlaneQuadric;
+		}
+	}
+
+	// 3 只属于一个三角形的边界边，加上经过这条边并垂直于三角形的平面，坍缩时边界不会向内收缩
+	for (int32 Triangle = 0; Triangle < NumTriangles; ++Triangle)
+	{
+		if (TriangleRemoved[Triangle])
+			continue;
+
+		const uint32* Corners = &Triangles[Triangle * 3];
+		const FVector TriangleNormal = ((GetPosition(Corners[1]) - GetPosition(Corners[0])) ^ (GetPosition(Corners[2]) - GetPosition(Corners[0]))).GetSafeNormal();
+		for (int32 Corner = 0; Corner < 3; ++Corner)
+		{
+			const uint32 Vertex0 = Corners[Corner];
+			const uint32 Vertex1 = Corners[(Corner + 1) % 3];
+			if (EdgeTriangleCounts.FindChecked(MakeEdgeKey(Vertex0, Vertex1)) != 1)
+				continue;
+
+			const FVector Edge = GetPosition(Vertex1) - GetPosition(Vertex0);
+			const FVector BoundaryNormal = (Edge ^ TriangleNormal).GetSafeNormal();
+			if (BoundaryNormal.IsZero())
+				continue;
+
+			FQuadric BoundaryQuadric;
+			BoundaryQuadric.AddPlane(BoundaryNormal, -(BoundaryNormal | GetPosition(Vertex0)), BoundaryWeight * Edge.SizeSquared());
+			Quadrics[Vertex0] += BoundaryQuadric;
+			Quadrics[Vertex1] += BoundaryQuadric;
+		}
+	}
+
+	// 4 所有边作为候选加入最小堆，每条边选择误差较小的坍缩方向
+	TArray<uint32> VertexVersions;
+	VertexVersions.SetNumZeroed(NumVertices);
+	
+	TArray<FEdgeCollapse> CollapseHeap;
+	CollapseHeap.Reserve(EdgeTriangleCounts.Num());
+	
+	const auto PushEdge = [&](uint32 Vertex0, uint32 Vertex1)
+	{
+		FQuadric EdgeQuadric = Quadrics[Vertex0];
+		EdgeQuadric += Quadrics[Vertex1];
+		const double Error0 = EdgeQuadric.Evaluate(GetPosition(Vertex0));
+		const double Error1 = EdgeQuadric.Evaluate(GetPosition(Vertex1));
+		
+		const uint32 From = Error1 <= Error0 ? Vertex0 : Vertex1;
+		const uint32 To = Error1 <= Error0 ? Vertex1 : Vertex0;
+		CollapseHeap.HeapPush(FEdgeCollapse{ FMath::Min(Error0, Error1), From, To, VertexVersions[From], VertexVersions[To] });
+	};
+	
+	for (const TPair<uint64, int32>& Edge : EdgeTriangleCounts)
+	{
+		PushEdge(static_cast<uint32>(Edge.Key >> 32), static_cast<uint32>(Edge.Key & MAX_uint32));
+	}
+	EdgeTriangleCounts.Empty();
+
+	// 5 反复坍缩误差最小的边，直到三角形个数达到目标或者没有可以坍缩的边
+	//    取消标记每处理一批候选检查一次，大模型简化一级需要几秒，取消后不必等到这一级完成
+	constexpr int32 CancelCheckInterval = 1024;
+	int32 NumPoppedCollapses = 0;
+	
+	TArray<uint32> Neighbors;
+	while (NumRemainingTriangles > TargetNumTriangles && CollapseHeap.Num() > 0)
+	{
+		if (bCancelled && ++NumPoppedCollapses % CancelCheckInterval == 0 && *bCancelled)
+			break;
+		
+		FEdgeCollapse Collapse;
+		CollapseHeap.HeapPop(Collapse, false);
+		if (VertexVersions[Collapse.From] != Collapse.FromVersion || VertexVersions[Collapse.To] != Collapse.ToVersion)
+			continue;
+
+		const uint32 From = Collapse.From;
+		const uint32 To = Collapse.To;
+		
+		// From移动到To之后，不包含To的相邻三角形法线反向说明三角形翻转了，跳过这次坍缩
+		bool bFlipped = false;
+		for (const int32 Triangle : VertexTriangles[From])
+		{
+			const uint32* Corners = &Triangles[Triangle * 3];
+			if (Corners[0] == To || Corners[1] == To || Corners[2] == To)
+				continue;
+
+			FVector Positions[3] = { GetPosition(Corners[0]), GetPosition(Corners[1]), GetPosition(Corners[2]) };
+			const FVector OldNormal = (Positions[1] - Positions[0]) ^ (Positions[2] - Positions[0]);
+			for (int32 Corner = 0; Corner < 3; ++Corner)
+			{
+				if (Corners[Corner] == From)
+				{
+					Positions[Corner] = GetPosition(To);
+				}
+			}
+			const FVector NewNormal = (Positions[1] - Positions[0]) ^ (Positions[2] - Positions[0]);
+			if ((OldNormal | NewNormal) <= 0.0f)
+			{
+				bFlipped = true;
+				break;
+			}
+		}
+		
+		if (bFlipped)
+			continue;
+
+		// 同时包含From和To的三角形退化后删除，其余三角形的From替换为To
+		for (const int32 Triangle : VertexTriangles[From])
+		{
+			uint32* Corners = &Triangles[Triangle * 3];
+			if (Corners[0] == To || Corners[1] == To || Corners[2] == To)
+			{
+				TriangleRemoved[Triangle] = true;
+				--NumRemainingTriangles;
+				for (int32 Corner = 0; Corner < 3; ++Corner)
+				{
+					if (Corners[Corner] != From)
+					{
+						VertexTriangles[Corners[Corner]].RemoveSingleSwap(Triangle, false);
+					}
+				}
+			}
+			else
+			{
+				for (int32 Corner = 0; Corner < 3; ++Corner)
+				{
+					if (Corners[Corner] == From)
+					{
+						Corners[Corner] = To;
+					}
+				}
+				VertexTriangles[To].Add(Triangle);
+			}
+		}
+		VertexTriangles[From].Empty();
+
+		Quadrics[To] += Quadrics[From];
+		++VertexVersions[From];
+		++VertexVersions[To];
+
+		// To的误差变了，和它相连的边重新计算误差后入队，旧的候选因为版本号不同在出队时丢弃
+		Neighbors.Reset();
+		for (const int32 Triangle : VertexTriangles[To])
+		{
+			for (int32 Corner = 0; Corner < 3; ++Corner)
+			{
+				const uint32 Neighbor = Triangles[Triangle * 3 + Corner];
+				if (Neighbor != To)
+				{
+					Neighbors.AddUnique(Neighbor);
+				}
+			}
+		}
+		for (const uint32 Neighbor : Neighbors)
+		{
+			PushEdge(To, Neighbor);
+		}
+	}
+
+	// 6 输出剩余的三角形，保持原来的顺序和绕序
+	TArray<uint32> SimplifiedIndices;
+	SimplifiedIndices.Reserve(NumRemainingTriangles * 3);
+	for (int32 Triangle = 0; Triangle < NumTriangles; ++Triangle)
+	{
+		if (!TriangleRemoved[Triangle])
+		{
+			SimplifiedIndices.Append(&Triangles[Triangle * 3], 3);
+		}
+	}
+	
+	return SimplifiedIndices;
+}
+
+TArray<int32> FMeshOptimizer::BuildClusters(TArray<uint32>& Indices, int32 NumVertices, int32 MaxTriangles)
+{
+	const int32 NumTriangles = Indices.Num() / 3;
+	TArray<int32> NumClusterTriangles;
+	if (NumTriangles == 0 || NumVertices <= 0 || MaxTriangles <= 0)
+		return NumClusterTriangles;
+
+	// 1 建立每个顶点使用的三角形列表，所有列表连续存储
+	TArray<int32> TriangleListOffsets;
+	TriangleListOffsets.SetNumZeroed(NumVertices + 1);
+	for (int32 Index = 0; Index < NumTriangles * 3; ++Index)
+	{
+		++TriangleListOffsets[Indices[Index] + 1];
+	}
+	for (int32 Vertex = 0; Vertex < NumVertices; ++Vertex)
+	{
+		TriangleListOffsets[Vertex + 1] += TriangleListOffsets[Vertex];
+	}
+
+	TArray<int32> TriangleLists;
+	TriangleLists.SetNumUninitialized(NumTriangles * 3);
+	{
+		TArray<int32> WriteOffsets(TriangleListOffsets.GetData(), NumVertices);
+		for (int32 Index = 0; Index < NumTriangles * 3; ++Index)
+		{
+			TriangleLists[WriteOffsets[Indices[Index]]++] = Index / 3;
+		}
+	}
+
+	// 2 逐个生成簇，每个簇从种子三角形开始广度优先扩展，直到三角形个数达到上限或者没有相邻的三角形
+	//    扩展时加入队列但没有放进簇的三角形就是这个簇的边缘，下一个簇从这里开始，和这个簇紧挨着
+	TBitArray<> TriangleAssigned(false, NumTriangles);
+	TArray<int32> QueuedCluster;
+	QueuedCluster.Init(INDEX_NONE, NumTriangles);
+
+	TArray<uint32> ClusteredIndices;
+	ClusteredIndices.Reserve(Indices.Num());
+
+	TArray<int32> Queue;
+	TArray<int32> ClusterTriangles;
+	int32 NextUnassignedTriangle = 0;
+	int32 NumAssigned = 0;
+	
+	while (NumAssigned < NumTriangles)
+	{
+		// 优先使用上一个簇边缘还没有分配的三角形作为种子，没有时按原来的顺序取下一个
+		int32 SeedTriangle = INDEX_NONE;
+		for (const int32 Triangle : Queue)
+		{
+			if (!TriangleAssigned[Triangle])
+			{
+				SeedTriangle = Triangle;
+				break;
+			}
+		}
+		if (SeedTriangle == INDEX_NONE)
+		{
+			while (TriangleAssigned[NextUnassignedTriangle])
+			{
+				++NextUnassignedTriangle;
+			}
+			SeedTriangle = NextUnassignedTriangle;
+		}
+
+		const int32 ClusterIndex = NumClusterTriangles.Num();
+		Queue.Reset();
+		Queue.Add(SeedTriangle);
+		QueuedCluster[SeedTriangle] = ClusterIndex;
+		ClusterTriangles.Reset();
+		
+		for (int32 QueueIndex = 0; QueueIndex < Queue.Num() && ClusterTriangles.Num() < MaxTriangles; ++QueueIndex)
+		{
+			const int32 Triangle = Queue[QueueIndex];
+			TriangleAssigned[Triangle] = true;
+			ClusterTriangles.Add(Triangle);
+
+			for (int32 Corner = 0; Corner < 3; ++Corner)
+			{
+				const uint32 Vertex = Indices[Triangle * 3 + Corner];
+				for (int32 ListIndex = TriangleListOffsets[Vertex]; ListIndex < TriangleListOffsets[Vertex + 1]; ++ListIndex)
+				{
+					const int32 Neighbor = TriangleLists[ListIndex];
+					if (!TriangleAssigned[Neighbor] && QueuedCluster[Neighbor] != ClusterIndex)
+					{
+						QueuedCluster[Neighbor] = ClusterIndex;
+						Queue.Add(Neighbor);
+					}
+				}
+			}
+		}
+
+		// 簇内按原来的顺序输出，保留OptimizeVertexCache的结果
+		ClusterTriangles.Sort();
+		for (const int32 Triangle : ClusterTriangles)
+		{
+			ClusteredIndices.Append(&Indices[Triangle * 3], 3);
+		}
+		
+		NumAssigned += ClusterTriangles.Num();
+		NumClusterTriangles.Add(ClusterTriangles.Num());
+	}
+
+	// 不足一个三角形的多余索引保持在末尾
+	for (int32 Index = NumTriangles * 3; Index < Indices.Num(); ++Index)
+	{
+		ClusteredIndices.Add(Indices[Index]);
+	}
+	
+	Indices = MoveTemp(ClusteredIndices);
+	return NumClusterTriangles;
+}
+
+TArray<FRenderObjectCluster> FMeshOptimizer::ComputeClusterBounds(TArrayView<const FRenderObjectVertex> Vertices, TArrayView<const uint32> Indices, TArrayView<const int32> NumClusterTriangles)
+{
+	TArray<FRenderObjectCluster> Clusters;
+	Clusters.Reserve(NumClusterTriangles.Num());
+
+	int32 FirstIndex = 0;
+	for (const int32 NumTriangles : NumClusterTriangles)
+	{
+		FRenderObjectCluster& Cluster = Clusters.AddDefaulted_GetRef();
+		Cluster.FirstIndex = FirstIndex;
+		Cluster.NumIndices = NumTriangles * 3;
+		const TArrayView<const uint32> ClusterIndices = Indices.Slice(FirstIndex, Cluster.NumIndices);
+		FirstIndex += Cluster.NumIndices;
+
+		// 1 顶点范围和包围盒
+		uint32 MinVertex = MAX_uint32;
+		uint32 MaxVertex = 0;
+		FBox Bounds(ForceInit);
+		for (const uint32 Vertex : ClusterIndices)
+		{
+			MinVertex = FMath::Min(MinVertex, Vertex);
+			MaxVertex = FMath::Max(MaxVertex, Vertex);
+			Bounds += Vertices[Vertex].Position;
+		}
+		if (Cluster.NumIndices == 0)
+			continue;
+		
+		Cluster.FirstVertex = static_cast<int32>(MinVertex);
+		Cluster.NumVertices = static_cast<int32>(MaxVertex - MinVertex) + 1;
+
+		// 2 包围球以包围盒中心为球心，半径取到最远顶点的距离
+		Cluster.Center = Bounds.GetCenter();
+		float MaxDistanceSquared = 0.0f;
+		for (const uint32 Vertex : ClusterIndices)
+		{
+			MaxDistanceSquared = FMath::Max(MaxDistanceSquared, FVector::DistSquared(Cluster.Center, Vertices[Vertex].Position));
+		}
+		Cluster.Radius = FMath::Sqrt(MaxDistanceSquared);
+
+		// 3 法线锥的轴取三角形单位法线的平均方向，法线和渲染器判断正反面时使用的绕序一致
+		TArray<FVector, TInlineAllocator<128>> Normals;
+		FVector AxisSum = FVector::ZeroVector;
+		for (int32 Index = 0; Index + 2 < ClusterIndices.Num(); Index += 3)
+		{
+			const FVector& P0 = Vertices[ClusterIndices[Index]].Position;
+			const FVector& P1 = Vertices[ClusterIndices[Index + 1]].Position;
+			const FVector& P2 = Vertices[ClusterIndices[Index + 2]].Position;
+			
+			// 退化的三角形不会被画出来，不影响法线锥
+			const FVector Normal = ((P1 - P0) ^ (P2 - P0)).GetSafeNormal();
+			if (!Normal.IsZero())
+			{
+				Normals.Add(Normal);
+				AxisSum += Normal;
+			}
+		}
+
+		// 4 张角由和轴夹角最大的法线决定，夹角达到90度时保持默认值，簇不会被背面剔除
+		const FVector Axis = AxisSum.GetSafeNormal();
+		if (Axis.IsZero())
+			continue;
+		
+		float MinCosAngle = 1.0f;
+		for (const FVector& Normal : Normals)
+		{
+			MinCosAngle = FMath::Min(MinCosAngle, FVector::DotProduct(Normal, Axis));
+		}
+		if (MinCosAngle > KINDA_SMALL_NUMBER)
+		{
+			Cluster.ConeAxis = Axis;
+			Cluster.ConeCutoff = FMath::Sqrt(FMath::Max(0.0f, 1.0f - MinCosAngle * MinCosAngle));
+		}
+	}
+
+	return Clusters;
+}
+
+/////////////////////////////////////////////////////
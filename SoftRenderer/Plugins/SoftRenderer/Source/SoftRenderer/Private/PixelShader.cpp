@@ -0,0 +1,18 @@
+﻿#include "PixelShader.h"
+
+/////////////////////////////////////////////////////
+// UPixelShader
+
+UPixelShader::UPixelShader(const FObjectInitializer& ObjectInitializer)
+	: Super(ObjectInitializer)
+{
+	Color = FLinearColor::White;
+}
+
+FLinearColor UPixelShader::RunPixelShader(const FPixelShaderInput& Input) const
+{
+	// 默认输出固定的颜色
+	return Color;
+}
+
+/////////////////////////////////////////////////////
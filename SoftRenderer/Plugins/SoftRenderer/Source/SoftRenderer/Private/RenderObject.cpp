@@ -1,4 +1,75 @@
 ﻿#include "RenderObject.h"
+#include "SoftRendererModule.h"
+
+/////////////////////////////////////////////////////
+// RenderObjectMeshData
+
+namespace RenderObjectMeshData
+{
+	/** 二进制网格数据的标识 'SRMD' 和格式版本，版本2增加了LOD0的簇，版本1的数据可以直接读取 */
+	constexpr uint32 Magic = 0x444D5253;
+	constexpr uint32 Version = 2;
+
+	/** 每段数据的对齐字节数，读入后可以直接按SIMD宽度访问 */
+	constexpr uint64 StreamAlignment = 16;
+
+	/** 文件头 */
+	struct FHeader
+	{
+		uint32 Magic;
+		uint32 Version;
+		uint32 NumLODs;
+		uint32 NumClusters;
+	};
+
+	/** 一级模型的描述，偏移都从二进制数据的开头算起 */
+	struct FLODHeader
+	{
+		uint32 NumVertices;
+		uint32 NumIndices;
+		uint32 IndexSize;
+		float ScreenSize;
+		uint64 PositionOffset;
+		uint64 IndexOffset;
+	};
+
+	static_assert(sizeof(FRenderObjectVertex) == sizeof(FVector), "Vertices are copied to and from the position stream as a whole.");
+	static_assert(sizeof(FHeader) == 16 && sizeof(FLODHeader) == 32, "The mesh data layout must not depend on the compiler.");
+	static_assert(sizeof(FRenderObjectCluster) == 48, "Clusters are copied to and from the cluster stream as a whole.");
+
+	/** 簇流紧跟在模型描述后面，版本1的数据没有簇，偏移的计算方式相同 */
+	static FORCEINLINE uint64 GetClusterOffset(uint32 NumLODs)
+	{
+		return Align(sizeof(FHeader) + sizeof(FLODHeader) * NumLODs, StreamAlignment);
+	}
+
+	/** 保存资源时从属性中暂时移走的数组，二进制网格数据中已经有一份 */
+	struct FMeshArrays
+	{
+		TArray<FRenderObjectVertex> Vertices;
+		TArray<int32> Indices;
+		TArray<uint16> CompactIndices;
+		TArray<FRenderObjectCluster> Clusters;
+		TArray<FRenderObjectLOD> LODs;
+	};
+
+	/** 交换渲染对象和Arrays中的所有数组，LODs只交换每一级的顶点和索引，级数和ScreenSize留在渲染对象中 */
+	static void SwapMeshArrays(URenderObject& RenderObject, FMeshArrays& Arrays)
+	{
+		Swap(RenderObject.Vertices, Arrays.Vertices);
+		Swap(RenderObject.Indices, Arrays.Indices);
+		Swap(RenderObject.CompactIndices, Arrays.CompactIndices);
+		Swap(RenderObject.Clusters, Arrays.Clusters);
+
+		Arrays.LODs.SetNum(RenderObject.LODs.Num());
+		for (int32 LODIndex = 0; LODIndex < RenderObject.LODs.Num(); ++LODIndex)
+		{
+			Swap(RenderObject.LODs[LODIndex].Vertices, Arrays.LODs[LODIndex].Vertices);
+			Swap(RenderObject.LODs[LODIndex].Indices, Arrays.LODs[LODIndex].Indices);
+			Swap(RenderObject.LODs[LODIndex].CompactIndices, Arrays.LODs[LODIndex].CompactIndices);
+		}
+	}
+}
 
 /////////////////////////////////////////////////////
 // URenderObject
@@ -9,12 +80,463 @@ URenderObject::URenderObject(const FObjectInitializer& ObjectInitializer)
 	WorldLocation = FVector::ZeroVector;
 	WorldRotation = FRotator::ZeroRotator;
 	WorldScale = FVector::OneVector;
+
+	LocalBounds = FBox(ForceInit);
+	LocalBoundingSphere = FSphere(ForceInit);
+	bLocalBoundsDirty = true;
+	RenderStateVersion = 0;
+
+	CachedLocalToWorld = FMatrix::Identity;
+	CachedWorldLocation = FVector::ZeroVector;
+	CachedWorldRotation = FRotator::ZeroRotator;
+	CachedWorldScale = FVector::OneVector;
+	TransformVersion = 0;
+
+	bMeshDataInBulk = false;
+	bMeshDataLoaded = false;
+}
+
+void URenderObject::Serialize(FArchive& Ar)
+{
+	using namespace RenderObjectMeshData;
+
+	// 已经读取的网格数据在二进制网格数据中有一份，保存资源时属性中的数组不再保存
+	//    撤销和复制等非持久化的序列化仍然保存数组
+	const bool bSkipMeshArrays = bMeshDataInBulk && Ar.IsSaving() && Ar.IsPersistent();
+	FMeshArrays SkippedArrays;
+	if (bSkipMeshArrays)
+	{
+		SwapMeshArrays(*this, SkippedArrays);
+	}
+	
+	Super::Serialize(Ar);
+
+	if (bSkipMeshArrays)
+	{
+		SwapMeshArrays(*this, SkippedArrays);
+	}
+
+	// 属性先序列化，加载时已经知道后面有没有二进制网格数据，没有烘焙过的旧资源不受影响
+	if (bMeshDataInBulk)
+	{
+		MeshBulkData.Serialize(Ar, this);
+	}
+}
+
+void URenderObject::BakeMeshData()
+{
+	WriteMeshBulkData();
+
+	// 清空属性中的数组，资源中只保留一份二进制数据
+	Vertices.Empty();
+	Indices.Empty();
+	CompactIndices.Empty();
+	Clusters.Empty();
+	for (FRenderObjectLOD& LOD : LODs)
+	{
+		LOD.Vertices.Empty();
+		LOD.Indices.Empty();
+		LOD.CompactIndices.Empty();
+	}
+	
+	bMeshDataInBulk = true;
+	bMeshDataLoaded = false;
+	MarkBoundsDirty();
+}
+
+void URenderObject::WriteMeshBulkData()
+{
+	using namespace RenderObjectMeshData;
+
+	// 1 计算簇流以及每一级模型的位置流和索引流在二进制数据中的偏移
+	const int32 NumLODs = GetNumLODs();
+	TArray<FLODHeader> LODHeaders;
+	LODHeaders.SetNumZeroed(NumLODs);
+
+	const TArrayView<const FRenderObjectCluster> LODClusters = GetLODClusters();
+	const uint64 ClusterOffset = GetClusterOffset(NumLODs);
+	uint64 DataSize = Align(ClusterOffset + static_cast<uint64>(LODClusters.Num()) * sizeof(FRenderObjectCluster), StreamAlignment);
+	for (int32 LODIndex = 0; LODIndex < NumLODs; ++LODIndex)
+	{
+		FLODHeader& LODHeader = LODHeaders[LODIndex];
+		LODHeader.NumVertices = GetLODVertices(LODIndex).Num();
+		LODHeader.NumIndices = GetNumIndices(LODIndex);
+		LODHeader.IndexSize = UsesCompactIndices(LODIndex) ? sizeof(uint16) : sizeof(int32);
+		LODHeader.ScreenSize = LODIndex == 0 ? 0.0f : LODs[LODIndex - 1].ScreenSize;
+		LODHeader.PositionOffset = DataSize;
+		DataSize = Align(DataSize + static_cast<uint64>(LODHeader.NumVertices) * sizeof(FVector), StreamAlignment);
+		LODHeader.IndexOffset = DataSize;
+		DataSize = Align(DataSize + static_cast<uint64>(LODHeader.NumIndices) * LODHeader.IndexSize, StreamAlignment);
+	}
+
+	// 2 写入文件头、模型描述和数据流，对齐产生的空隙填0
+	MeshBulkData.Lock(LOCK_READ_WRITE);
+	uint8* Data = static_cast<uint8*>(MeshBulkData.Realloc(DataSize));
+	FMemory::Memzero(Data, DataSize);
+
+	const FHeader Header = { Magic, Version, static_cast<uint32>(NumLODs), static_cast<uint32>(LODClusters.Num()) };
+	FMemory::Memcpy(Data, &Header, sizeof(FHeader));
+	FMemory::Memcpy(Data + sizeof(FHeader), LODHeaders.GetData(), sizeof(FLODHeader) * NumLODs);
+	FMemory::Memcpy(Data + ClusterOffset, LODClusters.GetData(), sizeof(FRenderObjectCluster) * LODClusters.Num());
+	
+	for (int32 LODIndex = 0; LODIndex < NumLODs; ++LODIndex)
+	{
+		const FLODHeader& LODHeader = LODHeaders[LODIndex];
+		FMemory::Memcpy(Data + LODHeader.PositionOffset, GetLODVertices(LODIndex).GetData(), LODHeader.NumVertices * sizeof(FVector));
+		FMemory::Memcpy(Data + LODHeader.IndexOffset, GetIndexData(LODIndex), LODHeader.NumIndices * LODHeader.IndexSize);
+	}
+	MeshBulkData.Unlock();
+
+	// 数据放在资源的末尾，加载资源时跳过，第一次读取时才加载
+	MeshBulkData.SetBulkDataFlags(BULKDATA_Force_NOT_InlinePayload);
+}
+
+void URenderObject::ConditionalLoadMeshData()
+{
+	if (!bMeshDataInBulk || bMeshDataLoaded)
+		return;
+
+	// 读取失败也只尝试一次，避免每帧重复读取
+	bMeshDataLoaded = true;
+	
+	for (const URenderObject* Source = this; Source != nullptr; Source = Cast<URenderObject>(Source->GetArchetype()))
+	{
+		const int64 DataSize = Source->MeshBulkData.GetBulkDataSize();
+		if (DataSize == 0)
+			continue;
+
+		const uint8* Data = static_cast<const uint8*>(Source->MeshBulkData.LockReadOnly());
+		const bool bLoaded = LoadMeshData(Data, DataSize);
+		Source->MeshBulkData.Unlock();
+
+		if (!bLoaded)
+		{
+			UE_LOG(LogSoftRenderer, Warning, TEXT("Invalid mesh data in %s."), *Source->GetPathName());
+		}
+		return;
+	}
+
+	UE_LOG(LogSoftRenderer, Warning, TEXT("%s has no mesh data to load."), *GetPathName());
+}
+
+bool URenderObject::LoadMeshData(const uint8* Data, int64 DataSize)
+{
+	using namespace RenderObjectMeshData;
+
+	// 1 检查文件头和每一级模型的数据流是否都在数据范围内
+	if (Data == nullptr || DataSize < static_cast<int64>(sizeof(FHeader)))
+		return false;
+
+	FHeader Header;
+	FMemory::Memcpy(&Header, Data, sizeof(FHeader));
+	if (Header.Magic != Magic || Header.Version == 0 || Header.Version > Version || Header.NumLODs == 0
+		|| static_cast<uint64>(DataSize) < sizeof(FHeader) + static_cast<uint64>(Header.NumLODs) * sizeof(FLODHeader))
+		return false;
+
+	// 版本1的这个字段保留为0，正好表示没有簇
+	const uint64 ClusterOffset = GetClusterOffset(Header.NumLODs);
+	if (ClusterOffset + static_cast<uint64>(Header.NumClusters) * sizeof(FRenderObjectCluster) > static_cast<uint64>(DataSize))
+		return false;
+
+	TArray<FLODHeader> LODHeaders;
+	LODHeaders.SetNumUninitialized(Header.NumLODs);
+	FMemory::Memcpy(LODHeaders.GetData(), Data + sizeof(FHeader), sizeof(FLODHeader) * Header.NumLODs);
+	
+	for (const FLODHeader& LODHeader : LODHeaders)
+	{
+		if ((LODHeader.IndexSize != sizeof(uint16) && LODHeader.IndexSize != sizeof(int32))
+			|| LODHeader.PositionOffset + static_cast<uint64>(LODHeader.NumVertices) * sizeof(FVector) > static_cast<uint64>(DataSize)
+			|| LODHeader.IndexOffset + static_cast<uint64>(LODHeader.NumIndices) * LODHeader.IndexSize > static_cast<uint64>(DataSize))
+			return false;
+	}
+
+	// 簇的索引范围和顶点范围都必须在LOD0之内，渲染器不再逐个检查
+	TArray<FRenderObjectCluster> LoadedClusters;
+	LoadedClusters.SetNumUninitialized(Header.NumClusters);
+	FMemory::Memcpy(LoadedClusters.GetData(), Data + ClusterOffset, sizeof(FRenderObjectCluster) * Header.NumClusters);
+
+	for (const FRenderObjectCluster& Cluster : LoadedClusters)
+	{
+		if (Cluster.FirstIndex < 0 || Cluster.NumIndices < 0 || static_cast<uint64>(Cluster.FirstIndex) + Cluster.NumIndices > LODHeaders[0].NumIndices
+			|| Cluster.FirstVertex < 0 || Cluster.NumVertices < 0 || static_cast<uint64>(Cluster.FirstVertex) + Cluster.NumVertices > LODHeaders[0].NumVertices)
+			return false;
+	}
+
+	// 2 簇流以及每一级模型的位置流和索引流整块复制到数组中
+	Clusters = MoveTemp(LoadedClusters);
+	LODs.SetNum(Header.NumLODs - 1);
+	for (int32 LODIndex = 0, NumLODs = Header.NumLODs; LODIndex < NumLODs; ++LODIndex)
+	{
+		const FLODHeader& LODHeader = LODHeaders[LODIndex];
+		TArray<FRenderObjectVertex>& LODVertices = LODIndex == 0 ? Vertices : LODs[LODIndex - 1].Vertices;
+		TArray<int32>& LODIndices = LODIndex == 0 ? Indices : LODs[LODIndex - 1].Indices;
+		TArray<uint16>& LODCompactIndices = LODIndex == 0 ? CompactIndices : LODs[LODIndex - 1].CompactIndices;
+
+		LODVertices.SetNumUninitialized(LODHeader.NumVertices);
+		FMemory::Memcpy(LODVertices.GetData(), Data + LODHeader.PositionOffset, LODHeader.NumVertices * sizeof(FVector));
+
+		LODIndices.Reset();
+		LODCompactIndices.Reset();
+		if (LODHeader.IndexSize == sizeof(uint16))
+		{
+			LODCompactIndices.SetNumUninitialized(LODHeader.NumIndices);
+			FMemory::Memcpy(LODCompactIndices.GetData(), Data + LODHeader.IndexOffset, LODHeader.NumIndices * sizeof(uint16));
+		}
+		else
+		{
+			LODIndices.SetNumUninitialized(LODHeader.NumIndices);
+			FMemory::Memcpy(LODIndices.GetData(), Data + LODHeader.IndexOffset, LODHeader.NumIndices * sizeof(int32));
+		}
+
+		if (LODIndex > 0)
+		{
+			LODs[LODIndex - 1].ScreenSize = LODHeader.ScreenSize;
+		}
+	}
+
+	MarkBoundsDirty();
+	return true;
+}
+
+const FMatrix& URenderObject::GetLocalToWorld() const
+{
+	// 比较9个分量比从四元数重新构造矩阵便宜得多，静态的渲染对象每帧只需要比较
+	if (TransformVersion == 0 || CachedWorldLocation != WorldLocation || CachedWorldRotation != WorldRotation || CachedWorldScale != WorldScale)
+	{
+		CachedWorldLocation = WorldLocation;
+		CachedWorldRotation = WorldRotation;
+		CachedWorldScale = WorldScale;
+		CachedLocalToWorld = FTransform(WorldRotation.Quaternion(), WorldLocation, WorldScale).ToMatrixWithScale();
+		++TransformVersion;
+	}
+	
+	return CachedLocalToWorld;
+}
+
+const FBox& URenderObject::GetLocalBounds()
+{
+	if (bLocalBoundsDirty)
+	{
+		UpdateLocalBounds();
+	}
+	
+	return LocalBounds;
+}
+
+const FSphere& URenderObject::GetLocalBoundingSphere()
+{
+	if (bLocalBoundsDirty)
+	{
+		UpdateLocalBounds();
+	}
+
+	return LocalBoundingSphere;
+}
+
+void URenderObject::SetIndices(TArrayView<const uint32> InIndices, int32 LODIndex)
+{
+	check(LODIndex >= 0 && LODIndex < GetNumLODs());
+	
+	TArray<int32>& LODIndices = LODIndex == 0 ? Indices : LODs[LODIndex - 1].Indices;
+	TArray<uint16>& LODCompactIndices = LODIndex == 0 ? CompactIndices : LODs[LODIndex - 1].CompactIndices;
+	LODIndices.Reset();
+	LODCompactIndices.Reset();
+	
+	if (GetLODVertices(LODIndex).Num() <= MAX_uint16 + 1)
+	{
+		LODCompactIndices.SetNumUninitialized(InIndices.Num());
+		for (int32 Index = 0, Count = InIndices.Num(); Index < Count; ++Index)
+		{
+			LODCompactIndices[Index] = static_cast<uint16>(InIndices[Index]);
+		}
+	}
+	else
+	{
+		LODIndices.SetNumUninitialized(InIndices.Num());
+		for (int32 Index = 0, Count = InIndices.Num(); Index < Count; ++Index)
+		{
+			LODIndices[Index] = static_cast<int32>(InIndices[Index]);
+		}
+	}
+
+	if (LODIndex == 0)
+	{
+		Clusters.Reset();
+	}
+
+	MarkRenderStateDirty();
+}
+
+TArrayView<const FRenderObjectCluster> URenderObject::GetLODClusters(int32 LODIndex) const
+{
+	// 簇按索引顺序排列并且覆盖全部索引，最后一个簇的结尾和索引个数对不上说明索引被修改过
+	if (LODIndex != 0 || Clusters.Num() == 0 || Clusters.Last().FirstIndex + Clusters.Last().NumIndices != GetNumIndices(0))
+		return TArrayView<const FRenderObjectCluster>();
+
+	return Clusters;
+}
+
+int32 URenderObject::SelectLOD(float ScreenSize) const
+{
+	// 从LOD1开始找，屏幕尺寸小于这一级的阈值就继续往更简化的一级走
+	int32 LODIndex = 0;
+	while (LODIndex < LODs.Num() && ScreenSize < LODs[LODIndex].ScreenSize)
+	{
+		++LODIndex;
+	}
+	
+	return LODIndex;
+}
+
+const TArray<FIntPoint>& URenderObject::GetUniqueEdges(int32 LODIndex)
+{
+	check(LODIndex >= 0 && LODIndex < GetNumLODs());
+	
+	if (EdgeCaches.Num() != GetNumLODs())
+	{
+		EdgeCaches.SetNum(GetNumLODs());
+	}
+	
+	FRenderObjectEdgeCache& EdgeCache = EdgeCaches[LODIndex];
+	if (EdgeCache.IndexData == GetIndexData(LODIndex) && EdgeCache.NumIndices == GetNumIndices(LODIndex) && EdgeCache.RenderStateVersion == RenderStateVersion)
+		return EdgeCache.UniqueEdges;
+
+	EdgeCache.IndexData = GetIndexData(LODIndex);
+	EdgeCache.NumIndices = GetNumIndices(LODIndex);
+	EdgeCache.RenderStateVersion = RenderStateVersion;
+	
+	// 每条边编码成一个64位的键，小的顶点索引在高位，排序后去掉重复的键
+	// 排序后的边按第一个顶点的顺序排列，访问顶点的顺序和顶点数组的顺序接近
+	TArray<uint64> EdgeKeys;
+	const auto AddTriangleEdges = [&EdgeKeys](const auto& InIndices)
+	{
+		EdgeKeys.Reserve(InIndices.Num());
+		for (int32 Index = 0, Count = InIndices.Num() / 3; Index < Count; ++Index)
+		{
+			for (int32 Corner = 0; Corner < 3; ++Corner)
+			{
+				const uint32 Vertex0 = static_cast<uint32>(InIndices[Index * 3 + Corner]);
+				const uint32 Vertex1 = static_cast<uint32>(InIndices[Index * 3 + (Corner == 2 ? 0 : Corner + 1)]);
+				if (Vertex0 != Vertex1)
+				{
+					EdgeKeys.Add((static_cast<uint64>(FMath::Min(Vertex0, Vertex1)) << 32) | FMath::Max(Vertex0, Vertex1));
+				}
+			}
+		}
+	};
+	
+	if (UsesCompactIndices(LODIndex))
+	{
+		AddTriangleEdges(GetLODCompactIndices(LODIndex));
+	}
+	else
+	{
+		AddTriangleEdges(GetLODIndices(LODIndex));
+	}
+
+	EdgeKeys.Sort();
+
+	TArray<FIntPoint>& UniqueEdges = EdgeCache.UniqueEdges;
+	UniqueEdges.Reset();
+	for (int32 Index = 0, Count = EdgeKeys.Num(); Index < Count; ++Index)
+	{
+		if (Index == 0 || EdgeKeys[Index] != EdgeKeys[Index - 1])
+		{
+			UniqueEdges.Emplace(static_cast<int32>(EdgeKeys[Index] >> 32), static_cast<int32>(EdgeKeys[Index] & MAX_uint32));
+		}
+	}
+	UniqueEdges.Shrink();
+	
+	return UniqueEdges;
+}
+
+void URenderObject::MarkBoundsDirty()
+{
+	bLocalBoundsDirty = true;
+	MarkRenderStateDirty();
+}
+
+void URenderObject::MarkRenderStateDirty()
+{
+	++RenderStateVersion;
+}
+
+void URenderObject::UpdateLocalBounds()
+{
+	// 简化模型的顶点不一定是LOD0顶点的子集，包围盒包含所有级的顶点，切换LOD时包围盒保持不变
+	LocalBounds = FBox(ForceInit);
+	for (int32 LODIndex = 0; LODIndex < GetNumLODs(); ++LODIndex)
+	{
+		for (const FRenderObjectVertex& Vertex : GetLODVertices(LODIndex))
+		{
+			LocalBounds += Vertex.Position;
+		}
+	}
+
+	// 包围球以包围盒中心为球心，半径取到最远顶点的距离，比包围盒的外接球更紧
+	LocalBoundingSphere = FSphere(ForceInit);
+	if (LocalBounds.IsValid)
+	{
+		const FVector Center = LocalBounds.GetCenter();
+		float MaxDistanceSquared = 0.0f;
+		for (int32 LODIndex = 0; LODIndex < GetNumLODs(); ++LODIndex)
+		{
+			for (const FRenderObjectVertex& Vertex : GetLODVertices(LODIndex))
+			{
+				MaxDistanceSquared = FMath::Max(MaxDistanceSquared, FVector::DistSquared(Center, Vertex.Position));
+			}
+		}
+		LocalBoundingSphere = FSphere(Center, FMath::Sqrt(MaxDistanceSquared));
+	}
+	
+	bLocalBoundsDirty = false;
 }
 
-FMatrix URenderObject::GetLocalToWorld() const
+#if WITH_EDITOR
+void URenderObject::PreEditChange(FProperty* PropertyAboutToChange)
 {
-	return FTransform(WorldRotation.Quaternion(), WorldLocation, WorldScale).ToMatrixWithScale();
+	Super::PreEditChange(PropertyAboutToChange);
+
+	// 网格数据在二进制网格数据中时先读取出来，编辑的是完整的数组
+	ConditionalLoadMeshData();
+}
+
+void URenderObject::PostEditChangeProperty(FPropertyChangedEvent& PropertyChangedEvent)
+{
+	Super::PostEditChangeProperty(PropertyChangedEvent);
+
+	// 编辑器中修改了任何属性都重绘一次
+	MarkRenderStateDirty();
+
+	const FName PropertyName = PropertyChangedEvent.GetMemberPropertyName();
+	if (PropertyName == GET_MEMBER_NAME_CHECKED(URenderObject, Vertices)
+		|| PropertyName == GET_MEMBER_NAME_CHECKED(URenderObject, LODs))
+	{
+		MarkBoundsDirty();
+	}
+
+	// 保存资源时只保存二进制网格数据，修改后的数组重新写入，否则下次加载资源时修改会丢失
+	if (bMeshDataInBulk
+		&& (PropertyName == GET_MEMBER_NAME_CHECKED(URenderObject, Vertices)
+			|| PropertyName == GET_MEMBER_NAME_CHECKED(URenderObject, Indices)
+			|| PropertyName == GET_MEMBER_NAME_CHECKED(URenderObject, LODs)))
+	{
+		WriteMeshBulkData();
+	}
+}
+
+void URenderObject::PostEditUndo()
+{
+	Super::PostEditUndo();
+
+	// 撤销恢复的是属性中的数组，同样重新写入二进制网格数据
+	if (bMeshDataInBulk && bMeshDataLoaded)
+	{
+		WriteMeshBulkData();
+	}
+	MarkBoundsDirty();
 }
+#endif
 
 /////////////////////////////////////////////////////
 
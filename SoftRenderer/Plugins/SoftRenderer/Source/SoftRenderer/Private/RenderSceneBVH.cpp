@@ -0,0 +1,471 @@
+﻿#include "RenderSceneBVH.h"
+#include "RenderObject.h"
+#include "ViewFrustum.h"
+
+/**
+ * 包围盒的表面积，SAH中射线击中包围盒的概率和表面积成正比
+ */
+static FORCEINLINE float SurfaceArea(const FVector& Min, const FVector& Max)
+{
+	const FVector Size = Max - Min;
+	return 2.0f * (Size.X * Size.Y + Size.Y * Size.Z + Size.Z * Size.X);
+}
+
+/**
+ * 射线和轴对齐包围盒求交(Slab方法)，OutEntry返回射线进入包围盒的参数，起点在包围盒内时为0
+ */
+static FORCEINLINE bool IntersectRayBox(const FVector& Origin, const FVector& InvDirection, const FVector& Min, const FVector& Max, float MaxDistance, float& OutEntry)
+{
+	const FVector T0 = (Min - Origin) * InvDirection;
+	const FVector T1 = (Max - Origin) * InvDirection;
+	const FVector TNear = T0.ComponentMin(T1);
+	const FVector TFar = T0.ComponentMax(T1);
+	
+	const float Entry = FMath::Max3(TNear.X, TNear.Y, TNear.Z);
+	const float Exit = FMath::Min3(TFar.X, TFar.Y, TFar.Z);
+	OutEntry = FMath::Max(Entry, 0.0f);
+	return Entry <= Exit && Exit >= 0.0f && Entry <= MaxDistance;
+}
+
+/**
+ * 射线和渲染对象LOD0的所有三角形求交(Moller-Trumbore算法)，返回最近的三角形
+ *    射线变换到模型本地空间再求交，仿射变换不改变射线参数，求出的距离可以直接和世界空间的结果比较
+ */
+static bool IntersectRenderObject(URenderObject* RenderObject, const FVector& Origin, const FVector& Direction, float MaxDistance, int32& OutTriangleIndex, float& OutDistance)
+{
+	const FMatrix& LocalToWorld = RenderObject->GetLocalToWorld();
+	if (LocalToWorld.Determinant() == 0.0f)
+		return false;
+
+	const FMatrix WorldToLocal = LocalToWorld.Inverse();
+	const FVector LocalOrigin = WorldToLocal.TransformPosition(Origin);
+	const FVector LocalDirection = WorldToLocal.TransformVector(Direction);
+	const TArray<FRenderObjectVertex>& Vertices = RenderObject->GetLODVertices(0);
+
+	bool bHit = false;
+	OutDistance = MaxDistance;
+	
+	// int32和uint16两种索引格式共用同一份代码
+	const auto IntersectTriangles = [&](const auto& Indices)
+	{
+		for (int32 TriangleIndex = 0, NumTriangles = Indices.Num() / 3; TriangleIndex < NumTriangles; ++TriangleIndex)
+		{
+			const FVector& V0 = Vertices[Indices[TriangleIndex * 3]].Position;
+			const FVector& V1 = Vertices[Indices[TriangleIndex * 3 + 1]].Position;
+			const FVector& V2 = Vertices[Indices[TriangleIndex * 3 + 2]].Position;
+			
+			const FVector Edge1 = V1 - V0;
+			const FVector Edge2 = V2 - V0;
+			const FVector P = FVector::CrossProduct(LocalDirection, Edge2);
+			const float Determinant = FVector::DotProduct(Edge1, P);
+
+			// 射线和三角形平行，或者三角形退化
+			if (Determinant == 0.0f)
+				continue;
+
+			// 交点的重心坐标必须在三角形内
+			const float InvDeterminant = 1.0f / Determinant;
+			const FVector T = LocalOrigin - V0;
+			const float U = FVector::DotProduct(T, P) * InvDeterminant;
+			if (U < 0.0f || U > 1.0f)
+				continue;
+
+			const FVector Q = FVector::CrossProduct(T, Edge1);
+			const float V = FVector::DotProduct(LocalDirection, Q) * InvDeterminant;
+			if (V < 0.0f || U + V > 1.0f)
+				continue;
+
+			const float Distance = FVector::DotProduct(Edge2, Q) * InvDeterminant;
+			if (Distance >= 0.0f && Distance < OutDistance)
+			{
+				OutDistance = Distance;
+				OutTriangleIndex = TriangleIndex;
+				bHit = true;
+			}
+		}
+	};
+
+	if (RenderObject->UsesCompactIndices())
+	{
+		IntersectTriangles(RenderObject->GetLODCompactIndices());
+	}
+	else
+	{
+		IntersectTriangles(RenderObject->GetLODIndices());
+	}
+	return bHit;
+}
+
+/////////////////////////////////////////////////////
+// FRenderSceneBVH
+
+void FRenderSceneBVH::Update(const TArray<URenderObject*>& RenderObjects)
+{
+	bool bRebuild = Objects.Num() != RenderObjects.Num();
+	bool bRefit = false;
+	Objects.SetNum(RenderObjects.Num());
+
+	for (int32 Index = 0, Count = RenderObjects.Num(); Index < Count; ++Index)
+	{
+		// 1 渲染对象被替换、移除或者回收时重建
+		URenderObject* RenderObject = IsValid(RenderObjects[Index]) ? RenderObjects[Index] : nullptr;
+		FObjectEntry& Entry = Objects[Index];
+		if (Entry.RenderObject.Get() != RenderObject || Entry.RenderObject.IsStale())
+		{
+			Entry = FObjectEntry();
+			Entry.RenderObject = RenderObject;
+			bRebuild = true;
+		}
+
+		if (RenderObject == nullptr)
+			continue;
+
+		// 2 变换和本地包围盒都没有变化时沿用世界空间包围盒
+		const FMatrix& LocalToWorld = RenderObject->GetLocalToWorld();
+		const FBox& LocalBounds = RenderObject->GetLocalBounds();
+		if (Entry.TransformVersion == RenderObject->GetTransformVersion()
+			&& Entry.LocalMin == LocalBounds.Min && Entry.LocalMax == LocalBounds.Max
+			&& Entry.WorldBounds.IsValid == LocalBounds.IsValid)
+			continue;
+
+		// 3 重新计算世界空间包围盒，包围盒的有效性变化时渲染对象进出层次包围盒，需要重建
+		const bool bWasValid = Entry.WorldBounds.IsValid;
+		Entry.TransformVersion = RenderObject->GetTransformVersion();
+		Entry.LocalMin = LocalBounds.Min;
+		Entry.LocalMax = LocalBounds.Max;
+		Entry.WorldBounds = LocalBounds.IsValid ? LocalBounds.TransformBy(LocalToWorld) : FBox(ForceInit);
+		
+		bRebuild |= bWasValid != Entry.WorldBounds.IsValid;
+		bRefit = true;
+	}
+
+	if (bRebuild)
+	{
+		Build();
+	}
+	else if (bRefit && Refit() > BuildTotalArea * RebuildAreaRatio)
+	{
+		Build();
+	}
+}
+
+void FRenderSceneBVH::Build()
+{
+	ObjectIndices.Reset();
+	for (int32 Index = 0, Count = Objects.Num(); Index < Count; ++Index)
+	{
+		if (Objects[Index].WorldBounds.IsValid)
+		{
+			ObjectIndices.Add(Index);
+		}
+	}
+
+	Nodes.Reset();
+	if (ObjectIndices.Num() > 0)
+	{
+		FNode& Root = Nodes.AddDefaulted_GetRef();
+		Root.FirstObject = 0;
+		Root.NumObjects = ObjectIndices.Num();
+		Root.LeftChild = INDEX_NONE;
+
+		// 用显式的栈代替递归，SAH划分不平衡时树可能很深
+		TArray<int32, TInlineAllocator<64>> PendingNodes;
+		PendingNodes.Add(0);
+		while (PendingNodes.Num() > 0)
+		{
+			const int32 NodeIndex = PendingNodes.Pop(false);
+			Subdivide(NodeIndex);
+			
+			if (Nodes[NodeIndex].LeftChild != INDEX_NONE)
+			{
+				PendingNodes.Add(Nodes[NodeIndex].LeftChild + 1);
+				PendingNodes.Add(Nodes[NodeIndex].LeftChild);
+			}
+		}
+	}
+
+	BuildTotalArea = CalculateTotalArea();
+}
+
+void FRenderSceneBVH::Subdivide(int32 NodeIndex)
+{
+	// 划分过程中节点数组会增长，不能一直持有节点的引用
+	UpdateLeafBounds(Nodes[NodeIndex]);
+	const int32 FirstObject = Nodes[NodeIndex].FirstObject;
+	const int32 NumObjects = Nodes[NodeIndex].NumObjects;
+	if (NumObjects <= MaxLeafObjects)
+		return;
+
+	// 1 渲染对象包围盒中心的范围，每个轴按中心的位置均匀分箱
+	FBox CentroidBounds(ForceInit);
+	for (int32 Index = FirstObject; Index < FirstObject + NumObjects; ++Index)
+	{
+		CentroidBounds += Objects[ObjectIndices[Index]].WorldBounds.GetCenter();
+	}
+
+	const auto GetBin = [&CentroidBounds](const FVector& Center, int32 Axis, float BinScale)
+	{
+		return FMath::Clamp(FMath::FloorToInt((Center[Axis] - CentroidBounds.Min[Axis]) * BinScale), 0, NumSAHBins - 1);
+	};
+
+	int32 BestAxis = INDEX_NONE;
+	int32 BestSplit = 0;
+	float BestCost = MAX_flt;
+	
+	for (int32 Axis = 0; Axis < 3; ++Axis)
+	{
+		const float AxisExtent = CentroidBounds.Max[Axis] - CentroidBounds.Min[Axis];
+		if (AxisExtent <= KINDA_SMALL_NUMBER)
+			continue;
+		
+		// 2 统计每个箱子的渲染对象个数和包围盒
+		FBox BinBounds[NumSAHBins];
+		int32 BinCounts[NumSAHBins];
+		for (int32 Bin = 0; Bin < NumSAHBins; ++Bin)
+		{
+			BinBounds[Bin].Init();
+			BinCounts[Bin] = 0;
+		}
+
+		const float BinScale = NumSAHBins / AxisExtent;
+		for (int32 Index = FirstObject; Index < FirstObject + NumObjects; ++Index)
+		{
+			const FBox& Bounds = Objects[ObjectIndices[Index]].WorldBounds;
+			const int32 Bin = GetBin(Bounds.GetCenter(), Axis, BinScale);
+			BinBounds[Bin] += Bounds;
+			++BinCounts[Bin];
+		}
+
+		// 3 先从右往左累计右侧的表面积和个数，再从左往右扫描每个分割位置，代价是两侧包围盒的表面积乘以渲染对象个数
+		float RightAreas[NumSAHBins];
+		int32 RightCounts[NumSAHBins];
+		FBox AccumulatedBounds(ForceInit);
+		int32 AccumulatedCount = 0;
+		for (int32 Bin = NumSAHBins - 1; Bin > 0; --Bin)
+		{
+			AccumulatedBounds += BinBounds[Bin];
+			AccumulatedCount += BinCounts[Bin];
+			RightAreas[Bin] = AccumulatedCount > 0 ? SurfaceArea(AccumulatedBounds.Min, AccumulatedBounds.Max) : 0.0f;
+			RightCounts[Bin] = AccumulatedCount;
+		}
+
+		AccumulatedBounds.Init();
+		AccumulatedCount = 0;
+		for (int32 Split = 1; Split < NumSAHBins; ++Split)
+		{
+			AccumulatedBounds += BinBounds[Split - 1];
+			AccumulatedCount += BinCounts[Split - 1];
+			if (AccumulatedCount == 0 || RightCounts[Split] == 0)
+				continue;
+
+			const float Cost = SurfaceArea(AccumulatedBounds.Min, AccumulatedBounds.Max) * AccumulatedCount + RightAreas[Split] * RightCounts[Split];
+			if (Cost < BestCost)
+			{
+				BestCost = Cost;
+				BestAxis = Axis;
+				BestSplit = Split;
+			}
+		}
+	}
+
+	// 4 中心在分割位置左侧的渲染对象移到前面，所有中心重合无法按位置划分时按个数对半分
+	int32 MidObject = FirstObject + NumObjects / 2;
+	if (BestAxis != INDEX_NONE)
+	{
+		const float BinScale = NumSAHBins / (CentroidBounds.Max[BestAxis] - CentroidBounds.Min[BestAxis]);
+		int32 Left = FirstObject;
+		int32 Right = FirstObject + NumObjects - 1;
+		while (Left <= Right)
+		{
+			if (GetBin(Objects[ObjectIndices[Left]].WorldBounds.GetCenter(), BestAxis, BinScale) < BestSplit)
+			{
+				++Left;
+			}
+			else
+			{
+				Swap(ObjectIndices[Left], ObjectIndices[Right--]);
+			}
+		}
+		MidObject = Left;
+	}
+
+	// 5 两个子节点相邻存放
+	const int32 LeftChild = Nodes.Num();
+	Nodes.AddDefaulted(2);
+	
+	Nodes[LeftChild].FirstObject = FirstObject;
+	Nodes[LeftChild].NumObjects = MidObject - FirstObject;
+	Nodes[LeftChild].LeftChild = INDEX_NONE;
+	
+	Nodes[LeftChild + 1].FirstObject = MidObject;
+	Nodes[LeftChild + 1].NumObjects = FirstObject + NumObjects - MidObject;
+	Nodes[LeftChild + 1].LeftChild = INDEX_NONE;
+	
+	Nodes[NodeIndex].LeftChild = LeftChild;
+}
+
+float FRenderSceneBVH::Refit()
+{
+	// 子节点总是在父节点后面，倒序遍历保证先修正子节点
+	for (int32 NodeIndex = Nodes.Num() - 1; NodeIndex >= 0; --NodeIndex)
+	{
+		FNode& Node = Nodes[NodeIndex];
+		if (Node.LeftChild == INDEX_NONE)
+		{
+			UpdateLeafBounds(Node);
+		}
+		else
+		{
+			const FNode& LeftNode = Nodes[Node.LeftChild];
+			const FNode& RightNode = Nodes[Node.LeftChild + 1];
+			Node.Min = LeftNode.Min.ComponentMin(RightNode.Min);
+			Node.Max = LeftNode.Max.ComponentMax(RightNode.Max);
+		}
+	}
+
+	return CalculateTotalArea();
+}
+
+void FRenderSceneBVH::UpdateLeafBounds(FNode& Node) const
+{
+	FBox Bounds(ForceInit);
+	for (int32 Index = Node.FirstObject; Index < Node.FirstObject + Node.NumObjects; ++Index)
+	{
+		Bounds += Objects[ObjectIndices[Index]].WorldBounds;
+	}
+	Node.Min = Bounds.Min;
+	Node.Max = Bounds.Max;
+}
+
+float FRenderSceneBVH::CalculateTotalArea() const
+{
+	float TotalArea = 0.0f;
+	for (const FNode& Node : Nodes)
+	{
+		TotalArea += SurfaceArea(Node.Min, Node.Max);
+	}
+	return TotalArea;
+}
+
+void FRenderSceneBVH::CullFrustum(const FViewFrustum& Frustum, TBitArray<>& OutVisibleObjects) const
+{
+	OutVisibleObjects.Init(false, Objects.Num());
+	if (Nodes.Num() == 0)
+		return;
+
+	TArray<int32, TInlineAllocator<64>> PendingNodes;
+	PendingNodes.Add(0);
+	while (PendingNodes.Num() > 0)
+	{
+		const FNode& Node = Nodes[PendingNodes.Pop(false)];
+		
+		bool bFullyInside;
+		if (!Frustum.IntersectBox((Node.Min + Node.Max) * 0.5f, (Node.Max - Node.Min) * 0.5f, bFullyInside))
+			continue;
+
+		// 完全在视锥体内的节点，子树中的所有渲染对象都可见
+		if (bFullyInside)
+		{
+			for (int32 Index = Node.FirstObject; Index < Node.FirstObject + Node.NumObjects; ++Index)
+			{
+				OutVisibleObjects[ObjectIndices[Index]] = true;
+			}
+			continue;
+		}
+
+		// 和视锥体相交的叶子，逐个测试渲染对象的包围盒
+		if (Node.LeftChild == INDEX_NONE)
+		{
+			for (int32 Index = Node.FirstObject; Index < Node.FirstObject + Node.NumObjects; ++Index)
+			{
+				const FBox& Bounds = Objects[ObjectIndices[Index]].WorldBounds;
+				if (Frustum.IntersectBox(Bounds.GetCenter(), Bounds.GetExtent()))
+				{
+					OutVisibleObjects[ObjectIndices[Index]] = true;
+				}
+			}
+			continue;
+		}
+
+		PendingNodes.Add(Node.LeftChild);
+		PendingNodes.Add(Node.LeftChild + 1);
+	}
+}
+
+bool FRenderSceneBVH::RayCast(const FVector& Origin, const FVector& Direction, float MaxDistance, int32& OutObjectIndex, int32& OutTriangleIndex, float& OutDistance) const
+{
+	OutObjectIndex = INDEX_NONE;
+	OutTriangleIndex = INDEX_NONE;
+	OutDistance = MaxDistance;
+	
+	if (Nodes.Num() == 0 || Direction.IsZero())
+		return false;
+
+	// 方向分量为0时用很大的数代替倒数，避免0乘以无穷大得到NaN
+	const FVector InvDirection(
+		Direction.X != 0.0f ? 1.0f / Direction.X : BIG_NUMBER,
+		Direction.Y != 0.0f ? 1.0f / Direction.Y : BIG_NUMBER,
+		Direction.Z != 0.0f ? 1.0f / Direction.Z : BIG_NUMBER);
+
+	// 栈中记录节点和射线进入节点的参数，已经找到更近的交点时跳过
+	TArray<TPair<int32, float>, TInlineAllocator<64>> PendingNodes;
+	float RootEntry;
+	if (IntersectRayBox(Origin, InvDirection, Nodes[0].Min, Nodes[0].Max, OutDistance, RootEntry))
+	{
+		PendingNodes.Emplace(0, RootEntry);
+	}
+	
+	while (PendingNodes.Num() > 0)
+	{
+		const TPair<int32, float> Pending = PendingNodes.Pop(false);
+		if (Pending.Value > OutDistance)
+			continue;
+
+		const FNode& Node = Nodes[Pending.Key];
+		if (Node.LeftChild == INDEX_NONE)
+		{
+			for (int32 Index = Node.FirstObject; Index < Node.FirstObject + Node.NumObjects; ++Index)
+			{
+				// 渲染对象在上一次Update之后被回收时跳过
+				const int32 ObjectIndex = ObjectIndices[Index];
+				URenderObject* RenderObject = Objects[ObjectIndex].RenderObject.Get();
+				if (RenderObject == nullptr)
+					continue;
+				
+				int32 TriangleIndex;
+				float Distance;
+				if (IntersectRenderObject(RenderObject, Origin, Direction, OutDistance, TriangleIndex, Distance))
+				{
+					OutObjectIndex = ObjectIndex;
+					OutTriangleIndex = TriangleIndex;
+					OutDistance = Distance;
+				}
+			}
+			continue;
+		}
+
+		// 近的子节点后入栈，先被处理，找到的交点可以剪掉远的子节点
+		float LeftEntry;
+		float RightEntry;
+		const bool bHitLeft = IntersectRayBox(Origin, InvDirection, Nodes[Node.LeftChild].Min, Nodes[Node.LeftChild].Max, OutDistance, LeftEntry);
+		const bool bHitRight = IntersectRayBox(Origin, InvDirection, Nodes[Node.LeftChild + 1].Min, Nodes[Node.LeftChild + 1].Max, OutDistance, RightEntry);
+		if (bHitLeft && bHitRight)
+		{
+			const bool bLeftFirst = LeftEntry <= RightEntry;
+			PendingNodes.Emplace(bLeftFirst ? Node.LeftChild + 1 : Node.LeftChild, bLeftFirst ? RightEntry : LeftEntry);
+			PendingNodes.Emplace(bLeftFirst ? Node.LeftChild : Node.LeftChild + 1, bLeftFirst ? LeftEntry : RightEntry);
+		}
+		else if (bHitLeft)
+		{
+			PendingNodes.Emplace(Node.LeftChild, LeftEntry);
+		}
+		else if (bHitRight)
+		{
+			PendingNodes.Emplace(Node.LeftChild + 1, RightEntry);
+		}
+	}
+
+	return OutObjectIndex != INDEX_NONE;
+}
+
+/////////////////////////////////////////////////////
@@ -1,15 +1,41 @@
 ﻿#include "SoftRenderer.h"
 #include "VertexShader.h"
+#include "SoftRendererStats.h"
+#include "Misc/ScopeExit.h"
+#include "HAL/ThreadSafeCounter64.h"
+#include "Core/SoftRasterCore.h"
 
 /////////////////////////////////////////////////////
 // USoftRenderer
 
+static_assert(FTileRasterizer::TileSize == UFrameBuffer::ClearTileSize, "Raster tiles must match the frame buffer clear tiles so that workers never resolve the same tile.");
+
+/** 开启遮挡剔除时，每收集这么多三角形就光栅化一次，让后面的渲染对象可以被前面已经画好的深度遮挡，第一批最少，之后每次翻倍 */
+static constexpr int32 MinOcclusionFlushTriangles = 256;
+static constexpr int32 MaxOcclusionFlushTriangles = 16 * 1024;
+
+/**
+ * 屏幕坐标转换为整数像素坐标：加 0.5 的偏移取屏幕像素方格中心对齐，其实就是四舍五入
+ */
+static FORCEINLINE FIntPoint ScreenPosToPixel(const FVector2D& ScreenPos)
+{
+	return FIntPoint(FMath::FloorToInt(ScreenPos.X + 0.5f), FMath::FloorToInt(ScreenPos.Y + 0.5f));
+}
+
 USoftRenderer::USoftRenderer(const FObjectInitializer& ObjectInitializer)
 	: Super(ObjectInitializer)
 {
 	RenderMode = ESoftRendererRenderMode::Wireframe;
 	
 	ViewportSize = FIntPoint(1280, 720);
+	WireframeColor = FLinearColor::Blue;
+	bUseTiledRasterizer = true;
+	bUseFastClear = true;
+	bEnableOcclusionCulling = true;
+	bEnableDirtyRegions = true;
+	bCacheTransformedVertices = true;
+	bUseSceneBVH = true;
+	ForcedLOD = INDEX_NONE;
 	FrameBuffer = nullptr;
 	RenderScene = nullptr;
 }
@@ -29,6 +55,15 @@ void USoftRenderer::InitRenderer()
 		{
 			RenderScene->OpaqueRenderObjects.Emplace(NewObject<URenderObject>(RenderScene,RenderScene->OpaqueRenderObjectsClasses[Index]));
 		}
+
+		// 创建实例化绘制共用的渲染对象
+		for (FRenderObjectInstances& Instances : RenderScene->InstancedRenderObjects)
+		{
+			if (!IsValid(Instances.RenderObject) && Instances.RenderObjectClass)
+			{
+				Instances.RenderObject = NewObject<URenderObject>(RenderScene, Instances.RenderObjectClass);
+			}
+		}
 	}
 }
 
@@ -40,13 +75,542 @@ void USoftRenderer::Render()
 	if (!IsValid(RenderScene))
 		return;
 
-	// 1 视口变化时Resize下FrameBuffer
-	FrameBuffer->Resize(ViewportSize.X, ViewportSize.Y);
+	// 每个阶段的耗时和计数都累加到Stats中，结束时同步到STAT_计数器
+	Stats = FSoftRendererStats();
+	ON_SCOPE_EXIT
+	{
+		INC_DWORD_STAT_BY(STAT_SoftRenderer_VerticesShaded, Stats.NumVerticesShaded);
+		INC_DWORD_STAT_BY(STAT_SoftRenderer_TrianglesSubmitted, Stats.NumTrianglesSubmitted);
+		INC_DWORD_STAT_BY(STAT_SoftRenderer_TrianglesCulled, Stats.NumTrianglesCulled);
+		INC_DWORD_STAT_BY(STAT_SoftRenderer_ClustersCulled, Stats.NumClustersCulled);
+		INC_DWORD_STAT_BY(STAT_SoftRenderer_LinesSubmitted, Stats.NumLinesSubmitted);
+		INC_DWORD_STAT_BY(STAT_SoftRenderer_LinesCulled, Stats.NumLinesCulled);
+		INC_DWORD_STAT_BY(STAT_SoftRenderer_PixelsWritten, Stats.NumPixelsWritten);
+	};
+	SCOPE_SOFTRENDERER_STAGE(STAT_SoftRenderer_Render, Stats.RenderTime);
 
-	// 2 将上一帧渲染的颜色数据用指定颜色清空
-	FrameBuffer->Clear(ClearColor);
+	const bool bOcclusionCulling = IsOcclusionCullingActive();
+	const bool bSolid = RenderMode == ESoftRendererRenderMode::Solid;
+	
+	FSoftRendererViewState ViewState;
+	{
+		SCOPE_SOFTRENDERER_STAGE(STAT_SoftRenderer_Setup, Stats.SetupTime);
+		
+		// 1 视口变化时Resize下FrameBuffer
+		FrameBuffer->Resize(ViewportSize.X, ViewportSize.Y);
+
+		// 2 相机或者视口变化时重新计算视口变换矩阵和投影矩阵
+		UpdateViewMatrices();
+		PackedWireframeColor = WireframeColor.ToFColor(false).DWColor();
+
+		// 3 每个渲染对象对应一个变换缓存，渲染对象被替换时缓存在UpdateTransformCache中重置
+		//    顶点和索引保存在二进制网格数据中的渲染对象，第一次绘制前读取
+		TransformCaches.SetNum(RenderScene->OpaqueRenderObjects.Num());
+		for (URenderObject* RenderObject : RenderScene->OpaqueRenderObjects)
+		{
+			if (IsValid(RenderObject))
+			{
+				RenderObject->ConditionalLoadMeshData();
+			}
+		}
+		for (const FRenderObjectInstances& Instances : RenderScene->InstancedRenderObjects)
+		{
+			if (IsValid(Instances.RenderObject))
+			{
+				Instances.RenderObject->ConditionalLoadMeshData();
+			}
+		}
+
+		// 层次包围盒只修正变化的渲染对象，渲染对象增删时重建
+		if (bUseSceneBVH)
+		{
+			SceneBVH.Update(RenderScene->OpaqueRenderObjects);
+		}
+
+		// 4 和上一帧比较找出需要重绘的块
+		ViewState.bValid = bEnableDirtyRegions;
+		ViewState.FrameBuffer = FrameBuffer;
+		ViewState.FrameBufferSize = FIntPoint(FrameBuffer->GetWidth(), FrameBuffer->GetHeight());
+		ViewState.WorldToProjection = CachedWorldToProjectionMatrix;
+		ViewState.RenderMode = RenderMode;
+		ViewState.ClearColor = ClearColor;
+		ViewState.WireframeColor = WireframeColor;
+		ViewState.bOcclusionCulling = bOcclusionCulling;
+		ViewState.ForcedLOD = FMath::Max(ForcedLOD, INDEX_NONE);
+
+		bPartialRedraw = bEnableDirtyRegions && !UpdateDirtyTiles(ViewState);
+	}
+
+	// 5 清空需要重绘的部分，实体模式还需要清空深度
+	{
+		SCOPE_SOFTRENDERER_STAGE(STAT_SoftRenderer_Clear, Stats.ClearTime);
+		
+		if (bPartialRedraw)
+		{
+			Stats.NumRedrawnTiles = DirtyTiles.CountSetBits();
+			
+			// 场景没有任何变化，保留上一帧的图像
+			if (Stats.NumRedrawnTiles == 0)
+			{
+				Swap(RenderStates, NewRenderStates);
+				Swap(InstanceRenderStates, NewInstanceRenderStates);
+				LastViewState = ViewState;
+				return;
+			}
 
-	// 3 计算视口变换矩阵
+			FrameBuffer->ClearTiles(DirtyTiles, ClearColor, bSolid, 0.0f);
+			
+			// 层次深度缓冲中其他块的深度仍然有效，只重建被清空的块
+			if (bOcclusionCulling)
+			{
+				const int32 NumTilesX = FrameBuffer->GetNumClearTilesX();
+				for (TConstSetBitIterator<> It(DirtyTiles); It; ++It)
+				{
+					const int32 TileMinX = (It.GetIndex() % NumTilesX) * UFrameBuffer::ClearTileSize;
+					const int32 TileMinY = (It.GetIndex() / NumTilesX) * UFrameBuffer::ClearTileSize;
+					HierarchicalZBuffer.MarkDirty(FIntRect(TileMinX, TileMinY, TileMinX + UFrameBuffer::ClearTileSize, TileMinY + UFrameBuffer::ClearTileSize));
+				}
+				HierarchicalZBuffer.Update(FrameBuffer);
+			}
+		}
+		else
+		{
+			Stats.NumRedrawnTiles = FrameBuffer->GetNumClearTilesX() * FrameBuffer->GetNumClearTilesY();
+			
+			FrameBuffer->Clear(ClearColor, bUseFastClear);
+			if (bSolid)
+			{
+				FrameBuffer->ClearDepth(0.0f, bUseFastClear);
+			}
+
+			if (bOcclusionCulling)
+			{
+				HierarchicalZBuffer.Init(FrameBuffer->GetWidth(), FrameBuffer->GetHeight(), 0.0f);
+			}
+		}
+	}
+	
+	// 6 逐个处理不透明物体，收集屏幕空间三角形或者线段，局部重绘时跳过和需要重绘的块不相交的物体
+	FrameArena.Reset();
+	RasterTriangles.Reset();
+	RasterLines.Reset();
+	
+	const TArray<URenderObject*>& RenderObjects = RenderScene->OpaqueRenderObjects;
+	if (bUseSceneBVH)
+	{
+		// 层次包围盒剔除整个在视锥体外的子树，按渲染对象的顺序只遍历可能可见的渲染对象
+		SceneBVH.CullFrustum(ViewFrustum, VisibleObjects);
+		Stats.NumFrustumCulledObjects += SceneBVH.GetNumObjects() - VisibleObjects.CountSetBits();
+	}
+	else
+	{
+		VisibleObjects.Init(true, RenderObjects.Num());
+	}
+
+	DrawOrder.Reset();
+	for (TConstSetBitIterator<> It(VisibleObjects); It; ++It)
+	{
+		DrawOrder.Add(It.GetIndex());
+	}
+
+	// 开启遮挡剔除时从近到远绘制，离相机最近的物体先写入深度，后面被它挡住的物体才能被剔除
+	OcclusionFlushThreshold = MinOcclusionFlushTriangles;
+	if (bOcclusionCulling)
+	{
+		const TArrayView<float> NearestDistances = FrameArena.AllocateArray<float>(RenderObjects.Num());
+		for (const int32 Index : DrawOrder)
+		{
+			URenderObject* RenderObject = RenderObjects[Index];
+			NearestDistances[Index] = IsValid(RenderObject) ? CalculateNearestViewDistance(RenderObject, RenderObject->GetLocalToWorld()) : 0.0f;
+		}
+
+		// 距离相同时按渲染对象的顺序，每一帧的绘制顺序保持稳定
+		DrawOrder.Sort([&NearestDistances](int32 A, int32 B)
+		{
+			return NearestDistances[A] < NearestDistances[B] || (NearestDistances[A] == NearestDistances[B] && A < B);
+		});
+	}
+	
+	for (const int32 Index : DrawOrder)
+	{
+		URenderObject* RenderObject = RenderObjects[Index];
+		if (!IsValid(RenderObject))
+			continue;
+
+		if (bPartialRedraw && !IntersectsDirtyTiles(NewRenderStates[Index].ScreenBounds))
+			continue;
+		
+		DrawPrimitive(RenderObject, UpdateTransformCache(Index, RenderObject), bUseSceneBVH);
+
+		if (bOcclusionCulling)
+		{
+			ConditionalFlushForOcclusion();
+		}
+	}
+
+	// 实例化绘制的物体，局部重绘时跳过所有实例都和需要重绘的块不相交的一组物体
+	const TArray<FRenderObjectInstances>& InstancedRenderObjects = RenderScene->InstancedRenderObjects;
+	for (int32 Index = 0, Count = InstancedRenderObjects.Num(); Index < Count; ++Index)
+	{
+		if (!IsValid(InstancedRenderObjects[Index].RenderObject))
+			continue;
+
+		if (bPartialRedraw && !IntersectsDirtyTiles(NewInstanceRenderStates[Index].ScreenBounds))
+			continue;
+
+		DrawInstances(InstancedRenderObjects[Index]);
+	}
+
+	// 7 光栅化剩余的图元
+	FlushRasterPrimitives();
+
+	// 8 记录这一帧的渲染状态，着色器在绘制时才创建，材质状态在绘制之后记录
+	if (bEnableDirtyRegions)
+	{
+		for (int32 Index = 0, Count = RenderObjects.Num(); Index < Count; ++Index)
+		{
+			if (IsValid(RenderObjects[Index]))
+			{
+				CaptureMaterialState(RenderObjects[Index], NewRenderStates[Index]);
+			}
+		}
+		for (int32 Index = 0, Count = InstancedRenderObjects.Num(); Index < Count; ++Index)
+		{
+			if (IsValid(InstancedRenderObjects[Index].RenderObject))
+			{
+				CaptureMaterialState(InstancedRenderObjects[Index].RenderObject, NewInstanceRenderStates[Index]);
+			}
+		}
+		Swap(RenderStates, NewRenderStates);
+		Swap(InstanceRenderStates, NewInstanceRenderStates);
+	}
+	else
+	{
+		RenderStates.Reset();
+		InstanceRenderStates.Reset();
+	}
+	LastViewState = ViewState;
+}
+
+bool USoftRenderer::RayPick(FVector Origin, FVector Direction, float MaxDistance, FSoftRendererRayHit& OutHit)
+{
+	OutHit = FSoftRendererRayHit();
+	if (!IsValid(RenderScene) || Direction.IsNearlyZero())
+		return false;
+
+	// 层次包围盒需要所有渲染对象的包围盒，没有渲染过的渲染对象先读取网格数据
+	for (URenderObject* RenderObject : RenderScene->OpaqueRenderObjects)
+	{
+		if (IsValid(RenderObject))
+		{
+			RenderObject->ConditionalLoadMeshData();
+		}
+	}
+	SceneBVH.Update(RenderScene->OpaqueRenderObjects);
+
+	const FVector UnitDirection = Direction.GetUnsafeNormal();
+	int32 ObjectIndex;
+	int32 TriangleIndex;
+	float Distance;
+	if (!SceneBVH.RayCast(Origin, UnitDirection, MaxDistance, ObjectIndex, TriangleIndex, Distance))
+		return false;
+
+	OutHit.RenderObject = RenderScene->OpaqueRenderObjects[ObjectIndex];
+	OutHit.TriangleIndex = TriangleIndex;
+	OutHit.Location = Origin + UnitDirection * Distance;
+	OutHit.Distance = Distance;
+	return true;
+}
+
+bool USoftRenderer::PickAtScreenPosition(FVector2D ScreenPosition, FSoftRendererRayHit& OutHit)
+{
+	OutHit = FSoftRendererRayHit();
+	UpdateViewMatrices();
+
+	// 屏幕坐标转换到标准化设备坐标，Reversed-Z的近平面深度为1，深度0.5的点在近平面后面，两点连线就是经过这个像素的视线
+	//    透视投影的远平面在无穷远处，不能使用深度0的点
+	const FMatrix ProjectionToWorld = CachedWorldToProjectionMatrix.Inverse();
+	const float NDCX = ScreenPosition.X / ViewportSize.X * 2.0f - 1.0f;
+	const float NDCY = 1.0f - ScreenPosition.Y / ViewportSize.Y * 2.0f;
+	
+	const FVector4 NearPoint = ProjectionToWorld.TransformFVector4(FVector4(NDCX, NDCY, 1.0f, 1.0f));
+	const FVector4 FarPoint = ProjectionToWorld.TransformFVector4(FVector4(NDCX, NDCY, 0.5f, 1.0f));
+	if (FMath::IsNearlyZero(NearPoint.W) || FMath::IsNearlyZero(FarPoint.W))
+		return false;
+
+	const FVector Origin = FVector(NearPoint) / NearPoint.W;
+	const FVector Direction = FVector(FarPoint) / FarPoint.W - Origin;
+	return RayPick(Origin, Direction, WORLD_MAX, OutHit);
+}
+
+bool USoftRenderer::UpdateDirtyTiles(const FSoftRendererViewState& ViewState)
+{
+	const TArray<URenderObject*>& RenderObjects = RenderScene->OpaqueRenderObjects;
+	const bool bFullRedraw = !ViewState.Equals(LastViewState);
+	
+	DirtyTiles.Init(false, FrameBuffer->GetNumClearTilesX() * FrameBuffer->GetNumClearTilesY());
+	NewRenderStates.SetNum(RenderObjects.Num());
+	
+	for (int32 Index = 0, Count = RenderObjects.Num(); Index < Count; ++Index)
+	{
+		URenderObject* RenderObject = RenderObjects[Index];
+		FRenderObjectRenderState& NewState = NewRenderStates[Index];
+		const FRenderObjectRenderState* OldState = RenderStates.IsValidIndex(Index) ? &RenderStates[Index] : nullptr;
+		
+		if (!IsValid(RenderObject))
+		{
+			NewState = FRenderObjectRenderState();
+			if (!bFullRedraw && OldState)
+			{
+				MarkDirtyTiles(OldState->ScreenBounds);
+			}
+			continue;
+		}
+		
+		// 1 变换、几何、模型级数和材质都没有变化的渲染对象沿用上一帧的屏幕范围，不需要重新投影包围盒
+		const FMatrix& LocalToWorld = RenderObject->GetLocalToWorld();
+		const FRenderObjectTransformCache& Cache = UpdateTransformCache(Index, RenderObject);
+		const int32 LODIndex = Cache.LODIndex;
+		if (!bFullRedraw && OldState && OldState->RenderObject.Get() == RenderObject
+			&& OldState->RenderStateVersion == RenderObject->GetRenderStateVersion()
+			&& OldState->LODIndex == LODIndex
+			&& OldState->VerticesData == RenderObject->GetLODVertices(LODIndex).GetData() && OldState->NumVertices == RenderObject->GetLODVertices(LODIndex).Num()
+			&& OldState->IndicesData == RenderObject->GetIndexData(LODIndex) && OldState->NumIndices == RenderObject->GetNumIndices(LODIndex)
+			&& OldState->LocalToWorld.Equals(LocalToWorld, 0.0f)
+			&& IsMaterialStateEqual(RenderObject, *OldState))
+		{
+			NewState = *OldState;
+			continue;
+		}
+
+		// 2 发生变化的渲染对象，上一帧和这一帧覆盖的块都需要重绘
+		CaptureRenderState(RenderObject, LocalToWorld, Cache, NewState);
+		if (!bFullRedraw)
+		{
+			if (OldState)
+			{
+				MarkDirtyTiles(OldState->ScreenBounds);
+			}
+			MarkDirtyTiles(NewState.ScreenBounds);
+		}
+	}
+
+	// 3 实例化绘制的物体按组比较，共用的模型、材质或者任何一个实例的变换变化时，整组上一帧和这一帧覆盖的块都需要重绘
+	const TArray<FRenderObjectInstances>& InstancedRenderObjects = RenderScene->InstancedRenderObjects;
+	NewInstanceRenderStates.SetNum(InstancedRenderObjects.Num());
+	
+	for (int32 Index = 0, Count = InstancedRenderObjects.Num(); Index < Count; ++Index)
+	{
+		const FRenderObjectInstances& Instances = InstancedRenderObjects[Index];
+		URenderObject* RenderObject = Instances.RenderObject;
+		FRenderObjectRenderState& NewState = NewInstanceRenderStates[Index];
+		const FRenderObjectRenderState* OldState = InstanceRenderStates.IsValidIndex(Index) ? &InstanceRenderStates[Index] : nullptr;
+		
+		if (!IsValid(RenderObject))
+		{
+			NewState = FRenderObjectRenderState();
+			if (!bFullRedraw && OldState)
+			{
+				MarkDirtyTiles(OldState->ScreenBounds);
+			}
+			continue;
+		}
+
+		// 每个实例的模型级数只和实例的变换、相机有关，比较LOD0的几何和所有实例变换的哈希就够了
+		const TArray<FTransform>& InstanceTransforms = Instances.InstanceTransforms;
+		const uint32 InstanceTransformsHash = FCrc::MemCrc32(InstanceTransforms.GetData(), InstanceTransforms.Num() * sizeof(FTransform));
+		if (!bFullRedraw && OldState && OldState->RenderObject.Get() == RenderObject
+			&& OldState->RenderStateVersion == RenderObject->GetRenderStateVersion()
+			&& OldState->VerticesData == RenderObject->Vertices.GetData() && OldState->NumVertices == RenderObject->Vertices.Num()
+			&& OldState->IndicesData == RenderObject->GetIndexData() && OldState->NumIndices == RenderObject->GetNumIndices()
+			&& OldState->NumInstances == InstanceTransforms.Num() && OldState->InstanceTransformsHash == InstanceTransformsHash
+			&& IsMaterialStateEqual(RenderObject, *OldState))
+		{
+			NewState = *OldState;
+			continue;
+		}
+
+		CaptureInstancesRenderState(Instances, InstanceTransformsHash, NewState);
+		if (!bFullRedraw)
+		{
+			if (OldState)
+			{
+				MarkDirtyTiles(OldState->ScreenBounds);
+			}
+			MarkDirtyTiles(NewState.ScreenBounds);
+		}
+	}
+
+	// 4 从场景中移除的渲染对象和实例化绘制的物体，上一帧覆盖的块需要重绘
+	if (!bFullRedraw)
+	{
+		for (int32 Index = RenderObjects.Num(); Index < RenderStates.Num(); ++Index)
+		{
+			MarkDirtyTiles(RenderStates[Index].ScreenBounds);
+		}
+		for (int32 Index = InstancedRenderObjects.Num(); Index < InstanceRenderStates.Num(); ++Index)
+		{
+			MarkDirtyTiles(InstanceRenderStates[Index].ScreenBounds);
+		}
+	}
+
+	return bFullRedraw;
+}
+
+void USoftRenderer::CaptureRenderState(URenderObject* RenderObject, const FMatrix& LocalToWorld, const FRenderObjectTransformCache& Cache, FRenderObjectRenderState& OutState) const
+{
+	OutState.RenderObject = RenderObject;
+	OutState.LocalToWorld = LocalToWorld;
+	OutState.RenderStateVersion = RenderObject->GetRenderStateVersion();
+	OutState.LODIndex = Cache.LODIndex;
+	OutState.VerticesData = RenderObject->GetLODVertices(Cache.LODIndex).GetData();
+	OutState.NumVertices = RenderObject->GetLODVertices(Cache.LODIndex).Num();
+	OutState.IndicesData = RenderObject->GetIndexData(Cache.LODIndex);
+	OutState.NumIndices = RenderObject->GetNumIndices(Cache.LODIndex);
+	OutState.ScreenBounds = CalculateDirtyBounds(RenderObject, LocalToWorld, Cache.LocalToProjection);
+	CaptureMaterialState(RenderObject, OutState);
+}
+
+void USoftRenderer::CaptureInstancesRenderState(const FRenderObjectInstances& Instances, uint32 InstanceTransformsHash, FRenderObjectRenderState& OutState) const
+{
+	URenderObject* RenderObject = Instances.RenderObject;
+	OutState.RenderObject = RenderObject;
+	OutState.LocalToWorld = FMatrix::Identity;
+	OutState.RenderStateVersion = RenderObject->GetRenderStateVersion();
+	OutState.LODIndex = 0;
+	OutState.VerticesData = RenderObject->Vertices.GetData();
+	OutState.NumVertices = RenderObject->Vertices.Num();
+	OutState.IndicesData = RenderObject->GetIndexData();
+	OutState.NumIndices = RenderObject->GetNumIndices();
+	OutState.NumInstances = Instances.InstanceTransforms.Num();
+	OutState.InstanceTransformsHash = InstanceTransformsHash;
+
+	// 屏幕范围取所有实例屏幕范围的并集，已经覆盖整个屏幕时不需要再计算剩下的实例
+	const FIntRect FullRect(0, 0, FrameBuffer->GetWidth(), FrameBuffer->GetHeight());
+	OutState.ScreenBounds = FIntRect();
+	for (const FTransform& InstanceTransform : Instances.InstanceTransforms)
+	{
+		const FMatrix LocalToWorld = InstanceTransform.ToMatrixWithScale();
+		const FIntRect InstanceBounds = CalculateDirtyBounds(RenderObject, LocalToWorld, LocalToWorld * CachedWorldToProjectionMatrix);
+		if (InstanceBounds.IsEmpty())
+			continue;
+
+		if (OutState.ScreenBounds.IsEmpty())
+		{
+			OutState.ScreenBounds = InstanceBounds;
+		}
+		else
+		{
+			OutState.ScreenBounds.Union(InstanceBounds);
+		}
+
+		if (OutState.ScreenBounds == FullRect)
+			break;
+	}
+	CaptureMaterialState(RenderObject, OutState);
+}
+
+bool USoftRenderer::IsMaterialStateEqual(const URenderObject* RenderObject, const FRenderObjectRenderState& State)
+{
+	const FRenderObjectMaterial& Material = RenderObject->Material;
+	return State.VertexShaderClass == Material.VertexShaderClass.Get()
+		&& State.PixelShaderClass == Material.PixelShaderClass.Get()
+		&& State.VertexShader == Material.VertexShader
+		&& State.PixelShader == Material.PixelShader
+		&& (!IsValid(Material.PixelShader) || State.PixelShaderColor == Material.PixelShader->Color)
+		&& State.bBackfaceCulling == Material.bBackfaceCulling;
+}
+
+void USoftRenderer::CaptureMaterialState(const URenderObject* RenderObject, FRenderObjectRenderState& OutState)
+{
+	const FRenderObjectMaterial& Material = RenderObject->Material;
+	OutState.VertexShaderClass = Material.VertexShaderClass.Get();
+	OutState.PixelShaderClass = Material.PixelShaderClass.Get();
+	OutState.VertexShader = Material.VertexShader;
+	OutState.PixelShader = Material.PixelShader;
+	OutState.PixelShaderColor = IsValid(Material.PixelShader) ? Material.PixelShader->Color : FLinearColor::Transparent;
+	OutState.bBackfaceCulling = Material.bBackfaceCulling;
+}
+
+FIntRect USoftRenderer::CalculateDirtyBounds(URenderObject* RenderObject, const FMatrix& LocalToWorld, const FMatrix& LocalToProjection) const
+{
+	const FIntRect FullRect(0, 0, FrameBuffer->GetWidth(), FrameBuffer->GetHeight());
+	
+	// 没有顶点着色器的渲染对象不会被绘制
+	const UVertexShader* VertexShader = RenderObject->Material.VertexShader;
+	if (!IsValid(VertexShader))
+	{
+		VertexShader = RenderObject->Material.VertexShaderClass ? RenderObject->Material.VertexShaderClass.GetDefaultObject() : nullptr;
+		if (VertexShader == nullptr)
+			return FIntRect();
+	}
+
+	if (IsOutsideFrustum(RenderObject, LocalToWorld))
+		return FIntRect();
+	
+	// 自定义的顶点着色器可能移动顶点，包围盒的投影不可靠，认为覆盖整个屏幕
+	if (!VertexShader->SupportsVertexShaderBatch())
+		return FullRect;
+
+	FIntRect ScreenRect;
+	float NearestDepth;
+	if (!CalculateScreenBounds(RenderObject, LocalToProjection, ViewportSize, ScreenRect, NearestDepth))
+		return FullRect;
+
+	ScreenRect.Clip(FullRect);
+	return ScreenRect.IsEmpty() ? FIntRect() : ScreenRect;
+}
+
+void USoftRenderer::MarkDirtyTiles(const FIntRect& Rect)
+{
+	const int32 MinX = FMath::Max(Rect.Min.X, 0);
+	const int32 MinY = FMath::Max(Rect.Min.Y, 0);
+	const int32 MaxX = FMath::Min(Rect.Max.X, FrameBuffer->GetWidth());
+	const int32 MaxY = FMath::Min(Rect.Max.Y, FrameBuffer->GetHeight());
+	if (MinX >= MaxX || MinY >= MaxY)
+		return;
+
+	const int32 NumTilesX = FrameBuffer->GetNumClearTilesX();
+	for (int32 TileY = MinY / UFrameBuffer::ClearTileSize, LastTileY = (MaxY - 1) / UFrameBuffer::ClearTileSize; TileY <= LastTileY; ++TileY)
+	{
+		for (int32 TileX = MinX / UFrameBuffer::ClearTileSize, LastTileX = (MaxX - 1) / UFrameBuffer::ClearTileSize; TileX <= LastTileX; ++TileX)
+		{
+			DirtyTiles[TileY * NumTilesX + TileX] = true;
+		}
+	}
+}
+
+bool USoftRenderer::IntersectsDirtyTiles(const FIntRect& Rect) const
+{
+	const int32 MinX = FMath::Max(Rect.Min.X, 0);
+	const int32 MinY = FMath::Max(Rect.Min.Y, 0);
+	const int32 MaxX = FMath::Min(Rect.Max.X, FrameBuffer->GetWidth());
+	const int32 MaxY = FMath::Min(Rect.Max.Y, FrameBuffer->GetHeight());
+	if (MinX >= MaxX || MinY >= MaxY)
+		return false;
+
+	const int32 NumTilesX = FrameBuffer->GetNumClearTilesX();
+	for (int32 TileY = MinY / UFrameBuffer::ClearTileSize, LastTileY = (MaxY - 1) / UFrameBuffer::ClearTileSize; TileY <= LastTileY; ++TileY)
+	{
+		for (int32 TileX = MinX / UFrameBuffer::ClearTileSize, LastTileX = (MaxX - 1) / UFrameBuffer::ClearTileSize; TileX <= LastTileX; ++TileX)
+		{
+			if (DirtyTiles[TileY * NumTilesX + TileX])
+				return true;
+		}
+	}
+	return false;
+}
+
+void USoftRenderer::UpdateViewMatrices()
+{
+	if (ViewVersion != 0 && CachedCamera.Equals(RenderCamera) && CachedViewportSize == ViewportSize)
+		return;
+
+	CachedCamera = RenderCamera;
+	CachedViewportSize = ViewportSize;
+	++ViewVersion;
+	
+	// 1 计算视口变换矩阵
 	//    这里要乘以一个额外的矩阵原因
 	//       1 采用UE的坐标系，Z向上  X屏幕向内  Y向右
 	//       2 需要转换为DirectX的左手坐标系，需要再旋转下
@@ -56,66 +620,727 @@ void USoftRenderer::Render()
 		FPlane(0,	1,	0,	0),
 		FPlane(0,	0,	0,	1));
 	
-	const FMatrix WorldToViewMatrix = FTranslationMatrix(-RenderCamera.ViewOrigin) * ViewRotationMatrix;
+	CachedWorldToViewMatrix = FTranslationMatrix(-RenderCamera.ViewOrigin) * ViewRotationMatrix;
 
-	// 4 计算投影矩阵
-	const FMatrix ProjectMatrix = CalculateProjectionMatrix();
+	// 2 计算投影矩阵，提取视锥体的裁剪平面
+	CachedProjectionMatrix = CalculateProjectionMatrix();
+	CachedWorldToProjectionMatrix = CachedWorldToViewMatrix * CachedProjectionMatrix;
+	ViewFrustum.Init(CachedWorldToProjectionMatrix);
+	Clipper.Init(ViewportSize);
+}
+
+FRenderObjectTransformCache& USoftRenderer::UpdateTransformCache(int32 ObjectIndex, URenderObject* RenderObject)
+{
+	FRenderObjectTransformCache& Cache = TransformCaches[ObjectIndex];
+	if (Cache.RenderObject.Get() != RenderObject)
+	{
+		Cache = FRenderObjectTransformCache();
+		Cache.RenderObject = RenderObject;
+	}
+
+	// 渲染对象的变换或者相机变化时重新相乘，缓存的顶点变换结果随之失效
+	const FMatrix& LocalToWorld = RenderObject->GetLocalToWorld();
+	if (Cache.TransformVersion != RenderObject->GetTransformVersion() || Cache.ViewVersion != ViewVersion)
+	{
+		Cache.LocalToProjection = LocalToWorld * CachedWorldToProjectionMatrix;
+		Cache.TransformVersion = RenderObject->GetTransformVersion();
+		Cache.ViewVersion = ViewVersion;
+		Cache.bVerticesValid = false;
+	}
+
+	Cache.LODIndex = SelectLODIndex(RenderObject, LocalToWorld, Cache.LocalToProjection);
+	return Cache;
+}
+
+int32 USoftRenderer::SelectLODIndex(URenderObject* RenderObject, const FMatrix& LocalToWorld, const FMatrix& LocalToProjection) const
+{
+	// 屏幕尺寸只需要变换包围球中心，每帧重新选择，包围球和LOD的阈值变化时不需要额外检测
+	const int32 NumLODs = RenderObject->GetNumLODs();
+	return ForcedLOD >= 0 ? FMath::Min(ForcedLOD, NumLODs - 1) : NumLODs > 1 ? RenderObject->SelectLOD(CalculateScreenSize(RenderObject, LocalToWorld, LocalToProjection)) : 0;
+}
+
+void USoftRenderer::DrawPrimitive(URenderObject* RenderObject, FRenderObjectTransformCache& Cache, bool bFrustumTested)
+{
+	// 1 获取着色器
+	UVertexShader* VertexShader;
+	UPixelShader* PixelShader;
+	if (!PrepareShaders(RenderObject, VertexShader, PixelShader))
+		return;
+
+	// 2 本地空间到齐次裁剪空间的变换矩阵在变换缓存中预先相乘，渲染对象和相机不变时跨帧复用
+	const FMatrix& LocalToWorld = RenderObject->GetLocalToWorld();
+
+	// 完全在视锥体外的物体不需要变换顶点，层次包围盒已经剔除过的不再测试
+	if (!bFrustumTested && IsOutsideFrustum(RenderObject, LocalToWorld))
+	{
+		++Stats.NumFrustumCulledObjects;
+		return;
+	}
 	
-	// 5 逐个渲染不透明物体
-	for (const auto& RenderObject : RenderScene->OpaqueRenderObjects)
+	const FMatrix& LocalToProjection = Cache.LocalToProjection;
+
+	// 被已经画好的深度完全遮挡时，不需要再变换顶点
+	if (IsOcclusionCullingActive() && IsOccluded(RenderObject, LocalToProjection))
 	{
-		if (!IsValid(RenderObject))
+		++Stats.NumOccludedObjects;
+		return;
+	}
+	
+	// 3 大模型按簇做视锥剔除和背面剔除，整簇被剔除时它的顶点不需要变换，三角形也不需要装配
+	const int32 LODIndex = Cache.LODIndex;
+	const bool bClustersCulled = CullClusters(RenderObject, LODIndex, VertexShader, LocalToWorld);
+	if (bClustersCulled && VisibleClusters.Num() == 0)
+		return;
+	
+	// 4 准备顶点变换的输出缓冲，长度按4对齐方便SIMD读取，不写回渲染对象的顶点数据
+	//    开启顶点缓存时输出到变换缓存中跨帧保留，否则从每帧的临时内存中分配
+	const TArray<FRenderObjectVertex>& Vertices = RenderObject->GetLODVertices(LODIndex);
+	const int32 NumVertices = Vertices.Num();
+	const int32 NumPaddedVertices = Align(NumVertices, 4);
+
+	FTransformedVertices Transformed;
+	bool bTransformVertices = true;
+	
+	if (bCacheTransformedVertices)
+	{
+		// 变换矩阵、顶点数据和顶点着色器都没有变化时，直接使用上一次的顶点变换结果
+		//    上一次只变换了部分簇的顶点时，这一帧可见的簇必须都包含在内，线框模式和没有簇被剔除时要用到所有顶点
+		bTransformVertices = !Cache.bVerticesValid
+			|| Cache.RenderStateVersion != RenderObject->GetRenderStateVersion()
+			|| Cache.VerticesData != Vertices.GetData()
+			|| Cache.NumVertices != NumVertices
+			|| Cache.VertexShader != VertexShader
+			|| !(bClustersCulled ? Cache.HasShadedClusters(VisibleClusters) : Cache.bAllVerticesShaded);
+	}
+	
+	if (bCacheTransformedVertices)
+	{
+		if (bTransformVertices)
+		{
+			Cache.ClipPosX.SetNumUninitialized(NumPaddedVertices);
+			Cache.ClipPosY.SetNumUninitialized(NumPaddedVertices);
+			Cache.ClipPosZ.SetNumUninitialized(NumPaddedVertices);
+			Cache.ClipPosW.SetNumUninitialized(NumPaddedVertices);
+			Cache.ScreenPos.SetNumUninitialized(NumVertices);
+			Cache.Depth.SetNumUninitialized(NumVertices);
+			Cache.OutCodes.SetNumUninitialized(NumVertices);
+			
+			Cache.bVerticesValid = true;
+			Cache.RenderStateVersion = RenderObject->GetRenderStateVersion();
+			Cache.VerticesData = Vertices.GetData();
+			Cache.NumVertices = NumVertices;
+			Cache.VertexShader = VertexShader;
+
+			// 记录这次变换覆盖了哪些簇，之后可见的簇是其中的一部分时可以继续复用
+			Cache.bAllVerticesShaded = !bClustersCulled;
+			Cache.ShadedClusters.Init(false, bClustersCulled ? RenderObject->GetLODClusters(LODIndex).Num() : 0);
+			if (bClustersCulled)
+			{
+				for (const int32 ClusterIndex : VisibleClusters)
+				{
+					Cache.ShadedClusters[ClusterIndex] = true;
+				}
+			}
+		}
+
+		Transformed.ClipPos.X = TArrayView<float>(Cache.ClipPosX.GetData(), NumVertices);
+		Transformed.ClipPos.Y = TArrayView<float>(Cache.ClipPosY.GetData(), NumVertices);
+		Transformed.ClipPos.Z = TArrayView<float>(Cache.ClipPosZ.GetData(), NumVertices);
+		Transformed.ClipPos.W = TArrayView<float>(Cache.ClipPosW.GetData(), NumVertices);
+		Transformed.ScreenPos = Cache.ScreenPos;
+		Transformed.Depth = Cache.Depth;
+		Transformed.OutCodes = Cache.OutCodes;
+	}
+	else
+	{
+		Cache.ReleaseVertices();
+		
+		Transformed.ClipPos.X = FrameArena.AllocateArray<float>(NumPaddedVertices, 16).Slice(0, NumVertices);
+		Transformed.ClipPos.Y = FrameArena.AllocateArray<float>(NumPaddedVertices, 16).Slice(0, NumVertices);
+		Transformed.ClipPos.Z = FrameArena.AllocateArray<float>(NumPaddedVertices, 16).Slice(0, NumVertices);
+		Transformed.ClipPos.W = FrameArena.AllocateArray<float>(NumPaddedVertices, 16).Slice(0, NumVertices);
+		Transformed.ScreenPos = FrameArena.AllocateArray<FVector2D>(NumVertices);
+		Transformed.Depth = FrameArena.AllocateArray<float>(NumVertices);
+		Transformed.OutCodes = FrameArena.AllocateArray<uint32>(NumVertices);
+	}
+
+	// 5 顶点变换的结果过期时重新执行顶点着色器，有簇被剔除时只变换可见的簇用到的顶点
+	if (bTransformVertices)
+	{
+		if (bClustersCulled)
+		{
+			ShadeClusterVertices(RenderObject, LODIndex, VertexShader, LocalToWorld, LocalToProjection, Transformed);
+		}
+		else
+		{
+			ShadeVertices(Vertices, VertexShader, LocalToWorld, LocalToProjection, Transformed);
+		}
+	}
+
+	// 6 输出屏幕空间三角形或者线段
+	AssemblePrimitives(RenderObject, LODIndex, LocalToWorld, PixelShader, Transformed, bClustersCulled);
+}
+
+void USoftRenderer::DrawInstances(const FRenderObjectInstances& Instances)
+{
+	URenderObject* RenderObject = Instances.RenderObject;
+	
+	// 1 所有实例共用渲染对象的着色器
+	UVertexShader* VertexShader;
+	UPixelShader* PixelShader;
+	if (!PrepareShaders(RenderObject, VertexShader, PixelShader))
+		return;
+
+	// 2 顶点变换的输出缓冲按顶点最多的一级模型分配一次，所有实例轮流使用
+	//    图元装配时屏幕坐标已经复制到图元中，下一个实例可以直接覆盖上一个实例的变换结果
+	int32 MaxNumVertices = 0;
+	for (int32 LODIndex = 0, NumLODs = RenderObject->GetNumLODs(); LODIndex < NumLODs; ++LODIndex)
+	{
+		MaxNumVertices = FMath::Max(MaxNumVertices, RenderObject->GetLODVertices(LODIndex).Num());
+	}
+	const int32 NumPaddedVertices = Align(MaxNumVertices, 4);
+
+	FTransformedVertices Buffers;
+	Buffers.ClipPos.X = FrameArena.AllocateArray<float>(NumPaddedVertices, 16);
+	Buffers.ClipPos.Y = FrameArena.AllocateArray<float>(NumPaddedVertices, 16);
+	Buffers.ClipPos.Z = FrameArena.AllocateArray<float>(NumPaddedVertices, 16);
+	Buffers.ClipPos.W = FrameArena.AllocateArray<float>(NumPaddedVertices, 16);
+	Buffers.ScreenPos = FrameArena.AllocateArray<FVector2D>(MaxNumVertices);
+	Buffers.Depth = FrameArena.AllocateArray<float>(MaxNumVertices);
+	Buffers.OutCodes = FrameArena.AllocateArray<uint32>(MaxNumVertices);
+
+	const bool bOcclusionCulling = IsOcclusionCullingActive();
+	for (const FTransform& InstanceTransform : Instances.InstanceTransforms)
+	{
+		// 3 每个实例单独做视锥剔除和遮挡剔除
+		const FMatrix LocalToWorld = InstanceTransform.ToMatrixWithScale();
+		if (IsOutsideFrustum(RenderObject, LocalToWorld))
+		{
+			++Stats.NumFrustumCulledObjects;
 			continue;
+		}
+
+		const FMatrix LocalToProjection = LocalToWorld * CachedWorldToProjectionMatrix;
+		if (bOcclusionCulling && IsOccluded(RenderObject, LocalToProjection))
+		{
+			++Stats.NumOccludedObjects;
+			continue;
+		}
+
+		// 4 共用的顶点数据用实例的矩阵变换后装配图元，同一组实例连续处理，模型数据一直留在CPU缓存中
+		const int32 LODIndex = SelectLODIndex(RenderObject, LocalToWorld, LocalToProjection);
+		const TArray<FRenderObjectVertex>& Vertices = RenderObject->GetLODVertices(LODIndex);
+		const FTransformedVertices Transformed = Buffers.Slice(0, Vertices.Num());
 		
-		DrawPrimitive(RenderObject, WorldToViewMatrix, ProjectMatrix);
+		ShadeVertices(Vertices, VertexShader, LocalToWorld, LocalToProjection, Transformed);
+		AssemblePrimitives(RenderObject, LODIndex, LocalToWorld, PixelShader, Transformed);
+
+		if (bOcclusionCulling)
+		{
+			ConditionalFlushForOcclusion();
+		}
 	}
 }
 
-void USoftRenderer::DrawPrimitive(URenderObject* RenderObject, const FMatrix& WorldToViewMatrix, const FMatrix& ProjectionMatrix) const
+bool USoftRenderer::PrepareShaders(URenderObject* RenderObject, UVertexShader*& OutVertexShader, UPixelShader*& OutPixelShader) const
 {
-	// 1 获取顶点着色器
-	UVertexShader* VertexShader = RenderObject->Material.VertexShader;
-	if (!IsValid(VertexShader) && RenderObject->Material.VertexShaderClass)
+	OutVertexShader = RenderObject->Material.VertexShader;
+	OutPixelShader = nullptr;
+	
+	if (!IsValid(OutVertexShader) && RenderObject->Material.VertexShaderClass)
 	{
 		RenderObject->Material.VertexShader = NewObject<UVertexShader>(RenderObject, RenderObject->Material.VertexShaderClass);
-		VertexShader = RenderObject->Material.VertexShader;
+		OutVertexShader = RenderObject->Material.VertexShader;
 	}
 
-	if (!IsValid(VertexShader))
+	if (!IsValid(OutVertexShader))
+		return false;
+
+	// 实体模式还需要像素着色器，没有指定时使用默认的像素着色器
+	if (RenderMode == ESoftRendererRenderMode::Solid)
+	{
+		OutPixelShader = RenderObject->Material.PixelShader;
+		if (!IsValid(OutPixelShader))
+		{
+			const TSubclassOf<UPixelShader> PixelShaderClass = RenderObject->Material.PixelShaderClass ? RenderObject->Material.PixelShaderClass : TSubclassOf<UPixelShader>(UPixelShader::StaticClass());
+			RenderObject->Material.PixelShader = NewObject<UPixelShader>(RenderObject, PixelShaderClass);
+			OutPixelShader = RenderObject->Material.PixelShader;
+		}
+	}
+	return true;
+}
+
+void USoftRenderer::ShadeVertices(TArrayView<const FRenderObjectVertex> Vertices, UVertexShader* VertexShader, const FMatrix& LocalToWorld, const FMatrix& LocalToProjection, const FTransformedVertices& Transformed)
+{
+	SCOPE_SOFTRENDERER_STAGE(STAT_SoftRenderer_VertexShading, Stats.VertexShadingTime);
+	
+	const FVertexShaderBatchOutput& ClipPos = Transformed.ClipPos;
+	const int32 NumVertices = Vertices.Num();
+	Stats.NumVerticesShaded += NumVertices;
+
+	// 1 执行顶点着色器输出齐次裁剪空间坐标
+	if (VertexShader->SupportsVertexShaderBatch())
+	{
+		VertexShader->RunVertexShaderBatch(Vertices, LocalToProjection, ClipPos);
+	}
+	else
+	{
+		// 自定义的顶点着色器，逐个顶点执行
+		for (int32 Index = 0; Index < NumVertices; ++Index)
+		{
+			const FVector4 VertexPos = VertexShader->RunVertexShader(Vertices[Index], LocalToWorld, CachedWorldToViewMatrix, CachedProjectionMatrix);
+			ClipPos.X[Index] = VertexPos.X;
+			ClipPos.Y[Index] = VertexPos.Y;
+			ClipPos.Z[Index] = VertexPos.Z;
+			ClipPos.W[Index] = VertexPos.W;
+		}
+	}
+
+	// 2 计算每个顶点的OutCode
+	for (int32 Index = 0; Index < NumVertices; ++Index)
+	{
+		Transformed.OutCodes[Index] = Clipper.ComputeOutCode(ClipPos.X[Index], ClipPos.Y[Index], ClipPos.Z[Index], ClipPos.W[Index]);
+	}
+
+	// 3 透视除法和视口变换，一次计算4个顶点，屏幕坐标按 (X, Y) 交错写入
+	//    在近平面后面或者保护带外的顶点算出的屏幕坐标没有意义，这些顶点所在的三角形会先裁剪再重新计算
+	static_assert(sizeof(FVector2D) == 2 * sizeof(float), "Screen positions are written by the raster core as packed floats.");
+	SoftRasterCore::ProjectToScreen(ClipPos.X.GetData(), ClipPos.Y.GetData(), ClipPos.Z.GetData(), ClipPos.W.GetData(), NumVertices,
+		ViewportSize.X, ViewportSize.Y, reinterpret_cast<float*>(Transformed.ScreenPos.GetData()), Transformed.Depth.GetData());
+}
+
+bool USoftRenderer::CullClusters(URenderObject* RenderObject, int32 LODIndex, const UVertexShader* VertexShader, const FMatrix& LocalToWorld)
+{
+	VisibleClusters.Reset();
+
+	// 线框模式要画出所有的边，自定义的顶点着色器可能移动顶点，导入时计算的包围球和法线锥都不再可靠
+	const TArrayView<const FRenderObjectCluster> Clusters = RenderObject->GetLODClusters(LODIndex);
+	if (RenderMode != ESoftRendererRenderMode::Solid || Clusters.Num() == 0 || !VertexShader->SupportsVertexShaderBatch())
+		return false;
+
+	// 1 背面剔除在本地空间进行，相机的位置和朝向变换到本地空间，法线锥不需要变换
+	//    仿射变换不改变相机在三角形平面哪一侧，镜像变换下同样成立
+	const bool bBackfaceCulling = RenderObject->Material.bBackfaceCulling;
+	const bool bOrthographic = CachedCamera.ProjectionMode == ESoftRendererCameraProjectionMode::Orthographic;
+	const FMatrix WorldToLocal = bBackfaceCulling ? LocalToWorld.Inverse() : FMatrix::Identity;
+	const FVector LocalViewOrigin = WorldToLocal.TransformPosition(CachedCamera.ViewOrigin);
+	const FVector LocalViewDirection = WorldToLocal.TransformVector(CachedCamera.Rotation.Vector()).GetSafeNormal();
+
+	// 非均匀缩放时包围球的半径按最大的缩放放大
+	const float RadiusScale = LocalToWorld.GetMaximumAxisScale();
+	
+	for (int32 ClusterIndex = 0, NumClusters = Clusters.Num(); ClusterIndex < NumClusters; ++ClusterIndex)
+	{
+		const FRenderObjectCluster& Cluster = Clusters[ClusterIndex];
+
+		// 2 包围球变换到世界空间做视锥剔除
+		bool bFullyInside = false;
+		if (!ViewFrustum.IntersectSphere(LocalToWorld.TransformPosition(Cluster.Center), Cluster.Radius * RadiusScale, bFullyInside))
+		{
+			++Stats.NumClustersCulled;
+			continue;
+		}
+
+		// 3 法线锥内的所有法线都背向包围球内的任意一点到相机的方向时，簇的三角形全部是背面
+		//    透视投影: dot(Center - ViewOrigin, Axis) >= Cutoff * |Center - ViewOrigin| + Radius
+		//    正交投影: 所有三角形的视线方向相同，dot(ViewDirection, Axis) >= Cutoff
+		if (bBackfaceCulling && Cluster.HasNormalCone())
+		{
+			const FVector ToCenter = Cluster.Center - LocalViewOrigin;
+			const bool bBackfacing = bOrthographic
+				? FVector::DotProduct(LocalViewDirection, Cluster.ConeAxis) >= Cluster.ConeCutoff
+				: FVector::DotProduct(ToCenter, Cluster.ConeAxis) >= Cluster.ConeCutoff * ToCenter.Size() + Cluster.Radius;
+			
+			if (bBackfacing)
+			{
+				++Stats.NumClustersCulled;
+				continue;
+			}
+		}
+
+		VisibleClusters.Add(ClusterIndex);
+	}
+
+	return VisibleClusters.Num() < Clusters.Num();
+}
+
+void USoftRenderer::ShadeClusterVertices(URenderObject* RenderObject, int32 LODIndex, UVertexShader* VertexShader, const FMatrix& LocalToWorld, const FMatrix& LocalToProjection, const FTransformedVertices& Transformed)
+{
+	// 两段用到的顶点之间没有用到的顶点不超过这个数时合并成一段
+	constexpr int32 MaxUnusedVertexGap = 8;
+	
+	const TArrayView<const FRenderObjectVertex> Vertices = RenderObject->GetLODVertices(LODIndex);
+	const TArrayView<const FRenderObjectCluster> Clusters = RenderObject->GetLODClusters(LODIndex);
+	const int32 NumVertices = Vertices.Num();
+
+	// 1 可见的簇的顶点范围合并成一个扫描范围，只清空和扫描这个范围的标记
+	//    顶点按第一次使用的顺序排列，每个簇的顶点范围基本上是连续的一段
+	int32 ScanBegin = NumVertices;
+	int32 ScanEnd = 0;
+	for (const int32 ClusterIndex : VisibleClusters)
+	{
+		const FRenderObjectCluster& Cluster = Clusters[ClusterIndex];
+		ScanBegin = FMath::Min(ScanBegin, FMath::Clamp(Cluster.FirstVertex, 0, NumVertices));
+		ScanEnd = FMath::Max(ScanEnd, FMath::Clamp(Cluster.FirstVertex + Cluster.NumVertices, 0, NumVertices));
+	}
+	if (ScanBegin >= ScanEnd)
 		return;
 
-	// 2 计算渲染对象的本地空间到时间空间的变换矩阵
-	const FMatrix LocalToWorld = RenderObject->GetLocalToWorld();
+	const TArrayView<uint8> VertexUsed = FrameArena.AllocateArray<uint8>(NumVertices);
+	FMemory::Memzero(VertexUsed.GetData() + ScanBegin, ScanEnd - ScanBegin);
+
+	// 2 标记可见的簇的三角形用到的顶点
+	const auto MarkUsedVertices = [&](const auto& Indices)
+	{
+		for (const int32 ClusterIndex : VisibleClusters)
+		{
+			const FRenderObjectCluster& Cluster = Clusters[ClusterIndex];
+			for (int32 Index = Cluster.FirstIndex, EndIndex = Cluster.FirstIndex + Cluster.NumIndices; Index < EndIndex; ++Index)
+			{
+				VertexUsed[Indices[Index]] = 1;
+			}
+		}
+	};
+
+	if (RenderObject->UsesCompactIndices(LODIndex))
+	{
+		MarkUsedVertices(RenderObject->GetLODCompactIndices(LODIndex));
+	}
+	else
+	{
+		MarkUsedVertices(RenderObject->GetLODIndices(LODIndex));
+	}
+
+	// 3 用到的顶点按连续的几段执行顶点着色器，每段的输出写到缓冲中对应的位置
+	//    透视除法按4个顶点一组对齐读取，段的起点向前对齐到4的倍数，终点向后对齐，输出缓冲按4对齐分配，不会越界
+	//    两段之间的间隔大于MaxUnusedVertexGap，对齐后也不会重叠
+	const auto ShadeRun = [&](int32 Begin, int32 End)
+	{
+		Begin = AlignDown(Begin, 4);
+		End = FMath::Min(Align(End, 4), NumVertices);
+		ShadeVertices(Vertices.Slice(Begin, End - Begin), VertexShader, LocalToWorld, LocalToProjection, Transformed.Slice(Begin, End - Begin));
+	};
 	
-	// 3 对每一个顶点执行顶点着色器程序
-	for (auto& Vertex : RenderObject->Vertices)
+	int32 RunBegin = INDEX_NONE;
+	int32 RunEnd = INDEX_NONE;
+	for (int32 Vertex = ScanBegin; Vertex < ScanEnd; ++Vertex)
 	{
-		Vertex.VertexPos = VertexShader->RunVertexShader(Vertex, LocalToWorld, WorldToViewMatrix, ProjectionMatrix);
+		if (!VertexUsed[Vertex])
+			continue;
 
-		// 透视除法, 齐次坐标空间 /w 归一化到NDC坐标系中 
-		Vertex.VertexPos *= 1 / Vertex.VertexPos.W;
+		if (RunBegin != INDEX_NONE && Vertex - RunEnd > MaxUnusedVertexGap)
+		{
+			ShadeRun(RunBegin, RunEnd);
+			RunBegin = INDEX_NONE;
+		}
 
-		// 计算屏幕坐标
-		Vertex.ScreenPos.X = (Vertex.VertexPos.X + 1.0f) * ViewportSize.X * 0.5f;
-		Vertex.ScreenPos.Y = (1.0f - Vertex.VertexPos.Y) * ViewportSize.Y * 0.5f;
+		if (RunBegin == INDEX_NONE)
+		{
+			RunBegin = Vertex;
+		}
+		RunEnd = Vertex + 1;
+	}
 
-		// 整数屏幕坐标：加 0.5 的偏移取屏幕像素方格中心对齐，其实就是四舍五入
-		Vertex.ScreenPosInPixels = FIntPoint( static_cast<int32>(Vertex.ScreenPos.X + 0.5f), static_cast<int32>(Vertex.ScreenPos.Y + 0.5f));
+	if (RunBegin != INDEX_NONE)
+	{
+		ShadeRun(RunBegin, RunEnd);
 	}
+}
+
+void USoftRenderer::AssemblePrimitives(URenderObject* RenderObject, int32 LODIndex, const FMatrix& LocalToWorld, UPixelShader* PixelShader, const FTransformedVertices& Transformed, bool bVisibleClustersOnly)
+{
+	SCOPE_SOFTRENDERER_STAGE(STAT_SoftRenderer_PrimitiveAssembly, Stats.PrimitiveAssemblyTime);
+
+	const FVertexShaderBatchOutput& ClipPos = Transformed.ClipPos;
+	const TArrayView<FVector2D> ScreenPos = Transformed.ScreenPos;
+	const TArrayView<float> Depth = Transformed.Depth;
+	const TArrayView<uint32> OutCodes = Transformed.OutCodes;
 	
+	// 1 线框模式按去重后的边输出线段，相邻三角形共享的边只画一次
+	//    两个端点在同一个平面外侧的边直接丢弃，跨过近平面、远平面或者超出保护带的边裁剪后输出
 	if (RenderMode == ESoftRendererRenderMode::Wireframe)
 	{
-		for (int32 Index = 0, Count = RenderObject->Indices.Num() / 3; Index < Count; ++Index)
+		const TArray<FIntPoint>& Edges = RenderObject->GetUniqueEdges(LODIndex);
+		Stats.NumLinesSubmitted += Edges.Num();
+		
+		for (const FIntPoint& Edge : Edges)
+		{
+			const uint32 OutCode0 = OutCodes[Edge.X];
+			const uint32 OutCode1 = OutCodes[Edge.Y];
+			if (OutCode0 & OutCode1 & FClipper::OutCode_RejectMask)
+			{
+				++Stats.NumLinesCulled;
+				continue;
+			}
+
+			const uint32 ClipPlanes = (OutCode0 | OutCode1) & FClipper::OutCode_ClipMask;
+			if (ClipPlanes == 0)
+			{
+				FRasterLine& Line = RasterLines.AddDefaulted_GetRef();
+				Line.ScreenPos[0] = ScreenPos[Edge.X];
+				Line.ScreenPos[1] = ScreenPos[Edge.Y];
+				continue;
+			}
+
+			// 在齐次裁剪空间裁剪，裁剪后的端点重新做透视除法和视口变换
+			FVector4 SegmentClipPos[2] =
+			{
+				FVector4(ClipPos.X[Edge.X], ClipPos.Y[Edge.X], ClipPos.Z[Edge.X], ClipPos.W[Edge.X]),
+				FVector4(ClipPos.X[Edge.Y], ClipPos.Y[Edge.Y], ClipPos.Z[Edge.Y], ClipPos.W[Edge.Y])
+			};
+			if (!Clipper.ClipSegment(SegmentClipPos[0], SegmentClipPos[1], ClipPlanes))
+			{
+				++Stats.NumLinesCulled;
+				continue;
+			}
+
+			FRasterLine& Line = RasterLines.AddDefaulted_GetRef();
+			for (int32 Corner = 0; Corner < 2; ++Corner)
+			{
+				const FVector4& VertexPos = SegmentClipPos[Corner];
+				const float InvW = 1.0f / VertexPos.W;
+				Line.ScreenPos[Corner] = FVector2D(
+					(VertexPos.X * InvW + 1.0f) * ViewportSize.X * 0.5f,
+					(1.0f - VertexPos.Y * InvW) * ViewportSize.Y * 0.5f);
+			}
+		}
+		return;
+	}
+	
+	// 2 实体模式输出屏幕空间三角形，每个三角形由索引中连续的3个索引构成，int32和uint16两种索引格式共用同一份代码
+	//    三个顶点在同一个平面外侧的三角形直接丢弃，跨过近平面、远平面或者超出保护带的三角形裁剪后输出
+	//    开启背面剔除时，屏幕上(Y向下)顶点顺时针排列的是正面，镜像变换会让绕序颠倒
+	const bool bBackfaceCulling = RenderObject->Material.bBackfaceCulling;
+	const float FrontFaceSign = bBackfaceCulling && LocalToWorld.Determinant() < 0.0f ? -1.0f : 1.0f;
+	
+	const auto EmitTriangles = [&](const auto& Indices, int32 FirstIndex, int32 NumIndices)
+	{
+		Stats.NumTrianglesSubmitted += NumIndices / 3;
+		
+		for (int32 Index = FirstIndex / 3, Count = (FirstIndex + NumIndices) / 3; Index < Count; ++Index)
 		{
-			const auto& Vertex1ScreenPos = RenderObject->Vertices[RenderObject->Indices[Index]].ScreenPosInPixels;
-			const auto& Vertex2ScreenPos = RenderObject->Vertices[RenderObject->Indices[Index + 1]].ScreenPosInPixels;
-			const auto& Vertex3ScreenPos = RenderObject->Vertices[RenderObject->Indices[Index + 2]].ScreenPosInPixels;
+			const int32 VertexIndices[3] = { Indices[Index * 3], Indices[Index * 3 + 1], Indices[Index * 3 + 2] };
+			const uint32 OutCode0 = OutCodes[VertexIndices[0]];
+			const uint32 OutCode1 = OutCodes[VertexIndices[1]];
+			const uint32 OutCode2 = OutCodes[VertexIndices[2]];
+
+			if (OutCode0 & OutCode1 & OutCode2 & FClipper::OutCode_RejectMask)
+			{
+				++Stats.NumTrianglesCulled;
+				continue;
+			}
+
+			const uint32 ClipPlanes = (OutCode0 | OutCode1 | OutCode2) & FClipper::OutCode_ClipMask;
+			if (ClipPlanes == 0)
+			{
+				// 不需要裁剪，直接使用顶点的屏幕坐标
+				if (bBackfaceCulling)
+				{
+					const FVector2D& ScreenPos0 = ScreenPos[VertexIndices[0]];
+					if (((ScreenPos[VertexIndices[1]] - ScreenPos0) ^ (ScreenPos[VertexIndices[2]] - ScreenPos0)) * FrontFaceSign <= 0.0f)
+					{
+						++Stats.NumTrianglesCulled;
+						continue;
+					}
+				}
+				
+				FRasterTriangle& Triangle = RasterTriangles.AddDefaulted_GetRef();
+				for (int32 Corner = 0; Corner < 3; ++Corner)
+				{
+					const int32 VertexIndex = VertexIndices[Corner];
+					Triangle.ScreenPosInPixels[Corner] = ScreenPosToPixel(ScreenPos[VertexIndex]);
+					Triangle.ScreenPos[Corner] = ScreenPos[VertexIndex];
+					Triangle.Depth[Corner] = Depth[VertexIndex];
+				}
+				Triangle.PixelShader = PixelShader;
+				continue;
+			}
+
+			// 在齐次裁剪空间裁剪，得到的凸多边形重新做透视除法和视口变换
+			FVector4 TriangleClipPos[3];
+			for (int32 Corner = 0; Corner < 3; ++Corner)
+			{
+				const int32 VertexIndex = VertexIndices[Corner];
+				TriangleClipPos[Corner] = FVector4(ClipPos.X[VertexIndex], ClipPos.Y[VertexIndex], ClipPos.Z[VertexIndex], ClipPos.W[VertexIndex]);
+			}
+
+			FVector4 PolygonClipPos[FClipper::MaxPolygonVertices];
+			const int32 NumPolygonVertices = Clipper.ClipTriangle(TriangleClipPos, ClipPlanes, PolygonClipPos);
+			if (NumPolygonVertices < 3)
+			{
+				++Stats.NumTrianglesCulled;
+				continue;
+			}
+
+			FVector2D PolygonScreenPos[FClipper::MaxPolygonVertices];
+			float PolygonDepth[FClipper::MaxPolygonVertices];
+			for (int32 PolygonIndex = 0; PolygonIndex < NumPolygonVertices; ++PolygonIndex)
+			{
+				const FVector4& VertexPos = PolygonClipPos[PolygonIndex];
+				const float InvW = 1.0f / VertexPos.W;
+				PolygonScreenPos[PolygonIndex] = FVector2D(
+					(VertexPos.X * InvW + 1.0f) * ViewportSize.X * 0.5f,
+					(1.0f - VertexPos.Y * InvW) * ViewportSize.Y * 0.5f);
+				PolygonDepth[PolygonIndex] = VertexPos.Z * InvW;
+			}
+
+			// 裁剪后的凸多边形和原三角形绕序相同，用有向面积判断正反面，不受近平面后面的顶点影响
+			if (bBackfaceCulling)
+			{
+				float DoubleArea = 0.0f;
+				for (int32 PolygonIndex = 0; PolygonIndex < NumPolygonVertices; ++PolygonIndex)
+				{
+					DoubleArea += PolygonScreenPos[PolygonIndex] ^ PolygonScreenPos[PolygonIndex + 1 < NumPolygonVertices ? PolygonIndex + 1 : 0];
+				}
+				if (DoubleArea * FrontFaceSign <= 0.0f)
+				{
+					++Stats.NumTrianglesCulled;
+					continue;
+				}
+			}
+
+			// 凸多边形以第0个顶点扇形三角化
+			for (int32 FanIndex = 1; FanIndex + 1 < NumPolygonVertices; ++FanIndex)
+			{
+				const int32 PolygonIndices[3] = { 0, FanIndex, FanIndex + 1 };
 			
-			FrameBuffer->DrawLine(Vertex1ScreenPos.X, Vertex1ScreenPos.Y, Vertex2ScreenPos.X, Vertex2ScreenPos.Y);
-			FrameBuffer->DrawLine(Vertex2ScreenPos.X, Vertex2ScreenPos.Y, Vertex3ScreenPos.X, Vertex3ScreenPos.Y);
-			FrameBuffer->DrawLine(Vertex1ScreenPos.X, Vertex1ScreenPos.Y, Vertex3ScreenPos.X, Vertex3ScreenPos.Y);
+				FRasterTriangle& Triangle = RasterTriangles.AddDefaulted_GetRef();
+				for (int32 Corner = 0; Corner < 3; ++Corner)
+				{
+					const int32 PolygonIndex = PolygonIndices[Corner];
+					Triangle.ScreenPosInPixels[Corner] = ScreenPosToPixel(PolygonScreenPos[PolygonIndex]);
+					Triangle.ScreenPos[Corner] = PolygonScreenPos[PolygonIndex];
+					Triangle.Depth[Corner] = PolygonDepth[PolygonIndex];
+				}
+				Triangle.PixelShader = PixelShader;
+			}
+		}
+	};
+
+	// 有簇被剔除时只装配可见的簇，每个簇的三角形在索引中是连续的一段
+	const auto EmitClusters = [&](const auto& Indices)
+	{
+		if (!bVisibleClustersOnly)
+		{
+			EmitTriangles(Indices, 0, Indices.Num());
+			return;
+		}
+
+		const TArrayView<const FRenderObjectCluster> Clusters = RenderObject->GetLODClusters(LODIndex);
+		for (const int32 ClusterIndex : VisibleClusters)
+		{
+			EmitTriangles(Indices, Clusters[ClusterIndex].FirstIndex, Clusters[ClusterIndex].NumIndices);
+		}
+	};
+
+	if (RenderObject->UsesCompactIndices(LODIndex))
+	{
+		EmitClusters(RenderObject->GetLODCompactIndices(LODIndex));
+	}
+	else
+	{
+		EmitClusters(RenderObject->GetLODIndices(LODIndex));
+	}
+}
+
+void USoftRenderer::FlushRasterPrimitives()
+{
+	if (RasterTriangles.Num() == 0 && RasterLines.Num() == 0)
+		return;
+
+	SCOPE_SOFTRENDERER_STAGE(STAT_SoftRenderer_Raster, Stats.RasterTime);
+	
+	// 一帧只有一种渲染模式，线框模式只有线段，实体模式只有三角形
+	const bool bRasterLines = RasterLines.Num() > 0;
+	const int32 NumPrimitives = bRasterLines ? RasterLines.Num() : RasterTriangles.Num();
+	
+	// 分块光栅化时多个工作线程同时累加写入的像素个数
+	FThreadSafeCounter64 NumPixelsWritten;
+	const auto RasterizeFunction = [this, bRasterLines, &NumPixelsWritten](int32 PrimitiveIndex, const FIntRect& ClipRect)
+	{
+		const int32 NumPixels = bRasterLines
+			? RasterizeLine(RasterLines[PrimitiveIndex], ClipRect)
+			: RasterizeTriangle(RasterTriangles[PrimitiveIndex], ClipRect);
+		
+		if (NumPixels > 0)
+		{
+			NumPixelsWritten.Add(NumPixels);
+		}
+	};
+
+	if (bUseTiledRasterizer || bPartialRedraw)
+	{
+		// 图元分配到屏幕Tile中，多个工作线程并行光栅化，每个线程只写自己Tile内的像素
+		// 局部重绘时只分配到需要重绘的Tile，其他Tile保留上一帧的内容
+		const TBitArray<>* ActiveTiles = bPartialRedraw ? &DirtyTiles : nullptr;
+		TileRasterizer.Init(FrameBuffer->GetWidth(), FrameBuffer->GetHeight());
+		if (bRasterLines)
+		{
+			TileRasterizer.BinLines(RasterLines, ActiveTiles);
+		}
+		else
+		{
+			TileRasterizer.BinTriangles(RasterTriangles, ActiveTiles);
+		}
+		TileRasterizer.Rasterize(RasterizeFunction);
+	}
+	else
+	{
+		const FIntRect FullRect(0, 0, FrameBuffer->GetWidth(), FrameBuffer->GetHeight());
+		for (int32 PrimitiveIndex = 0; PrimitiveIndex < NumPrimitives; ++PrimitiveIndex)
+		{
+			RasterizeFunction(PrimitiveIndex, FullRect);
+		}
+	}
+	Stats.NumPixelsWritten += static_cast<int32>(NumPixelsWritten.GetValue());
+
+	// 用新写入的深度重建层次深度缓冲中被覆盖的Tile
+	if (IsOcclusionCullingActive())
+	{
+		for (const FRasterTriangle& Triangle : RasterTriangles)
+		{
+			HierarchicalZBuffer.MarkDirty(Triangle.GetPixelBounds());
 		}
+		HierarchicalZBuffer.Update(FrameBuffer);
 	}
+
+	RasterTriangles.Reset();
+	RasterLines.Reset();
+}
+
+void USoftRenderer::ConditionalFlushForOcclusion()
+{
+	// 遮挡剔除需要已经画好的深度，三角形攒够一批就先光栅化
+	if (RasterTriangles.Num() < OcclusionFlushThreshold)
+		return;
+
+	FlushRasterPrimitives();
+	OcclusionFlushThreshold = FMath::Min(OcclusionFlushThreshold * 2, MaxOcclusionFlushTriangles);
+}
+
+int32 USoftRenderer::RasterizeTriangle(const FRasterTriangle& Triangle, const FIntRect& ClipRect) const
+{
+	const UPixelShader* PixelShader = Triangle.PixelShader;
+	return FrameBuffer->DrawTriangle(Triangle.ScreenPos, Triangle.Depth, [PixelShader](const FPixelShaderInput& Input)
+	{
+		return PixelShader->RunPixelShader(Input).ToFColor(false).DWColor();
+	}, ClipRect);
+}
+
+int32 USoftRenderer::RasterizeLine(const FRasterLine& Line, const FIntRect& ClipRect) const
+{
+	// 线段先裁剪到屏幕范围(向外多留1个像素)再画，画线的开销只和可见的像素有关
+	// 所有Tile使用相同的范围裁剪，同一条线在不同Tile中画出的像素可以无缝拼接
+	const FBox2D ScreenRect(FVector2D(-1.0f, -1.0f), FVector2D(FrameBuffer->GetWidth() + 1.0f, FrameBuffer->GetHeight() + 1.0f));
+	
+	FVector2D Start = Line.ScreenPos[0];
+	FVector2D End = Line.ScreenPos[1];
+	if (!FClipper::ClipLine(Start, End, ScreenRect))
+		return 0;
+
+	const FIntPoint StartPixel = ScreenPosToPixel(Start);
+	const FIntPoint EndPixel = ScreenPosToPixel(End);
+	return FrameBuffer->DrawLine(StartPixel.X, StartPixel.Y, EndPixel.X, EndPixel.Y, PackedWireframeColor, ClipRect);
 }
 
 FMatrix USoftRenderer::CalculateProjectionMatrix() const
@@ -140,9 +1365,24 @@ FMatrix USoftRenderer::CalculateProjectionMatrix() const
 		YAxisMultiplier = 1.0f;
 	}
 
-	FMatrix ProjectionMatrix;
+	FMatrix ProjectionMatrix = FMatrix::Identity;
 	
-	if (RenderCamera.ProjectionMode == ESoftRendererCameraProjectionMode::Orthographic)
+	if (RenderCamera.ProjectionMode == ESoftRendererCameraProjectionMode::Perspective)
+	{
+		const float HalfFOV = FMath::Max(0.001f, RenderCamera.FOV) * PI / 360.0f;
+		const float NearPlane = FMath::Max(0.01f, RenderCamera.NearClipPlane);
+
+		// 近平面和远平面传入相同的值时构造远平面在无穷远处的矩阵，NDC深度 = NearPlane / 视空间深度
+		ProjectionMatrix = FReversedZPerspectiveMatrix(
+				HalfFOV,
+				HalfFOV,
+				XAxisMultiplier,
+				YAxisMultiplier,
+				NearPlane,
+				NearPlane
+				);
+	}
+	else if (RenderCamera.ProjectionMode == ESoftRendererCameraProjectionMode::Orthographic)
 	{
 		const float OrthoWidth = RenderCamera.OrthoWidth / 2.0f * XAxisMultiplier;
 		const float OrthoHeight = RenderCamera.OrthoWidth / 2.0f / YAxisMultiplier;
@@ -153,7 +1393,7 @@ FMatrix USoftRenderer::CalculateProjectionMatrix() const
 		constexpr float ZScale = 1.0f / (FarPlane - NearPlane);
 		constexpr float ZOffset = -NearPlane;
 
-		ProjectionMatrix = FOrthoMatrix(
+		ProjectionMatrix = FReversedZOrthoMatrix(
 				OrthoWidth, 
 				OrthoHeight,
 				ZScale,
@@ -164,4 +1404,105 @@ FMatrix USoftRenderer::CalculateProjectionMatrix() const
 	return ProjectionMatrix;
 }
 
+bool USoftRenderer::IsOutsideFrustum(URenderObject* RenderObject, const FMatrix& LocalToWorld) const
+{
+	const FBox& LocalBounds = RenderObject->GetLocalBounds();
+	if (!LocalBounds.IsValid)
+		return true;
+
+	// 先用包围球快速测试，大部分物体在这里就能确定完全在外面或者完全在里面
+	const FSphere WorldSphere = RenderObject->GetLocalBoundingSphere().TransformBy(LocalToWorld);
+	bool bFullyInside = false;
+	if (!ViewFrustum.IntersectSphere(WorldSphere.Center, WorldSphere.W, bFullyInside))
+		return true;
+
+	if (bFullyInside)
+		return false;
+
+	// 包围球和平面相交时，再用更紧的世界空间包围盒测试
+	const FBox WorldBounds = LocalBounds.TransformBy(LocalToWorld);
+	return !ViewFrustum.IntersectBox(WorldBounds.GetCenter(), WorldBounds.GetExtent());
+}
+
+bool USoftRenderer::CalculateScreenBounds(URenderObject* RenderObject, const FMatrix& LocalToProjection, const FIntPoint& InViewportSize, FIntRect& OutScreenRect, float& OutNearestDepth)
+{
+	const FBox& LocalBounds = RenderObject->GetLocalBounds();
+	if (!LocalBounds.IsValid)
+		return false;
+
+	// 包围盒的8个角点投影到屏幕上，求出屏幕范围和离相机最近的深度
+	FVector2D ScreenMin(MAX_flt, MAX_flt);
+	FVector2D ScreenMax(-MAX_flt, -MAX_flt);
+	float NearestDepth = -MAX_flt;
+	
+	for (int32 Corner = 0; Corner < 8; ++Corner)
+	{
+		const FVector LocalCorner(
+			(Corner & 1) ? LocalBounds.Max.X : LocalBounds.Min.X,
+			(Corner & 2) ? LocalBounds.Max.Y : LocalBounds.Min.Y,
+			(Corner & 4) ? LocalBounds.Max.Z : LocalBounds.Min.Z);
+		const FVector4 ClipCorner = LocalToProjection.TransformPosition(LocalCorner);
+
+		// 有角点在相机平面后面时得不到可靠的屏幕范围
+		if (ClipCorner.W <= KINDA_SMALL_NUMBER)
+			return false;
+
+		const float InvW = 1.0f / ClipCorner.W;
+		const FVector2D ScreenCorner(
+			(ClipCorner.X * InvW + 1.0f) * InViewportSize.X * 0.5f,
+			(1.0f - ClipCorner.Y * InvW) * InViewportSize.Y * 0.5f);
+		
+		ScreenMin = ScreenMin.ComponentMin(ScreenCorner);
+		ScreenMax = ScreenMax.ComponentMax(ScreenCorner);
+		NearestDepth = FMath::Max(NearestDepth, ClipCorner.Z * InvW);
+	}
+
+	// 屏幕范围向外扩展1个像素，和光栅化时三角形的像素范围保持一致
+	constexpr float MaxScreenCoordinate = 1 << 20;
+	OutScreenRect = FIntRect(
+		FMath::FloorToInt(FMath::Max(ScreenMin.X, -MaxScreenCoordinate)) - 1,
+		FMath::FloorToInt(FMath::Max(ScreenMin.Y, -MaxScreenCoordinate)) - 1,
+		FMath::CeilToInt(FMath::Min(ScreenMax.X, MaxScreenCoordinate)) + 2,
+		FMath::CeilToInt(FMath::Min(ScreenMax.Y, MaxScreenCoordinate)) + 2);
+	OutNearestDepth = NearestDepth;
+	return true;
+}
+
+float USoftRenderer::CalculateScreenSize(URenderObject* RenderObject, const FMatrix& LocalToWorld, const FMatrix& LocalToProjection) const
+{
+	const FSphere& LocalSphere = RenderObject->GetLocalBoundingSphere();
+	const float WorldRadius = LocalSphere.W * LocalToWorld.GetMaximumAxisScale();
+
+	// 投影矩阵的缩放项把视空间的长度换算到[-1, 1]的标准化设备坐标，正交投影的W恒为1
+	// 和UE的ComputeBoundsScreenSize一样取水平和垂直方向中较大的一个，W至少取1避免相机在包围球内时除以很小的数
+	const float ClipCenterW = LocalToProjection.TransformPosition(LocalSphere.Center).W;
+	const float ScreenMultiple = FMath::Max(CachedProjectionMatrix.M[0][0], CachedProjectionMatrix.M[1][1]);
+	return ScreenMultiple * WorldRadius / FMath::Max(ClipCenterW, 1.0f);
+}
+
+float USoftRenderer::CalculateNearestViewDistance(URenderObject* RenderObject, const FMatrix& LocalToWorld) const
+{
+	// 包围球中心沿相机朝向的距离减去半径，透视投影和正交投影都适用
+	const FSphere& LocalSphere = RenderObject->GetLocalBoundingSphere();
+	const FVector Center = LocalToWorld.TransformPosition(LocalSphere.Center);
+	return FVector::DotProduct(Center - CachedCamera.ViewOrigin, CachedCamera.Rotation.Vector()) - LocalSphere.W * LocalToWorld.GetMaximumAxisScale();
+}
+
+bool USoftRenderer::IsOccluded(URenderObject* RenderObject, const FMatrix& LocalToProjection)
+{
+	// 得不到可靠的屏幕范围时不剔除
+	FIntRect ScreenRect;
+	float NearestDepth;
+	if (!CalculateScreenBounds(RenderObject, LocalToProjection, ViewportSize, ScreenRect, NearestDepth))
+		return false;
+
+	return HierarchicalZBuffer.IsOccluded(ScreenRect, NearestDepth);
+}
+
+bool USoftRenderer::IsOcclusionCullingActive() const
+{
+	// 线框模式不写深度，无法遮挡剔除
+	return bEnableOcclusionCulling && RenderMode == ESoftRendererRenderMode::Solid;
+}
+
 /////////////////////////////////////////////////////
@@ -0,0 +1,132 @@
+﻿#include "SoftRendererCommandlet.h"
+#include "SoftRenderer.h"
+#include "SoftRendererModule.h"
+#include "FrameSequenceWriter.h"
+#include "Misc/Paths.h"
+
+/////////////////////////////////////////////////////
+// USoftRendererRenderCommandlet
+
+USoftRendererRenderCommandlet::USoftRendererRenderCommandlet(const FObjectInitializer& ObjectInitializer)
+	: Super(ObjectInitializer)
+{
+	IsClient = false;
+	IsServer = false;
+	IsEditor = true;
+	LogToConsole = true;
+	
+	HelpDescription = TEXT("Renders a RenderScene offscreen with the software renderer and writes the frames as PNG or PPM files.");
+	HelpUsage = TEXT("-run=SoftRendererRender -Scene=/Game/Path/Scene.Scene_C [-Output=Dir] [-Frames=N] [-Format=png|ppm] [-Width=W] [-Height=H] [-Mode=Wireframe|Solid] [-Orbit=Degrees] [-Pitch=Degrees]");
+}
+
+int32 USoftRendererRenderCommandlet::Main(const FString& Params)
+{
+	// 1 解析参数
+	FString ScenePath;
+	if (!FParse::Value(*Params, TEXT("Scene="), ScenePath))
+	{
+		UE_LOG(LogSoftRenderer, Error, TEXT("Missing -Scene. Usage: %s"), *HelpUsage);
+		return 1;
+	}
+
+	UClass* SceneClass = LoadClass<URenderScene>(nullptr, *ScenePath);
+	if (SceneClass == nullptr)
+	{
+		UE_LOG(LogSoftRenderer, Error, TEXT("Failed to load RenderScene class %s."), *ScenePath);
+		return 1;
+	}
+
+	FString OutputDirectory = FPaths::Combine(FPaths::ProjectSavedDir(), TEXT("SoftRenderer"));
+	FParse::Value(*Params, TEXT("Output="), OutputDirectory);
+
+	int32 NumFrames = 1;
+	FParse::Value(*Params, TEXT("Frames="), NumFrames);
+	NumFrames = FMath::Max(1, NumFrames);
+
+	FString FormatName = TEXT("png");
+	FParse::Value(*Params, TEXT("Format="), FormatName);
+	const EFrameImageFormat Format = FormatName == TEXT("ppm") ? EFrameImageFormat::PPM : EFrameImageFormat::PNG;
+
+	FIntPoint ViewportSize(1280, 720);
+	FParse::Value(*Params, TEXT("Width="), ViewportSize.X);
+	FParse::Value(*Params, TEXT("Height="), ViewportSize.Y);
+	ViewportSize = ViewportSize.ComponentMax(FIntPoint(2, 2));
+
+	FString ModeName = TEXT("Wireframe");
+	FParse::Value(*Params, TEXT("Mode="), ModeName);
+
+	float OrbitDegrees = 0.0f;
+	FParse::Value(*Params, TEXT("Orbit="), OrbitDegrees);
+
+	float Pitch = -20.0f;
+	FParse::Value(*Params, TEXT("Pitch="), Pitch);
+
+	// 2 创建渲染器和场景，离屏渲染不需要上传纹理
+	USoftRenderer* Renderer = NewObject<USoftRenderer>();
+	Renderer->ViewportSize = ViewportSize;
+	Renderer->RenderMode = ModeName == TEXT("Solid") ? ESoftRendererRenderMode::Solid : ESoftRendererRenderMode::Wireframe;
+	Renderer->RenderScene = NewObject<URenderScene>(Renderer, SceneClass);
+	Renderer->InitRenderer();
+
+	// 3 计算整个场景的包围球，透视相机的垂直视场角刚好容纳包围球
+	FBox SceneBounds(ForceInit);
+	for (URenderObject* RenderObject : Renderer->RenderScene->OpaqueRenderObjects)
+	{
+		if (IsValid(RenderObject))
+		{
+			RenderObject->ConditionalLoadMeshData();
+			const FBox& LocalBounds = RenderObject->GetLocalBounds();
+			if (LocalBounds.IsValid)
+			{
+				SceneBounds += LocalBounds.TransformBy(RenderObject->GetLocalToWorld());
+			}
+		}
+	}
+	for (const FRenderObjectInstances& Instances : Renderer->RenderScene->InstancedRenderObjects)
+	{
+		if (IsValid(Instances.RenderObject))
+		{
+			Instances.RenderObject->ConditionalLoadMeshData();
+			const FBox& LocalBounds = Instances.RenderObject->GetLocalBounds();
+			if (LocalBounds.IsValid)
+			{
+				for (const FTransform& InstanceTransform : Instances.InstanceTransforms)
+				{
+					SceneBounds += LocalBounds.TransformBy(InstanceTransform);
+				}
+			}
+		}
+	}
+	
+	const FVector SceneCenter = SceneBounds.IsValid ? SceneBounds.GetCenter() : FVector::ZeroVector;
+	const float SceneRadius = SceneBounds.IsValid ? FMath::Max(SceneBounds.GetExtent().Size(), 1.0f) : 500.0f;
+
+	FSoftRendererCamera& Camera = Renderer->RenderCamera;
+	Camera.ProjectionMode = ESoftRendererCameraProjectionMode::Perspective;
+	const float CameraDistance = SceneRadius / FMath::Sin(FMath::DegreesToRadians(Camera.FOV * 0.5f));
+	Camera.NearClipPlane = FMath::Max(0.01f, FMath::Min(Camera.NearClipPlane, (CameraDistance - SceneRadius) * 0.5f));
+
+	// 4 逐帧环绕场景渲染，编码和写文件在后台线程上进行
+	UE_LOG(LogSoftRenderer, Display, TEXT("Rendering %d frames of %s to %s."), NumFrames, *SceneClass->GetName(), *OutputDirectory);
+
+	FFrameSequenceWriter Writer(OutputDirectory, SceneClass->GetName(), Format);
+	for (int32 Frame = 0; Frame < NumFrames; ++Frame)
+	{
+		Camera.Rotation = FRotator(Pitch, OrbitDegrees * Frame / NumFrames, 0.0f);
+		Camera.ViewOrigin = SceneCenter - Camera.Rotation.Vector() * CameraDistance;
+
+		Renderer->Render();
+		Writer.AddFrame(Renderer->FrameBuffer);
+	}
+
+	if (!Writer.Flush())
+	{
+		UE_LOG(LogSoftRenderer, Error, TEXT("Some frames failed to write."));
+		return 1;
+	}
+
+	UE_LOG(LogSoftRenderer, Display, TEXT("Wrote %d frames."), Writer.GetNumFrames());
+	return 0;
+}
+
+/////////////////////////////////////////////////////
@@ -1,9 +1,29 @@
 ﻿#include "SoftRendererModule.h"
+#include "SoftRendererStats.h"
 
 #define LOCTEXT_NAMESPACE "FSoftRendererModule"
 
 DEFINE_LOG_CATEGORY(LogSoftRenderer);
 
+DEFINE_STAT(STAT_SoftRenderer_Render);
+DEFINE_STAT(STAT_SoftRenderer_Setup);
+DEFINE_STAT(STAT_SoftRenderer_Clear);
+DEFINE_STAT(STAT_SoftRenderer_VertexShading);
+DEFINE_STAT(STAT_SoftRenderer_PrimitiveAssembly);
+DEFINE_STAT(STAT_SoftRenderer_Raster);
+DEFINE_STAT(STAT_SoftRenderer_Upload);
+
+DEFINE_STAT(STAT_SoftRenderer_VerticesShaded);
+DEFINE_STAT(STAT_SoftRenderer_TrianglesSubmitted);
+DEFINE_STAT(STAT_SoftRenderer_TrianglesCulled);
+DEFINE_STAT(STAT_SoftRenderer_ClustersCulled);
+DEFINE_STAT(STAT_SoftRenderer_LinesSubmitted);
+DEFINE_STAT(STAT_SoftRenderer_LinesCulled);
+DEFINE_STAT(STAT_SoftRenderer_PixelsWritten);
+DEFINE_STAT(STAT_SoftRenderer_BytesUploaded);
+
+UE_TRACE_CHANNEL_DEFINE(SoftRendererChannel);
+
 void FSoftRendererModule::StartupModule()
 {
 	// This code will execute after your module is loaded into memory; the exact timing is specified in the .uplugin file per-module
@@ -0,0 +1,199 @@
+﻿#include "SoftRendererReferenceCommandlet.h"
+#include "SoftRendererReferenceScenes.h"
+#include "SoftRendererModule.h"
+#include "Dom/JsonObject.h"
+#include "Misc/FileHelper.h"
+#include "Misc/Paths.h"
+#include "Serialization/JsonSerializer.h"
+
+namespace SoftRendererReference
+{
+	/**
+	 * 渲染结果写成JSON，bHashes和bTimings分别决定是否写入图像哈希和帧耗时
+	 *    提交到版本库中的哈希基准只有哈希，和机器相关的帧耗时写到另外的文件
+	 *    bMerge为true时保留文件中这次没有运行的用例，用-Scene只更新部分场景的基准时不会丢掉其他场景
+	 */
+	static bool SaveResults(const FString& Filename, const TArray<FCaseResult>& Results, bool bHashes, bool bTimings, bool bMerge = false)
+	{
+		TSharedPtr<FJsonObject> Cases;
+		if (bMerge)
+		{
+			Cases = LoadBaseline(Filename);
+		}
+		if (!Cases.IsValid())
+		{
+			Cases = MakeShared<FJsonObject>();
+		}
+		
+		for (const FCaseResult& Result : Results)
+		{
+			TSharedRef<FJsonObject> Case = MakeShared<FJsonObject>();
+			if (bHashes)
+			{
+				Case->SetStringField(TEXT("Hash"), FormatHash(Result.Hash));
+			}
+			if (bTimings)
+			{
+				Case->SetNumberField(TEXT("FrameTime"), Result.FrameTime);
+				Case->SetNumberField(TEXT("PixelsPerSecond"), Result.PixelsPerSecond);
+			}
+			Cases->SetObjectField(Result.Name, Case);
+		}
+
+		TSharedRef<FJsonObject> Root = MakeShared<FJsonObject>();
+		if (bTimings)
+		{
+			Root->SetStringField(TEXT("Date"), FDateTime::UtcNow().ToIso8601());
+		}
+		Root->SetObjectField(TEXT("Cases"), Cases.ToSharedRef());
+
+		FString Text;
+		const TSharedRef<TJsonWriter<>> Writer = TJsonWriterFactory<>::Create(&Text);
+		return FJsonSerializer::Serialize(Root, Writer) && FFileHelper::SaveStringToFile(Text, *Filename);
+	}
+}
+
+/////////////////////////////////////////////////////
+// USoftRendererReferenceCommandlet
+
+USoftRendererReferenceCommandlet::USoftRendererReferenceCommandlet(const FObjectInitializer& ObjectInitializer)
+	: Super(ObjectInitializer)
+{
+	IsClient = false;
+	IsServer = false;
+	IsEditor = true;
+	LogToConsole = true;
+	
+	HelpDescription = TEXT("Renders procedural reference scenes with the software renderer and checks image hashes and frame times against baselines.");
+	HelpUsage = TEXT("-run=SoftRendererReference [-Baseline=File.json] [-TimingBaseline=File.json] [-Update|-UpdateHashes|-UpdateTimings] [-Scene=Name] [-Iterations=N] [-Tolerance=Percent] [-Output=File.json]");
+}
+
+int32 USoftRendererReferenceCommandlet::Main(const FString& Params)
+{
+	using namespace SoftRendererReference;
+
+	// 1 解析参数
+	FString BaselineFilename = GetHashBaselineFilename();
+	FParse::Value(*Params, TEXT("Baseline="), BaselineFilename);
+
+	FString TimingBaselineFilename = GetTimingBaselineFilename();
+	FParse::Value(*Params, TEXT("TimingBaseline="), TimingBaselineFilename);
+
+	FString OutputFilename = FPaths::Combine(FPaths::ProjectSavedDir(), TEXT("SoftRenderer"), TEXT("ReferenceResults.json"));
+	FParse::Value(*Params, TEXT("Output="), OutputFilename);
+
+	FString SceneFilter;
+	FParse::Value(*Params, TEXT("Scene="), SceneFilter);
+
+	int32 Iterations = DefaultTimingIterations;
+	FParse::Value(*Params, TEXT("Iterations="), Iterations);
+	Iterations = FMath::Max(1, Iterations);
+
+	float Tolerance = DefaultTimingTolerance;
+	FParse::Value(*Params, TEXT("Tolerance="), Tolerance);
+
+	const bool bUpdate = FParse::Param(*Params, TEXT("Update"));
+	const bool bUpdateHashes = bUpdate || FParse::Param(*Params, TEXT("UpdateHashes"));
+	const bool bUpdateTimings = bUpdate || FParse::Param(*Params, TEXT("UpdateTimings"));
+
+	// 2 渲染所有用例
+	const TArray<FReferenceCase> Cases = GetReferenceCases(SceneFilter);
+	if (Cases.Num() == 0)
+	{
+		UE_LOG(LogSoftRenderer, Error, TEXT("No reference scene matches -Scene=%s."), *SceneFilter);
+		return 1;
+	}
+	
+	TArray<FCaseResult> Results;
+	for (const FReferenceCase& Case : Cases)
+	{
+		Results.Add(RenderCase(Case, Iterations));
+	}
+
+	// 3 和基准比较，图像不同、缺少哈希或者帧耗时超过容差都算失败
+	//    哈希基准提交在版本库中，缺少时所有用例都失败；帧耗时基准和机器相关，缺少时只跳过耗时的比较
+	const TSharedPtr<FJsonObject> HashBaseline = bUpdateHashes ? nullptr : LoadBaseline(BaselineFilename);
+	if (!bUpdateHashes && !HashBaseline.IsValid())
+	{
+		UE_LOG(LogSoftRenderer, Error, TEXT("No hash baseline found at %s, run with -UpdateHashes to create one."), *BaselineFilename);
+	}
+	
+	const TSharedPtr<FJsonObject> TimingBaseline = bUpdateTimings ? nullptr : LoadBaseline(TimingBaselineFilename);
+	if (!bUpdateTimings && !TimingBaseline.IsValid())
+	{
+		UE_LOG(LogSoftRenderer, Warning, TEXT("No timing baseline found at %s, frame times are not checked. Run with -UpdateTimings to create one."), *TimingBaselineFilename);
+	}
+
+	int32 NumFailures = 0;
+	for (const FCaseResult& Result : Results)
+	{
+		FString Status = TEXT("ok");
+		bool bFailed = true;
+		
+		FString BaselineHash;
+		double BaselineFrameTime = 0.0;
+		if (!Result.bStable)
+		{
+			Status = TEXT("UNSTABLE");
+		}
+		else if (!Result.CheckError.IsEmpty())
+		{
+			Status = Result.CheckError;
+		}
+		else if (!bUpdateHashes && !GetBaselineHash(HashBaseline, Result.Name, BaselineHash))
+		{
+			Status = TEXT("NO BASELINE HASH");
+		}
+		else if (!bUpdateHashes && BaselineHash != FormatHash(Result.Hash))
+		{
+			Status = TEXT("IMAGE MISMATCH");
+		}
+		else if (GetBaselineFrameTime(TimingBaseline, Result.Name, BaselineFrameTime) && IsSlowerThanBaseline(Result.FrameTime, BaselineFrameTime, Tolerance))
+		{
+			Status = FString::Printf(TEXT("SLOWER (baseline %.3f ms)"), BaselineFrameTime);
+		}
+		else
+		{
+			bFailed = false;
+		}
+
+		NumFailures += bFailed ? 1 : 0;
+		
+		UE_LOG(LogSoftRenderer, Display, TEXT("%-30s %s %9.3f ms %10.2f Mpix/s  %s"),
+			*Result.Name, *FormatHash(Result.Hash), Result.FrameTime, Result.PixelsPerSecond / 1.0e6, *Status);
+	}
+
+	// 4 结果总是写入输出文件，方便持续集成记录吞吐量的变化，更新基准时同时写入对应的基准文件
+	if (!SaveResults(OutputFilename, Results, true, true))
+	{
+		UE_LOG(LogSoftRenderer, Error, TEXT("Failed to write %s."), *OutputFilename);
+		return 1;
+	}
+
+	if (bUpdateHashes || bUpdateTimings)
+	{
+		if (NumFailures > 0)
+		{
+			UE_LOG(LogSoftRenderer, Error, TEXT("Baselines not updated because some scenes render differently from frame to frame or fail their checks."));
+			return 1;
+		}
+
+		if (bUpdateHashes && !SaveResults(BaselineFilename, Results, true, false, true))
+		{
+			UE_LOG(LogSoftRenderer, Error, TEXT("Failed to write %s."), *BaselineFilename);
+			return 1;
+		}
+		
+		if (bUpdateTimings && !SaveResults(TimingBaselineFilename, Results, false, true, true))
+		{
+			UE_LOG(LogSoftRenderer, Error, TEXT("Failed to write %s."), *TimingBaselineFilename);
+			return 1;
+		}
+		UE_LOG(LogSoftRenderer, Display, TEXT("Baselines updated: %s"), bUpdateHashes && bUpdateTimings ? TEXT("hashes and timings") : bUpdateHashes ? TEXT("hashes") : TEXT("timings"));
+	}
+
+	UE_LOG(LogSoftRenderer, Display, TEXT("%d of %d reference cases failed."), NumFailures, Results.Num());
+	return NumFailures > 0 ? 1 : 0;
+}
+
+/////////////////////////////////////////////////////
@@ -0,0 +1,459 @@
+﻿#include "SoftRendererReferenceScenes.h"
+#include "RenderScene.h"
+#include "MeshOptimizer.h"
+#include "Dom/JsonObject.h"
+#include "Hash/CityHash.h"
+#include "Misc/FileHelper.h"
+#include "Misc/Paths.h"
+#include "Serialization/JsonReader.h"
+#include "Serialization/JsonSerializer.h"
+
+namespace SoftRendererReference
+{
+	/** 参考场景的画面大小 */
+	static const FIntPoint ViewportSize(1280, 720);
+
+	/** 相机位置，看向+X方向 */
+	static const FVector CameraOrigin(-500.0f, 0.0f, 0.0f);
+
+	/**
+	 * 程序生成的网格
+	 */
+	struct FMesh
+	{
+		TArray<FVector> Positions;
+		TArray<uint32> Indices;
+	};
+
+	/**
+	 * 经纬度球面，Segments为经线数，Rings为纬线数
+	 */
+	static FMesh MakeSphere(int32 Segments, int32 Rings, float Radius)
+	{
+		FMesh Mesh;
+		Mesh.Positions.Reserve((Segments + 1) * (Rings + 1));
+		Mesh.Indices.Reserve(Segments * Rings * 6);
+		
+		for (int32 Ring = 0; Ring <= Rings; ++Ring)
+		{
+			const float Theta = PI * Ring / Rings;
+			for (int32 Segment = 0; Segment <= Segments; ++Segment)
+			{
+				const float Phi = 2.0f * PI * Segment / Segments;
+				Mesh.Positions.Emplace(Radius * FMath::Sin(Theta) * FMath::Cos(Phi), Radius * FMath::Sin(Theta) * FMath::Sin(Phi), Radius * FMath::Cos(Theta));
+			}
+		}
+
+		for (int32 Ring = 0; Ring < Rings; ++Ring)
+		{
+			for (int32 Segment = 0; Segment < Segments; ++Segment)
+			{
+				const uint32 V00 = Ring * (Segments + 1) + Segment;
+				const uint32 V10 = V00 + 1;
+				const uint32 V01 = V00 + Segments + 1;
+				const uint32 V11 = V01 + 1;
+				Mesh.Indices.Append({ V00, V01, V10, V10, V01, V11 });
+			}
+		}
+		return Mesh;
+	}
+
+	/**
+	 * XY平面上以原点为中心的网格，每个格子两个三角形
+	 */
+	static FMesh MakeGrid(int32 NumCellsX, int32 NumCellsY, float Size)
+	{
+		FMesh Mesh;
+		Mesh.Positions.Reserve((NumCellsX + 1) * (NumCellsY + 1));
+		Mesh.Indices.Reserve(NumCellsX * NumCellsY * 6);
+		
+		for (int32 Y = 0; Y <= NumCellsY; ++Y)
+		{
+			for (int32 X = 0; X <= NumCellsX; ++X)
+			{
+				Mesh.Positions.Emplace((float(X) / NumCellsX - 0.5f) * Size, (float(Y) / NumCellsY - 0.5f) * Size, 0.0f);
+			}
+		}
+
+		for (int32 Y = 0; Y < NumCellsY; ++Y)
+		{
+			for (int32 X = 0; X < NumCellsX; ++X)
+			{
+				const uint32 V00 = Y * (NumCellsX + 1) + X;
+				const uint32 V10 = V00 + 1;
+				const uint32 V01 = V00 + NumCellsX + 1;
+				const uint32 V11 = V01 + 1;
+				Mesh.Indices.Append({ V00, V01, V10, V10, V01, V11 });
+			}
+		}
+		return Mesh;
+	}
+
+	/**
+	 * 以原点为中心的立方体
+	 */
+	static FMesh MakeBox(float Extent)
+	{
+		FMesh Mesh;
+		for (int32 Corner = 0; Corner < 8; ++Corner)
+		{
+			Mesh.Positions.Emplace((Corner & 1) ? Extent : -Extent, (Corner & 2) ? Extent : -Extent, (Corner & 4) ? Extent : -Extent);
+		}
+
+		Mesh.Indices = {
+			0, 2, 1, 1, 2, 3,	// -Z
+			4, 5, 6, 5, 7, 6,	// +Z
+			0, 1, 4, 1, 5, 4,	// -Y
+			2, 6, 3, 3, 6, 7,	// +Y
+			0, 4, 2, 2, 4, 6,	// -X
+			1, 3, 5, 3, 7, 5,	// +X
+		};
+		return Mesh;
+	}
+
+	/**
+	 * 用网格创建一个渲染对象，使用默认的顶点着色器和指定颜色的像素着色器
+	 */
+	static URenderObject* CreateRenderObject(URenderScene* Scene, const FMesh& Mesh, const FLinearColor& Color)
+	{
+		URenderObject* RenderObject = NewObject<URenderObject>(Scene);
+		RenderObject->Vertices.SetNum(Mesh.Positions.Num());
+		for (int32 Index = 0; Index < Mesh.Positions.Num(); ++Index)
+		{
+			RenderObject->Vertices[Index].Position = Mesh.Positions[Index];
+		}
+		RenderObject->SetIndices(Mesh.Indices);
+		RenderObject->Material.VertexShaderClass = UVertexShader::StaticClass();
+
+		UPixelShader* PixelShader = NewObject<UPixelShader>(RenderObject);
+		PixelShader->Color = Color;
+		RenderObject->Material.PixelShader = PixelShader;
+		return RenderObject;
+	}
+
+	/**
+	 * 用网格创建一个渲染对象加入场景
+	 */
+	static void AddRenderObject(URenderScene* Scene, const FMesh& Mesh, const FVector& Location, const FRotator& Rotation, const FLinearColor& Color)
+	{
+		URenderObject* RenderObject = CreateRenderObject(Scene, Mesh, Color);
+		RenderObject->WorldLocation = Location;
+		RenderObject->WorldRotation = Rotation;
+		Scene->OpaqueRenderObjects.Add(RenderObject);
+	}
+
+	static void BuildDenseSphere(URenderScene* Scene)
+	{
+		// 256 x 128 个格子，约6.5万个三角形
+		AddRenderObject(Scene, MakeSphere(256, 128, 300.0f), FVector(300.0f, 0.0f, 0.0f), FRotator(20.0f, 30.0f, 0.0f), FLinearColor(0.8f, 0.3f, 0.2f));
+	}
+
+	static void BuildGrid100k(URenderScene* Scene)
+	{
+		// 224 x 224 个格子，100352个三角形
+		AddRenderObject(Scene, MakeGrid(224, 224, 1200.0f), FVector(400.0f, 0.0f, 0.0f), FRotator(60.0f, 0.0f, 30.0f), FLinearColor(0.2f, 0.7f, 0.3f));
+	}
+
+	/** 小立方体阵列的第Y列第Z行的变换 */
+	static FTransform GetSmallObjectTransform(int32 Y, int32 Z)
+	{
+		const FVector Location(300.0f + 10.0f * ((Y + Z) % 5), (Y - 11.5f) * 36.0f, (Z - 7.5f) * 36.0f);
+		const FRotator Rotation(Y * 7.0f, Z * 11.0f, (Y + Z) * 5.0f);
+		return FTransform(Rotation, Location);
+	}
+
+	static void BuildManySmallObjects(URenderScene* Scene)
+	{
+		// 24 x 16 个小立方体，每个12个三角形，旋转各不相同
+		const FMesh Box = MakeBox(10.0f);
+		for (int32 Y = 0; Y < 24; ++Y)
+		{
+			for (int32 Z = 0; Z < 16; ++Z)
+			{
+				const FTransform Transform = GetSmallObjectTransform(Y, Z);
+				AddRenderObject(Scene, Box, Transform.GetLocation(), Transform.Rotator(), FLinearColor(Y / 24.0f, Z / 16.0f, 0.5f));
+			}
+		}
+	}
+
+	static void BuildManyInstances(URenderScene* Scene)
+	{
+		// 和ManySmallObjects相同的立方体，实例共用一个颜色
+		FRenderObjectInstances& Instances = Scene->InstancedRenderObjects.AddDefaulted_GetRef();
+		Instances.RenderObject = CreateRenderObject(Scene, MakeBox(10.0f), FLinearColor(0.5f, 0.5f, 0.5f));
+		for (int32 Y = 0; Y < 24; ++Y)
+		{
+			for (int32 Z = 0; Z < 16; ++Z)
+			{
+				Instances.InstanceTransforms.Add(GetSmallObjectTransform(Y, Z));
+			}
+		}
+	}
+
+	static void BuildClusteredSphere(URenderScene* Scene)
+	{
+		// 192 x 96 个格子，和导入的大模型一样划分簇并打开背面剔除，球的一部分在屏幕外
+		const FMesh Sphere = MakeSphere(192, 96, 400.0f);
+		URenderObject* RenderObject = CreateRenderObject(Scene, Sphere, FLinearColor(0.3f, 0.4f, 0.8f));
+		
+		TArray<uint32> Indices = Sphere.Indices;
+		FMeshOptimizer::OptimizeVertexCache(Indices, RenderObject->Vertices.Num());
+		const TArray<int32> NumClusterTriangles = FMeshOptimizer::BuildClusters(Indices, RenderObject->Vertices.Num());
+		FMeshOptimizer::OptimizeVertexFetch(RenderObject->Vertices, Indices);
+		
+		RenderObject->SetIndices(Indices);
+		RenderObject->Clusters = FMeshOptimizer::ComputeClusterBounds(RenderObject->Vertices, Indices, NumClusterTriangles);
+		RenderObject->Material.bBackfaceCulling = true;
+		RenderObject->WorldLocation = FVector(400.0f, 700.0f, 100.0f);
+		Scene->OpaqueRenderObjects.Add(RenderObject);
+	}
+
+	static void BuildOccludedObjects(URenderScene* Scene)
+	{
+		// 8 x 6 个球排在一面墙后面，墙最后加入场景，从近到远绘制时墙先写入深度
+		const FMesh Sphere = MakeSphere(16, 16, 30.0f);
+		for (int32 Y = 0; Y < 8; ++Y)
+		{
+			for (int32 Z = 0; Z < 6; ++Z)
+			{
+				AddRenderObject(Scene, Sphere, FVector(400.0f, (Y - 3.5f) * 100.0f, (Z - 2.5f) * 100.0f), FRotator::ZeroRotator, FLinearColor(Y / 8.0f, 0.8f, Z / 6.0f));
+			}
+		}
+		
+		AddRenderObject(Scene, MakeGrid(32, 32, 1600.0f), FVector::ZeroVector, FRotator(90.0f, 0.0f, 0.0f), FLinearColor(0.6f, 0.6f, 0.6f));
+	}
+
+	static void BuildOffscreenGeometry(URenderScene* Scene)
+	{
+		const FMesh Box = MakeBox(100.0f);
+		const FMesh Sphere = MakeSphere(64, 32, 200.0f);
+		
+		// 1 完全在视锥体外的物体：相机后方、左右两侧很远处、正上方
+		AddRenderObject(Scene, Sphere, CameraOrigin - FVector(800.0f, 0.0f, 0.0f), FRotator::ZeroRotator, FLinearColor::Red);
+		AddRenderObject(Scene, Box, FVector(0.0f, 5000.0f, 0.0f), FRotator::ZeroRotator, FLinearColor::Red);
+		AddRenderObject(Scene, Box, FVector(0.0f, -5000.0f, 0.0f), FRotator::ZeroRotator, FLinearColor::Red);
+		AddRenderObject(Scene, Box, FVector(0.0f, 0.0f, 5000.0f), FRotator::ZeroRotator, FLinearColor::Red);
+
+		// 2 穿过近平面的物体：相机脚下延伸到身后的地面，和包住相机一侧的立方体
+		AddRenderObject(Scene, MakeGrid(64, 64, 4000.0f), FVector(0.0f, 0.0f, -150.0f), FRotator::ZeroRotator, FLinearColor(0.4f, 0.4f, 0.4f));
+		AddRenderObject(Scene, Box, CameraOrigin + FVector(50.0f, 150.0f, 0.0f), FRotator(0.0f, 45.0f, 0.0f), FLinearColor::Blue);
+
+		// 3 部分在屏幕外的物体
+		AddRenderObject(Scene, Sphere, FVector(200.0f, 650.0f, 250.0f), FRotator::ZeroRotator, FLinearColor::Yellow);
+	}
+
+	/**
+	 * 帧图像所有像素的哈希
+	 */
+	static uint64 HashFrameBuffer(UFrameBuffer* FrameBuffer)
+	{
+		TArray<FColor> Pixels;
+		FrameBuffer->ReadPixels(Pixels);
+		return CityHash64(reinterpret_cast<const char*>(Pixels.GetData()), Pixels.Num() * sizeof(FColor));
+	}
+
+	/**
+	 * 相机移开再移回来后绘制一帧，使用默认设置，但所有渲染对象缓存的顶点变换结果都已经过期
+	 */
+	static void RenderWithStaleCache(USoftRenderer* Renderer)
+	{
+		const FSoftRendererCamera SavedCamera = Renderer->RenderCamera;
+		Renderer->RenderCamera.ViewOrigin.Z += 1.0f;
+		Renderer->Render();
+		Renderer->RenderCamera = SavedCamera;
+		Renderer->Render();
+	}
+
+	/**
+	 * 簇剔除的检查，实体模式下必须有簇被剔除，相机移动后执行顶点着色器的顶点必须比清空簇之后少，并且两者的图像相同
+	 */
+	static FString CheckClusterCulling(USoftRenderer* Renderer, uint64 Hash)
+	{
+		if (Renderer->RenderMode != ESoftRendererRenderMode::Solid)
+			return FString();
+
+		// 1 使用默认设置，顶点缓存过期的这一帧只变换可见的簇用到的顶点
+		RenderWithStaleCache(Renderer);
+		const int32 NumClustersCulled = Renderer->Stats.NumClustersCulled;
+		const int32 NumClusteredVertices = Renderer->Stats.NumVerticesShaded;
+		const uint64 ClusteredHash = HashFrameBuffer(Renderer->FrameBuffer);
+
+		// 2 清空所有渲染对象的簇再画一次作为参考，然后恢复簇
+		TArray<TArray<FRenderObjectCluster>> SavedClusters;
+		for (URenderObject* RenderObject : Renderer->RenderScene->OpaqueRenderObjects)
+		{
+			SavedClusters.Add(MoveTemp(RenderObject->Clusters));
+			RenderObject->Clusters.Reset();
+		}
+		
+		RenderWithStaleCache(Renderer);
+		const int32 NumUnclusteredVertices = Renderer->Stats.NumVerticesShaded;
+		const uint64 UnclusteredHash = HashFrameBuffer(Renderer->FrameBuffer);
+
+		for (int32 Index = 0; Index < SavedClusters.Num(); ++Index)
+		{
+			Renderer->RenderScene->OpaqueRenderObjects[Index]->Clusters = MoveTemp(SavedClusters[Index]);
+		}
+
+		if (NumClustersCulled == 0)
+			return TEXT("NO CLUSTER CULLED");
+
+		if (NumClusteredVertices >= NumUnclusteredVertices)
+			return FString::Printf(TEXT("CLUSTER VERTICES NOT SKIPPED (%d >= %d)"), NumClusteredVertices, NumUnclusteredVertices);
+
+		if (ClusteredHash != UnclusteredHash || Hash != UnclusteredHash)
+			return TEXT("CLUSTER MISMATCH");
+		
+		return FString();
+	}
+
+	/**
+	 * 遮挡剔除的检查，实体模式下墙后面的物体必须被剔除
+	 */
+	static FString CheckOcclusionCulling(USoftRenderer* Renderer, uint64 Hash)
+	{
+		if (Renderer->RenderMode != ESoftRendererRenderMode::Solid)
+			return FString();
+
+		return Renderer->Stats.NumOccludedObjects > 0 ? FString() : TEXT("NOTHING OCCLUDED");
+	}
+
+	/**
+	 * 参考场景列表，名字写入基准文件，修改已有场景的内容后需要更新基准
+	 */
+	static const FReferenceScene ReferenceScenes[] =
+	{
+		{ TEXT("DenseSphere"), &BuildDenseSphere },
+		{ TEXT("Grid100k"), &BuildGrid100k },
+		{ TEXT("ManySmallObjects"), &BuildManySmallObjects },
+		{ TEXT("ManyInstances"), &BuildManyInstances },
+		{ TEXT("ClusteredSphere"), &BuildClusteredSphere, &CheckClusterCulling },
+		{ TEXT("OccludedObjects"), &BuildOccludedObjects, &CheckOcclusionCulling },
+		{ TEXT("OffscreenGeometry"), &BuildOffscreenGeometry },
+	};
+
+	TArray<FReferenceCase> GetReferenceCases(const FString& SceneFilter)
+	{
+		const ESoftRendererRenderMode RenderModes[] = { ESoftRendererRenderMode::Wireframe, ESoftRendererRenderMode::Solid };
+		const UEnum* RenderModeEnum = StaticEnum<ESoftRendererRenderMode>();
+		
+		TArray<FReferenceCase> Cases;
+		for (const FReferenceScene& ReferenceScene : ReferenceScenes)
+		{
+			if (!SceneFilter.IsEmpty() && !FString(ReferenceScene.Name).Contains(SceneFilter))
+				continue;
+
+			for (ESoftRendererRenderMode RenderMode : RenderModes)
+			{
+				const FString Name = FString::Printf(TEXT("%s.%s"), ReferenceScene.Name, *RenderModeEnum->GetNameStringByValue(static_cast<int64>(RenderMode)));
+				Cases.Add({ &ReferenceScene, RenderMode, Name });
+			}
+		}
+		return Cases;
+	}
+
+	/**
+	 * 关闭局部重绘保证每一帧都完整绘制，其他设置使用渲染器的默认值
+	 */
+	FCaseResult RenderCase(const FReferenceCase& Case, int32 Iterations)
+	{
+		URenderScene* Scene = NewObject<URenderScene>();
+		Case.Scene->Build(Scene);
+		
+		USoftRenderer* Renderer = NewObject<USoftRenderer>();
+		Renderer->ViewportSize = ViewportSize;
+		Renderer->RenderMode = Case.RenderMode;
+		Renderer->bEnableDirtyRegions = false;
+		Renderer->RenderCamera.ProjectionMode = ESoftRendererCameraProjectionMode::Perspective;
+		Renderer->RenderCamera.ViewOrigin = CameraOrigin;
+		Renderer->RenderCamera.Rotation = FRotator::ZeroRotator;
+		Renderer->RenderScene = Scene;
+		Renderer->InitRenderer();
+
+		FCaseResult Result;
+		Result.Name = Case.Name;
+		
+		Renderer->Render();
+		Result.Hash = HashFrameBuffer(Renderer->FrameBuffer);
+
+		if (Case.Scene->Check)
+		{
+			Result.CheckError = Case.Scene->Check(Renderer, Result.Hash);
+		}
+
+		TArray<float> FrameTimes;
+		int64 NumPixelsWritten = 0;
+		for (int32 Iteration = 0, NumIterations = FMath::Max(1, Iterations); Iteration < NumIterations; ++Iteration)
+		{
+			Renderer->Render();
+			FrameTimes.Add(Renderer->Stats.RenderTime);
+			NumPixelsWritten += Renderer->Stats.NumPixelsWritten;
+		}
+
+		// 缓存的变换结果和层次深度缓冲都已经生效，图像必须和第一帧完全一致
+		Result.bStable = HashFrameBuffer(Renderer->FrameBuffer) == Result.Hash;
+
+		FrameTimes.Sort();
+		Result.FrameTime = FrameTimes[FrameTimes.Num() / 2];
+
+		float TotalTime = 0.0f;
+		for (float FrameTime : FrameTimes)
+		{
+			TotalTime += FrameTime;
+		}
+		Result.PixelsPerSecond = TotalTime > 0.0f ? NumPixelsWritten / (TotalTime * 0.001) : 0.0;
+		return Result;
+	}
+
+	FString FormatHash(uint64 Hash)
+	{
+		return FString::Printf(TEXT("%016llx"), Hash);
+	}
+
+	FString GetHashBaselineFilename()
+	{
+		return FPaths::Combine(FPaths::ProjectConfigDir(), TEXT("SoftRendererReference.json"));
+	}
+
+	FString GetTimingBaselineFilename()
+	{
+		return FPaths::Combine(FPaths::ProjectSavedDir(), TEXT("SoftRenderer"), TEXT("ReferenceTimings.json"));
+	}
+
+	TSharedPtr<FJsonObject> LoadBaseline(const FString& Filename)
+	{
+		FString Text;
+		if (!FFileHelper::LoadFileToString(Text, *Filename))
+			return nullptr;
+
+		TSharedPtr<FJsonObject> Root;
+		if (!FJsonSerializer::Deserialize(TJsonReaderFactory<>::Create(Text), Root) || !Root.IsValid())
+			return nullptr;
+
+		const TSharedPtr<FJsonObject>* Cases = nullptr;
+		return Root->TryGetObjectField(TEXT("Cases"), Cases) ? *Cases : nullptr;
+	}
+
+	bool GetBaselineHash(const TSharedPtr<FJsonObject>& Baseline, const FString& CaseName, FString& OutHash)
+	{
+		const TSharedPtr<FJsonObject>* BaselineCase = nullptr;
+		if (!Baseline.IsValid() || !Baseline->TryGetObjectField(CaseName, BaselineCase))
+			return false;
+
+		return (*BaselineCase)->TryGetStringField(TEXT("Hash"), OutHash) && !OutHash.IsEmpty();
+	}
+
+	bool GetBaselineFrameTime(const TSharedPtr<FJsonObject>& Baseline, const FString& CaseName, double& OutFrameTime)
+	{
+		const TSharedPtr<FJsonObject>* BaselineCase = nullptr;
+		if (!Baseline.IsValid() || !Baseline->TryGetObjectField(CaseName, BaselineCase))
+			return false;
+
+		return (*BaselineCase)->TryGetNumberField(TEXT("FrameTime"), OutFrameTime) && OutFrameTime > 0.0;
+	}
+
+	bool IsSlowerThanBaseline(float FrameTime, double BaselineFrameTime, float TolerancePercent)
+	{
+		return FrameTime > BaselineFrameTime * (1.0 + TolerancePercent * 0.01);
+	}
+}
@@ -0,0 +1,70 @@
+﻿#include "SoftRendererReferenceScenes.h"
+#include "Dom/JsonObject.h"
+#include "Misc/AutomationTest.h"
+
+#if WITH_DEV_AUTOMATION_TESTS
+
+/**
+ * 参考场景的自动化测试，和参考场景命令行工具检查相同的内容
+ *    每个用例的图像哈希必须和Config/SoftRendererReference.json中的哈希相同，缺少哈希的用例失败
+ *    每个用例的帧耗时和每秒写入的像素个数记录在测试结果中，帧耗时超过本机耗时基准的容差时失败
+ *    耗时基准和机器相关，由命令行工具的-UpdateTimings生成，机器上没有耗时基准时只给出警告
+ *    Session Frontend的Automation页面或者 -ExecCmds="Automation RunTests SoftRenderer.Reference" 运行
+ */
+BEGIN_DEFINE_SPEC(FSoftRendererReferenceSpec, "SoftRenderer.Reference", EAutomationTestFlags::EditorContext | EAutomationTestFlags::CommandletContext | EAutomationTestFlags::ProductFilter)
+	TSharedPtr<FJsonObject> HashBaseline;
+	TSharedPtr<FJsonObject> TimingBaseline;
+END_DEFINE_SPEC(FSoftRendererReferenceSpec)
+
+void FSoftRendererReferenceSpec::Define()
+{
+	using namespace SoftRendererReference;
+
+	BeforeEach([this]()
+	{
+		HashBaseline = LoadBaseline(GetHashBaselineFilename());
+		TimingBaseline = LoadBaseline(GetTimingBaselineFilename());
+	});
+
+	for (const FReferenceCase& Case : GetReferenceCases())
+	{
+		It(Case.Name, [this, Case]()
+		{
+			// 1 渲染几帧，检查跨帧的结果不变
+			const FCaseResult Result = RenderCase(Case, DefaultTimingIterations);
+			TestTrue(TEXT("Frames are identical"), Result.bStable);
+			
+			if (!Result.CheckError.IsEmpty())
+			{
+				AddError(FString::Printf(TEXT("Scene check failed: %s"), *Result.CheckError));
+			}
+
+			// 2 记录吞吐量，和本机的耗时基准比较
+			AddInfo(FString::Printf(TEXT("Frame time %.3f ms, %.2f Mpix/s"), Result.FrameTime, Result.PixelsPerSecond / 1.0e6));
+
+			double BaselineFrameTime = 0.0;
+			if (!GetBaselineFrameTime(TimingBaseline, Case.Name, BaselineFrameTime))
+			{
+				AddWarning(FString::Printf(TEXT("No timing baseline for %s in %s, frame time is not checked. Run the SoftRendererReference commandlet with -UpdateTimings on this machine."),
+					*Case.Name, *GetTimingBaselineFilename()));
+			}
+			else if (IsSlowerThanBaseline(Result.FrameTime, BaselineFrameTime, DefaultTimingTolerance))
+			{
+				AddError(FString::Printf(TEXT("Frame time %.3f ms is more than %.0f%% slower than the baseline %.3f ms."),
+					Result.FrameTime, DefaultTimingTolerance, BaselineFrameTime));
+			}
+
+			// 3 哈希基准提交在版本库中，每个用例都必须有哈希
+			FString BaselineHash;
+			if (!GetBaselineHash(HashBaseline, Case.Name, BaselineHash))
+			{
+				AddError(FString::Printf(TEXT("No baseline hash for %s in %s, run the SoftRendererReference commandlet with -UpdateHashes. Rendered %s."),
+					*Case.Name, *GetHashBaselineFilename(), *FormatHash(Result.Hash)));
+				return;
+			}
+			TestEqual(TEXT("Image hash"), FormatHash(Result.Hash), BaselineHash);
+		});
+	}
+}
+
+#endif
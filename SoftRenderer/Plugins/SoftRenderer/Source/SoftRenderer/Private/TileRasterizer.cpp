@@ -0,0 +1,86 @@
+﻿#include "TileRasterizer.h"
+#include "Async/ParallelFor.h"
+
+/////////////////////////////////////////////////////
+// FTileRasterizer
+
+void FTileRasterizer::Init(int32 InWidth, int32 InHeight)
+{
+	Width = FMath::Max(0, InWidth);
+	Height = FMath::Max(0, InHeight);
+
+	NumTilesX = FMath::DivideAndRoundUp(Width, TileSize);
+	NumTilesY = FMath::DivideAndRoundUp(Height, TileSize);
+
+	// 只清空数据不释放内存，每一帧复用上一帧的分配
+	TileBins.SetNum(NumTilesX * NumTilesY);
+	for (TArray<int32>& TileBin : TileBins)
+	{
+		TileBin.Reset();
+	}
+}
+
+template <typename PrimitiveType>
+void FTileRasterizer::BinPrimitives(TArrayView<const PrimitiveType> Primitives, const TBitArray<>* ActiveTiles)
+{
+	check(ActiveTiles == nullptr || ActiveTiles->Num() == TileBins.Num());
+	
+	for (int32 PrimitiveIndex = 0, Count = Primitives.Num(); PrimitiveIndex < Count; ++PrimitiveIndex)
+	{
+		const FIntRect Bounds = Primitives[PrimitiveIndex].GetPixelBounds();
+		if (Bounds.Max.X <= 0 || Bounds.Max.Y <= 0 || Bounds.Min.X >= Width || Bounds.Min.Y >= Height)
+			continue;
+
+		const int32 MinTileX = FMath::Max(Bounds.Min.X, 0) / TileSize;
+		const int32 MinTileY = FMath::Max(Bounds.Min.Y, 0) / TileSize;
+		const int32 MaxTileX = (FMath::Min(Bounds.Max.X, Width) - 1) / TileSize;
+		const int32 MaxTileY = (FMath::Min(Bounds.Max.Y, Height) - 1) / TileSize;
+
+		for (int32 TileY = MinTileY; TileY <= MaxTileY; ++TileY)
+		{
+			for (int32 TileX = MinTileX; TileX <= MaxTileX; ++TileX)
+			{
+				const int32 TileIndex = TileY * NumTilesX + TileX;
+				if (ActiveTiles == nullptr || (*ActiveTiles)[TileIndex])
+				{
+					TileBins[TileIndex].Add(PrimitiveIndex);
+				}
+			}
+		}
+	}
+}
+
+void FTileRasterizer::BinTriangles(TArrayView<const FRasterTriangle> Triangles, const TBitArray<>* ActiveTiles)
+{
+	BinPrimitives(Triangles, ActiveTiles);
+}
+
+void FTileRasterizer::BinLines(TArrayView<const FRasterLine> Lines, const TBitArray<>* ActiveTiles)
+{
+	BinPrimitives(Lines, ActiveTiles);
+}
+
+void FTileRasterizer::Rasterize(FRasterizeFunction RasterizeFunction) const
+{
+	ParallelFor(TileBins.Num(), [this, &RasterizeFunction](int32 TileIndex)
+	{
+		const TArray<int32>& TileBin = TileBins[TileIndex];
+		if (TileBin.Num() == 0)
+			return;
+
+		const FIntRect TileRect = GetTileRect(TileIndex);
+		for (const int32 PrimitiveIndex : TileBin)
+		{
+			RasterizeFunction(PrimitiveIndex, TileRect);
+		}
+	});
+}
+
+FIntRect FTileRasterizer::GetTileRect(int32 TileIndex) const
+{
+	const int32 MinX = (TileIndex % NumTilesX) * TileSize;
+	const int32 MinY = (TileIndex / NumTilesX) * TileSize;
+	return FIntRect(MinX, MinY, FMath::Min(MinX + TileSize, Width), FMath::Min(MinY + TileSize, Height));
+}
+
+/////////////////////////////////////////////////////
@@ -1,4 +1,5 @@
 ﻿#include "VertexShader.h"
+#include "Core/SoftRasterCore.h"
 
 /////////////////////////////////////////////////////
 // UVertexShader
@@ -20,4 +21,18 @@ FVector4 UVertexShader::RunVertexShader(const FRenderObjectVertex& Vertex,
 	return ClipSpacePos;
 }
 
+void UVertexShader::RunVertexShaderBatch(TArrayView<const FRenderObjectVertex> Vertices, const FMatrix& LocalToProjectionMatrix, const FVertexShaderBatchOutput& Output)
+{
+	// 顶点只有位置，按连续的 (X, Y, Z) 传给核心库，UE使用行向量，和核心库的矩阵约定相同
+	static_assert(sizeof(FRenderObjectVertex) == 3 * sizeof(float), "Vertex positions are passed to the raster core as packed floats.");
+
+	SoftRasterCore::TransformPositions(reinterpret_cast<const float*>(Vertices.GetData()), Vertices.Num(), LocalToProjectionMatrix.M,
+		Output.X.GetData(), Output.Y.GetData(), Output.Z.GetData(), Output.W.GetData());
+}
+
+bool UVertexShader::SupportsVertexShaderBatch() const
+{
+	return GetClass() == UVertexShader::StaticClass();
+}
+
 /////////////////////////////////////////////////////
@@ -0,0 +1,108 @@
+﻿#include "ViewFrustum.h"
+
+/////////////////////////////////////////////////////
+// FViewFrustum
+
+void FViewFrustum::Init(const FMatrix& WorldToProjectionMatrix)
+{
+	// UE使用行向量，裁剪空间坐标的每个分量等于 [X Y Z 1] 和矩阵一列的点积
+	// 可见条件 W+X>=0, W-X>=0, W+Y>=0, W-Y>=0, Z>=0, W-Z>=0 都是世界坐标的线性函数，系数就是对应列的组合
+	const FMatrix& M = WorldToProjectionMatrix;
+	const auto ColumnCombination = [&M](int32 Column, float ColumnScale, int32 OtherColumn, float OtherScale)
+	{
+		float Coefficients[4];
+		for (int32 Row = 0; Row < 4; ++Row)
+		{
+			Coefficients[Row] = M.M[Row][Column] * ColumnScale + M.M[Row][OtherColumn] * OtherScale;
+		}
+
+		// FPlane::PlaneDot(P) = Dot(Normal, P) - W，常数项取反
+		return FPlane(Coefficients[0], Coefficients[1], Coefficients[2], -Coefficients[3]);
+	};
+
+	Planes[0] = ColumnCombination(3, 1.0f, 0, 1.0f);	// 左
+	Planes[1] = ColumnCombination(3, 1.0f, 0, -1.0f);	// 右
+	Planes[2] = ColumnCombination(3, 1.0f, 1, 1.0f);	// 下
+	Planes[3] = ColumnCombination(3, 1.0f, 1, -1.0f);	// 上
+	Planes[4] = ColumnCombination(3, 1.0f, 2, -1.0f);	// 近
+	Planes[5] = ColumnCombination(2, 1.0f, 2, 0.0f);	// 远
+
+	for (int32 PlaneIndex = 0; PlaneIndex < NumPlanes; ++PlaneIndex)
+	{
+		// 归一化后PlaneDot才是真实的距离，才能和包围球半径比较
+		FPlane& Plane = Planes[PlaneIndex];
+		const float NormalLength = FVector(Plane).Size();
+		if (NormalLength > SMALL_NUMBER)
+		{
+			Plane /= NormalLength;
+		}
+		else
+		{
+			// 无穷远的远平面，所有点到它的距离都当作无穷大
+			Plane = FPlane(0.0f, 0.0f, 0.0f, -BIG_NUMBER);
+		}
+
+		AbsNormals[PlaneIndex] = FVector(Plane).GetAbs();
+	}
+}
+
+bool FViewFrustum::IntersectSphere(const FVector& Center, float Radius, bool& bOutFullyInside) const
+{
+	bOutFullyInside = true;
+	
+	for (int32 PlaneIndex = 0; PlaneIndex < NumPlanes; ++PlaneIndex)
+	{
+		const float Distance = Planes[PlaneIndex].PlaneDot(Center);
+		if (Distance < -Radius)
+		{
+			bOutFullyInside = false;
+			return false;
+		}
+
+		if (Distance < Radius)
+		{
+			bOutFullyInside = false;
+		}
+	}
+
+	return true;
+}
+
+bool FViewFrustum::IntersectBox(const FVector& Center, const FVector& Extent) const
+{
+	for (int32 PlaneIndex = 0; PlaneIndex < NumPlanes; ++PlaneIndex)
+	{
+		// 包围盒在法线方向上的投影半径，中心到平面的距离小于负的投影半径时整个包围盒在平面外侧
+		const float Distance = Planes[PlaneIndex].PlaneDot(Center);
+		const float ProjectedExtent = FVector::DotProduct(AbsNormals[PlaneIndex], Extent);
+		if (Distance < -ProjectedExtent)
+			return false;
+	}
+
+	return true;
+}
+
+bool FViewFrustum::IntersectBox(const FVector& Center, const FVector& Extent, bool& bOutFullyInside) const
+{
+	bOutFullyInside = true;
+	
+	for (int32 PlaneIndex = 0; PlaneIndex < NumPlanes; ++PlaneIndex)
+	{
+		const float Distance = Planes[PlaneIndex].PlaneDot(Center);
+		const float ProjectedExtent = FVector::DotProduct(AbsNormals[PlaneIndex], Extent);
+		if (Distance < -ProjectedExtent)
+		{
+			bOutFullyInside = false;
+			return false;
+		}
+
+		if (Distance < ProjectedExtent)
+		{
+			bOutFullyInside = false;
+		}
+	}
+
+	return true;
+}
+
+/////////////////////////////////////////////////////
@@ -0,0 +1,91 @@
+﻿#pragma once
+
+#include "CoreMinimal.h"
+
+/**
+ * 齐次裁剪空间的裁剪
+ *    可见范围为 -W <= X <= W, -W <= Y <= W, 0 <= Z <= W
+ *    深度使用Reversed-Z，Z = W是近平面，Z = 0是远平面
+ *
+ *    三角形只和近平面、远平面以及保护带(Guard Band)的四个平面裁剪，不和屏幕边缘裁剪：
+ *    保护带比屏幕大GuardBandPixels个像素，落在保护带内屏幕外的部分由光栅化的ClipRect丢弃，
+ *    绝大多数和屏幕边缘相交的三角形不需要真正裁剪，只有跨过近平面或者超出保护带的三角形才生成新的顶点
+ *
+ *    线框模式的线段先在齐次裁剪空间和同样的平面裁剪，再在屏幕空间用Liang-Barsky算法裁剪到屏幕范围内，画线的开销只和可见的像素个数有关
+ */
+class SOFTRENDERER_API FClipper
+{
+public:
+	/** 顶点在各个裁剪平面外侧的标志位 */
+	enum EOutCode : uint32
+	{
+		OutCode_Left				= 1 << 0,
+		OutCode_Right				= 1 << 1,
+		OutCode_Bottom				= 1 << 2,
+		OutCode_Top					= 1 << 3,
+		OutCode_Near				= 1 << 4,
+		OutCode_Far					= 1 << 5,
+		OutCode_GuardBandLeft		= 1 << 6,
+		OutCode_GuardBandRight		= 1 << 7,
+		OutCode_GuardBandBottom		= 1 << 8,
+		OutCode_GuardBandTop		= 1 << 9,
+	};
+
+	/** 三个顶点在同一个平面外侧时三角形完全不可见 */
+	static constexpr uint32 OutCode_RejectMask = OutCode_Left | OutCode_Right | OutCode_Bottom | OutCode_Top | OutCode_Near | OutCode_Far;
+
+	/** 需要真正裁剪的平面 */
+	static constexpr uint32 OutCode_ClipMask = OutCode_Near | OutCode_Far | OutCode_GuardBandLeft | OutCode_GuardBandRight | OutCode_GuardBandBottom | OutCode_GuardBandTop;
+
+	/** 参与裁剪的平面个数 */
+	static constexpr int32 NumClipPlanes = 6;
+
+	/** 三角形裁剪后的凸多边形最多的顶点个数，每个平面最多增加一个顶点 */
+	static constexpr int32 MaxPolygonVertices = 3 + NumClipPlanes;
+
+	/** 保护带超出屏幕边缘的像素个数，视口很大时缩小到裁剪后的屏幕坐标不超过SoftRasterCore::MaxTriangleCoordinate */
+	static constexpr float GuardBandPixels = 4096.0f;
+
+public:
+	/**
+	 * 按视口大小计算保护带的范围
+	 *    屏幕坐标范围是 [-保护带, 视口大小 + 保护带]，保护带不超过光栅化允许的坐标上限减去视口大小
+	 */
+	void Init(const FIntPoint& ViewportSize);
+
+	/**
+	 * 计算齐次裁剪空间坐标的OutCode
+	 */
+	uint32 ComputeOutCode(float X, float Y, float Z, float W) const;
+
+	/**
+	 * 用Sutherland-Hodgman算法把三角形依次和ClipPlanes中标记的平面裁剪，输出凸多边形
+	 *    返回多边形的顶点个数，少于3个时三角形被完全裁掉
+	 */
+	int32 ClipTriangle(const FVector4 Vertices[3], uint32 ClipPlanes, FVector4 OutVertices[MaxPolygonVertices]) const;
+
+	/**
+	 * 把齐次裁剪空间的线段依次和ClipPlanes中标记的平面裁剪，线段完全被裁掉时返回false
+	 *    和三角形一样总是从内侧的端点向外侧插值
+	 */
+	bool ClipSegment(FVector4& Start, FVector4& End, uint32 ClipPlanes) const;
+
+	/**
+	 * 用Liang-Barsky算法把屏幕空间的线段裁剪到Rect范围内，线段完全在范围外时返回false
+	 *    完全在范围内的线段端点保持不变
+	 */
+	static bool ClipLine(FVector2D& Start, FVector2D& End, const FBox2D& Rect);
+
+private:
+	/**
+	 * 顶点到第PlaneIndex个裁剪平面的有向距离，不小于0时在平面内侧
+	 */
+	float PlaneDistance(int32 PlaneIndex, const FVector4& Vertex) const;
+
+private:
+	/** 保护带在NDC空间的X范围 [-GuardBandX, GuardBandX] */
+	float GuardBandX = 1.0f;
+
+	/** 保护带在NDC空间的Y范围 [-GuardBandY, GuardBandY] */
+	float GuardBandY = 1.0f;
+};
@@ -0,0 +1,266 @@
+﻿#pragma once
+
+#include <cstdint>
+#include "Core/SoftRasterSimd.h"
+
+/**
+ * 软光栅渲染器的核心算法，只依赖C++标准库
+ *    UFrameBuffer、UVertexShader和USoftRenderer只负责引擎对象的管理，实际的清空、画线、填充三角形和顶点变换都调用这里的函数
+ *    这部分代码不依赖UObject，可以脱离引擎单独编译，Plugins/SoftRenderer/Benchmark下的性能测试直接使用这些函数
+ */
+namespace SoftRasterCore
+{
+	/** 三角形顶点坐标的亚像素精度位数，1/16像素 */
+	constexpr int32_t SubPixelBits = 4;
+	constexpr int32_t SubPixelScale = 1 << SubPixelBits;
+
+	/** 三角形顶点屏幕坐标绝对值的上限(像素)，超出时边函数会溢出，SetupTriangle直接丢弃这个三角形 */
+	constexpr int32_t MaxTriangleCoordinate = 1 << 14;
+
+	/** 三角形光栅化时整体测试的像素块大小 */
+	constexpr int32_t RasterBlockSize = 8;
+
+	/**
+	 * 像素矩形，左闭右开区间
+	 */
+	struct FRasterRect
+	{
+		int32_t MinX;
+		int32_t MinY;
+		int32_t MaxX;
+		int32_t MaxY;
+	};
+
+	/**
+	 * 光栅化的目标，颜色和深度都按行存储，每行Width个像素
+	 */
+	struct FRasterSurface
+	{
+		uint32_t* Pixels;
+		float* Depth;
+		int32_t Width;
+		int32_t Height;
+	};
+
+	/**
+	 * 用32位的值填充一段连续内存
+	 *    先逐个写到16字节对齐，中间每次写入4个16字节，最后写剩下的部分
+	 *    bStreaming为true时使用非临时写入(Non-Temporal Store)，数据不经过缓存直接写入内存，适合整帧清空这种写完之后不会马上读的大块内存
+	 */
+	void FillMemory32(uint32_t* Data, int64_t Count, uint32_t Value, bool bStreaming);
+
+	/**
+	 * 裁剪之后的直线，由SetupLine计算，DrawLine按游程写入
+	 */
+	struct FLineSetup
+	{
+		/** 实际写入的像素范围 */
+		FRasterRect Bounds;
+
+		/** 第一个像素在颜色缓冲中的下标 */
+		int64_t FirstPixel;
+
+		/** 写入的像素个数 */
+		int64_t NumPixels;
+
+		/** 主轴和次轴每走一步，像素下标的偏移 */
+		int64_t MajorStride;
+		int64_t MinorStride;
+
+		/** 主轴和次轴的变化量，以及第一个像素的误差项 */
+		int64_t DMajor;
+		int64_t DMinor;
+		int64_t Error;
+	};
+
+	/**
+	 * 计算Bresenham直线裁剪到ClipRect和目标范围之后的状态，直线完全在范围外时返回false
+	 *    裁剪后画出的像素和从起点开始逐步迭代完全一致，A->B和B->A画出的像素也相同
+	 */
+	bool SetupLine(int32_t StartX, int32_t StartY, int32_t EndX, int32_t EndY, const FRasterRect& ClipRect, int32_t Width, int32_t Height, FLineSetup& OutSetup);
+
+	/**
+	 * 按SetupLine的结果写入直线的像素
+	 */
+	void DrawLine(const FLineSetup& Setup, uint32_t* Pixels, uint32_t Color);
+
+	/**
+	 * 三角形的边函数和插值平面，由SetupTriangle计算
+	 */
+	struct FTriangleSetup
+	{
+		/** 包围盒和裁剪范围的交集 */
+		FRasterRect Bounds;
+
+		/** 三条边的边函数 E(X, Y) = EdgeStepX * X + EdgeStepY * Y + EdgeOrigin + EdgeBias */
+		int64_t EdgeStepX[3];
+		int64_t EdgeStepY[3];
+		int64_t EdgeOrigin[3];
+		int64_t EdgeBias[3];
+
+		/** 重心坐标和深度的平面方程 Value(X, Y) = Plane[0] * X + Plane[1] * Y + Plane[2] */
+		float BarycentricPlane[3][3];
+		float DepthPlane[3];
+
+		/** 交换顶点顺序之后的第i个顶点对应原来的第几个顶点 */
+		int32_t VertexOrder[3];
+	};
+
+	/**
+	 * 计算半空间(Half-Space)算法需要的边函数和插值平面，三角形不需要绘制时返回false
+	 *    面积为0、顶点坐标超出定点数范围、或者和裁剪范围没有交集的三角形都不绘制，正反面都填充
+	 */
+	bool SetupTriangle(const float ScreenX[3], const float ScreenY[3], const float Depth[3], const FRasterRect& ClipRect, int32_t Width, int32_t Height, FTriangleSetup& OutSetup);
+
+	/**
+	 * 填充三角形
+	 *    以8x8的像素块为单位遍历包围盒，块内按2x2像素为一组测试，使用Reversed-Z做Early-Z深度测试
+	 *    深度测试通过的像素调用 Shader(X, Y, Depth, Barycentric)，返回写入的颜色，Barycentric按原始顶点顺序排列
+	 *    返回写入的像素个数
+	 */
+	template<typename ShaderType>
+	int32_t RasterizeTriangle(const FTriangleSetup& Setup, const FRasterSurface& Surface, ShaderType&& Shader);
+
+	/**
+	 * 批量变换顶点位置，一次计算4个顶点
+	 *    Positions是连续存储的 (X, Y, Z)，Matrix使用行向量约定，ClipPos = [X Y Z 1] * Matrix
+	 *    结果按SoA布局写入4个数组，每个数组的长度等于NumVertices
+	 */
+	void TransformPositions(const float* Positions, int32_t NumVertices, const float Matrix[4][4], float* OutX, float* OutY, float* OutZ, float* OutW);
+
+	/**
+	 * 透视除法和视口变换，一次计算4个顶点
+	 *    ClipX/ClipY/ClipZ/ClipW必须16字节对齐，长度补齐到4的倍数
+	 *    屏幕坐标按 (X, Y) 交错写入OutScreenPos，深度写入OutDepth，只写入前NumVertices个
+	 */
+	void ProjectToScreen(const float* ClipX, const float* ClipY, const float* ClipZ, const float* ClipW, int32_t NumVertices, int32_t ViewportWidth, int32_t ViewportHeight, float* OutScreenPos, float* OutDepth);
+
+	/////////////////////////////////////////////////////
+	// 模板函数实现
+
+	template<typename ShaderType>
+	int32_t RasterizeTriangle(const FTriangleSetup& Setup, const FRasterSurface& Surface, ShaderType&& Shader)
+	{
+		using namespace Simd;
+
+		int32_t NumPixelsWritten = 0;
+
+		const FFloat4 DepthPlaneX = Float4Set1(Setup.DepthPlane[0]);
+		const FFloat4 DepthPlaneY = Float4Set1(Setup.DepthPlane[1]);
+		const FFloat4 DepthPlaneOrigin = Float4Set1(Setup.DepthPlane[2]);
+
+		// 2x2像素块中4个像素相对左上角像素的偏移，依次为 (0, 0) (1, 0) (0, 1) (1, 1)
+		const FFloat4 QuadOffsetX = Float4Set(0.0f, 1.0f, 0.0f, 1.0f);
+		const FFloat4 QuadOffsetY = Float4Set(0.0f, 0.0f, 1.0f, 1.0f);
+
+		const int32_t MinX = Setup.Bounds.MinX;
+		const int32_t MinY = Setup.Bounds.MinY;
+		const int32_t MaxX = Setup.Bounds.MaxX;
+		const int32_t MaxY = Setup.Bounds.MaxY;
+
+		// 1 以8x8的像素块为单位遍历包围盒
+		for (int32_t BlockY = MinY; BlockY < MaxY; BlockY += RasterBlockSize)
+		{
+			const int32_t BlockMaxY = BlockY + RasterBlockSize < MaxY ? BlockY + RasterBlockSize : MaxY;
+
+			for (int32_t BlockX = MinX; BlockX < MaxX; BlockX += RasterBlockSize)
+			{
+				const int32_t BlockMaxX = BlockX + RasterBlockSize < MaxX ? BlockX + RasterBlockSize : MaxX;
+
+				// 1.1 边函数是线性函数，块内的最大最小值一定在四个角上
+				//    任意一条边在四个角上都小于0，整个块在三角形外，直接跳过
+				//    一条边在四个角上都大于等于0，块内所有像素都在这条边内侧，不需要逐像素测试
+				int64_t BlockEdge[3];
+				bool bEdgeNeedsTest[3];
+				bool bBlockOutside = false;
+				for (int32_t Index = 0; Index < 3; ++Index)
+				{
+					const int64_t Corner00 = Setup.EdgeStepX[Index] * BlockX + Setup.EdgeStepY[Index] * BlockY + Setup.EdgeOrigin[Index] + Setup.EdgeBias[Index];
+					const int64_t Corner10 = Corner00 + Setup.EdgeStepX[Index] * (BlockMaxX - 1 - BlockX);
+					const int64_t Corner01 = Corner00 + Setup.EdgeStepY[Index] * (BlockMaxY - 1 - BlockY);
+					const int64_t Corner11 = Corner10 + Setup.EdgeStepY[Index] * (BlockMaxY - 1 - BlockY);
+
+					if (Corner00 < 0 && Corner10 < 0 && Corner01 < 0 && Corner11 < 0)
+					{
+						bBlockOutside = true;
+						break;
+					}
+
+					BlockEdge[Index] = Corner00;
+					bEdgeNeedsTest[Index] = Corner00 < 0 || Corner10 < 0 || Corner01 < 0 || Corner11 < 0;
+				}
+
+				if (bBlockOutside)
+					continue;
+
+				// 1.2 块内按2x2像素为一组测试，边穿过这个块时块内的边函数值不会超过int32的范围
+				for (int32_t QuadY = BlockY; QuadY < BlockMaxY; QuadY += 2)
+				{
+					for (int32_t QuadX = BlockX; QuadX < BlockMaxX; QuadX += 2)
+					{
+						// 超出块范围的像素去掉
+						int32_t Coverage = 0xF;
+						if (QuadX + 1 >= BlockMaxX)
+							Coverage &= 0x5;
+						if (QuadY + 1 >= BlockMaxY)
+							Coverage &= 0x3;
+
+						FInt4 EdgeSigns = Int4Set1(0);
+						for (int32_t Index = 0; Index < 3; ++Index)
+						{
+							if (!bEdgeNeedsTest[Index])
+								continue;
+
+							const int32_t StepX = static_cast<int32_t>(Setup.EdgeStepX[Index]);
+							const int32_t StepY = static_cast<int32_t>(Setup.EdgeStepY[Index]);
+							const int32_t QuadEdge = static_cast<int32_t>(BlockEdge[Index] + Setup.EdgeStepX[Index] * (QuadX - BlockX) + Setup.EdgeStepY[Index] * (QuadY - BlockY));
+
+							const FInt4 Edge = Int4Add(Int4Set1(QuadEdge), Int4Set(0, StepX, StepY, StepX + StepY));
+							EdgeSigns = Int4Or(EdgeSigns, Edge);
+						}
+
+						// 三个边函数按位或之后符号位为1说明至少有一条边小于0，像素在三角形外
+						Coverage &= ~Int4SignMask(EdgeSigns);
+						if (Coverage == 0)
+							continue;
+
+						// 1.3 计算4个像素的深度
+						alignas(16) float QuadDepth[4];
+						const FFloat4 PixelX = Float4Add(Float4Set1(static_cast<float>(QuadX)), QuadOffsetX);
+						const FFloat4 PixelY = Float4Add(Float4Set1(static_cast<float>(QuadY)), QuadOffsetY);
+						Float4StoreAligned(QuadDepth, Float4MultiplyAdd(PixelX, DepthPlaneX, Float4MultiplyAdd(PixelY, DepthPlaneY, DepthPlaneOrigin)));
+
+						// 1.4 深度测试，通过后才写入深度并执行像素着色器(Early-Z)
+						for (int32_t Lane = 0; Lane < 4; ++Lane)
+						{
+							if ((Coverage & (1 << Lane)) == 0)
+								continue;
+
+							const int32_t PixelPosX = QuadX + (Lane & 1);
+							const int32_t PixelPosY = QuadY + (Lane >> 1);
+							const int64_t PixelIndex = static_cast<int64_t>(PixelPosY) * Surface.Width + PixelPosX;
+
+							// Reversed-Z，深度更大的像素离相机更近
+							if (QuadDepth[Lane] <= Surface.Depth[PixelIndex])
+								continue;
+
+							Surface.Depth[PixelIndex] = QuadDepth[Lane];
+
+							float Barycentric[3];
+							for (int32_t Index = 0; Index < 3; ++Index)
+							{
+								const float* Plane = Setup.BarycentricPlane[Index];
+								Barycentric[Setup.VertexOrder[Index]] = Plane[0] * PixelPosX + Plane[1] * PixelPosY + Plane[2];
+							}
+
+							Surface.Pixels[PixelIndex] = Shader(PixelPosX, PixelPosY, QuadDepth[Lane], Barycentric);
+							++NumPixelsWritten;
+						}
+					}
+				}
+			}
+		}
+
+		return NumPixelsWritten;
+	}
+}
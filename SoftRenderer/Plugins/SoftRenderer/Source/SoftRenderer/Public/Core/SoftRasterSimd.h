@@ -0,0 +1,113 @@
+﻿#pragma once
+
+#include <cstdint>
+
+/**
+ * 核心光栅化库使用的4通道SIMD函数，不依赖引擎
+ *    x86-64使用SSE2，AArch64使用NEON，其他平台使用逐通道计算的标量实现，三种实现的结果完全一致
+ */
+#if defined(__SSE2__) || defined(_M_X64) || defined(_M_AMD64)
+	#define SOFTRASTER_SIMD_SSE2 1
+	#include <emmintrin.h>
+#elif defined(__aarch64__) || defined(_M_ARM64)
+	#define SOFTRASTER_SIMD_NEON 1
+	#include <arm_neon.h>
+#endif
+
+namespace SoftRasterCore
+{
+namespace Simd
+{
+#if defined(SOFTRASTER_SIMD_SSE2)
+	typedef __m128 FFloat4;
+	typedef __m128i FInt4;
+
+	inline FFloat4 Float4Set1(float Value) { return _mm_set1_ps(Value); }
+	inline FFloat4 Float4Set(float X, float Y, float Z, float W) { return _mm_setr_ps(X, Y, Z, W); }
+	inline FFloat4 Float4LoadAligned(const float* Data) { return _mm_load_ps(Data); }
+	inline void Float4Store(float* Data, FFloat4 Value) { _mm_storeu_ps(Data, Value); }
+	inline void Float4StoreAligned(float* Data, FFloat4 Value) { _mm_store_ps(Data, Value); }
+	inline FFloat4 Float4Add(FFloat4 A, FFloat4 B) { return _mm_add_ps(A, B); }
+	inline FFloat4 Float4Subtract(FFloat4 A, FFloat4 B) { return _mm_sub_ps(A, B); }
+	inline FFloat4 Float4Multiply(FFloat4 A, FFloat4 B) { return _mm_mul_ps(A, B); }
+	inline FFloat4 Float4Divide(FFloat4 A, FFloat4 B) { return _mm_div_ps(A, B); }
+	inline FFloat4 Float4MultiplyAdd(FFloat4 A, FFloat4 B, FFloat4 C) { return _mm_add_ps(_mm_mul_ps(A, B), C); }
+
+	inline FInt4 Int4Set1(int32_t Value) { return _mm_set1_epi32(Value); }
+	inline FInt4 Int4Set(int32_t X, int32_t Y, int32_t Z, int32_t W) { return _mm_setr_epi32(X, Y, Z, W); }
+	inline FInt4 Int4Add(FInt4 A, FInt4 B) { return _mm_add_epi32(A, B); }
+	inline FInt4 Int4Or(FInt4 A, FInt4 B) { return _mm_or_si128(A, B); }
+	
+	/** 4个通道的符号位，第i位对应第i个通道 */
+	inline int32_t Int4SignMask(FInt4 Value) { return _mm_movemask_ps(_mm_castsi128_ps(Value)); }
+
+	/** 对齐到16字节的地址写入4个32位的值，Streaming为true时不经过缓存 */
+	inline void Store4x32(uint32_t* Data, FInt4 Value, bool bStreaming)
+	{
+		if (bStreaming)
+		{
+			_mm_stream_si128(reinterpret_cast<__m128i*>(Data), Value);
+		}
+		else
+		{
+			_mm_store_si128(reinterpret_cast<__m128i*>(Data), Value);
+		}
+	}
+
+	/** 非临时写入之后的内存屏障 */
+	inline void StreamingFence() { _mm_sfence(); }
+	
+#elif defined(SOFTRASTER_SIMD_NEON)
+	typedef float32x4_t FFloat4;
+	typedef int32x4_t FInt4;
+
+	inline FFloat4 Float4Set1(float Value) { return vdupq_n_f32(Value); }
+	inline FFloat4 Float4Set(float X, float Y, float Z, float W) { const float Lanes[4] = { X, Y, Z, W }; return vld1q_f32(Lanes); }
+	inline FFloat4 Float4LoadAligned(const float* Data) { return vld1q_f32(Data); }
+	inline void Float4Store(float* Data, FFloat4 Value) { vst1q_f32(Data, Value); }
+	inline void Float4StoreAligned(float* Data, FFloat4 Value) { vst1q_f32(Data, Value); }
+	inline FFloat4 Float4Add(FFloat4 A, FFloat4 B) { return vaddq_f32(A, B); }
+	inline FFloat4 Float4Subtract(FFloat4 A, FFloat4 B) { return vsubq_f32(A, B); }
+	inline FFloat4 Float4Multiply(FFloat4 A, FFloat4 B) { return vmulq_f32(A, B); }
+	inline FFloat4 Float4Divide(FFloat4 A, FFloat4 B) { return vdivq_f32(A, B); }
+	inline FFloat4 Float4MultiplyAdd(FFloat4 A, FFloat4 B, FFloat4 C) { return vaddq_f32(vmulq_f32(A, B), C); }
+
+	inline FInt4 Int4Set1(int32_t Value) { return vdupq_n_s32(Value); }
+	inline FInt4 Int4Set(int32_t X, int32_t Y, int32_t Z, int32_t W) { const int32_t Lanes[4] = { X, Y, Z, W }; return vld1q_s32(Lanes); }
+	inline FInt4 Int4Add(FInt4 A, FInt4 B) { return vaddq_s32(A, B); }
+	inline FInt4 Int4Or(FInt4 A, FInt4 B) { return vorrq_s32(A, B); }
+	
+	inline int32_t Int4SignMask(FInt4 Value)
+	{
+		const uint32x4_t Signs = vshrq_n_u32(vreinterpretq_u32_s32(Value), 31);
+		return static_cast<int32_t>(vgetq_lane_u32(Signs, 0) | (vgetq_lane_u32(Signs, 1) << 1) | (vgetq_lane_u32(Signs, 2) << 2) | (vgetq_lane_u32(Signs, 3) << 3));
+	}
+
+	inline void Store4x32(uint32_t* Data, FInt4 Value, bool /*bStreaming*/) { vst1q_u32(Data, vreinterpretq_u32_s32(Value)); }
+	inline void StreamingFence() {}
+	
+#else
+	struct FFloat4 { float V[4]; };
+	struct FInt4 { int32_t V[4]; };
+
+	inline FFloat4 Float4Set1(float Value) { return FFloat4{ { Value, Value, Value, Value } }; }
+	inline FFloat4 Float4Set(float X, float Y, float Z, float W) { return FFloat4{ { X, Y, Z, W } }; }
+	inline FFloat4 Float4LoadAligned(const float* Data) { return FFloat4{ { Data[0], Data[1], Data[2], Data[3] } }; }
+	inline void Float4Store(float* Data, FFloat4 Value) { for (int32_t Lane = 0; Lane < 4; ++Lane) Data[Lane] = Value.V[Lane]; }
+	inline void Float4StoreAligned(float* Data, FFloat4 Value) { Float4Store(Data, Value); }
+	inline FFloat4 Float4Add(FFloat4 A, FFloat4 B) { for (int32_t Lane = 0; Lane < 4; ++Lane) A.V[Lane] += B.V[Lane]; return A; }
+	inline FFloat4 Float4Subtract(FFloat4 A, FFloat4 B) { for (int32_t Lane = 0; Lane < 4; ++Lane) A.V[Lane] -= B.V[Lane]; return A; }
+	inline FFloat4 Float4Multiply(FFloat4 A, FFloat4 B) { for (int32_t Lane = 0; Lane < 4; ++Lane) A.V[Lane] *= B.V[Lane]; return A; }
+	inline FFloat4 Float4Divide(FFloat4 A, FFloat4 B) { for (int32_t Lane = 0; Lane < 4; ++Lane) A.V[Lane] /= B.V[Lane]; return A; }
+	inline FFloat4 Float4MultiplyAdd(FFloat4 A, FFloat4 B, FFloat4 C) { return Float4Add(Float4Multiply(A, B), C); }
+
+	inline FInt4 Int4Set1(int32_t Value) { return FInt4{ { Value, Value, Value, Value } }; }
+	inline FInt4 Int4Set(int32_t X, int32_t Y, int32_t Z, int32_t W) { return FInt4{ { X, Y, Z, W } }; }
+	inline FInt4 Int4Add(FInt4 A, FInt4 B) { for (int32_t Lane = 0; Lane < 4; ++Lane) A.V[Lane] = static_cast<int32_t>(static_cast<uint32_t>(A.V[Lane]) + static_cast<uint32_t>(B.V[Lane])); return A; }
+	inline FInt4 Int4Or(FInt4 A, FInt4 B) { for (int32_t Lane = 0; Lane < 4; ++Lane) A.V[Lane] |= B.V[Lane]; return A; }
+	inline int32_t Int4SignMask(FInt4 Value) { int32_t Mask = 0; for (int32_t Lane = 0; Lane < 4; ++Lane) Mask |= (Value.V[Lane] < 0 ? 1 : 0) << Lane; return Mask; }
+	inline void Store4x32(uint32_t* Data, FInt4 Value, bool /*bStreaming*/) { for (int32_t Lane = 0; Lane < 4; ++Lane) Data[Lane] = static_cast<uint32_t>(Value.V[Lane]); }
+	inline void StreamingFence() {}
+#endif
+}
+}
@@ -0,0 +1,58 @@
+﻿#pragma once
+
+#include "CoreMinimal.h"
+
+/**
+ * 每一帧使用的线性内存分配器
+ *    帧内的分配只移动偏移量，每一帧开始时调用Reset一次性释放本帧所有的分配
+ *    一帧内分配超出容量时，超出的部分临时从堆上分配，下一次Reset按本帧的总用量扩大容量，
+ *    之后用量不再增长的帧不会产生任何堆分配
+ *
+ *    分配出的内存只在本帧内有效，不会调用构造和析构函数，只能存放可以平凡析构的数据
+ */
+class SOFTRENDERER_API FFrameArena
+{
+public:
+	FFrameArena() = default;
+	~FFrameArena();
+
+	FFrameArena(const FFrameArena&) = delete;
+	FFrameArena& operator=(const FFrameArena&) = delete;
+
+	/**
+	 * 释放本帧所有的分配，上一帧容量不足时在这里扩容
+	 */
+	void Reset();
+
+	/**
+	 * 分配Size字节的内存，Alignment不能超过MaxAlignment
+	 */
+	void* Allocate(SIZE_T Size, uint32 Alignment);
+
+	/**
+	 * 分配Num个元素的数组，内容未初始化
+	 */
+	template <typename ElementType>
+	TArrayView<ElementType> AllocateArray(int32 Num, uint32 Alignment = alignof(ElementType))
+	{
+		static_assert(TIsTriviallyDestructible<ElementType>::Value, "FFrameArena never runs destructors.");
+		return MakeArrayView(static_cast<ElementType*>(Allocate(Num * sizeof(ElementType), Alignment)), Num);
+	}
+
+public:
+	/** 支持的最大对齐字节数 */
+	static constexpr uint32 MaxAlignment = 64;
+
+private:
+	/** 线性分配的内存块 */
+	uint8* Memory = nullptr;
+
+	/** 内存块的字节数 */
+	SIZE_T Capacity = 0;
+
+	/** 本帧已经分配的字节数，包括超出容量的部分 */
+	SIZE_T Offset = 0;
+
+	/** 本帧超出容量时临时分配的内存块 */
+	TArray<void*> OverflowBlocks;
+};
@@ -1,8 +1,26 @@
 ﻿#pragma once
 
 #include "CoreMinimal.h"
+#include "PixelShader.h"
 #include "FrameBuffer.generated.h"
 
+/**
+ * 帧图像的像素存储
+ *    帧图像有多份像素存储轮流使用，上传到纹理时直接把当前的存储交给渲染线程读取，不再复制一份
+ *    渲染线程上传完成之前这份存储不能写入，下一帧Clear时换到一份空闲的存储继续绘制
+ */
+struct FFrameBufferPixelStorage
+{
+	/** 一维像素数组数据 */
+	TArray<uint32> Pixels;
+
+	/** 这份存储中每个块的内容版本，和帧图像的块版本不同时说明内容已经过期 */
+	TArray<uint32> TileVersions;
+
+	/** 渲染线程是否还在读取这份存储 */
+	FThreadSafeBool bUploading;
+};
+
 /**
  * FrameBuffer --- 帧图像数据
  * 
@@ -17,7 +35,17 @@
  *    - 0 1 2 3 
  *    - 4 5 6 7
  *    Y
- * 
+ *
+ * DepthBuffer和Pixels一一对应，存储每个像素的深度，使用Reversed-Z，值越大离相机越近，清空值为0.0
+ *
+ * 快速清空(Fast Clear)
+ *    帧图像划分为ClearTileSize x ClearTileSize的块，快速清空只记录清空值并把所有块标记为待清空，不写内存
+ *    画点、画线、填充三角形第一次写入一个块之前才真正填充这个块，整帧都没有画到的块不会产生任何内存写入
+ *    分块光栅化的Tile大小和清空块大小一致，每个工作线程只会填充自己的Tile，不需要加锁
+ *
+ * 局部重绘(Dirty Region)
+ *    ClearTiles只清空指定的块，其他块保留上一帧的内容，上传纹理时只上传上一次上传之后被修改过的块
+ *    每个块有一个内容版本号，切换像素存储时只从上一份存储复制版本过期并且没有被清空的块
  */
 UCLASS(Blueprintable, BlueprintType)
 class UFrameBuffer : public UObject
@@ -31,13 +59,73 @@ protected:
 	/** 帧图像的像素高度 */
 	int32 Height;
 
-	/** 帧图像的一维像素数组数据 */
-	TArray<uint32> Pixels;
+	/** 帧图像的一维像素数组数据，指向当前使用的像素存储 */
+	TArrayView<uint32> Pixels;
+
+	/** 轮流使用的像素存储，上传中的存储由渲染线程的回调共同持有，帧图像释放后也不会提前释放内存 */
+	TArray<TSharedRef<FFrameBufferPixelStorage, ESPMode::ThreadSafe>> PixelStorages;
+
+	/** 当前使用的像素存储序号 */
+	int32 CurrentPixelStorage;
+
+	/** 帧图像的一维深度数组数据 */
+	TArray<float> DepthBuffer;
+
+	/** 清空块的水平个数 */
+	int32 NumClearTilesX;
+
+	/** 清空块的垂直个数 */
+	int32 NumClearTilesY;
+
+	/** 快速清空后每个块的颜色是否还没有写入内存，每个块一个字节，不同线程可以同时修改不同的块 */
+	TArray<uint8> PendingColorClearTiles;
+
+	/** 快速清空后每个块的深度是否还没有写入内存 */
+	TArray<uint8> PendingDepthClearTiles;
+
+	/** 待写入的清空颜色 */
+	uint32 PendingClearColor;
+
+	/** 待写入的清空深度 */
+	float PendingClearDepth;
+
+	/** 是否有块的颜色等待清空 */
+	bool bHasPendingColorClear;
+
+	/** 是否有块的深度等待清空 */
+	bool bHasPendingDepthClear;
 
-	/** 导出帧图像数据到Texture */
+	/** 每个块当前的内容版本，每次写入块时递增 */
+	TArray<uint32> TileVersions;
+
+	/** 上一次上传纹理之后每个块是否被修改过 */
+	TArray<uint8> ModifiedTiles;
+
+	/** 纹理中每个块的内容是否是TextureClearColor，快速清空后两帧都没有画到的块不需要重新上传 */
+	TArray<uint8> TextureClearedTiles;
+
+	/** 纹理中被清空的块的颜色 */
+	uint32 TextureClearColor;
+
+	/** 导出帧图像数据到Texture，大小不变时一直使用同一个纹理资源 */
 	UPROPERTY(Transient)
 	UTexture2D* Texture;
 	
+public:
+	/** 快速清空的块大小，和分块光栅化的Tile大小一致 */
+	static constexpr int32 ClearTileSize = 64;
+
+	/** 轮流使用的像素存储份数 */
+	static constexpr int32 NumPixelStorages = 3;
+
+	/** 上一次UpdateTexture2D在游戏线程上的耗时(毫秒)，不包括渲染线程执行上传的时间 */
+	UPROPERTY(BlueprintReadOnly, Transient)
+	float UploadTime;
+
+	/** 上一次UpdateTexture2D提交上传的字节数，没有需要上传的块时为0 */
+	UPROPERTY(BlueprintReadOnly, Transient)
+	int32 NumBytesUploaded;
+	
 public:
 	/**
 	 * 指定帧图像的新像素宽高
@@ -47,9 +135,23 @@ public:
 
 	/**
 	 * 清理帧图像数据，用指定的颜色填充整个帧图像数据
+	 *    bFastClear为true时只标记所有块待清空，第一次写入或者读取时才填充
 	 */
 	UFUNCTION(BlueprintCallable)
-	void Clear(FLinearColor ClearColor = FLinearColor::Black);
+	void Clear(FLinearColor ClearColor = FLinearColor::Black, bool bFastClear = false);
+
+	/**
+	 * 清理深度数据，用指定的深度填充整个深度缓冲
+	 *    bFastClear为true时只标记所有块待清空，第一次写入或者读取时才填充
+	 */
+	UFUNCTION(BlueprintCallable)
+	void ClearDepth(float ClearDepthValue = 0.0f, bool bFastClear = false);
+
+	/**
+	 * 只清空Tiles中标记的块，和快速清空一样第一次写入时才填充，其他块保留上一帧的内容
+	 *    Tiles的个数必须等于清空块的个数，块序号为TileY * NumClearTilesX + TileX
+	 */
+	void ClearTiles(const TBitArray<>& Tiles, FLinearColor ClearColor, bool bClearDepth, float ClearDepthValue = 0.0f);
 	
 	/**
 	 * 在X,Y对应位置的像素上填充Color指定的颜色
@@ -59,11 +161,113 @@ public:
 	
 	/**
 	 * 帧图像数据更新到Texture2D纹理中
+	 *    只在第一次调用或者大小变化时创建纹理资源，之后只上传和纹理内容不同的块，上传在渲染线程上异步进行
+	 *    上传期间当前的像素存储交给渲染线程读取，之后的第一次清空或者写入会切换到一份空闲的像素存储
 	 */
 	UFUNCTION(BlueprintCallable)
 	UTexture2D* UpdateTexture2D();
 
 public:
-	void DrawLine(int32 StartX, int32 StartY, int32 EndX, int32 EndY);
-	
+	/** 帧图像的像素宽度 */
+	FORCEINLINE int32 GetWidth() const { return Width; }
+
+	/** 帧图像的像素高度 */
+	FORCEINLINE int32 GetHeight() const { return Height; }
+
+	/** 帧图像的深度数据，快速清空后还没有写入的块保存的是旧数据，需要配合IsDepthClearPending使用 */
+	FORCEINLINE const TArray<float>& GetDepthBuffer() const { return DepthBuffer; }
+
+	/** 快速清空后，第TileIndex个清空块的深度是否还没有写入内存 */
+	FORCEINLINE bool IsDepthClearPending(int32 TileIndex) const { return bHasPendingDepthClear && PendingDepthClearTiles[TileIndex] != 0; }
+
+	/** 清空块的水平个数 */
+	FORCEINLINE int32 GetNumClearTilesX() const { return NumClearTilesX; }
+
+	/** 清空块的垂直个数 */
+	FORCEINLINE int32 GetNumClearTilesY() const { return NumClearTilesY; }
+
+	/** 快速清空的深度值 */
+	FORCEINLINE float GetPendingClearDepth() const { return PendingClearDepth; }
+
+	/**
+	 * 把Rect范围覆盖的所有待清空的块写入清空值
+	 *    多线程同时调用时，不同线程的Rect不能覆盖同一个块
+	 */
+	void ResolveFastClear(const FIntRect& Rect);
+
+	/**
+	 * 把所有待清空的块写入清空值，读取整个帧图像数据之前调用
+	 */
+	void ResolveFastClear();
+
+	/**
+	 * 读取整个帧图像的像素，先写入所有待清空的块，离屏渲染时代替UpdateTexture2D使用
+	 */
+	void ReadPixels(TArray<FColor>& OutPixels);
+
+	/**
+	 * 使用Bresenham算法在两个像素之间画一条直线
+	 */
+	void DrawLine(int32 StartX, int32 StartY, int32 EndX, int32 EndY, const FLinearColor& Color = FLinearColor::Blue);
+
+	/**
+	 * 画一条直线，只写入ClipRect范围内的像素(左闭右开区间)
+	 *    画出的像素与不裁剪时完全一致，只是丢弃ClipRect之外的部分，
+	 *    分块光栅化时每个Tile用自己的范围作为ClipRect，多个线程可以同时画同一条线而不会写同一个像素
+	 */
+	void DrawLine(int32 StartX, int32 StartY, int32 EndX, int32 EndY, const FLinearColor& Color, const FIntRect& ClipRect);
+
+	/**
+	 * 使用打包后的颜色画一条直线，只写入ClipRect范围内的像素(左闭右开区间)
+	 *    直线先在主轴和次轴两个方向上一次性裁剪，然后按水平、垂直、对角线或者游程直接写入像素数组，循环内没有范围检查
+	 *    画很多条同样颜色的线时，调用方预先转换一次颜色，返回写入的像素个数
+	 */
+	int32 DrawLine(int32 StartX, int32 StartY, int32 EndX, int32 EndY, uint32 PackedColor, const FIntRect& ClipRect);
+
+	/**
+	 * 像素着色回调，返回打包后的像素颜色
+	 */
+	typedef TFunctionRef<uint32(const FPixelShaderInput& Input)> FPixelShaderFunction;
+
+	/**
+	 * 使用半空间(Half-Space)算法填充三角形，只写入ClipRect范围内的像素(左闭右开区间)
+	 *    ScreenPos是三个顶点的屏幕坐标(像素单位，带亚像素精度)，Depth是三个顶点的深度
+	 *    以8x8的像素块为单位测试，完全在三角形外的块整体跳过，部分覆盖的块用SIMD一次测试2x2个像素
+	 *    通过深度测试的像素才执行PixelShaderFunction(Early-Z)，边函数全部使用整数计算，裁剪前后的结果完全一致
+	 *    返回写入的像素个数
+	 */
+	int32 DrawTriangle(const FVector2D ScreenPos[3], const float Depth[3], FPixelShaderFunction PixelShaderFunction, const FIntRect& ClipRect);
+
+protected:
+	/**
+	 * 当前的像素存储还在上传时，切换到一份空闲的像素存储
+	 */
+	void AcquirePixelStorage();
+
+	/**
+	 * 计算Rect范围覆盖的块，返回左闭右开的块序号范围，Rect和帧图像不相交时返回false
+	 */
+	bool GetTileRange(const FIntRect& Rect, FIntRect& OutTileRange) const;
+
+	/**
+	 * 把一个待清空的块写入清空值
+	 */
+	void ResolveTile(int32 TileIndex);
+
+	/**
+	 * 记录块被修改，递增块的内容版本
+	 */
+	void MarkTileModified(int32 TileIndex);
+
+	/**
+	 * 写入Rect范围的像素之前调用，当前的像素存储还在上传时先切换存储，再填充待清空的块，记录这些块被修改
+	 *    多线程同时调用时，不同线程的Rect不能覆盖同一个块，并且上传之后要先在单个线程上Clear、ClearTiles或者写入一次
+	 */
+	void BeginWrite(const FIntRect& Rect);
+
+	/**
+	 * 块是否需要上传到纹理
+	 */
+	bool IsTileDirtyForTexture(int32 TileIndex) const;
+
 };
@@ -0,0 +1,84 @@
+﻿#pragma once
+
+#include "CoreMinimal.h"
+#include "Async/Future.h"
+
+class UFrameBuffer;
+
+/**
+ * 帧序列的图像格式
+ */
+enum class EFrameImageFormat : uint8
+{
+	PPM,    // 二进制PPM(P6)，不压缩，编码最快
+	PNG     // PNG，无损压缩
+};
+
+/**
+ * 离屏渲染的帧序列写入器
+ *    每一帧的像素复制一份后交给后台线程池编码并写入文件，渲染线程不等待磁盘
+ *    等待写入的帧超过MaxPendingFrames时才等待最早的一帧写完，限制复制的像素占用的内存
+ *    文件名为 Directory/BaseName_00000.ppm 这样的格式，序号从0开始
+ */
+class SOFTRENDERER_API FFrameSequenceWriter
+{
+public:
+	FFrameSequenceWriter(const FString& InDirectory, const FString& InBaseName, EFrameImageFormat InFormat, int32 InMaxPendingFrames = 4);
+	~FFrameSequenceWriter();
+
+	FFrameSequenceWriter(const FFrameSequenceWriter&) = delete;
+	FFrameSequenceWriter& operator=(const FFrameSequenceWriter&) = delete;
+
+	/**
+	 * 读取帧图像的像素，作为下一帧交给后台线程写入
+	 */
+	void AddFrame(UFrameBuffer* FrameBuffer);
+
+	/**
+	 * 等待所有帧写入完成，返回是否所有帧都写入成功
+	 */
+	bool Flush();
+
+	/**
+	 * 已经添加的帧个数
+	 */
+	FORCEINLINE int32 GetNumFrames() const { return NumFrames; }
+
+	/**
+	 * 把BGRA像素编码为指定格式的文件数据，Alpha通道被忽略
+	 */
+	static bool EncodeImage(const TArray<FColor>& Pixels, int32 Width, int32 Height, EFrameImageFormat Format, TArray<uint8>& OutData);
+
+	/**
+	 * 格式对应的文件扩展名，不带点
+	 */
+	static const TCHAR* GetFileExtension(EFrameImageFormat Format);
+
+protected:
+	/**
+	 * 等待最早的一帧写入完成
+	 */
+	void WaitOldestFrame();
+
+protected:
+	/** 输出目录 */
+	FString Directory;
+
+	/** 文件名前缀 */
+	FString BaseName;
+
+	/** 图像格式 */
+	EFrameImageFormat Format;
+
+	/** 最多同时等待写入的帧个数 */
+	int32 MaxPendingFrames;
+
+	/** 已经添加的帧个数 */
+	int32 NumFrames;
+
+	/** 是否所有已经完成的帧都写入成功 */
+	bool bAllSucceeded;
+
+	/** 等待写入的帧，按添加的顺序排列 */
+	TArray<TFuture<bool>> PendingFrames;
+};
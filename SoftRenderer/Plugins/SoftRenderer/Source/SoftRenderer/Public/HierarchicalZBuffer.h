@@ -0,0 +1,79 @@
+﻿#pragma once
+
+#include "CoreMinimal.h"
+#include "TileRasterizer.h"
+
+class UFrameBuffer;
+
+/**
+ * 层次深度缓冲(Hierarchical-Z)，用于遮挡剔除
+ *    两层深度金字塔，第0层每个单元对应8x8的像素块，第1层每个单元对应一个Tile，每个单元记录覆盖像素中的最小和最大深度
+ *    使用Reversed-Z，深度值越大离相机越近，一个物体离相机最近的深度比它覆盖的所有单元的最小深度还小时，物体的所有像素都无法通过深度测试，可以直接剔除
+ *
+ *    光栅化过程中深度缓冲不断被填充，每批三角形光栅化后用MarkDirty标记写过的区域，Update只重建被标记的Tile
+ */
+class SOFTRENDERER_API FHierarchicalZBuffer
+{
+public:
+	/** 第0层单元的像素宽高 */
+	static constexpr int32 BlockSize = 8;
+
+	/** 第1层单元的像素宽高，和光栅化的Tile大小一致 */
+	static constexpr int32 TileSize = FTileRasterizer::TileSize;
+
+	static_assert(TileSize % BlockSize == 0, "Tile size must be a multiple of the block size.");
+
+public:
+	/**
+	 * 按渲染目标的像素宽高重建金字塔，所有单元设置为清空的深度
+	 */
+	void Init(int32 InWidth, int32 InHeight, float ClearDepth);
+
+	/**
+	 * 标记深度缓冲中被写过的区域
+	 */
+	void MarkDirty(const FIntRect& Rect);
+
+	/**
+	 * 从深度缓冲重建所有被标记的Tile
+	 */
+	void Update(const UFrameBuffer* FrameBuffer);
+
+	/**
+	 * 测试屏幕范围ScreenRect(左闭右开区间)内离相机最近深度为NearestDepth的物体是否被完全遮挡
+	 */
+	bool IsOccluded(const FIntRect& ScreenRect, float NearestDepth) const;
+
+private:
+	/**
+	 * 从深度缓冲重建一个Tile，包括Tile内的所有8x8像素块
+	 */
+	void UpdateTile(const UFrameBuffer* FrameBuffer, int32 TileIndex);
+
+private:
+	/** 渲染目标的像素宽度 */
+	int32 Width = 0;
+
+	/** 渲染目标的像素高度 */
+	int32 Height = 0;
+
+	/** 水平方向第0层单元的个数 */
+	int32 NumBlocksX = 0;
+
+	/** 水平方向第1层单元的个数 */
+	int32 NumTilesX = 0;
+
+	/** 第0层，每个8x8像素块的最小和最大深度 */
+	TArray<float> BlockMinDepth;
+	TArray<float> BlockMaxDepth;
+
+	/** 第1层，每个Tile的最小和最大深度 */
+	TArray<float> TileMinDepth;
+	TArray<float> TileMaxDepth;
+
+	/** 每个Tile是否需要重建 */
+	TBitArray<> DirtyTiles;
+
+	/** 需要重建的Tile列表 */
+	TArray<int32> DirtyTileList;
+};
@@ -0,0 +1,61 @@
+﻿#pragma once
+
+#include "CoreMinimal.h"
+#include "HAL/ThreadSafeBool.h"
+
+struct FRenderObjectVertex;
+struct FRenderObjectCluster;
+
+/**
+ * 模型数据的离线优化工具，导入模型时调用，渲染时不使用
+ */
+class SOFTRENDERER_API FMeshOptimizer
+{
+public:
+	/**
+	 * 使用Forsyth算法重排三角形顺序，让相邻的三角形尽量共享最近用过的顶点
+	 *    每次从最近使用的顶点所在的三角形中选出得分最高的一个输出，顶点的得分由在LRU缓存中的位置和剩余的三角形个数决定
+	 *    只改变三角形的顺序，不改变三角形本身和顶点的绕序
+	 */
+	static void OptimizeVertexCache(TArray<uint32>& Indices, int32 NumVertices);
+
+	/**
+	 * 按索引中第一次使用的顺序重排顶点并重映射索引，没有被任何三角形使用的顶点会被删除
+	 *    在OptimizeVertexCache之后调用，顶点变换和三角形组装时按接近顺序的方式访问顶点数组
+	 */
+	static void OptimizeVertexFetch(TArray<FRenderObjectVertex>& Vertices, TArray<uint32>& Indices);
+
+	/**
+	 * 计算索引在指定大小的FIFO顶点缓存下的ACMR(Average Cache Miss Ratio)，即每个三角形平均需要变换的顶点个数
+	 *    取值范围0.5到3.0，越小越好
+	 */
+	static float CalculateACMR(TArrayView<const uint32> Indices, int32 NumVertices, int32 CacheSize = 16);
+
+	/**
+	 * 合并位置完全相同的顶点并重映射索引，被合并的顶点留在数组中，之后由OptimizeVertexFetch删除
+	 *    渲染对象的顶点只有位置，模型在UV接缝和法线不连续处拆开的顶点可以合并，三角形重新连成一片
+	 */
+	static void WeldVertices(TArrayView<const FRenderObjectVertex> Vertices, TArray<uint32>& Indices);
+
+	/**
+	 * 使用二次误差度量(Quadric Error Metrics)的边坍缩简化模型，三角形个数减少到TargetNumTriangles左右
+	 *    每次坍缩误差最小的边，坍缩后的顶点放在误差较小的一个端点上，简化后的顶点是原顶点的子集
+	 *    边界边额外加上垂直于三角形的平面的误差，尽量保持轮廓；会让三角形翻转的坍缩被跳过，所以不一定能达到目标个数
+	 *    返回的索引仍然引用原来的顶点数组，需要再调用OptimizeVertexFetch删除不再使用的顶点
+	 *    bCancelled不为空时定期检查，变为true后停止坍缩，返回当前已经简化到的结果
+	 */
+	static TArray<uint32> SimplifyMesh(TArrayView<const FRenderObjectVertex> Vertices, TArrayView<const uint32> Indices, int32 TargetNumTriangles, const FThreadSafeBool* bCancelled = nullptr);
+
+	/**
+	 * 把三角形划分为最多MaxTriangles个三角形的簇，重排索引让同一个簇的三角形连续存放，返回每个簇的三角形个数
+	 *    从上一个簇边缘还没有分配的三角形开始，沿共享顶点的相邻三角形广度优先扩展，每个簇是空间上紧凑的一片
+	 *    簇内保持输入的三角形顺序，在OptimizeVertexCache之后、OptimizeVertexFetch之前调用
+	 */
+	static TArray<int32> BuildClusters(TArray<uint32>& Indices, int32 NumVertices, int32 MaxTriangles = 128);
+
+	/**
+	 * 计算每个簇的索引范围、顶点范围、包围球和法线锥，顶点和索引已经是最终的顺序
+	 *    法线锥的轴是簇内三角形单位法线的平均方向，张角刚好包含所有三角形的法线，张角达到90度时簇不能做背面剔除
+	 */
+	static TArray<FRenderObjectCluster> ComputeClusterBounds(TArrayView<const FRenderObjectVertex> Vertices, TArrayView<const uint32> Indices, TArrayView<const int32> NumClusterTriangles);
+};
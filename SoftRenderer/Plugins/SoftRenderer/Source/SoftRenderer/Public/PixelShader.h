@@ -0,0 +1,39 @@
+﻿#pragma once
+
+#include "CoreMinimal.h"
+#include "PixelShader.generated.h"
+
+/**
+ * 像素着色器的输入
+ */
+struct FPixelShaderInput
+{
+	/** 像素坐标 */
+	FIntPoint PixelPos;
+
+	/** 像素的深度 */
+	float Depth;
+
+	/** 像素在三角形中的重心坐标，分别是三角形三个顶点的权重 */
+	FVector Barycentric;
+};
+
+/**
+ * 像素着色器对象
+ *    实体渲染模式下，每个通过深度测试的像素执行一次RunPixelShader，深度测试失败的像素不会执行(Early-Z)
+ *    分块光栅化时同一个像素着色器会在多个工作线程上同时执行，RunPixelShader中不能修改对象自身的状态
+ */
+UCLASS(Blueprintable, BlueprintType)
+class SOFTRENDERER_API UPixelShader : public UObject
+{
+	GENERATED_UCLASS_BODY()
+
+public:
+	/** 像素颜色 */
+	UPROPERTY(EditAnywhere, BlueprintReadWrite)
+	FLinearColor Color;
+
+public:
+	virtual FLinearColor RunPixelShader(const FPixelShaderInput& Input) const;
+	
+};
@@ -2,6 +2,8 @@
 
 #include "CoreMinimal.h"
 #include "VertexShader.h"
+#include "PixelShader.h"
+#include "Serialization/BulkData.h"
 #include "RenderObject.generated.h"
 
 /**
@@ -24,6 +26,135 @@ public:
 	 */
 	UPROPERTY(Transient)
 	UVertexShader* VertexShader;
+
+	/**
+	 * 像素着色器类，只用于实体渲染模式，没有指定时使用默认的UPixelShader
+	 */
+	UPROPERTY(EditAnywhere, BlueprintReadWrite)
+	TSubclassOf<UPixelShader> PixelShaderClass;
+
+	/**
+	 * 像素着色器
+	 */
+	UPROPERTY(Transient)
+	UPixelShader* PixelShader;
+
+	/**
+	 * 实体模式下是否剔除背面的三角形，屏幕上顶点顺时针排列的一面是正面
+	 *    只对封闭的模型开启，大模型还可以按簇整体剔除背向相机的部分
+	 */
+	UPROPERTY(EditAnywhere, BlueprintReadWrite)
+	bool bBackfaceCulling = false;
+};
+
+/**
+ * 模型的一个簇(Cluster)，导入时把LOD0中相邻的最多128个三角形划分为一个簇
+ *    簇的三角形在索引中连续存放，渲染器按簇做视锥剔除和背面剔除，整簇被剔除时它的顶点不需要变换
+ *    所有成员都是4字节的数值，二进制网格数据中直接整块复制
+ */
+USTRUCT(BlueprintType)
+struct FRenderObjectCluster
+{
+	GENERATED_BODY()
+
+public:
+	/**
+	 * 本地空间包围球的球心
+	 */
+	UPROPERTY(VisibleAnywhere)
+	FVector Center = FVector::ZeroVector;
+
+	/**
+	 * 本地空间包围球的半径
+	 */
+	UPROPERTY(VisibleAnywhere)
+	float Radius = 0.0f;
+
+	/**
+	 * 法线锥的轴，簇内三角形法线的平均方向，单位向量
+	 */
+	UPROPERTY(VisibleAnywhere)
+	FVector ConeAxis = FVector::ZeroVector;
+
+	/**
+	 * 法线锥半张角的正弦，法线锥张角达到90度时大于1，这样的簇不会被背面剔除
+	 */
+	UPROPERTY(VisibleAnywhere)
+	float ConeCutoff = 2.0f;
+
+	/**
+	 * 簇的第一个索引和索引个数
+	 */
+	UPROPERTY(VisibleAnywhere)
+	int32 FirstIndex = 0;
+
+	UPROPERTY(VisibleAnywhere)
+	int32 NumIndices = 0;
+
+	/**
+	 * 簇的三角形用到的顶点范围，顶点按第一次使用的顺序排列，范围内大部分顶点都被这个簇使用
+	 */
+	UPROPERTY(VisibleAnywhere)
+	int32 FirstVertex = 0;
+
+	UPROPERTY(VisibleAnywhere)
+	int32 NumVertices = 0;
+
+public:
+	/**
+	 * 簇是否可以做背面剔除
+	 */
+	FORCEINLINE bool HasNormalCone() const { return ConeCutoff <= 1.0f; }
+};
+
+/**
+ * 渲染对象的一级简化模型(LOD)
+ *    索引的存储方式和URenderObject的Indices、CompactIndices相同
+ */
+USTRUCT(BlueprintType)
+struct FRenderObjectLOD
+{
+	GENERATED_BODY()
+
+public:
+	/**
+	 * 这一级模型本地空间的顶点信息
+	 */
+	UPROPERTY(EditAnywhere, BlueprintReadWrite)
+	TArray<FRenderObjectVertex> Vertices;
+
+	/**
+	 * 这一级模型的int32格式索引信息，不为空时优先使用
+	 */
+	UPROPERTY(EditAnywhere, BlueprintReadWrite)
+	TArray<int32> Indices;
+
+	/**
+	 * 这一级模型的uint16格式索引信息
+	 */
+	UPROPERTY(VisibleAnywhere)
+	TArray<uint16> CompactIndices;
+
+	/**
+	 * 渲染对象的屏幕尺寸小于这个值时使用这一级模型
+	 *    屏幕尺寸是包围球直径在屏幕上占视口高度的比例，1.0表示刚好和视口一样高
+	 */
+	UPROPERTY(EditAnywhere, BlueprintReadWrite)
+	float ScreenSize = 0.0f;
+};
+
+/**
+ * 渲染对象一级模型的去重边列表缓存
+ */
+struct FRenderObjectEdgeCache
+{
+	/** 去重后的边列表 */
+	TArray<FIntPoint> UniqueEdges;
+
+	/** 生成边列表时的索引数组地址、索引个数和渲染状态版本号 */
+	const void* IndexData = nullptr;
+	int32 NumIndices = INDEX_NONE;
+	uint32 RenderStateVersion = 0;
 };
 
 /**
@@ -36,6 +167,15 @@ public:
  *    Vertices[2] = FRenderObjectVertex(Position = [0, 50, 0])
  *     
  *    Indices = {0, 1, 2} (表示用Vertices数组中的第0，1，2这三个顶点来构造一个三角形)
+ *
+ * 二进制网格数据(Mesh Bulk Data)
+ *    导入的大模型调用BakeMeshData把所有级模型的顶点和索引写成一整块二进制数据，加载资源时不再逐个元素反序列化结构体数组
+ *    数据布局: 文件头 | 每一级模型的描述 | 每一级模型的位置流和索引流，每段数据按16字节对齐，多字节数据按小端存储
+ *    二进制数据默认不随资源一起加载，第一次绘制前由渲染器调用ConditionalLoadMeshData整块读入，再直接复制到顶点和索引数组
+ *
+ * 簇(Cluster)
+ *    导入的大模型把LOD0划分为多个簇，每个簇带有包围球和法线锥，渲染器在变换顶点之前按簇剔除，只变换剩下的簇用到的顶点
+ *    簇只描述LOD0的索引，运行时修改LOD0的索引时由SetIndices清空，简化模型很少占据大片屏幕，不划分簇
  */
 UCLASS(Blueprintable, BlueprintType)
 class SOFTRENDERER_API URenderObject : public UObject
@@ -53,10 +193,38 @@ public:
 	 * 模型本地空间的索引信息，一个三角形3个顶点构成，必须是3的倍数
 	 * 这里使用uint32来索引，实际渲染管线还有uint16格式的索引信息可选，uint16格式存储用于节省内存
 	 * 由于蓝图这里uint32编译不过，用int32代替
+	 * Indices不为空时优先使用Indices，否则使用CompactIndices
 	 */
 	UPROPERTY(EditAnywhere, BlueprintReadWrite)
 	TArray<int32> Indices;
 
+	/**
+	 * uint16格式的索引信息，顶点个数不超过65536时由SetIndices自动使用，内存只有Indices的一半
+	 *    蓝图不支持uint16，只能在C++中修改
+	 */
+	UPROPERTY(VisibleAnywhere)
+	TArray<uint16> CompactIndices;
+
+	/**
+	 * 从LOD1开始的简化模型，LOD0就是上面的Vertices和Indices
+	 *    按ScreenSize从大到小排列，渲染器根据渲染对象在屏幕上的大小每帧选择一级模型
+	 */
+	UPROPERTY(EditAnywhere, BlueprintReadWrite)
+	TArray<FRenderObjectLOD> LODs;
+
+	/**
+	 * LOD0划分的簇，按索引中的顺序排列，所有簇正好覆盖全部索引，为空时整个模型一起绘制
+	 */
+	UPROPERTY(VisibleAnywhere)
+	TArray<FRenderObjectCluster> Clusters;
+
+	/**
+	 * 顶点和索引是否保存在二进制网格数据中
+	 *    为true时资源中的Vertices、Indices、LODs都是空的，第一次绘制前才从二进制网格数据中读取
+	 */
+	UPROPERTY(VisibleAnywhere)
+	bool bMeshDataInBulk;
+
 	/**
 	 * 渲染对象在世界空间中的位置
 	 */
@@ -83,9 +251,173 @@ public:
 	FRenderObjectMaterial Material;
 
 public:
+	/**
+	 * 设置第LODIndex级模型的索引信息，顶点个数不超过65536时存储为uint16格式，否则存储为int32格式
+	 *    需要先设置这一级模型的顶点，设置LOD0的索引时清空原来的簇
+	 */
+	void SetIndices(TArrayView<const uint32> InIndices, int32 LODIndex = 0);
+
+	/**
+	 * 模型的级数，包括LOD0
+	 */
+	FORCEINLINE int32 GetNumLODs() const { return LODs.Num() + 1; }
+
+	/**
+	 * 第LODIndex级模型的顶点
+	 */
+	FORCEINLINE const TArray<FRenderObjectVertex>& GetLODVertices(int32 LODIndex = 0) const { return LODIndex == 0 ? Vertices : LODs[LODIndex - 1].Vertices; }
+
+	/**
+	 * 第LODIndex级模型的int32格式索引
+	 */
+	FORCEINLINE const TArray<int32>& GetLODIndices(int32 LODIndex = 0) const { return LODIndex == 0 ? Indices : LODs[LODIndex - 1].Indices; }
+
+	/**
+	 * 第LODIndex级模型的uint16格式索引
+	 */
+	FORCEINLINE const TArray<uint16>& GetLODCompactIndices(int32 LODIndex = 0) const { return LODIndex == 0 ? CompactIndices : LODs[LODIndex - 1].CompactIndices; }
+
+	/**
+	 * 第LODIndex级模型是否使用uint16格式的索引
+	 */
+	FORCEINLINE bool UsesCompactIndices(int32 LODIndex = 0) const { return GetLODIndices(LODIndex).Num() == 0 && GetLODCompactIndices(LODIndex).Num() > 0; }
+
+	/**
+	 * 第LODIndex级模型实际使用的索引个数
+	 */
+	FORCEINLINE int32 GetNumIndices(int32 LODIndex = 0) const { return UsesCompactIndices(LODIndex) ? GetLODCompactIndices(LODIndex).Num() : GetLODIndices(LODIndex).Num(); }
+
+	/**
+	 * 第LODIndex级模型的簇，只有LOD0可能有簇，簇和索引不匹配时返回空数组
+	 */
+	TArrayView<const FRenderObjectCluster> GetLODClusters(int32 LODIndex = 0) const;
+
+	/**
+	 * 第LODIndex级模型实际使用的索引数组地址，渲染器用来检测索引数组是否被重新分配
+	 */
+	FORCEINLINE const void* GetIndexData(int32 LODIndex = 0) const
+	{
+		return UsesCompactIndices(LODIndex) ? static_cast<const void*>(GetLODCompactIndices(LODIndex).GetData()) : static_cast<const void*>(GetLODIndices(LODIndex).GetData());
+	}
+
+	/**
+	 * 根据渲染对象的屏幕尺寸选择模型的级数，屏幕尺寸小于某一级的ScreenSize时使用更简化的一级
+	 */
+	int32 SelectLOD(float ScreenSize) const;
+
+	/**
+	 * 获取第LODIndex级模型去重后的边列表，每条边的两个顶点索引从小到大排列，相邻三角形共享的边只出现一次，线框模式使用
+	 *    第一次调用时生成并缓存，索引数组变化或者标记渲染状态变化后重新生成
+	 */
+	const TArray<FIntPoint>& GetUniqueEdges(int32 LODIndex = 0);
+
+	/**
+	 * 把所有级模型的顶点和索引以及LOD0的簇写入二进制网格数据，然后清空Vertices、Indices、Clusters和LODs中的数组
+	 *    导入模型时调用，之后保存资源时只保存二进制网格数据，读取后的数组不再保存，在编辑器中修改数组时重新写入二进制网格数据
+	 */
+	void BakeMeshData();
+
+	/**
+	 * 顶点和索引保存在二进制网格数据中并且还没有读取时，读取二进制网格数据
+	 *    蓝图实例自己没有二进制网格数据，从原型(Archetype)也就是蓝图类的默认对象中读取
+	 *    渲染器在第一次绘制渲染对象之前调用
+	 */
+	void ConditionalLoadMeshData();
+
 	/**
 	 * 获取渲染对象从本地空间转换到世界空间的变换矩阵
+	 *    矩阵缓存在渲染对象中，只有WorldLocation、WorldRotation、WorldScale变化时才重新计算
+	 */
+	const FMatrix& GetLocalToWorld() const;
+
+	/**
+	 * 变换矩阵的版本号，GetLocalToWorld重新计算矩阵时递增，渲染器用来判断缓存的变换是否过期
+	 */
+	FORCEINLINE uint32 GetTransformVersion() const { return TransformVersion; }
+
+	/**
+	 * 获取模型本地空间的包围盒，第一次调用时计算并缓存
+	 */
+	const FBox& GetLocalBounds();
+
+	/**
+	 * 获取模型本地空间的包围球，和包围盒一起计算并缓存
+	 */
+	const FSphere& GetLocalBoundingSphere();
+
+	/**
+	 * 运行时修改了Vertices或者LODs之后调用，下一次渲染时重新计算包围盒和包围球，同时标记渲染状态变化
+	 */
+	UFUNCTION(BlueprintCallable)
+	void MarkBoundsDirty();
+
+	/**
+	 * 运行时原地修改了顶点、索引或者着色器参数之后调用，下一次渲染时重绘渲染对象覆盖的区域
+	 *    变换、顶点和索引数组的重新分配、着色器的替换由渲染器自动检测，不需要调用
+	 */
+	UFUNCTION(BlueprintCallable)
+	void MarkRenderStateDirty();
+
+	/**
+	 * 渲染状态的版本号，每次标记渲染状态变化时递增
 	 */
-	FMatrix GetLocalToWorld() const;
+	FORCEINLINE uint32 GetRenderStateVersion() const { return RenderStateVersion; }
+
+	virtual void Serialize(FArchive& Ar) override;
+	
+#if WITH_EDITOR
+	virtual void PreEditChange(FProperty* PropertyAboutToChange) override;
+	virtual void PostEditChangeProperty(FPropertyChangedEvent& PropertyChangedEvent) override;
+	virtual void PostEditUndo() override;
+#endif
+
+protected:
+	/**
+	 * 从所有级模型的顶点重新计算包围盒和包围球
+	 */
+	void UpdateLocalBounds();
+
+	/**
+	 * 把所有级模型的顶点和索引以及LOD0的簇写入二进制网格数据，属性中的数组保持不变
+	 */
+	void WriteMeshBulkData();
+
+	/**
+	 * 从二进制网格数据中读取所有级模型的顶点和索引，数据不完整或者格式不对时返回false
+	 */
+	bool LoadMeshData(const uint8* Data, int64 DataSize);
+
+protected:
+	/** 缓存的模型本地空间包围盒 */
+	FBox LocalBounds;
+
+	/** 缓存的模型本地空间包围球，没有顶点时半径为0 */
+	FSphere LocalBoundingSphere;
+
+	/** 包围盒和包围球是否需要重新计算 */
+	bool bLocalBoundsDirty;
+
+	/** 渲染状态的版本号 */
+	uint32 RenderStateVersion;
+
+	/** 每一级模型缓存的去重后的边列表 */
+	TArray<FRenderObjectEdgeCache> EdgeCaches;
+
+	/** 缓存的本地空间到世界空间的变换矩阵，在const的GetLocalToWorld中按需计算 */
+	mutable FMatrix CachedLocalToWorld;
+
+	/** 计算CachedLocalToWorld时使用的位置、旋转、缩放 */
+	mutable FVector CachedWorldLocation;
+	mutable FRotator CachedWorldRotation;
+	mutable FVector CachedWorldScale;
+
+	/** 变换矩阵的版本号，0表示还没有计算过 */
+	mutable uint32 TransformVersion;
+
+	/** 二进制网格数据，bMeshDataInBulk为true时跟在属性后面序列化 */
+	FByteBulkData MeshBulkData;
+
+	/** 是否已经尝试过读取二进制网格数据 */
+	bool bMeshDataLoaded;
 	
 };
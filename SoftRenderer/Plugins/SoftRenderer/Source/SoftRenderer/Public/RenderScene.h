@@ -4,9 +4,35 @@
 #include "RenderObject.h"
 #include "RenderScene.generated.h"
 
+/**
+ * 实例化绘制的一组物体
+ *    所有实例共用同一个渲染对象的模型、模型级数和材质，每个实例只保存自己的本地空间到世界空间的变换
+ *    渲染对象自身的WorldLocation、WorldRotation、WorldScale不参与实例的变换
+ *    场景中大量重复的物体用实例化绘制，模型数据只在内存中保存一份，二进制网格数据和线框的边列表也只处理一次
+ */
+USTRUCT(BlueprintType)
+struct FRenderObjectInstances
+{
+	GENERATED_BODY()
+
+public:
+	/** 实例使用的渲染对象类，RenderObject为空时InitRenderer用它创建渲染对象 */
+	UPROPERTY(EditAnywhere, BlueprintReadWrite)
+	TSubclassOf<URenderObject> RenderObjectClass;
+
+	/** 所有实例共用的渲染对象 */
+	UPROPERTY(BlueprintReadWrite, Transient)
+	URenderObject* RenderObject = nullptr;
+
+	/** 每个实例的本地空间到世界空间的变换 */
+	UPROPERTY(EditAnywhere, BlueprintReadWrite)
+	TArray<FTransform> InstanceTransforms;
+};
+
 /**
  * 简单的渲染场景表示
  *    OpaqueRenderObjects 不透明渲染对象列表
+ *    InstancedRenderObjects 实例化绘制的不透明物体列表
  */
 UCLASS(Blueprintable, BlueprintType)
 class URenderScene : public UObject
@@ -21,5 +47,9 @@ public:
 	/** 不透明渲染对象列表 */
 	UPROPERTY(Transient)
 	TArray<URenderObject*> OpaqueRenderObjects;
+
+	/** 实例化绘制的不透明物体列表 */
+	UPROPERTY(EditAnywhere, BlueprintReadWrite)
+	TArray<FRenderObjectInstances> InstancedRenderObjects;
 	
 };
@@ -0,0 +1,128 @@
+﻿#pragma once
+
+#include "CoreMinimal.h"
+
+class URenderObject;
+class FViewFrustum;
+
+/**
+ * 场景中不透明渲染对象的层次包围盒(Bounding Volume Hierarchy)，用于层次视锥剔除和射线拾取
+ *    叶子保存渲染对象的世界空间包围盒，每个叶子最多MaxLeafObjects个渲染对象，内部节点按SAH(Surface Area Heuristic)分箱划分
+ *    节点存储在一维数组中，父节点在子节点前面，两个子节点相邻存放，每个节点覆盖ObjectIndices中连续的一段渲染对象
+ *
+ * 增量更新
+ *    每帧Update只比较渲染对象的变换版本号和本地包围盒，变化的渲染对象重新计算世界空间包围盒，再自底向上修正(Refit)节点
+ *    渲染对象增删或者替换时重建，修正后所有节点的表面积之和超过重建时的RebuildAreaRatio倍时也重建，避免运动物体让树的质量持续下降
+ */
+class SOFTRENDERER_API FRenderSceneBVH
+{
+public:
+	/** 叶子节点最多的渲染对象个数 */
+	static constexpr int32 MaxLeafObjects = 4;
+
+	/** SAH划分时每个轴的分箱个数 */
+	static constexpr int32 NumSAHBins = 12;
+
+	/** 修正后节点表面积之和超过重建时的这个倍数就重建 */
+	static constexpr float RebuildAreaRatio = 2.0f;
+
+public:
+	/**
+	 * 和渲染对象列表同步，渲染对象增删时重建，包围盒变化时修正
+	 *    渲染对象的网格数据需要已经读取，没有顶点或者无效的渲染对象不进入层次包围盒
+	 */
+	void Update(const TArray<URenderObject*>& RenderObjects);
+
+	/**
+	 * 层次视锥剔除，OutVisibleObjects中标记包围盒和视锥体相交的渲染对象，长度等于渲染对象个数
+	 *    和视锥体不相交的节点整个子树跳过，完全在视锥体内的节点不再测试子节点
+	 *    标记的渲染对象已经完成视锥剔除，绘制时不需要再测试
+	 */
+	void CullFrustum(const FViewFrustum& Frustum, TBitArray<>& OutVisibleObjects) const;
+
+	/**
+	 * 世界空间射线和渲染对象的LOD0三角形求交，返回最近的交点，三角形两面都可以被击中
+	 *    Direction不需要归一化，OutDistance和MaxDistance都是以Direction的长度为单位的射线参数
+	 */
+	bool RayCast(const FVector& Origin, const FVector& Direction, float MaxDistance, int32& OutObjectIndex, int32& OutTriangleIndex, float& OutDistance) const;
+
+	/** 层次包围盒中的渲染对象个数 */
+	FORCEINLINE int32 GetNumObjects() const { return ObjectIndices.Num(); }
+
+	/** 节点个数 */
+	FORCEINLINE int32 GetNumNodes() const { return Nodes.Num(); }
+
+private:
+	/**
+	 * 层次包围盒的节点
+	 */
+	struct FNode
+	{
+		/** 节点的世界空间包围盒 */
+		FVector Min;
+		FVector Max;
+
+		/** 节点覆盖的渲染对象在ObjectIndices中的范围 */
+		int32 FirstObject;
+		int32 NumObjects;
+
+		/** 左子节点的序号，右子节点紧跟在后面，叶子节点为INDEX_NONE */
+		int32 LeftChild;
+	};
+
+	/**
+	 * 每个渲染对象记录的状态
+	 */
+	struct FObjectEntry
+	{
+		/** 渲染对象，弱引用，渲染对象被回收后下一次Update时重建 */
+		TWeakObjectPtr<URenderObject> RenderObject;
+
+		/** 计算世界空间包围盒时的变换版本号和本地包围盒 */
+		uint32 TransformVersion = 0;
+		FVector LocalMin = FVector::ZeroVector;
+		FVector LocalMax = FVector::ZeroVector;
+
+		/** 世界空间包围盒，无效时渲染对象不进入层次包围盒 */
+		FBox WorldBounds = FBox(ForceInit);
+	};
+
+private:
+	/**
+	 * 从所有有效的渲染对象重建整棵树
+	 */
+	void Build();
+
+	/**
+	 * 把节点按SAH划分为两个子节点，递归处理子节点，渲染对象足够少或者无法划分时作为叶子
+	 */
+	void Subdivide(int32 NodeIndex);
+
+	/**
+	 * 自底向上修正所有节点的包围盒，返回所有节点的表面积之和
+	 */
+	float Refit();
+
+	/**
+	 * 用ObjectIndices中[FirstObject, FirstObject + NumObjects)范围的渲染对象计算节点的包围盒
+	 */
+	void UpdateLeafBounds(FNode& Node) const;
+
+	/**
+	 * 所有节点的表面积之和
+	 */
+	float CalculateTotalArea() const;
+
+private:
+	/** 和渲染对象列表一一对应的状态 */
+	TArray<FObjectEntry> Objects;
+
+	/** 层次包围盒中的渲染对象序号，按叶子的顺序排列 */
+	TArray<int32> ObjectIndices;
+
+	/** 所有节点，第0个是根节点 */
+	TArray<FNode> Nodes;
+
+	/** 重建时所有节点的表面积之和 */
+	float BuildTotalArea = 0.0f;
+};
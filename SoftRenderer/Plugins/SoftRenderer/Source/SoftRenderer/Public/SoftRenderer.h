@@ -3,6 +3,12 @@
 #include "CoreMinimal.h"
 #include "FrameBuffer.h"
 #include "RenderScene.h"
+#include "Clipper.h"
+#include "FrameArena.h"
+#include "HierarchicalZBuffer.h"
+#include "RenderSceneBVH.h"
+#include "TileRasterizer.h"
+#include "ViewFrustum.h"
 #include "SoftRenderer.generated.h"
 
 /**
@@ -32,6 +38,10 @@ public:
 	UPROPERTY(EditAnywhere, BlueprintReadWrite)
 	float FOV = 90;
 
+	/** 近裁剪面到相机的距离，只用于透视投影模式，远裁剪面在无穷远处 */
+	UPROPERTY(EditAnywhere, BlueprintReadWrite, meta = (ClampMin = "0.01"))
+	float NearClipPlane = 10.0f;
+
 	/** 正交宽度，场景单位, 只用于正交投影模式 */
 	UPROPERTY(EditAnywhere, BlueprintReadWrite)
 	float OrthoWidth = 1280;
@@ -43,6 +53,18 @@ public:
 	/** 相机在世界空间中的旋转 */
 	UPROPERTY(EditAnywhere, BlueprintReadWrite)
 	FRotator Rotation = FRotator::ZeroRotator;
+
+public:
+	/** 两个相机的所有参数是否完全相同 */
+	bool Equals(const FSoftRendererCamera& Other) const
+	{
+		return ProjectionMode == Other.ProjectionMode
+			&& FOV == Other.FOV
+			&& NearClipPlane == Other.NearClipPlane
+			&& OrthoWidth == Other.OrthoWidth
+			&& ViewOrigin == Other.ViewOrigin
+			&& Rotation == Other.Rotation;
+	}
 };
 
 /**
@@ -51,7 +73,300 @@ public:
 UENUM()
 enum class ESoftRendererRenderMode : uint8
 {
-	Wireframe,  // 线框模式   第一课只支持线框模式
+	Wireframe,  // 线框模式
+	Solid,      // 实体模式   填充三角形，带深度测试
+};
+
+/**
+ * 每一帧的渲染统计信息
+ */
+USTRUCT(BlueprintType)
+struct FSoftRendererStats
+{
+	GENERATED_BODY()
+
+public:
+	/** 被视锥剔除的渲染对象个数，实例化绘制的物体按实例计数 */
+	UPROPERTY(BlueprintReadOnly)
+	int32 NumFrustumCulledObjects = 0;
+
+	/** 被层次深度缓冲遮挡剔除的渲染对象个数，实例化绘制的物体按实例计数 */
+	UPROPERTY(BlueprintReadOnly)
+	int32 NumOccludedObjects = 0;
+
+	/** 实体模式下被视锥剔除或者背面剔除的簇个数，整个渲染对象被剔除时它的簇不计入 */
+	UPROPERTY(BlueprintReadOnly)
+	int32 NumClustersCulled = 0;
+
+	/** 清空并重绘的块个数，整帧重绘时等于所有块的个数，场景没有变化时为0 */
+	UPROPERTY(BlueprintReadOnly)
+	int32 NumRedrawnTiles = 0;
+
+	/** 执行顶点着色器的顶点个数，使用缓存的顶点变换结果时不计入 */
+	UPROPERTY(BlueprintReadOnly)
+	int32 NumVerticesShaded = 0;
+
+	/** 实体模式下进入图元装配的三角形个数，被剔除的渲染对象和簇的三角形不计入 */
+	UPROPERTY(BlueprintReadOnly)
+	int32 NumTrianglesSubmitted = 0;
+
+	/** 实体模式下整个在裁剪空间某个平面外侧、裁剪后没有剩余部分，或者被背面剔除的三角形个数 */
+	UPROPERTY(BlueprintReadOnly)
+	int32 NumTrianglesCulled = 0;
+
+	/** 线框模式下进入图元装配的线段个数 */
+	UPROPERTY(BlueprintReadOnly)
+	int32 NumLinesSubmitted = 0;
+
+	/** 线框模式下整个在裁剪空间某个平面外侧，或者裁剪后没有剩余部分的线段个数 */
+	UPROPERTY(BlueprintReadOnly)
+	int32 NumLinesCulled = 0;
+
+	/** 光栅化写入的像素个数，不包括清空 */
+	UPROPERTY(BlueprintReadOnly)
+	int32 NumPixelsWritten = 0;
+
+	/** 整个Render的耗时(毫秒) */
+	UPROPERTY(BlueprintReadOnly)
+	float RenderTime = 0.0f;
+
+	/** 更新视口矩阵、读取网格数据和检测需要重绘的块的耗时(毫秒) */
+	UPROPERTY(BlueprintReadOnly)
+	float SetupTime = 0.0f;
+
+	/** 清空颜色和深度的耗时(毫秒) */
+	UPROPERTY(BlueprintReadOnly)
+	float ClearTime = 0.0f;
+
+	/** 执行顶点着色器、透视除法和视口变换的耗时(毫秒) */
+	UPROPERTY(BlueprintReadOnly)
+	float VertexShadingTime = 0.0f;
+
+	/** 剔除、裁剪并输出屏幕空间三角形或者线段的耗时(毫秒) */
+	UPROPERTY(BlueprintReadOnly)
+	float PrimitiveAssemblyTime = 0.0f;
+
+	/** 光栅化三角形或者线段的耗时(毫秒) */
+	UPROPERTY(BlueprintReadOnly)
+	float RasterTime = 0.0f;
+};
+
+/**
+ * 射线拾取的结果
+ */
+USTRUCT(BlueprintType)
+struct FSoftRendererRayHit
+{
+	GENERATED_BODY()
+
+public:
+	/** 被击中的渲染对象 */
+	UPROPERTY(BlueprintReadOnly)
+	URenderObject* RenderObject = nullptr;
+
+	/** 被击中的三角形在LOD0索引中的序号，索引中第TriangleIndex * 3开始的3个索引构成这个三角形 */
+	UPROPERTY(BlueprintReadOnly)
+	int32 TriangleIndex = INDEX_NONE;
+
+	/** 世界空间的交点 */
+	UPROPERTY(BlueprintReadOnly)
+	FVector Location = FVector::ZeroVector;
+
+	/** 射线起点到交点的距离 */
+	UPROPERTY(BlueprintReadOnly)
+	float Distance = 0.0f;
+};
+
+/**
+ * 渲染对象上一帧绘制时的状态，和这一帧比较检测渲染对象是否发生变化
+ *    实例化绘制的一组物体也用一个状态记录，模型和材质取共用的渲染对象，屏幕范围是所有实例的并集
+ */
+struct FRenderObjectRenderState
+{
+	/** 渲染对象 */
+	TWeakObjectPtr<URenderObject> RenderObject;
+
+	/** 本地空间到世界空间的变换矩阵 */
+	FMatrix LocalToWorld = FMatrix::Identity;
+
+	/** 渲染对象的渲染状态版本号 */
+	uint32 RenderStateVersion = 0;
+
+	/** 绘制的模型级数 */
+	int32 LODIndex = 0;
+
+	/** 这一级模型的顶点数组，数组重新分配或者个数变化时认为顶点发生变化 */
+	const FRenderObjectVertex* VerticesData = nullptr;
+	int32 NumVertices = 0;
+
+	/** 实际使用的索引数组，int32或者uint16格式 */
+	const void* IndicesData = nullptr;
+	int32 NumIndices = 0;
+
+	/** 材质的着色器类和着色器对象 */
+	UClass* VertexShaderClass = nullptr;
+	UClass* PixelShaderClass = nullptr;
+	const UVertexShader* VertexShader = nullptr;
+	const UPixelShader* PixelShader = nullptr;
+
+	/** 像素着色器的颜色 */
+	FLinearColor PixelShaderColor = FLinearColor::Transparent;
+
+	/** 材质是否开启背面剔除 */
+	bool bBackfaceCulling = false;
+
+	/** 渲染对象可能覆盖的屏幕像素范围，限制在屏幕范围内，不可见时为空 */
+	FIntRect ScreenBounds;
+
+	/** 实例化绘制时的实例个数和所有实例变换的哈希，不是实例化绘制时为0 */
+	int32 NumInstances = 0;
+	uint32 InstanceTransformsHash = 0;
+};
+
+/**
+ * 一个渲染对象变换后的顶点，每个数组的长度等于顶点个数
+ */
+struct FTransformedVertices
+{
+	/** 齐次裁剪空间坐标，SoA布局 */
+	FVertexShaderBatchOutput ClipPos;
+
+	/** 屏幕坐标、深度和裁剪OutCode */
+	TArrayView<FVector2D> ScreenPos;
+	TArrayView<float> Depth;
+	TArrayView<uint32> OutCodes;
+
+public:
+	/** 从FirstVertex开始的NumVertices个顶点，实例化绘制时所有实例轮流使用同一块缓冲，按簇剔除时只变换其中几段 */
+	FTransformedVertices Slice(int32 FirstVertex, int32 NumVertices) const
+	{
+		FTransformedVertices Result;
+		Result.ClipPos.X = ClipPos.X.Slice(FirstVertex, NumVertices);
+		Result.ClipPos.Y = ClipPos.Y.Slice(FirstVertex, NumVertices);
+		Result.ClipPos.Z = ClipPos.Z.Slice(FirstVertex, NumVertices);
+		Result.ClipPos.W = ClipPos.W.Slice(FirstVertex, NumVertices);
+		Result.ScreenPos = ScreenPos.Slice(FirstVertex, NumVertices);
+		Result.Depth = Depth.Slice(FirstVertex, NumVertices);
+		Result.OutCodes = OutCodes.Slice(FirstVertex, NumVertices);
+		return Result;
+	}
+};
+
+/**
+ * 渲染对象跨帧缓存的变换数据
+ *    渲染对象的变换和相机都没有变化时直接使用缓存的本地空间到齐次裁剪空间的矩阵
+ *    顶点数据和顶点着色器也没有变化时，连顶点变换的结果一起复用，跳过整个顶点阶段
+ */
+struct FRenderObjectTransformCache
+{
+	/** 缓存对应的渲染对象 */
+	TWeakObjectPtr<URenderObject> RenderObject;
+
+	/** 计算LocalToProjection时渲染对象的变换版本号和渲染器的相机版本号，0表示无效 */
+	uint32 TransformVersion = 0;
+	uint32 ViewVersion = 0;
+
+	/** 本地空间到齐次裁剪空间的变换矩阵 LocalToWorld * WorldToView * Projection */
+	FMatrix LocalToProjection = FMatrix::Identity;
+
+	/** 这一帧根据屏幕尺寸选择的模型级数，切换级数后顶点数组不同，缓存的顶点变换结果随之失效 */
+	int32 LODIndex = 0;
+
+	/** 缓存的顶点变换结果是否有效 */
+	bool bVerticesValid = false;
+
+	/** 按簇剔除时只变换了ShadedClusters中的簇用到的顶点，否则所有顶点的变换结果都有效 */
+	bool bAllVerticesShaded = false;
+	TBitArray<> ShadedClusters;
+
+	/** 变换顶点时渲染对象的渲染状态版本号、顶点数组和顶点着色器 */
+	uint32 RenderStateVersion = 0;
+	const FRenderObjectVertex* VerticesData = nullptr;
+	int32 NumVertices = 0;
+	const UVertexShader* VertexShader = nullptr;
+
+	/** 齐次裁剪空间坐标，SoA布局，长度按4对齐方便SIMD读取 */
+	TArray<float, TAlignedHeapAllocator<16>> ClipPosX;
+	TArray<float, TAlignedHeapAllocator<16>> ClipPosY;
+	TArray<float, TAlignedHeapAllocator<16>> ClipPosZ;
+	TArray<float, TAlignedHeapAllocator<16>> ClipPosW;
+
+	/** 屏幕坐标、深度和裁剪OutCode */
+	TArray<FVector2D> ScreenPos;
+	TArray<float> Depth;
+	TArray<uint32> OutCodes;
+
+public:
+	/** 缓存中是否包含这些簇用到的顶点的变换结果 */
+	bool HasShadedClusters(TArrayView<const int32> Clusters) const
+	{
+		if (bAllVerticesShaded)
+			return true;
+
+		for (const int32 ClusterIndex : Clusters)
+		{
+			if (!ShadedClusters.IsValidIndex(ClusterIndex) || !ShadedClusters[ClusterIndex])
+				return false;
+		}
+		return true;
+	}
+
+	/** 释放缓存的顶点变换结果 */
+	void ReleaseVertices()
+	{
+		bVerticesValid = false;
+		bAllVerticesShaded = false;
+		ShadedClusters.Empty();
+		ClipPosX.Empty();
+		ClipPosY.Empty();
+		ClipPosZ.Empty();
+		ClipPosW.Empty();
+		ScreenPos.Empty();
+		Depth.Empty();
+		OutCodes.Empty();
+	}
+};
+
+/**
+ * 上一帧影响所有像素的全局渲染状态，任何一项变化时整帧重绘
+ */
+struct FSoftRendererViewState
+{
+	/** 状态是否有效，第一帧和关闭局部重绘后无效 */
+	bool bValid = false;
+
+	/** 帧图像对象和大小 */
+	const UFrameBuffer* FrameBuffer = nullptr;
+	FIntPoint FrameBufferSize = FIntPoint::ZeroValue;
+
+	/** 世界空间到齐次裁剪空间的变换矩阵 */
+	FMatrix WorldToProjection = FMatrix::Identity;
+
+	/** 渲染模式 */
+	ESoftRendererRenderMode RenderMode = ESoftRendererRenderMode::Wireframe;
+
+	/** 清空颜色和线框颜色 */
+	FLinearColor ClearColor = FLinearColor::Transparent;
+	FLinearColor WireframeColor = FLinearColor::Transparent;
+
+	/** 是否进行遮挡剔除，层次深度缓冲只在开启时跨帧保持有效 */
+	bool bOcclusionCulling = false;
+
+	/** 强制使用的模型级数 */
+	int32 ForcedLOD = INDEX_NONE;
+
+	bool Equals(const FSoftRendererViewState& Other) const
+	{
+		return bValid && Other.bValid
+			&& FrameBuffer == Other.FrameBuffer
+			&& FrameBufferSize == Other.FrameBufferSize
+			&& WorldToProjection.Equals(Other.WorldToProjection, 0.0f)
+			&& RenderMode == Other.RenderMode
+			&& ClearColor == Other.ClearColor
+			&& WireframeColor == Other.WireframeColor
+			&& bOcclusionCulling == Other.bOcclusionCulling
+			&& ForcedLOD == Other.ForcedLOD;
+	}
 };
 
 /**
@@ -82,6 +397,52 @@ public:
 	UPROPERTY(EditAnywhere, BlueprintReadWrite)
 	FLinearColor ClearColor;
 
+	/** 线框模式下线段的颜色 */
+	UPROPERTY(EditAnywhere, BlueprintReadWrite)
+	FLinearColor WireframeColor;
+
+	/** 是否使用分块多线程光栅化，关闭时在游戏线程上逐个三角形光栅化，两种方式输出的图像完全一致 */
+	UPROPERTY(EditAnywhere, BlueprintReadWrite)
+	bool bUseTiledRasterizer;
+
+	/** 是否使用快速清空，每一帧只填充被画到的块，没有画到的块在导出纹理时才填充 */
+	UPROPERTY(EditAnywhere, BlueprintReadWrite)
+	bool bUseFastClear;
+
+	/** 实体模式下是否使用层次深度缓冲剔除被完全遮挡的渲染对象 */
+	UPROPERTY(EditAnywhere, BlueprintReadWrite)
+	bool bEnableOcclusionCulling;
+
+	/**
+	 * 是否开启局部重绘
+	 *    相机和全局设置不变时，只清空并重绘变化的渲染对象新旧屏幕范围覆盖的块，其他块保留上一帧的内容
+	 *    场景完全没有变化时不绘制，上传纹理时也只上传被重绘的块
+	 */
+	UPROPERTY(EditAnywhere, BlueprintReadWrite)
+	bool bEnableDirtyRegions;
+
+	/**
+	 * 是否跨帧缓存渲染对象的顶点变换结果
+	 *    渲染对象和相机都没有变化时跳过顶点着色器，每个顶点额外占用32字节内存
+	 *    顶点着色器的输出依赖其他状态时，状态变化后需要调用渲染对象的MarkRenderStateDirty
+	 */
+	UPROPERTY(EditAnywhere, BlueprintReadWrite)
+	bool bCacheTransformedVertices;
+
+	/**
+	 * 是否用场景的层次包围盒做视锥剔除
+	 *    完全在视锥体外的子树整体跳过，只遍历可能可见的渲染对象，渲染对象很多时减少逐个测试的开销
+	 */
+	UPROPERTY(EditAnywhere, BlueprintReadWrite)
+	bool bUseSceneBVH;
+
+	/**
+	 * 强制所有渲染对象使用的模型级数，小于0时根据每个渲染对象的屏幕尺寸自动选择
+	 *    超过渲染对象的模型级数时使用最简化的一级
+	 */
+	UPROPERTY(EditAnywhere, BlueprintReadWrite)
+	int32 ForcedLOD;
+
 	/** 渲染的帧图像数据 */
 	UPROPERTY(BlueprintReadOnly, Transient)
 	UFrameBuffer* FrameBuffer;
@@ -89,6 +450,10 @@ public:
 	/** 渲染场景对象,待渲染的物体保存在渲染场景中 */
 	UPROPERTY(BlueprintReadWrite, Transient)
 	URenderScene* RenderScene;
+
+	/** 上一帧的渲染统计信息 */
+	UPROPERTY(BlueprintReadOnly, Transient)
+	FSoftRendererStats Stats;
 	
 public:
 	/**
@@ -103,15 +468,253 @@ public:
 	UFUNCTION(BlueprintCallable)
 	void Render();
 
+	/**
+	 * 世界空间射线和场景中的不透明渲染对象求交，返回最近的交点，使用渲染对象LOD0的三角形
+	 *    用层次包围盒跳过射线没有经过的渲染对象，实例化绘制的物体不参与拾取
+	 */
+	UFUNCTION(BlueprintCallable)
+	bool RayPick(FVector Origin, FVector Direction, float MaxDistance, FSoftRendererRayHit& OutHit);
+
+	/**
+	 * 从相机经过屏幕像素坐标ScreenPosition发出射线拾取渲染对象
+	 */
+	UFUNCTION(BlueprintCallable)
+	bool PickAtScreenPosition(FVector2D ScreenPosition, FSoftRendererRayHit& OutHit);
+
 protected:
 	/**
-	 * 绘制渲染对象
+	 * 相机或者视口大小变化时重新计算视口变换矩阵和投影矩阵，并更新视锥体和裁剪器
+	 */
+	void UpdateViewMatrices();
+
+	/**
+	 * 获取第ObjectIndex个渲染对象的变换缓存，渲染对象或者相机变化时重新计算LocalToProjection
+	 *    同时根据渲染对象的屏幕尺寸选择这一帧绘制的模型级数
+	 */
+	FRenderObjectTransformCache& UpdateTransformCache(int32 ObjectIndex, URenderObject* RenderObject);
+
+	/**
+	 * 根据渲染对象的屏幕尺寸选择这一帧绘制的模型级数，ForcedLOD有效时使用强制的级数
+	 */
+	int32 SelectLODIndex(URenderObject* RenderObject, const FMatrix& LocalToWorld, const FMatrix& LocalToProjection) const;
+
+	/**
+	 * 绘制渲染对象，顶点变换后实体模式输出屏幕空间三角形到RasterTriangles，线框模式输出去重后的边到RasterLines
+	 *    顶点变换的结果没有过期时直接使用Cache中缓存的结果
+	 *    bFrustumTested为true表示渲染对象已经通过层次包围盒的视锥剔除，不再重复测试
+	 */
+	void DrawPrimitive(URenderObject* RenderObject, FRenderObjectTransformCache& Cache, bool bFrustumTested = false);
+
+	/**
+	 * 实例化绘制一组物体，共用的顶点数据依次用每个实例的变换矩阵变换，然后和DrawPrimitive一样输出图元
+	 *    每个实例单独做视锥剔除、遮挡剔除和模型级数选择，顶点变换的结果不跨帧缓存
+	 */
+	void DrawInstances(const FRenderObjectInstances& Instances);
+
+	/**
+	 * 获取绘制渲染对象使用的着色器，材质中还没有着色器对象时按着色器类创建
+	 *    实体模式没有指定像素着色器时使用默认的像素着色器，线框模式OutPixelShader为空，没有顶点着色器时返回false
+	 */
+	bool PrepareShaders(URenderObject* RenderObject, UVertexShader*& OutVertexShader, UPixelShader*& OutPixelShader) const;
+
+	/**
+	 * 执行顶点着色器输出齐次裁剪空间坐标，再计算每个顶点的OutCode，然后透视除法和视口变换
+	 */
+	void ShadeVertices(TArrayView<const FRenderObjectVertex> Vertices, UVertexShader* VertexShader, const FMatrix& LocalToWorld, const FMatrix& LocalToProjection, const FTransformedVertices& Transformed);
+
+	/**
+	 * 实体模式下对第LODIndex级模型的簇做视锥剔除和背面剔除，剩下的簇序号写入VisibleClusters
+	 *    模型没有簇、或者自定义的顶点着色器可能移动顶点时不做剔除，返回false；有簇被剔除时返回true
+	 */
+	bool CullClusters(URenderObject* RenderObject, int32 LODIndex, const UVertexShader* VertexShader, const FMatrix& LocalToWorld);
+
+	/**
+	 * 只变换VisibleClusters中的簇用到的顶点，其他顶点的变换结果是未定义的
+	 *    用到的顶点先标记出来，再把连续的几段分别交给ShadeVertices，间隔很短的两段合并成一段
+	 */
+	void ShadeClusterVertices(URenderObject* RenderObject, int32 LODIndex, UVertexShader* VertexShader, const FMatrix& LocalToWorld, const FMatrix& LocalToProjection, const FTransformedVertices& Transformed);
+
+	/**
+	 * 用变换后的顶点装配第LODIndex级模型的图元，实体模式输出屏幕空间三角形，线框模式输出去重后的边
+	 *    bVisibleClustersOnly为true时实体模式只装配VisibleClusters中的簇，开启背面剔除的材质按LocalToWorld的镜像情况判断正反面
+	 */
+	void AssemblePrimitives(URenderObject* RenderObject, int32 LODIndex, const FMatrix& LocalToWorld, UPixelShader* PixelShader, const FTransformedVertices& Transformed, bool bVisibleClustersOnly = false);
+
+	/**
+	 * 和上一帧的渲染状态比较，计算这一帧需要重绘的块
+	 *    返回true表示需要整帧重绘，否则DirtyTiles中标记了需要重绘的块，NewRenderStates输出这一帧每个渲染对象的状态
+	 */
+	bool UpdateDirtyTiles(const FSoftRendererViewState& ViewState);
+
+	/**
+	 * 记录渲染对象这一帧的变换、几何和屏幕范围
+	 */
+	void CaptureRenderState(URenderObject* RenderObject, const FMatrix& LocalToWorld, const FRenderObjectTransformCache& Cache, FRenderObjectRenderState& OutState) const;
+
+	/**
+	 * 记录实例化绘制的一组物体这一帧的几何、实例变换和所有实例屏幕范围的并集
+	 */
+	void CaptureInstancesRenderState(const FRenderObjectInstances& Instances, uint32 InstanceTransformsHash, FRenderObjectRenderState& OutState) const;
+
+	/**
+	 * 渲染对象的材质和上一帧记录的状态是否相同
+	 */
+	static bool IsMaterialStateEqual(const URenderObject* RenderObject, const FRenderObjectRenderState& State);
+
+	/**
+	 * 记录渲染对象的材质状态，着色器在绘制时才创建，所以在绘制之后记录
+	 */
+	static void CaptureMaterialState(const URenderObject* RenderObject, FRenderObjectRenderState& OutState);
+
+	/**
+	 * 渲染对象可能覆盖的屏幕像素范围，不可见时为空
+	 */
+	FIntRect CalculateDirtyBounds(URenderObject* RenderObject, const FMatrix& LocalToWorld, const FMatrix& LocalToProjection) const;
+
+	/**
+	 * 标记Rect范围覆盖的块需要重绘
 	 */
-	void DrawPrimitive(URenderObject* RenderObject, const FMatrix& WorldToViewMatrix, const FMatrix& ProjectionMatrix) const;
+	void MarkDirtyTiles(const FIntRect& Rect);
+
+	/**
+	 * Rect范围是否和需要重绘的块相交
+	 */
+	bool IntersectsDirtyTiles(const FIntRect& Rect) const;
+
+	/**
+	 * 光栅化当前收集到的所有屏幕空间三角形和线段，然后清空图元列表
+	 *    局部重绘时只光栅化需要重绘的块
+	 *    开启遮挡剔除时，光栅化后用新写入的深度更新层次深度缓冲
+	 */
+	void FlushRasterPrimitives();
+
+	/**
+	 * 开启遮挡剔除时，收集到的三角形达到OcclusionFlushThreshold就先光栅化，让后面的渲染对象可以被已经画好的深度遮挡
+	 *    阈值从很小开始，每光栅化一次翻倍，最近的几个遮挡物尽早写入深度，之后又不会频繁地小批量光栅化
+	 */
+	void ConditionalFlushForOcclusion();
+
+	/**
+	 * 在ClipRect范围内光栅化一个三角形，返回写入的像素个数，分块光栅化时会在多个工作线程上同时调用
+	 */
+	int32 RasterizeTriangle(const FRasterTriangle& Triangle, const FIntRect& ClipRect) const;
+
+	/**
+	 * 在ClipRect范围内光栅化一条线段，返回写入的像素个数，分块光栅化时会在多个工作线程上同时调用
+	 */
+	int32 RasterizeLine(const FRasterLine& Line, const FIntRect& ClipRect) const;
 
 	/**
 	 * 计算投影变换矩阵
+	 *    使用Reversed-Z：近平面的深度为1，远平面的深度为0，透视投影的远平面在无穷远处
+	 *    浮点数在0附近精度最高，正好抵消透视投影远处深度的非线性压缩
 	 */
 	FMatrix CalculateProjectionMatrix() const;
+
+	/**
+	 * 渲染对象的包围球和包围盒变换到世界空间，测试是否完全在视锥体外
+	 */
+	bool IsOutsideFrustum(URenderObject* RenderObject, const FMatrix& LocalToWorld) const;
+
+	/**
+	 * 渲染对象的包围盒投影到屏幕上，求出屏幕范围(向外扩展1个像素)和离相机最近的深度
+	 *    包围盒无效或者有角点在相机平面后面时返回false
+	 */
+	static bool CalculateScreenBounds(URenderObject* RenderObject, const FMatrix& LocalToProjection, const FIntPoint& InViewportSize, FIntRect& OutScreenRect, float& OutNearestDepth);
+
+	/**
+	 * 计算渲染对象的屏幕尺寸，即包围球直径在屏幕上占视口高度的比例，用来选择模型的级数
+	 *    透视投影下和包围球中心到相机平面的距离成反比，相机在包围球内时很大
+	 */
+	float CalculateScreenSize(URenderObject* RenderObject, const FMatrix& LocalToWorld, const FMatrix& LocalToProjection) const;
+
+	/**
+	 * 渲染对象的包围球沿相机朝向离相机最近的距离，相机在包围球内时为负数，遮挡剔除时按这个距离从近到远绘制
+	 */
+	float CalculateNearestViewDistance(URenderObject* RenderObject, const FMatrix& LocalToWorld) const;
+
+	/**
+	 * 渲染对象的包围盒投影到屏幕上，测试是否被层次深度缓冲完全遮挡
+	 */
+	bool IsOccluded(URenderObject* RenderObject, const FMatrix& LocalToProjection);
+
+	/**
+	 * 本帧是否进行遮挡剔除
+	 */
+	bool IsOcclusionCullingActive() const;
+
+protected:
+	/** 每一帧的临时内存，顶点变换的输出等只在本帧有效的数据从这里分配，跨帧复用 */
+	FFrameArena FrameArena;
+
+	/** 本帧等待光栅化的屏幕空间三角形 */
+	TArray<FRasterTriangle> RasterTriangles;
+
+	/** 本帧等待光栅化的屏幕空间线段，只用于线框模式 */
+	TArray<FRasterLine> RasterLines;
+
+	/** 分块光栅化器 */
+	FTileRasterizer TileRasterizer;
+
+	/** 本帧打包后的线框颜色，每一帧只转换一次 */
+	uint32 PackedWireframeColor = 0;
+
+	/** 缓存的相机和视口大小，和当前的设置不同时重新计算矩阵 */
+	FSoftRendererCamera CachedCamera;
+	FIntPoint CachedViewportSize = FIntPoint::ZeroValue;
+
+	/** 相机版本号，每次重新计算矩阵时递增，0表示还没有计算过 */
+	uint32 ViewVersion = 0;
+
+	/** 缓存的视口变换矩阵、投影矩阵和两者的乘积 */
+	FMatrix CachedWorldToViewMatrix = FMatrix::Identity;
+	FMatrix CachedProjectionMatrix = FMatrix::Identity;
+	FMatrix CachedWorldToProjectionMatrix = FMatrix::Identity;
+
+	/** 每个渲染对象的变换缓存，和RenderScene->OpaqueRenderObjects一一对应 */
+	TArray<FRenderObjectTransformCache> TransformCaches;
+
+	/** 齐次裁剪空间的裁剪器 */
+	FClipper Clipper;
+
+	/** 本帧相机的视锥体 */
+	FViewFrustum ViewFrustum;
+
+	/** 场景中不透明渲染对象的层次包围盒，和RenderScene->OpaqueRenderObjects同步 */
+	FRenderSceneBVH SceneBVH;
+
+	/** 本帧和视锥体相交的渲染对象，和RenderScene->OpaqueRenderObjects一一对应 */
+	TBitArray<> VisibleObjects;
+
+	/** 正在绘制的渲染对象没有被剔除的簇序号，每个渲染对象重新填充 */
+	TArray<int32> VisibleClusters;
+
+	/** 本帧可见的渲染对象的绘制顺序，开启遮挡剔除时从近到远排列 */
+	TArray<int32> DrawOrder;
+
+	/** 本帧下一次为遮挡剔除提前光栅化的三角形个数 */
+	int32 OcclusionFlushThreshold = 0;
+
+	/** 遮挡剔除使用的层次深度缓冲，局部重绘时跨帧保留 */
+	FHierarchicalZBuffer HierarchicalZBuffer;
+
+	/** 上一帧的全局渲染状态 */
+	FSoftRendererViewState LastViewState;
+
+	/** 上一帧每个渲染对象的状态，和RenderScene->OpaqueRenderObjects一一对应 */
+	TArray<FRenderObjectRenderState> RenderStates;
+
+	/** 这一帧每个渲染对象的状态，绘制完成后和RenderStates交换 */
+	TArray<FRenderObjectRenderState> NewRenderStates;
+
+	/** 上一帧和这一帧每组实例化绘制的物体的状态，和RenderScene->InstancedRenderObjects一一对应 */
+	TArray<FRenderObjectRenderState> InstanceRenderStates;
+	TArray<FRenderObjectRenderState> NewInstanceRenderStates;
+
+	/** 本帧需要重绘的块，和帧图像的清空块一一对应 */
+	TBitArray<> DirtyTiles;
+
+	/** 本帧是否只重绘DirtyTiles中标记的块 */
+	bool bPartialRedraw = false;
 	
 };
@@ -0,0 +1,23 @@
+﻿#pragma once
+
+#include "CoreMinimal.h"
+#include "Commandlets/Commandlet.h"
+#include "SoftRendererCommandlet.generated.h"
+
+/**
+ * 离屏渲染命令行工具，不需要窗口和GPU，可以在没有显卡的机器上批量运行
+ *    相机对准整个场景的包围球，沿场景中心水平环绕，每一帧渲染后交给后台线程写成图像文件
+ *
+ * 用法:
+ *    UE4Editor-Cmd <Project> -run=SoftRendererRender -Scene=<RenderScene蓝图类路径> -nullrhi
+ *        [-Output=<输出目录>] [-Frames=<帧数>] [-Format=png|ppm] [-Width=<宽>] [-Height=<高>]
+ *        [-Mode=Wireframe|Solid] [-Orbit=<整个序列环绕的角度>] [-Pitch=<相机俯仰角>]
+ */
+UCLASS()
+class USoftRendererRenderCommandlet : public UCommandlet
+{
+	GENERATED_UCLASS_BODY()
+
+public:
+	virtual int32 Main(const FString& Params) override;
+};
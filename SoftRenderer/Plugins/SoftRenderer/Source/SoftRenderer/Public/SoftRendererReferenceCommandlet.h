@@ -0,0 +1,34 @@
+﻿#pragma once
+
+#include "CoreMinimal.h"
+#include "Commandlets/Commandlet.h"
+#include "SoftRendererReferenceCommandlet.generated.h"
+
+/**
+ * 参考场景回归检查命令行工具
+ *    渲染SoftRendererReferenceScenes.h中的所有参考场景，把帧图像的哈希和哈希基准比较，同时统计帧耗时和每秒写入的像素个数
+ *    图像和基准不同、基准中缺少哈希、或者帧耗时超过耗时基准的容差时返回非0，可以直接接到持续集成中，每次修改渲染器之后运行一次
+ *    哈希基准提交在版本库中，图像有意改变之后用-UpdateHashes更新；帧耗时和机器相关，耗时基准在运行检查的机器上用-UpdateTimings生成
+ *
+ * 参考场景:
+ *    DenseSphere      高密度球体，大量很小的三角形
+ *    Grid100k         10万个三角形的倾斜网格，覆盖大部分屏幕
+ *    ManySmallObjects 数百个小立方体，每个渲染对象的固定开销占主要部分
+ *    ManyInstances    和ManySmallObjects相同摆放的立方体改为实例化绘制，对比两者的耗时
+ *    ClusteredSphere  划分了簇的球体，检查默认设置下相机移动后只变换可见的簇的顶点，并且图像和不划分簇时相同
+ *    OccludedObjects  墙后面的一组球体，检查遮挡剔除确实剔除了物体
+ *    OffscreenGeometry 视锥体外、相机后方以及穿过近平面的物体，覆盖剔除和裁剪的路径
+ *
+ * 用法:
+ *    UE4Editor-Cmd <Project> -run=SoftRendererReference -nullrhi
+ *        [-Baseline=<哈希基准文件>] [-TimingBaseline=<耗时基准文件>] [-UpdateHashes] [-UpdateTimings] [-Update(同时更新两个基准)]
+ *        [-Scene=<只运行名字包含这个字符串的场景>] [-Iterations=<每个场景计时的帧数>] [-Tolerance=<帧耗时允许增加的百分比>] [-Output=<结果文件>]
+ */
+UCLASS()
+class USoftRendererReferenceCommandlet : public UCommandlet
+{
+	GENERATED_UCLASS_BODY()
+
+public:
+	virtual int32 Main(const FString& Params) override;
+};
@@ -0,0 +1,119 @@
+﻿#pragma once
+
+#include "CoreMinimal.h"
+#include "SoftRenderer.h"
+
+class FJsonObject;
+class URenderScene;
+
+/**
+ * 回归检查使用的参考场景
+ *    场景全部由程序生成，参考场景命令行工具和自动化测试(SoftRenderer.Reference)共用
+ *    每个场景分别以线框和实体模式渲染，一个场景的一种渲染模式称为一个用例，名字为 场景名.渲染模式，例如 DenseSphere.Solid
+ *
+ * 基准文件:
+ *    图像哈希基准  Config/SoftRendererReference.json，提交到版本库中，所有用例都必须有哈希，缺少哈希的用例算作失败
+ *    帧耗时基准    和机器相关，不提交到版本库中，默认在 Saved/SoftRenderer/ReferenceTimings.json，由每台机器用命令行工具的-UpdateTimings生成
+ *                  命令行工具和自动化测试都用它检查性能回退，机器上没有这个文件时两者都只给出警告，不检查帧耗时
+ *    两个文件的格式都是 { "Cases": { "<用例名>": { ... } } }
+ */
+namespace SoftRendererReference
+{
+	/**
+	 * 一个参考场景
+	 *    Check在第一帧之后调用，返回失败的原因，不需要额外检查的场景为空
+	 */
+	struct FReferenceScene
+	{
+		const TCHAR* Name;
+		void (*Build)(URenderScene* Scene);
+		FString (*Check)(USoftRenderer* Renderer, uint64 Hash);
+	};
+
+	/**
+	 * 一个参考场景的一种渲染模式
+	 */
+	struct FReferenceCase
+	{
+		const FReferenceScene* Scene;
+		ESoftRendererRenderMode RenderMode;
+
+		/** 场景名和渲染模式，例如 DenseSphere.Solid */
+		FString Name;
+	};
+
+	/**
+	 * 一个用例的渲染结果
+	 */
+	struct FCaseResult
+	{
+		/** 用例名 */
+		FString Name;
+
+		/** 帧图像像素的哈希 */
+		uint64 Hash = 0;
+
+		/** 第一帧和最后一帧的图像是否相同，不同说明跨帧缓存的结果有误 */
+		bool bStable = true;
+
+		/** 场景自带的检查失败的原因，为空时检查通过 */
+		FString CheckError;
+
+		/** 每帧耗时的中位数(毫秒) */
+		float FrameTime = 0.0f;
+
+		/** 每秒光栅化写入的像素个数 */
+		double PixelsPerSecond = 0.0;
+	};
+
+	/**
+	 * 所有参考场景的用例，SceneFilter不为空时只返回场景名包含这个字符串的用例
+	 */
+	SOFTRENDERER_API TArray<FReferenceCase> GetReferenceCases(const FString& SceneFilter = FString());
+
+	/**
+	 * 生成用例的场景并渲染，第一帧的图像哈希作为结果，再连续渲染Iterations帧统计耗时
+	 */
+	SOFTRENDERER_API FCaseResult RenderCase(const FReferenceCase& Case, int32 Iterations);
+
+	/**
+	 * 哈希写成16进制字符串，避免JSON数字的精度问题
+	 */
+	SOFTRENDERER_API FString FormatHash(uint64 Hash);
+
+	/**
+	 * 提交到版本库中的图像哈希基准文件
+	 */
+	SOFTRENDERER_API FString GetHashBaselineFilename();
+
+	/**
+	 * 默认的帧耗时基准文件
+	 */
+	SOFTRENDERER_API FString GetTimingBaselineFilename();
+
+	/**
+	 * 读取基准文件中所有用例的记录，文件不存在或者格式错误时返回空
+	 */
+	SOFTRENDERER_API TSharedPtr<FJsonObject> LoadBaseline(const FString& Filename);
+
+	/**
+	 * 基准中一个用例的哈希，没有这个用例或者哈希为空时返回false
+	 */
+	SOFTRENDERER_API bool GetBaselineHash(const TSharedPtr<FJsonObject>& Baseline, const FString& CaseName, FString& OutHash);
+
+	/**
+	 * 基准中一个用例的帧耗时(毫秒)，没有这个用例或者耗时无效时返回false
+	 */
+	SOFTRENDERER_API bool GetBaselineFrameTime(const TSharedPtr<FJsonObject>& Baseline, const FString& CaseName, double& OutFrameTime);
+
+	/**
+	 * 帧耗时是否超过基准的容差，TolerancePercent是允许增加的百分比
+	 */
+	SOFTRENDERER_API bool IsSlowerThanBaseline(float FrameTime, double BaselineFrameTime, float TolerancePercent);
+
+	/** 命令行工具和自动化测试默认的帧耗时容差(百分比) */
+	constexpr float DefaultTimingTolerance = 20.0f;
+
+	/** 命令行工具和自动化测试默认每个用例计时的帧数 */
+	constexpr int32 DefaultTimingIterations = 10;
+}
@@ -0,0 +1,64 @@
+﻿#pragma once
+
+#include "CoreMinimal.h"
+#include "Stats/Stats.h"
+#include "Trace/Trace.h"
+#include "ProfilingDebugging/CpuProfilerTrace.h"
+
+/**
+ * 渲染流水线的性能统计
+ *    控制台输入 stat SoftRenderer 查看每个阶段的耗时和每帧的计数
+ *    启动参数加上 -trace=cpu,SoftRenderer 后，Unreal Insights中可以看到每个阶段的事件
+ */
+DECLARE_STATS_GROUP(TEXT("SoftRenderer"), STATGROUP_SoftRenderer, STATCAT_Advanced);
+
+DECLARE_CYCLE_STAT_EXTERN(TEXT("Render"), STAT_SoftRenderer_Render, STATGROUP_SoftRenderer, SOFTRENDERER_API);
+DECLARE_CYCLE_STAT_EXTERN(TEXT("Setup"), STAT_SoftRenderer_Setup, STATGROUP_SoftRenderer, SOFTRENDERER_API);
+DECLARE_CYCLE_STAT_EXTERN(TEXT("Clear"), STAT_SoftRenderer_Clear, STATGROUP_SoftRenderer, SOFTRENDERER_API);
+DECLARE_CYCLE_STAT_EXTERN(TEXT("Vertex Shading"), STAT_SoftRenderer_VertexShading, STATGROUP_SoftRenderer, SOFTRENDERER_API);
+DECLARE_CYCLE_STAT_EXTERN(TEXT("Primitive Assembly"), STAT_SoftRenderer_PrimitiveAssembly, STATGROUP_SoftRenderer, SOFTRENDERER_API);
+DECLARE_CYCLE_STAT_EXTERN(TEXT("Raster"), STAT_SoftRenderer_Raster, STATGROUP_SoftRenderer, SOFTRENDERER_API);
+DECLARE_CYCLE_STAT_EXTERN(TEXT("Texture Upload"), STAT_SoftRenderer_Upload, STATGROUP_SoftRenderer, SOFTRENDERER_API);
+
+DECLARE_DWORD_COUNTER_STAT_EXTERN(TEXT("Vertices Shaded"), STAT_SoftRenderer_VerticesShaded, STATGROUP_SoftRenderer, SOFTRENDERER_API);
+DECLARE_DWORD_COUNTER_STAT_EXTERN(TEXT("Triangles Submitted"), STAT_SoftRenderer_TrianglesSubmitted, STATGROUP_SoftRenderer, SOFTRENDERER_API);
+DECLARE_DWORD_COUNTER_STAT_EXTERN(TEXT("Triangles Culled"), STAT_SoftRenderer_TrianglesCulled, STATGROUP_SoftRenderer, SOFTRENDERER_API);
+DECLARE_DWORD_COUNTER_STAT_EXTERN(TEXT("Clusters Culled"), STAT_SoftRenderer_ClustersCulled, STATGROUP_SoftRenderer, SOFTRENDERER_API);
+DECLARE_DWORD_COUNTER_STAT_EXTERN(TEXT("Lines Submitted"), STAT_SoftRenderer_LinesSubmitted, STATGROUP_SoftRenderer, SOFTRENDERER_API);
+DECLARE_DWORD_COUNTER_STAT_EXTERN(TEXT("Lines Culled"), STAT_SoftRenderer_LinesCulled, STATGROUP_SoftRenderer, SOFTRENDERER_API);
+DECLARE_DWORD_COUNTER_STAT_EXTERN(TEXT("Pixels Written"), STAT_SoftRenderer_PixelsWritten, STATGROUP_SoftRenderer, SOFTRENDERER_API);
+DECLARE_DWORD_COUNTER_STAT_EXTERN(TEXT("Bytes Uploaded"), STAT_SoftRenderer_BytesUploaded, STATGROUP_SoftRenderer, SOFTRENDERER_API);
+
+/** Unreal Insights中软光栅渲染器各个阶段的事件通道 */
+UE_TRACE_CHANNEL_EXTERN(SoftRendererChannel, SOFTRENDERER_API);
+
+/**
+ * 流水线阶段的计时器，离开作用域时把耗时(毫秒)累加到StageTime
+ *    STAT_统计在Shipping版本中不存在，这个计时器总是有效，结果保存在渲染统计信息中供蓝图读取
+ */
+class FSoftRendererStageTimer
+{
+public:
+	explicit FSoftRendererStageTimer(float& InStageTime)
+		: StageTime(InStageTime)
+		, StartCycles(FPlatformTime::Cycles64())
+	{
+	}
+
+	~FSoftRendererStageTimer()
+	{
+		StageTime += static_cast<float>(FPlatformTime::ToMilliseconds64(FPlatformTime::Cycles64() - StartCycles));
+	}
+
+private:
+	float& StageTime;
+	uint64 StartCycles;
+};
+
+/**
+ * 统计当前作用域的耗时，同时记录到STAT_统计、Unreal Insights的事件和StageTime中
+ */
+#define SCOPE_SOFTRENDERER_STAGE(Stat, StageTime) \
+	SCOPE_CYCLE_COUNTER(Stat); \
+	TRACE_CPUPROFILER_EVENT_SCOPE_ON_CHANNEL(Stat, SoftRendererChannel); \
+	FSoftRendererStageTimer PREPROCESSOR_JOIN(SoftRendererStageTimer_, __LINE__)(StageTime)
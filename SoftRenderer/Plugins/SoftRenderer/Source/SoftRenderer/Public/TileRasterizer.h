@@ -0,0 +1,137 @@
+﻿#pragma once
+
+#include "CoreMinimal.h"
+
+class UPixelShader;
+
+/**
+ * 屏幕空间中等待光栅化的三角形
+ *    DrawPrimitive完成顶点变换后输出，所有渲染对象处理完之后统一光栅化
+ */
+struct FRasterTriangle
+{
+	/** 三个顶点的屏幕坐标,像素单位 */
+	FIntPoint ScreenPosInPixels[3];
+
+	/** 三个顶点的屏幕坐标，带亚像素精度，用于实体模式填充和线框模式裁剪线段 */
+	FVector2D ScreenPos[3];
+
+	/** 三个顶点的深度，用于实体模式 */
+	float Depth[3];
+
+	/** 像素着色器，用于实体模式 */
+	UPixelShader* PixelShader;
+
+public:
+	/**
+	 * 三角形可能覆盖的像素范围(左闭右开区间)
+	 *    在整数屏幕坐标的包围盒基础上向外扩展1个像素，保证实体模式下亚像素坐标覆盖的像素都在范围内
+	 */
+	FIntRect GetPixelBounds() const
+	{
+		return FIntRect(
+			FMath::Min3(ScreenPosInPixels[0].X, ScreenPosInPixels[1].X, ScreenPosInPixels[2].X) - 1,
+			FMath::Min3(ScreenPosInPixels[0].Y, ScreenPosInPixels[1].Y, ScreenPosInPixels[2].Y) - 1,
+			FMath::Max3(ScreenPosInPixels[0].X, ScreenPosInPixels[1].X, ScreenPosInPixels[2].X) + 2,
+			FMath::Max3(ScreenPosInPixels[0].Y, ScreenPosInPixels[1].Y, ScreenPosInPixels[2].Y) + 2);
+	}
+};
+
+/**
+ * 屏幕空间中等待光栅化的线段
+ *    线框模式下DrawPrimitive按渲染对象去重后的边输出，每条边只画一次
+ */
+struct FRasterLine
+{
+	/** 两个端点的屏幕坐标，带亚像素精度，已经和近平面、远平面以及保护带裁剪过 */
+	FVector2D ScreenPos[2];
+
+public:
+	/**
+	 * 线段可能覆盖的像素范围(左闭右开区间)，和三角形一样在四舍五入后的包围盒基础上向外扩展1个像素
+	 */
+	FIntRect GetPixelBounds() const
+	{
+		return FIntRect(
+			FMath::FloorToInt(FMath::Min(ScreenPos[0].X, ScreenPos[1].X) + 0.5f) - 1,
+			FMath::FloorToInt(FMath::Min(ScreenPos[0].Y, ScreenPos[1].Y) + 0.5f) - 1,
+			FMath::FloorToInt(FMath::Max(ScreenPos[0].X, ScreenPos[1].X) + 0.5f) + 2,
+			FMath::FloorToInt(FMath::Max(ScreenPos[0].Y, ScreenPos[1].Y) + 0.5f) + 2);
+	}
+};
+
+/**
+ * 分块光栅化器
+ *    屏幕划分为TileSize x TileSize大小的块(Tile)，每个三角形或者线段按屏幕包围盒分配(Binning)到覆盖的所有Tile中
+ *    光栅化时每个Tile由一个工作线程处理，并且只写入Tile范围内的像素，所以不同线程之间不会写入同一个像素
+ *    Tile内部按照图元的提交顺序光栅化，输出结果和单线程逐个光栅化完全一致
+ *    一帧内同一次分配只能使用一种图元，回调收到的序号对应分配时传入的数组
+ */
+class SOFTRENDERER_API FTileRasterizer
+{
+public:
+	/** Tile的像素宽高 */
+	static constexpr int32 TileSize = 64;
+
+	/**
+	 * 光栅化回调，在TileRect范围内(左闭右开区间)光栅化第PrimitiveIndex个图元
+	 *    不同Tile的回调会在多个工作线程上同时执行
+	 */
+	typedef TFunctionRef<void(int32 PrimitiveIndex, const FIntRect& TileRect)> FRasterizeFunction;
+
+public:
+	/**
+	 * 按渲染目标的像素宽高划分Tile，并清空上一帧的分块数据
+	 */
+	void Init(int32 InWidth, int32 InHeight);
+
+	/**
+	 * 把三角形按可能覆盖的像素范围分配到Tile中，完全在屏幕外的三角形直接丢弃
+	 *    ActiveTiles不为空时只分配到其中标记的Tile，局部重绘时其他Tile保留上一帧的内容
+	 */
+	void BinTriangles(TArrayView<const FRasterTriangle> Triangles, const TBitArray<>* ActiveTiles = nullptr);
+
+	/**
+	 * 把线段按可能覆盖的像素范围分配到Tile中，规则和BinTriangles相同
+	 */
+	void BinLines(TArrayView<const FRasterLine> Lines, const TBitArray<>* ActiveTiles = nullptr);
+
+	/**
+	 * 多线程并行光栅化所有非空的Tile
+	 */
+	void Rasterize(FRasterizeFunction RasterizeFunction) const;
+
+	/** 水平方向的Tile个数 */
+	FORCEINLINE int32 GetNumTilesX() const { return NumTilesX; }
+
+	/** 垂直方向的Tile个数 */
+	FORCEINLINE int32 GetNumTilesY() const { return NumTilesY; }
+
+	/**
+	 * 获取Tile覆盖的像素范围
+	 */
+	FIntRect GetTileRect(int32 TileIndex) const;
+
+private:
+	/**
+	 * 按图元的GetPixelBounds分配到Tile中
+	 */
+	template <typename PrimitiveType>
+	void BinPrimitives(TArrayView<const PrimitiveType> Primitives, const TBitArray<>* ActiveTiles);
+
+private:
+	/** 渲染目标的像素宽度 */
+	int32 Width = 0;
+
+	/** 渲染目标的像素高度 */
+	int32 Height = 0;
+
+	/** 水平方向的Tile个数 */
+	int32 NumTilesX = 0;
+
+	/** 垂直方向的Tile个数 */
+	int32 NumTilesY = 0;
+
+	/** 每个Tile中需要光栅化的图元索引，按提交顺序排列 */
+	TArray<TArray<int32>> TileBins;
+};
@@ -6,7 +6,8 @@
 /**
  * 渲染对象的顶点信息
  *    第一课中，目前顶点信息只用到Position的数据
- *    
+ *    顶点数据属于资源，渲染时只读不写，顶点变换的结果由渲染器保存在每一帧的临时缓冲中，
+ *    因此同一个渲染对象可以同时被多个渲染器绘制
  */
 USTRUCT(BlueprintType)
 struct FRenderObjectVertex
@@ -19,23 +20,19 @@ public:
 	 */
 	UPROPERTY(EditAnywhere)
 	FVector Position;
-
-public:
-	/**
-	 * 存储顶点着色器计算后的坐标位置
-	 */
-	FVector4 VertexPos;
 	
-	/**
-	 * 存储顶点着色器计算后的屏幕坐标位置
-	 */
-	FVector2D ScreenPos;
+};
 
-	/**
-	 * 存储顶点着色器计算后的屏幕坐标位置,像素单位
-	 */
-	FIntPoint ScreenPosInPixels;
-	
+/**
+ * 批量顶点着色器的输出，SoA(Structure of Arrays)布局
+ *    第i个顶点的齐次裁剪空间坐标为 (X[i], Y[i], Z[i], W[i])，每个数组的长度等于顶点个数
+ */
+struct FVertexShaderBatchOutput
+{
+	TArrayView<float> X;
+	TArrayView<float> Y;
+	TArrayView<float> Z;
+	TArrayView<float> W;
 };
 
 /**
@@ -49,5 +46,19 @@ class SOFTRENDERER_API UVertexShader : public UObject
 public:
 	virtual FVector4 RunVertexShader(const FRenderObjectVertex& Vertex,
 		const FMatrix& LocalToWorldMatrix, const FMatrix& WorldToViewMatrix, const FMatrix& ProjectionMatrix);
+
+	/**
+	 * 批量执行顶点着色器
+	 *    LocalToProjectionMatrix是每个渲染对象预先相乘好的 LocalToWorld * WorldToView * Projection 矩阵
+	 *    默认实现使用SIMD一次变换4个顶点，结果按SoA布局写入Output
+	 */
+	virtual void RunVertexShaderBatch(TArrayView<const FRenderObjectVertex> Vertices, const FMatrix& LocalToProjectionMatrix, const FVertexShaderBatchOutput& Output);
+
+	/**
+	 * 是否使用批量顶点着色器
+	 *    批量版本的默认实现不会调用RunVertexShader，只有UVertexShader自身默认启用
+	 *    子类重写RunVertexShaderBatch后需要重写这个函数返回true，否则渲染器逐个顶点调用RunVertexShader
+	 */
+	virtual bool SupportsVertexShaderBatch() const;
 	
 };
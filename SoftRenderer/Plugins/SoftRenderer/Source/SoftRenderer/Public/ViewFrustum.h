@@ -0,0 +1,46 @@
+﻿#pragma once
+
+#include "CoreMinimal.h"
+
+/**
+ * 视锥体，用于视锥剔除
+ *    从世界空间到齐次裁剪空间的矩阵中提取6个裁剪平面(Gribb-Hartmann方法)
+ *    齐次裁剪空间的可见范围为 -W <= X <= W, -W <= Y <= W, 0 <= Z <= W，深度使用Reversed-Z，Z = W是近平面
+ *    远平面在无穷远处时，远平面的法线为0，所有点都在它的内侧
+ *    平面的法线指向视锥体内部，点到所有平面的有向距离都不小于0时在视锥体内
+ */
+class SOFTRENDERER_API FViewFrustum
+{
+public:
+	/** 裁剪平面的个数 */
+	static constexpr int32 NumPlanes = 6;
+
+public:
+	/**
+	 * 从世界空间到齐次裁剪空间的变换矩阵(WorldToView * Projection)中提取裁剪平面
+	 */
+	void Init(const FMatrix& WorldToProjectionMatrix);
+
+	/**
+	 * 测试包围球是否和视锥体相交，bOutFullyInside返回包围球是否完全在视锥体内
+	 */
+	bool IntersectSphere(const FVector& Center, float Radius, bool& bOutFullyInside) const;
+
+	/**
+	 * 测试轴对齐包围盒是否和视锥体相交
+	 *    使用离平面最近的角点测试，可能把视锥体角落外面的包围盒判断为相交，但不会剔除可见的包围盒
+	 */
+	bool IntersectBox(const FVector& Center, const FVector& Extent) const;
+
+	/**
+	 * 测试轴对齐包围盒是否和视锥体相交，bOutFullyInside返回包围盒是否完全在视锥体内，层次剔除时完全在内的节点不需要再测试子节点
+	 */
+	bool IntersectBox(const FVector& Center, const FVector& Extent, bool& bOutFullyInside) const;
+
+private:
+	/** 世界空间的裁剪平面，PlaneDot(P) >= 0 表示P在平面内侧 */
+	FPlane Planes[NumPlanes];
+
+	/** 平面法线各分量的绝对值，用于包围盒测试 */
+	FVector AbsNormals[NumPlanes];
+};
@@ -37,7 +37,9 @@ public class SoftRenderer : ModuleRules
                 "Slate",
                 "SlateCore",
                 "RHI",
-                "RenderCore"
+                "RenderCore",
+                "ImageWrapper",
+                "Json"
                 // ... add private dependencies that you statically link with here ...  
             }
             );
@@ -11,6 +11,10 @@
 #include "IContentBrowserSingleton.h"
 #include "ContentBrowserModule.h"
 #include "RenderObject.h"
+#include "MeshOptimizer.h"
+#include "Async/Async.h"
+#include "Async/ParallelFor.h"
+#include "Misc/ScopedSlowTask.h"
 #include "Kismet2/BlueprintEditorUtils.h"
 #include "Kismet2/KismetEditorUtilities.h"
 
@@ -37,67 +41,262 @@ public:
 
 struct FCreateRenderObjectFromTextureExtension : public FContentBrowserSelectedAssetExtensionBase
 {
+	/** Maximum number of simplified LODs generated for a mesh that has no LODs of its own */
+	static constexpr int32 MaxGeneratedLODs = 3;
+
+	/** LOD generation stops before a level would drop below this many triangles */
+	static constexpr int32 MinGeneratedLODTriangles = 32;
+
+	/** LOD0 is split into clusters of at most this many triangles, culled as a whole by the renderer */
+	static constexpr int32 MaxClusterTriangles = 128;
+
+	/** Meshes with fewer triangles than this are drawn as a whole, clustering them would cost more than it saves */
+	static constexpr int32 MinClusteredTriangles = 2 * MaxClusterTriangles;
+
+	/** One LOD converted from the static mesh render data, not yet stored in a render object */
+	struct FImportedMeshLOD
+	{
+		TArray<FRenderObjectVertex> Vertices;
+		TArray<uint32> Indices;
+		TArray<FRenderObjectCluster> Clusters;
+		float ScreenSize = 0.0f;
+	};
+
+	/** Conversion of one selected static mesh, filled on a worker thread and turned into an asset on the game thread */
+	struct FImportJob
+	{
+		UStaticMesh* StaticMesh = nullptr;
+		TArray<FImportedMeshLOD> LODs;
+	};
+
 	FCreateRenderObjectFromTextureExtension()
 	{
 	}
-	
-	virtual void Execute() override
+
+	/** Copies the positions and the triangle list of one LOD of the static mesh render data */
+	static void ExtractMeshLOD(const FStaticMeshLODResources& StaticMeshLOD, TArray<FRenderObjectVertex>& OutVertices, TArray<uint32>& OutIndices)
 	{
-		const FAssetToolsModule& AssetToolsModule = FModuleManager::Get().LoadModuleChecked<FAssetToolsModule>("AssetTools");
+		const FPositionVertexBuffer& PositionVertexBuffer = StaticMeshLOD.VertexBuffers.PositionVertexBuffer;
+		const int32 NumVertexPositions = PositionVertexBuffer.GetNumVertices();
+
+		//Create the vertex
+		OutVertices.SetNumUninitialized(NumVertexPositions);
+		for (int32 VertexIndex = 0; VertexIndex < NumVertexPositions; ++VertexIndex)
+		{
+			OutVertices[VertexIndex].Position = PositionVertexBuffer.VertexPosition(VertexIndex);
+		}
+
+		// Copies the whole index buffer at once, widening 16-bit indices
+		StaticMeshLOD.IndexBuffer.GetCopy(OutIndices);
+	}
+
+	/**
+	 * Reorders the triangles for vertex cache locality, then the vertices in first-use order.
+	 * With bBuildClusters the triangles are also grouped into clusters first, so each cluster's vertices end up close together
+	 */
+	static void OptimizeMeshLOD(FImportedMeshLOD& LOD, bool bBuildClusters)
+	{
+		FMeshOptimizer::OptimizeVertexCache(LOD.Indices, LOD.Vertices.Num());
+
+		TArray<int32> NumClusterTriangles;
+		if (bBuildClusters && LOD.Indices.Num() / 3 >= MinClusteredTriangles)
+		{
+			NumClusterTriangles = FMeshOptimizer::BuildClusters(LOD.Indices, LOD.Vertices.Num(), MaxClusterTriangles);
+		}
+
+		FMeshOptimizer::OptimizeVertexFetch(LOD.Vertices, LOD.Indices);
+
+		if (NumClusterTriangles.Num() > 0)
+		{
+			LOD.Clusters = FMeshOptimizer::ComputeClusterBounds(LOD.Vertices, LOD.Indices, NumClusterTriangles);
+		}
+	}
+
+	/**
+	 * Converts every LOD of the static mesh, or generates LODs when it has only one. Touches no UObject state, so it runs on worker threads
+	 * Returns early with incomplete LODs once bCancelled is set, the caller then discards them
+	 */
+	static void BuildMeshLODs(const FStaticMeshRenderData& RenderData, TArray<FImportedMeshLOD>& OutLODs, const FThreadSafeBool& bCancelled)
+	{
+		// Only positions are imported, so vertices split at UV seams and hard edges are welded back together
+		FImportedMeshLOD& BaseLOD = OutLODs.AddDefaulted_GetRef();
+		ExtractMeshLOD(RenderData.LODResources[0], BaseLOD.Vertices, BaseLOD.Indices);
+		FMeshOptimizer::WeldVertices(BaseLOD.Vertices, BaseLOD.Indices);
+
+		if (RenderData.LODResources.Num() > 1)
+		{
+			// Import every LOD of the source mesh together with its screen size
+			OutLODs.SetNum(RenderData.LODResources.Num());
+			for (int32 LODIndex = 1; LODIndex < RenderData.LODResources.Num(); ++LODIndex)
+			{
+				if (bCancelled)
+					return;
+
+				FImportedMeshLOD& LOD = OutLODs[LODIndex];
+				ExtractMeshLOD(RenderData.LODResources[LODIndex], LOD.Vertices, LOD.Indices);
+				FMeshOptimizer::WeldVertices(LOD.Vertices, LOD.Indices);
+				LOD.ScreenSize = RenderData.ScreenSize[LODIndex].Default;
+			}
+		}
+		else
+		{
+			// The source mesh has no LODs, generate them by quadric edge collapse, halving the triangles at each level
+			float ScreenSize = 1.0f;
+			for (int32 LODIndex = 1; LODIndex <= MaxGeneratedLODs; ++LODIndex)
+			{
+				if (bCancelled)
+					return;
+
+				const TArray<uint32>& PreviousIndices = OutLODs.Last().Indices;
+				const int32 TargetNumTriangles = PreviousIndices.Num() / 3 / 2;
+				if (TargetNumTriangles < MinGeneratedLODTriangles)
+					break;
+
+				// The simplifier checks the flag itself, a dense mesh can take seconds per level
+				TArray<uint32> LODIndices = FMeshOptimizer::SimplifyMesh(OutLODs[0].Vertices, PreviousIndices, TargetNumTriangles, &bCancelled);
+				if (bCancelled)
+					return;
+
+				// Stop once the simplifier is blocked and a new level would barely differ from the previous one
+				if (LODIndices.Num() * 10 > PreviousIndices.Num() * 9)
+					break;
+
+				ScreenSize *= 0.5f;
+				FImportedMeshLOD& LOD = OutLODs.AddDefaulted_GetRef();
+				LOD.Vertices = OutLODs[0].Vertices;
+				LOD.Indices = MoveTemp(LODIndices);
+				LOD.ScreenSize = ScreenSize;
+			}
+		}
+
+		// Simplification reads the welded base mesh, so each level is optimized only after all levels exist
+		// Only LOD0 is clustered, the simplified levels are used when the mesh is small on screen
+		for (int32 LODIndex = 0; LODIndex < OutLODs.Num(); ++LODIndex)
+		{
+			if (bCancelled)
+				return;
+
+			OptimizeMeshLOD(OutLODs[LODIndex], LODIndex == 0);
+		}
+	}
+
+	/** Creates the RenderObject Blueprint for a finished job. Must run on the game thread */
+	static void CreateRenderObjectAsset(const FAssetToolsModule& AssetToolsModule, FImportJob& Job)
+	{
+		UStaticMesh* StaticMesh = Job.StaticMesh;
+
+		// Create the sprite
+		FString Name;
+		FString PackageName;
 		
-		for (auto AssetIt = SelectedAssets.CreateConstIterator(); AssetIt; ++AssetIt)
+		const FString DefaultSuffix = TEXT("_RenderObject");
+		AssetToolsModule.Get().CreateUniqueAssetName(StaticMesh->GetOutermost()->GetName(), DefaultSuffix, /*out*/ PackageName, /*out*/ Name);
+
+		UPackage* Package = CreatePackage( *PackageName);
+		if (ensure(Package))
 		{
-			const FAssetData& AssetData = *AssetIt;
-			if (UStaticMesh* StaticMesh = Cast<UStaticMesh>(AssetData.GetAsset()))
+			UBlueprint* NewBP = CastChecked<UBlueprint>(FKismetEditorUtilities::CreateBlueprint(URenderObject::StaticClass(), Package, FName(Name), EBlueprintType::BPTYPE_Normal, 
+	UBlueprint::StaticClass(), UBlueprintGeneratedClass::StaticClass(), NAME_None));
+
+			if (TSubclassOf<UObject> GeneratedClass = NewBP->GeneratedClass)
 			{
-				// Create the sprite
-				FString Name;
-				FString PackageName;
-				
-				const FString DefaultSuffix = TEXT("_RenderObject");
-				AssetToolsModule.Get().CreateUniqueAssetName(StaticMesh->GetOutermost()->GetName(), DefaultSuffix, /*out*/ PackageName, /*out*/ Name);
-
-				UPackage* Package = CreatePackage( *PackageName);
-				if (ensure(Package))
+				if (URenderObject* RenderObject = GeneratedClass->GetDefaultObject<URenderObject>())
 				{
-					UBlueprint* NewBP = CastChecked<UBlueprint>(FKismetEditorUtilities::CreateBlueprint(URenderObject::StaticClass(), Package, FName(Name), EBlueprintType::BPTYPE_Normal, 
-			UBlueprint::StaticClass(), UBlueprintGeneratedClass::StaticClass(), NAME_None));
-
-					if (TSubclassOf<UObject> GeneratedClass = NewBP->GeneratedClass)
+					// Meshes with no more than 65536 vertices are stored with 16-bit indices
+					RenderObject->LODs.Reset();
+					for (int32 LODIndex = 0; LODIndex < Job.LODs.Num(); ++LODIndex)
 					{
-						if (URenderObject* RenderObject = GeneratedClass->GetDefaultObject<URenderObject>())
+						FImportedMeshLOD& ImportedLOD = Job.LODs[LODIndex];
+						if (LODIndex == 0)
+						{
+							RenderObject->Vertices = MoveTemp(ImportedLOD.Vertices);
+						}
+						else
 						{
-							const FStaticMeshLODResources& StaticMeshLOD = StaticMesh->RenderData->LODResources[0];
-							
-							const int32 NumWedges = StaticMeshLOD.IndexBuffer.GetNumIndices();
-							const int32 NumVertexPositions = StaticMeshLOD.VertexBuffers.PositionVertexBuffer.GetNumVertices();
-
-							//Create the vertex
-							for (int32 VertexIndex = 0; VertexIndex < NumVertexPositions; ++VertexIndex)
-							{
-								FRenderObjectVertex Vertex;
-								Vertex.Position = StaticMeshLOD.VertexBuffers.PositionVertexBuffer.VertexPosition(VertexIndex);
-								RenderObject->Vertices.Emplace(Vertex);
-							}
-
-							for (int32 Index = 0; Index < NumWedges; ++Index)
-							{
-								RenderObject->Indices.Add(StaticMeshLOD.IndexBuffer.GetIndex(Index));
-							}
-
-							RenderObject->Material.VertexShaderClass = UVertexShader::StaticClass();
+							FRenderObjectLOD& LOD = RenderObject->LODs.AddDefaulted_GetRef();
+							LOD.Vertices = MoveTemp(ImportedLOD.Vertices);
+							LOD.ScreenSize = ImportedLOD.ScreenSize;
 						}
+						RenderObject->SetIndices(ImportedLOD.Indices, LODIndex);
 					}
 
-					FBlueprintEditorUtils::MarkBlueprintAsModified(NewBP);
-					
-					// Need to make sure we compile with the new source code
-					// FKismetEditorUtilities::CompileBlueprint(NewBP);
+					// Clusters describe the final LOD0 index order, so they are set after the indices
+					RenderObject->Clusters = MoveTemp(Job.LODs[0].Clusters);
+
+					// Store the geometry as one binary blob instead of per-element property arrays
+					RenderObject->BakeMeshData();
+
+					RenderObject->Material.VertexShaderClass = UVertexShader::StaticClass();
 				}
+			}
 
+			FBlueprintEditorUtils::MarkBlueprintAsModified(NewBP);
+			
+			// Need to make sure we compile with the new source code
+			// FKismetEditorUtilities::CompileBlueprint(NewBP);
+		}
+	}
+	
+	virtual void Execute() override
+	{
+		const FAssetToolsModule& AssetToolsModule = FModuleManager::Get().LoadModuleChecked<FAssetToolsModule>("AssetTools");
+
+		// Loading assets is only allowed on the game thread, so the meshes are resolved up front
+		TArray<FImportJob> Jobs;
+		Jobs.Reserve(SelectedAssets.Num());
+		for (auto AssetIt = SelectedAssets.CreateConstIterator(); AssetIt; ++AssetIt)
+		{
+			UStaticMesh* StaticMesh = Cast<UStaticMesh>(AssetIt->GetAsset());
+			if (StaticMesh && StaticMesh->RenderData && StaticMesh->RenderData->LODResources.Num() > 0)
+			{
+				Jobs.AddDefaulted_GetRef().StaticMesh = StaticMesh;
 			}
 		}
- 
+
+		if (Jobs.Num() == 0)
+			return;
+
+		FScopedSlowTask SlowTask(Jobs.Num(), LOCTEXT("CreateRenderObjects", "Creating RenderObjects..."));
+		SlowTask.MakeDialog(/*bShowCancelButton*/ true);
+
+		// Convert the meshes on worker threads while the game thread reports progress and watches the cancel button.
+		// The game thread does not tick meanwhile, so the meshes cannot be garbage collected under the workers
+		FThreadSafeCounter NumCompletedJobs;
+		FThreadSafeBool bCancelled = false;
+		TFuture<void> ConvertFuture = Async(EAsyncExecution::ThreadPool, [&Jobs, &NumCompletedJobs, &bCancelled]()
+		{
+			ParallelFor(Jobs.Num(), [&Jobs, &NumCompletedJobs, &bCancelled](int32 JobIndex)
+			{
+				if (bCancelled)
+					return;
+
+				FImportJob& Job = Jobs[JobIndex];
+				BuildMeshLODs(*Job.StaticMesh->RenderData, Job.LODs, bCancelled);
+				NumCompletedJobs.Increment();
+			});
+		});
+
+		int32 NumReportedJobs = 0;
+		while (!ConvertFuture.WaitFor(FTimespan::FromMilliseconds(50.0)))
+		{
+			const int32 NumCompleted = NumCompletedJobs.GetValue();
+			SlowTask.EnterProgressFrame(NumCompleted - NumReportedJobs);
+			NumReportedJobs = NumCompleted;
+
+			if (SlowTask.ShouldCancel())
+			{
+				bCancelled = true;
+			}
+		}
+
+		// Packages are only created once every mesh is converted, and not at all after a cancel
+		if (bCancelled)
+			return;
+
+		for (FImportJob& Job : Jobs)
+		{
+			CreateRenderObjectAsset(AssetToolsModule, Job);
+		}
 	}
 };
 